@@ -33,6 +33,8 @@ namespace cunistd{
 #include <jsoncpp/json/json.h>
 // Logger
 #include "logger.h"
+// Address
+#include "address.h"
 // Header
 #include "abuseipdb.h"
 
@@ -521,7 +523,7 @@ bool AbuseIPDB::reportAddress(std::string address, std::string comment, std::vec
 	return false;
 }
 
-bool AbuseIPDB::getBlacklist(unsigned int confidenceMinimum, unsigned long long int* generatedAt, std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>* blacklist)
+bool AbuseIPDB::getBlacklist(unsigned int confidenceMinimum, unsigned long long int* generatedAt, hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>* blacklist)
 {
 	this->isError = false;
 
@@ -645,9 +647,14 @@ bool AbuseIPDB::getBlacklist(unsigned int confidenceMinimum, unsigned long long
 							// Fill blacklist with new data
 							for (i = 0; i < obj["data"].size(); ++i) {
 								AbuseIPDBBlacklistedAddressType data;
+								hb::Address key;
 
 								// IP address
 								address = obj["data"][i]["ipAddress"].asString();
+								if (!hb::Address::parse(address, key)) {
+									this->log->warning("Invalid IP address " + address + " in AbuseIPDB blacklist, skipping!");
+									continue;
+								}
 
 								// Total reports
 								data.totalReports = obj["data"][i]["totalReports"].asUInt();
@@ -656,7 +663,7 @@ bool AbuseIPDB::getBlacklist(unsigned int confidenceMinimum, unsigned long long
 								data.abuseConfidenceScore = std::strtoul(obj["data"][i]["abuseConfidenceScore"].asString().c_str(), NULL, 10);
 
 								// Append to blacklist
-								blacklist->insert(std::pair<std::string,AbuseIPDBBlacklistedAddressType>(address, data));
+								blacklist->insert(key, data);
 							}
 						}
 					} else {
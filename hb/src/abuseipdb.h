@@ -17,6 +17,8 @@
 #include <curl/curl.h>
 // Util
 #include "util.h"
+// Address table
+#include "addresstable.h"
 // Logger
 #include "logger.h"
 // Logger
@@ -117,7 +119,7 @@ class AbuseIPDB{
 		/*
 		 * Download blacklist from abuseipdb.com
 		 */
-		bool getBlacklist(unsigned int confidenceMinimum, unsigned long long int* generatedAt, std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>* blacklist);
+		bool getBlacklist(unsigned int confidenceMinimum, unsigned long long int* generatedAt, hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>* blacklist);
 
 		/*
 		 * Store cURL response to memmory
@@ -0,0 +1,263 @@
+/*
+ * IPv4/IPv6 address in binary form with fast text parser and formatter
+ *
+ * Parser reads address directly from matched part of log line (no copy to
+ * std::string, no inet_pton), formatter produces the same text as inet_ntop,
+ * so addresses parsed here are equal to ones previously stored in data file.
+ */
+
+// Standard string library
+#include <string>
+// C string (memcmp, memcpy, memset)
+#include <cstring>
+// Header
+#include "address.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Parse IPv4 address to 4 bytes
+ */
+static bool parse4(const char* begin, const char* end, unsigned char* result)
+{
+	const char* pos = begin;
+	unsigned int value, digits;
+	for (int octet = 0; octet < 4; ++octet) {
+		if (octet > 0) {
+			if (pos >= end || *pos != '.') return false;
+			++pos;
+		}
+		value = 0;
+		digits = 0;
+		while (pos < end && *pos >= '0' && *pos <= '9' && digits < 3) {
+			value = value * 10 + (unsigned int)(*pos - '0');
+			++digits;
+			++pos;
+		}
+		if (digits == 0 || value > 255) return false;
+		result[octet] = (unsigned char)value;
+	}
+	return pos == end;
+}
+
+/*
+ * Hex digit value, -1 if not hex digit
+ */
+static inline int hexValue(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * Parse IPv6 address to 16 bytes
+ */
+static bool parse6(const char* begin, const char* end, unsigned char* result)
+{
+	unsigned char buf[16] = {0};
+	int words = 0;// Words parsed
+	int gap = -1;// Word index where :: is
+	const char* pos = begin;
+	const char* wordStart;
+	unsigned int value;
+	int digit, digits;
+
+	if (pos < end && *pos == ':') {
+		// Address can start with colon only if it is ::
+		if (pos + 1 >= end || pos[1] != ':') return false;
+		gap = 0;
+		pos += 2;
+		if (pos == end) {
+			memset(result, 0, 16);
+			return true;
+		}
+	}
+
+	while (pos < end) {
+		if (words >= 8) return false;
+		wordStart = pos;
+		value = 0;
+		digits = 0;
+		while (pos < end && digits < 5 && (digit = hexValue(*pos)) >= 0) {
+			value = (value << 4) | (unsigned int)digit;
+			++digits;
+			++pos;
+		}
+		if (digits == 0 || digits > 4) return false;
+
+		if (pos < end && *pos == '.') {
+			// Embedded IPv4 address takes last two words
+			if (words > 6) return false;
+			if (!parse4(wordStart, end, buf + words * 2)) return false;
+			words += 2;
+			pos = end;
+			break;
+		}
+
+		buf[words * 2] = (unsigned char)(value >> 8);
+		buf[words * 2 + 1] = (unsigned char)(value & 0xff);
+		++words;
+
+		if (pos == end) break;
+		if (*pos != ':') return false;
+		++pos;
+		if (pos < end && *pos == ':') {
+			if (gap != -1) return false;// Only one :: is allowed
+			gap = words;
+			++pos;
+		} else if (pos == end) {
+			return false;// Single trailing colon
+		}
+	}
+
+	if (gap == -1) {
+		if (words != 8) return false;
+		memcpy(result, buf, 16);
+	} else {
+		if (words > 7) return false;// :: must replace at least one word
+		int tail = words - gap;
+		memset(result, 0, 16);
+		memcpy(result, buf, gap * 2);
+		memcpy(result + 16 - tail * 2, buf + gap * 2, tail * 2);
+	}
+	return true;
+}
+
+/*
+ * Parse IPv4 or IPv6 address
+ */
+bool Address::parse(const char* begin, const char* end, hb::Address& address)
+{
+	unsigned char buf[16] = {0};
+	if (begin >= end) return false;
+
+	// IPv6 always contains colon, IPv4 never does, check only first 5 characters
+	for (const char* pos = begin; pos < end && pos < begin + 5; ++pos) {
+		if (*pos == ':') {
+			if (!parse6(begin, end, buf)) return false;
+			memcpy(address.bytes, buf, 16);
+			address.version = 6;
+			return true;
+		}
+	}
+	if (!parse4(begin, end, buf)) return false;
+	memcpy(address.bytes, buf, 16);
+	address.version = 4;
+	return true;
+}
+
+bool Address::parse(const std::string& text, hb::Address& address)
+{
+	return Address::parse(text.data(), text.data() + text.length(), address);
+}
+
+/*
+ * Write address in presentation form to buffer
+ */
+std::size_t Address::format(char* buffer) const
+{
+	static const char hex[] = "0123456789abcdef";
+	char* out = buffer;
+	unsigned int value;
+
+	if (this->version == 4) {
+		for (int i = 0; i < 4; ++i) {
+			if (i > 0) *out++ = '.';
+			value = this->bytes[i];
+			if (value >= 100) *out++ = (char)('0' + value / 100);
+			if (value >= 10) *out++ = (char)('0' + (value / 10) % 10);
+			*out++ = (char)('0' + value % 10);
+		}
+		*out = '\0';
+		return out - buffer;
+	}
+	if (this->version != 6) {
+		*out = '\0';
+		return 0;
+	}
+
+	// Find longest run of zero words (at least 2 words), first one wins if equal, same as inet_ntop
+	unsigned int words[8];
+	int bestBase = -1, bestLen = 0, curBase = -1, curLen = 0;
+	for (int i = 0; i < 8; ++i) {
+		words[i] = ((unsigned int)this->bytes[i * 2] << 8) | this->bytes[i * 2 + 1];
+		if (words[i] == 0) {
+			if (curBase == -1) {
+				curBase = i;
+				curLen = 1;
+			} else {
+				++curLen;
+			}
+		} else if (curBase != -1) {
+			if (curLen > bestLen) {
+				bestBase = curBase;
+				bestLen = curLen;
+			}
+			curBase = -1;
+		}
+	}
+	if (curBase != -1 && curLen > bestLen) {
+		bestBase = curBase;
+		bestLen = curLen;
+	}
+	if (bestLen < 2) bestBase = -1;
+
+	for (int i = 0; i < 8; ++i) {
+		if (bestBase != -1 && i >= bestBase && i < bestBase + bestLen) {
+			if (i == bestBase) *out++ = ':';
+			continue;
+		}
+		if (i != 0) *out++ = ':';
+		// IPv4 compatible or IPv4 mapped address
+		if (i == 6 && bestBase == 0 && (bestLen == 6 || (bestLen == 5 && words[5] == 0xffff))) {
+			Address ipv4;
+			ipv4.version = 4;
+			memcpy(ipv4.bytes, this->bytes + 12, 4);
+			out += ipv4.format(out);
+			return out - buffer;
+		}
+		value = words[i];
+		bool started = false;
+		for (int shift = 12; shift >= 0; shift -= 4) {
+			if (started || ((value >> shift) & 0xf) != 0 || shift == 0) {
+				*out++ = hex[(value >> shift) & 0xf];
+				started = true;
+			}
+		}
+	}
+	if (bestBase != -1 && bestBase + bestLen == 8) *out++ = ':';
+	*out = '\0';
+	return out - buffer;
+}
+
+/*
+ * Address in presentation form
+ */
+std::string Address::toString() const
+{
+	char buffer[48];
+	std::size_t length = this->format(buffer);
+	return std::string(buffer, length);
+}
+
+/*
+ * Comparison
+ */
+bool Address::operator==(const hb::Address& other) const
+{
+	return this->version == other.version && memcmp(this->bytes, other.bytes, 16) == 0;
+}
+
+bool Address::operator!=(const hb::Address& other) const
+{
+	return !(*this == other);
+}
+
+bool Address::operator<(const hb::Address& other) const
+{
+	if (this->version != other.version) return this->version < other.version;
+	return memcmp(this->bytes, other.bytes, 16) < 0;
+}
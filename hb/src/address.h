@@ -0,0 +1,56 @@
+/*
+ * IPv4/IPv6 address in binary form with fast text parser and formatter
+ */
+
+#ifndef HBADDRESS_H
+#define HBADDRESS_H
+
+// Standard string library
+#include <string>
+
+namespace hb{
+
+class Address{
+	private:
+
+	public:
+
+		/*
+		 * Address bytes in network order, IPv4 address uses first 4 bytes, rest are 0
+		 */
+		unsigned char bytes[16] = {0};
+
+		/*
+		 * IP version (4 or 6), 0 if address is not set
+		 */
+		unsigned char version = 0;
+
+		/*
+		 * Parse IPv4 (dotted decimal) or IPv6 (RFC 4291 text form, also with embedded IPv4) address
+		 * Returns false if text is not valid address, address is not changed then
+		 */
+		static bool parse(const char* begin, const char* end, hb::Address& address);
+		static bool parse(const std::string& text, hb::Address& address);
+
+		/*
+		 * Address in presentation form, same as inet_ntop (IPv6 is compressed, lower case)
+		 */
+		std::string toString() const;
+
+		/*
+		 * Write address in presentation form to buffer (at least 46 bytes), returns length (without terminating 0)
+		 */
+		std::size_t format(char* buffer) const;
+
+		/*
+		 * Comparison
+		 */
+		bool operator==(const hb::Address& other) const;
+		bool operator!=(const hb::Address& other) const;
+		bool operator<(const hb::Address& other) const;
+
+};
+
+}
+
+#endif
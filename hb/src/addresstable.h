@@ -0,0 +1,456 @@
+/*
+ * Hash table of data by IP address in binary form
+ *
+ * IPv4 addresses are keyed by 32-bit integer, IPv6 addresses by 128-bit
+ * integer, each version has own table. Entries are kept in dense vector, so
+ * there is no allocation per entry and iteration is sequential. Open
+ * addressing index (linear probing) maps key to entry position, each index
+ * slot also keeps 32-bit hash of key, so that entry key is compared only when
+ * hash matches. Erase moves last entry in place of erased one.
+ *
+ * Lookup with text address parses it first, find/insert return pointer to
+ * data, so that caller does lookup once and works with the pointer after that.
+ */
+
+#ifndef HBADDRESSTABLE_H
+#define HBADDRESSTABLE_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Pair
+#include <utility>
+// Fill
+#include <algorithm>
+// Fixed width integer types
+#include <cstdint>
+// C string (memcpy)
+#include <cstring>
+// Exceptions
+#include <stdexcept>
+// Type traits (conditional)
+#include <type_traits>
+// Address
+#include "address.h"
+
+namespace hb{
+
+/*
+ * IPv6 address as 128-bit key
+ */
+struct AddressKey128 {
+	uint64_t high;
+	uint64_t low;
+	bool operator==(const AddressKey128& other) const
+	{
+		return this->high == other.high && this->low == other.low;
+	}
+};
+
+/*
+ * Hash of key, upper bits of 64-bit multiplicative hash
+ */
+inline uint32_t addressKeyHash(uint32_t key)
+{
+	return (uint32_t)(((uint64_t)key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+inline uint32_t addressKeyHash(const hb::AddressKey128& key)
+{
+	uint64_t h = (key.high ^ (key.low * 0xC2B2AE3D27D4EB4FULL)) * 0x9E3779B97F4A7C15ULL;
+	return (uint32_t)(h >> 32);
+}
+
+/*
+ * Table of one IP version
+ */
+template <typename K, typename T>
+class AddressTablePart{
+	private:
+
+		/*
+		 * Index slot - hash of key in upper 32 bits, entry position + 1 in lower 32 bits, 0 if slot is empty
+		 */
+		std::vector<uint64_t> slots;
+		std::size_t mask = 0;
+
+		/*
+		 * Index slot of entry position, slot must exist
+		 */
+		std::size_t slotOf(std::size_t position) const
+		{
+			std::size_t i = addressKeyHash(this->entries[position].first) & this->mask;
+			while ((this->slots[i] & 0xFFFFFFFFULL) != position + 1) {
+				i = (i + 1) & this->mask;
+			}
+			return i;
+		}
+
+		/*
+		 * Put entry position in first free slot after ideal slot of hash
+		 */
+		void place(uint32_t hash, std::size_t position)
+		{
+			std::size_t i = hash & this->mask;
+			while (this->slots[i] != 0) {
+				i = (i + 1) & this->mask;
+			}
+			this->slots[i] = ((uint64_t)hash << 32) | (uint64_t)(position + 1);
+		}
+
+		/*
+		 * Rebuild index with given slot count (power of 2)
+		 */
+		void rehash(std::size_t slotCount)
+		{
+			this->slots.assign(slotCount, 0);
+			this->mask = slotCount - 1;
+			for (std::size_t i = 0; i < this->entries.size(); ++i) {
+				this->place(addressKeyHash(this->entries[i].first), i);
+			}
+		}
+
+	public:
+
+		/*
+		 * Entries (key and data)
+		 */
+		std::vector<std::pair<K, T>> entries;
+
+		/*
+		 * Position of entry with key, -1 if not found
+		 */
+		long long int find(const K& key) const
+		{
+			if (this->slots.size() == 0) {
+				return -1;
+			}
+			uint32_t hash = addressKeyHash(key);
+			std::size_t i = hash & this->mask;
+			uint64_t slot;
+			while ((slot = this->slots[i]) != 0) {
+				if ((uint32_t)(slot >> 32) == hash && this->entries[(slot & 0xFFFFFFFFULL) - 1].first == key) {
+					return (long long int)(slot & 0xFFFFFFFFULL) - 1;
+				}
+				i = (i + 1) & this->mask;
+			}
+			return -1;
+		}
+
+		/*
+		 * Position of entry with key, entry with given data is added if not found, inserted is set then
+		 */
+		std::size_t insert(const K& key, const T& data, bool& inserted)
+		{
+			long long int position = this->find(key);
+			if (position >= 0) {
+				inserted = false;
+				return (std::size_t)position;
+			}
+			// Index is kept at most 3/4 full
+			if ((this->entries.size() + 1) * 4 > this->slots.size() * 3) {
+				this->rehash(this->slots.size() < 16 ? 16 : this->slots.size() * 2);
+			}
+			this->entries.emplace_back(key, data);
+			this->place(addressKeyHash(key), this->entries.size() - 1);
+			inserted = true;
+			return this->entries.size() - 1;
+		}
+
+		/*
+		 * Erase entry at position, last entry is moved to its place
+		 */
+		void erase(std::size_t position)
+		{
+			// Remove from index, following slots of the same probe sequence are shifted back
+			std::size_t i = this->slotOf(position);
+			std::size_t j = i, k;
+			while (true) {
+				j = (j + 1) & this->mask;
+				if (this->slots[j] == 0) {
+					break;
+				}
+				k = (std::size_t)(this->slots[j] >> 32) & this->mask;
+				if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+					this->slots[i] = this->slots[j];
+					i = j;
+				}
+			}
+			this->slots[i] = 0;
+
+			// Move last entry in place of erased one
+			std::size_t last = this->entries.size() - 1;
+			if (position != last) {
+				std::size_t lastSlot = this->slotOf(last);
+				this->slots[lastSlot] = (this->slots[lastSlot] & 0xFFFFFFFF00000000ULL) | (uint64_t)(position + 1);
+				this->entries[position] = std::move(this->entries[last]);
+			}
+			this->entries.pop_back();
+		}
+
+		/*
+		 * Prepare for count entries
+		 */
+		void reserve(std::size_t count)
+		{
+			this->entries.reserve(count);
+			std::size_t slotCount = 16;
+			while (count * 4 > slotCount * 3) {
+				slotCount *= 2;
+			}
+			if (slotCount > this->slots.size()) {
+				this->rehash(slotCount);
+			}
+		}
+
+		/*
+		 * Remove all entries, allocated memory is kept
+		 */
+		void clear()
+		{
+			this->entries.clear();
+			std::fill(this->slots.begin(), this->slots.end(), 0);
+		}
+
+		/*
+		 * Allocated bytes
+		 */
+		std::size_t memoryUsage() const
+		{
+			return this->entries.capacity() * sizeof(std::pair<K, T>) + this->slots.capacity() * sizeof(uint64_t);
+		}
+};
+
+/*
+ * Data by IPv4 and IPv6 address
+ */
+template <typename T>
+class AddressTable{
+	private:
+
+		/*
+		 * IPv4 and IPv6 tables, IPv4 entries come first when iterating
+		 */
+		hb::AddressTablePart<uint32_t, T> v4;
+		hb::AddressTablePart<hb::AddressKey128, T> v6;
+
+		static uint32_t key4(const hb::Address& address)
+		{
+			uint32_t key;
+			memcpy(&key, address.bytes, 4);
+			return key;
+		}
+
+		static hb::AddressKey128 key6(const hb::Address& address)
+		{
+			hb::AddressKey128 key;
+			memcpy(&key.high, address.bytes, 8);
+			memcpy(&key.low, address.bytes + 8, 8);
+			return key;
+		}
+
+	public:
+
+		/*
+		 * Iterator, entry is returned as pair of address and reference to data (it->first, it->second)
+		 */
+		template <bool Const>
+		class Iterator{
+			private:
+				typedef typename std::conditional<Const, const hb::AddressTable<T>, hb::AddressTable<T>>::type Table;
+				Table* table = NULL;
+				std::size_t position = 0;
+				friend class AddressTable;
+				template <bool> friend class Iterator;
+
+			public:
+				typedef typename std::conditional<Const, const T, T>::type Value;
+
+				struct Entry {
+					hb::Address first;
+					Value& second;
+					Entry* operator->() { return this; }
+				};
+
+				Iterator() {}
+				Iterator(Table* table, std::size_t position) : table(table), position(position) {}
+				template <bool C = Const, typename = typename std::enable_if<C>::type>
+				Iterator(const Iterator<false>& other) : table(other.table), position(other.position) {}
+
+				Entry operator*() const
+				{
+					hb::Address address;
+					std::size_t v4Count = this->table->v4.entries.size();
+					if (this->position < v4Count) {
+						address.version = 4;
+						memcpy(address.bytes, &this->table->v4.entries[this->position].first, 4);
+						return Entry{address, this->table->v4.entries[this->position].second};
+					}
+					address.version = 6;
+					const hb::AddressKey128& key = this->table->v6.entries[this->position - v4Count].first;
+					memcpy(address.bytes, &key.high, 8);
+					memcpy(address.bytes + 8, &key.low, 8);
+					return Entry{address, this->table->v6.entries[this->position - v4Count].second};
+				}
+				Entry operator->() const { return **this; }
+				Iterator& operator++() { ++this->position; return *this; }
+				bool operator==(const Iterator& other) const { return this->position == other.position; }
+				bool operator!=(const Iterator& other) const { return this->position != other.position; }
+		};
+		typedef Iterator<false> iterator;
+		typedef Iterator<true> const_iterator;
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, this->size()); }
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, this->size()); }
+
+		std::size_t size() const
+		{
+			return this->v4.entries.size() + this->v6.entries.size();
+		}
+
+		bool empty() const
+		{
+			return this->size() == 0;
+		}
+
+		void clear()
+		{
+			this->v4.clear();
+			this->v6.clear();
+		}
+
+		/*
+		 * Prepare for count IPv4 and count6 IPv6 addresses
+		 */
+		void reserve(std::size_t count, std::size_t count6 = 0)
+		{
+			this->v4.reserve(count);
+			this->v6.reserve(count6);
+		}
+
+		/*
+		 * Data of address, NULL if address is not in table (or text is not valid address)
+		 */
+		T* find(const hb::Address& address)
+		{
+			long long int position;
+			if (address.version == 4) {
+				position = this->v4.find(AddressTable::key4(address));
+				return position >= 0 ? &this->v4.entries[position].second : NULL;
+			} else if (address.version == 6) {
+				position = this->v6.find(AddressTable::key6(address));
+				return position >= 0 ? &this->v6.entries[position].second : NULL;
+			}
+			return NULL;
+		}
+		const T* find(const hb::Address& address) const
+		{
+			return const_cast<AddressTable*>(this)->find(address);
+		}
+		T* find(const std::string& address)
+		{
+			hb::Address key;
+			return hb::Address::parse(address, key) ? this->find(key) : NULL;
+		}
+		const T* find(const std::string& address) const
+		{
+			return const_cast<AddressTable*>(this)->find(address);
+		}
+
+		/*
+		 * Data of address, added with given data if address is not in table yet (inserted is set then)
+		 * Address must be valid (version 4 or 6)
+		 */
+		T* insert(const hb::Address& address, const T& data, bool& inserted)
+		{
+			if (address.version == 4) {
+				return &this->v4.entries[this->v4.insert(AddressTable::key4(address), data, inserted)].second;
+			} else if (address.version == 6) {
+				return &this->v6.entries[this->v6.insert(AddressTable::key6(address), data, inserted)].second;
+			}
+			throw std::invalid_argument("Invalid IP address version " + std::to_string(address.version));
+		}
+		T* insert(const hb::Address& address, const T& data)
+		{
+			bool inserted;
+			return this->insert(address, data, inserted);
+		}
+
+		/*
+		 * Data of address, added if address is not in table yet
+		 * Throws std::invalid_argument if text is not valid address
+		 */
+		T& operator[](const hb::Address& address)
+		{
+			return *this->insert(address, T());
+		}
+		T& operator[](const std::string& address)
+		{
+			hb::Address key;
+			if (!hb::Address::parse(address, key)) {
+				throw std::invalid_argument("Invalid IP address " + address);
+			}
+			return *this->insert(key, T());
+		}
+
+		std::size_t count(const hb::Address& address) const
+		{
+			return this->find(address) != NULL ? 1 : 0;
+		}
+		std::size_t count(const std::string& address) const
+		{
+			return this->find(address) != NULL ? 1 : 0;
+		}
+
+		/*
+		 * Remove address, returns number of removed entries
+		 */
+		std::size_t erase(const hb::Address& address)
+		{
+			long long int position = -1;
+			if (address.version == 4) {
+				position = this->v4.find(AddressTable::key4(address));
+				if (position >= 0) this->v4.erase(position);
+			} else if (address.version == 6) {
+				position = this->v6.find(AddressTable::key6(address));
+				if (position >= 0) this->v6.erase(position);
+			}
+			return position >= 0 ? 1 : 0;
+		}
+		std::size_t erase(const std::string& address)
+		{
+			hb::Address key;
+			return hb::Address::parse(address, key) ? this->erase(key) : 0;
+		}
+
+		/*
+		 * Erase entry, returns iterator to next entry (last entry is moved in place of erased one, so iteration
+		 * with erase visits all entries once)
+		 */
+		iterator erase(iterator it)
+		{
+			std::size_t v4Count = this->v4.entries.size();
+			if (it.position < v4Count) {
+				this->v4.erase(it.position);
+				// Last IPv4 entry took its place, or iterator now points to first IPv6 entry
+				return iterator(this, it.position);
+			}
+			this->v6.erase(it.position - v4Count);
+			return iterator(this, it.position);
+		}
+
+		/*
+		 * Allocated bytes (entries and index)
+		 */
+		std::size_t memoryUsage() const
+		{
+			return this->v4.memoryUsage() + this->v6.memoryUsage();
+		}
+
+};
+
+}
+
+#endif
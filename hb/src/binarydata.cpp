@@ -0,0 +1,745 @@
+/*
+ * Binary datafile (datafile.engine = binary)
+ *
+ * Datafile is sequence of 64 byte slots, first slot is header (BinaryHeader)
+ * with record counts and AbuseIPDB sync data, each record takes one or more
+ * slots. First byte of record is type (same as in text datafile, see data.cpp),
+ * second byte is slot count of record, so that records can be skipped without
+ * knowing their type. Addresses are stored in binary form (hb::Address), so
+ * records have fixed size and no field needs to be parsed on load.
+ *
+ * d - suspicious address (BinaryAddressRecord)
+ * a - AbuseIPDB blacklisted address (BinaryAbuseIPDBRecord)
+ * f - log file bookmark (BinaryFileRecord, path continues in next slots)
+ * r - marked for removal, slot count is kept
+ *
+ * Updates overwrite record in place, new records are appended. Like in text
+ * datafile removed records are only marked and dropped when whole datafile is
+ * rewritten.
+ */
+
+// Standard string library
+#include <string>
+// C string (memcpy, memcmp, strerror)
+#include <cstring>
+// Standard definitions (offsetof)
+#include <cstddef>
+// C standard input/output (rename)
+#include <cstdio>
+// Linux stat
+namespace cstat{
+	#include <errno.h>
+	#include <sys/types.h>
+	#include <sys/stat.h>
+}
+// File control options (open, lockf)
+namespace cfcntl{
+	#include <fcntl.h>
+}
+// Miscellaneous UNIX symbolic constants, types and functions (pread, pwrite, fsync)
+namespace cunistd{
+	#include <unistd.h>
+}
+// Memory mapping
+namespace cmman{
+	#include <sys/mman.h>
+}
+// Address
+#include "address.h"
+// Header
+#include "binarydata.h"
+
+// Hostblock namespace
+using namespace hb;
+
+static_assert(sizeof(hb::BinaryHeader) == hb::BinaryData::kSlotSize, "Binary datafile header must take one slot");
+static_assert(sizeof(hb::BinaryAddressRecord) == hb::BinaryData::kSlotSize, "Binary address record must take one slot");
+static_assert(sizeof(hb::BinaryAbuseIPDBRecord) == hb::BinaryData::kSlotSize, "Binary AbuseIPDB record must take one slot");
+static_assert(sizeof(hb::BinaryFileRecord) == hb::BinaryData::kSlotSize, "Binary log file record must take one slot");
+
+/*
+ * Datafile magic
+ */
+static const char kMagic[8] = {'H', 'B', 'D', 'A', 'T', 'A', 0, 0};
+
+/*
+ * Offset of path in log file record
+ */
+static const std::size_t kPathOffset = offsetof(hb::BinaryFileRecord, path);
+
+/*
+ * Write whole buffer at offset
+ */
+static bool writeAt(int fd, const char* data, std::size_t length, long long int offset)
+{
+	long int written;
+	while (length > 0) {
+		written = cunistd::pwrite(fd, data, length, offset);
+		if (written <= 0) {
+			if (written == -1 && errno == EINTR) continue;
+			return false;
+		}
+		data += written;
+		length -= written;
+		offset += written;
+	}
+	return true;
+}
+
+/*
+ * Address in presentation form from binary record
+ */
+static std::string addressKey(const unsigned char* bytes, uint8_t version)
+{
+	hb::Address address;
+	memcpy(address.bytes, bytes, 16);
+	address.version = version;
+	char buffer[48];
+	std::size_t length = address.format(buffer);
+	return std::string(buffer, length);
+}
+
+/*
+ * Constructor
+ */
+BinaryData::BinaryData(hb::Logger* log)
+: log(log)
+{
+
+}
+
+/*
+ * Set datafile path
+ */
+void BinaryData::setPath(const std::string& path)
+{
+	if (this->path == path) {
+		return;
+	}
+	this->path = path;
+	this->addressIndex.clear();
+	this->abuseIPDBIndex.clear();
+	this->fileIndex.clear();
+	this->indexed = false;
+}
+
+/*
+ * Whether file at path is binary datafile
+ */
+bool BinaryData::isBinary(const std::string& path)
+{
+	char magic[8];
+	int fd = cfcntl::open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	bool result = cunistd::pread(fd, magic, sizeof(magic), 0) == (long int)sizeof(magic) && memcmp(magic, kMagic, sizeof(magic)) == 0;
+	cunistd::close(fd);
+	return result;
+}
+
+/*
+ * Load datafile
+ */
+bool BinaryData::load(hb::AddressTable<hb::SuspiciosAddressType>& addresses, hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, std::vector<hb::LogFile>& files, unsigned long long int& syncTime, unsigned long long int& blacklistGenTime, unsigned long long int& removedCount)
+{
+	struct cstat::stat fileStat;
+	hb::SuspiciosAddressType data;
+	hb::AbuseIPDBBlacklistedAddressType abuseIPDBData;
+	hb::LogFile logFile;
+	hb::Address address;
+
+	// Offset index is built with first update, so that it does not slow down load
+	this->addressIndex.clear();
+	this->abuseIPDBIndex.clear();
+	this->fileIndex.clear();
+	this->indexed = false;
+	removedCount = 0;
+
+	int fd = cfcntl::open(this->path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		this->log->error("Unable to open datafile for reading! " + std::to_string(errno) + ": " + strerror(errno));
+		return false;
+	}
+
+	// Do not read during long running writes from other processes
+	unsigned int retryCounter = 1;
+	while (cfcntl::lockf(fd, F_TEST, 0) == -1) {
+		if (retryCounter >= 3) {
+			cunistd::close(fd);
+			this->log->error("Unable to read datafile, file is locked!");
+			return false;
+		}
+		cunistd::usleep(500000);
+		++retryCounter;
+	}
+
+	if (cstat::fstat(fd, &fileStat) != 0 || fileStat.st_size < (long int)BinaryData::kSlotSize) {
+		cunistd::close(fd);
+		this->log->error("Unable to read datafile, file too small for binary datafile header!");
+		return false;
+	}
+	std::size_t size = fileStat.st_size;
+	void* map = cmman::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	cunistd::close(fd);
+	if (map == MAP_FAILED) {
+		this->log->error("Unable to map datafile! " + std::to_string(errno) + ": " + strerror(errno));
+		return false;
+	}
+	cmman::madvise(map, size, MADV_SEQUENTIAL);
+	const char* base = (const char*)map;
+
+	// Header
+	const hb::BinaryHeader* header = (const hb::BinaryHeader*)base;
+	if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version == 0 || header->version > BinaryData::kVersion || header->slotSize != BinaryData::kSlotSize) {
+		cmman::munmap(map, size);
+		this->log->error("Unsupported binary datafile version or datafile written on architecture with other byte order!");
+		return false;
+	}
+	syncTime = header->abuseIPDBSyncTime;
+	blacklistGenTime = header->abuseIPDBBlacklistGenTime;
+
+	// Records, slots are aligned, so records are used in place
+	std::size_t offset = BinaryData::kSlotSize, length;
+	const char* slot;
+	while (offset + BinaryData::kSlotSize <= size) {
+		slot = base + offset;
+		length = (std::size_t)(uint8_t)slot[1] * BinaryData::kSlotSize;
+		if (length == 0 || offset + length > size) {
+			this->log->warning("Binary datafile ends with incomplete record, ignoring last " + std::to_string(size - offset) + " byte(s)");
+			break;
+		}
+
+		if (slot[0] == 'd') {// Suspicious address
+
+			const hb::BinaryAddressRecord* record = (const hb::BinaryAddressRecord*)slot;
+			memcpy(address.bytes, record->address, 16);
+			address.version = record->version;
+			if (address.version != 4 && address.version != 6) {
+				this->log->warning("Binary datafile record with invalid IP version " + std::to_string(address.version) + " ignored");
+				offset += length;
+				continue;
+			}
+			data.lastActivity = record->lastActivity;
+			data.activityScore = record->activityScore;
+			data.activityCount = record->activityCount;
+			data.refusedCount = record->refusedCount;
+			data.whitelisted = (record->flags & 1) != 0;
+			data.blacklisted = (record->flags & 2) != 0;
+			if (data.whitelisted == true && data.blacklisted == true) {
+				this->log->warning("Address " + address.toString() + " is in whitelist and at the same time in blacklist! Removing address from blacklist...");
+				data.blacklisted = false;
+			}
+			data.lastReported = record->lastReported;
+			data.version = record->version;
+			data.iptableRule = false;
+			// Later record of the same address wins
+			addresses[address] = data;
+
+		} else if (slot[0] == 'a') {// AbuseIPDB blacklisted address
+
+			const hb::BinaryAbuseIPDBRecord* record = (const hb::BinaryAbuseIPDBRecord*)slot;
+			memcpy(address.bytes, record->address, 16);
+			address.version = record->version;
+			if (address.version != 4 && address.version != 6) {
+				this->log->warning("Binary datafile record with invalid IP version " + std::to_string(address.version) + " ignored");
+				offset += length;
+				continue;
+			}
+			abuseIPDBData.totalReports = record->totalReports;
+			abuseIPDBData.abuseConfidenceScore = record->abuseConfidenceScore;
+			abuseIPDBData.version = record->version;
+			abuseIPDBData.iptableRule = false;
+			blacklist[address] = abuseIPDBData;
+
+		} else if (slot[0] == 'f') {// Log file bookmark
+
+			const hb::BinaryFileRecord* record = (const hb::BinaryFileRecord*)slot;
+			if (kPathOffset + record->pathLength <= length) {
+				logFile.path = std::string(slot + kPathOffset, record->pathLength);
+				logFile.bookmark = record->bookmark;
+				logFile.size = record->size;
+				logFile.device = record->device;
+				logFile.inode = record->inode;
+				logFile.fingerprint = record->fingerprint;
+				logFile.fingerprintSize = record->fingerprintSize;
+				files.push_back(logFile);
+			}
+
+		} else if (slot[0] == 'r') {// Marked for removal
+			removedCount++;
+		}
+
+		offset += length;
+	}
+
+	cmman::munmap(map, size);
+	return true;
+}
+
+/*
+ * Write whole datafile
+ */
+bool BinaryData::save(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<hb::LogGroup>& logGroups, unsigned long long int syncTime, unsigned long long int blacklistGenTime)
+{
+	hb::BinaryHeader header;
+	std::string content, record;
+
+	this->addressIndex.clear();
+	this->abuseIPDBIndex.clear();
+	this->fileIndex.clear();
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = BinaryData::kVersion;
+	header.slotSize = BinaryData::kSlotSize;
+	header.abuseIPDBSyncTime = syncTime;
+	header.abuseIPDBBlacklistGenTime = blacklistGenTime;
+	content.reserve((1 + addresses.size() + blacklist.size()) * BinaryData::kSlotSize);
+	content.append((const char*)&header, sizeof(header));
+
+	hb::AddressTable<hb::SuspiciosAddressType>::const_iterator it;
+	for (it = addresses.begin(); it != addresses.end(); ++it) {
+		this->addressIndex[it->first.toString()] = content.length();
+		content += BinaryData::addressRecord(it->first, it->second);
+		header.addressCount++;
+	}
+
+	std::vector<hb::LogGroup>::const_iterator itlg;
+	std::vector<hb::LogFile>::const_iterator itlf;
+	for (itlg = logGroups.begin(); itlg != logGroups.end(); ++itlg) {
+		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+			record = BinaryData::fileRecord(*itlf);
+			if (record.length() == 0) {
+				this->log->warning("Log file path " + itlf->path + " is too long, bookmark not saved in binary datafile!");
+				continue;
+			}
+			this->fileIndex[itlf->path] = content.length();
+			content += record;
+			header.fileCount++;
+		}
+	}
+
+	hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::const_iterator itb;
+	for (itb = blacklist.begin(); itb != blacklist.end(); ++itb) {
+		this->abuseIPDBIndex[itb->first.toString()] = content.length();
+		content += BinaryData::abuseIPDBRecord(itb->first, itb->second);
+		header.abuseIPDBCount++;
+	}
+
+	// Header with counts
+	content.replace(0, sizeof(header), (const char*)&header, sizeof(header));
+	this->indexed = true;
+
+	// Write to temporary file and rename, so that datafile is never partially written
+	std::string tmpPath = this->path + ".tmp";
+	int fd = cfcntl::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		this->log->error("Unable to open datafile for writing! " + std::to_string(errno) + ": " + strerror(errno));
+		return false;
+	}
+	bool result = writeAt(fd, content.data(), content.length(), 0) && cunistd::fsync(fd) == 0;
+	cunistd::close(fd);
+	if (!result || std::rename(tmpPath.c_str(), this->path.c_str()) != 0) {
+		this->log->error("Failed to write binary datafile! " + std::to_string(errno) + ": " + strerror(errno));
+		cunistd::unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Open and lock datafile for update
+ */
+int BinaryData::openLocked(hb::BinaryHeader& header)
+{
+	int fd = cfcntl::open(this->path.c_str(), O_RDWR);
+	if (fd == -1) {
+		this->log->error("Unable to open datafile for update! " + std::to_string(errno) + ": " + strerror(errno));
+		return -1;
+	}
+
+	// Lock whole file
+	int fs = cfcntl::lockf(fd, F_LOCK, 0);
+	unsigned int retryCounter = 1;
+	while (fs == -1) {
+		if (retryCounter >= 3) {
+			break;
+		}
+		// Sleep
+		cunistd::usleep(500000);
+		// Retry
+		fs = cfcntl::lockf(fd, F_LOCK, 0);
+		++retryCounter;
+	}
+	if (fs == -1) {
+		cunistd::close(fd);
+		this->log->error("Unable to update datafile, file is locked!");
+		return -1;
+	}
+
+	if (cunistd::pread(fd, &header, sizeof(header), 0) != (long int)sizeof(header) || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != BinaryData::kVersion || header.slotSize != BinaryData::kSlotSize) {
+		cfcntl::lockf(fd, F_ULOCK, 0);
+		cunistd::close(fd);
+		this->log->error("Unable to update datafile, " + this->path + " is not binary datafile!");
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Write header and unlock datafile
+ */
+bool BinaryData::closeLocked(int fd, const hb::BinaryHeader& header, bool writeHeader)
+{
+	bool result = true;
+	if (writeHeader && !writeAt(fd, (const char*)&header, sizeof(header), 0)) {
+		this->log->error("Failed to update binary datafile header! " + std::to_string(errno) + ": " + strerror(errno));
+		result = false;
+	}
+	if (cfcntl::lockf(fd, F_ULOCK, 0) == -1) {
+		this->log->warning("Failed to unlock datafile after update!");
+	}
+	cunistd::close(fd);
+	return result;
+}
+
+/*
+ * Rebuild offset index from datafile
+ */
+bool BinaryData::scan(int fd)
+{
+	struct cstat::stat fileStat;
+	if (cstat::fstat(fd, &fileStat) != 0) {
+		return false;
+	}
+	std::size_t size = fileStat.st_size;
+	this->addressIndex.clear();
+	this->abuseIPDBIndex.clear();
+	this->fileIndex.clear();
+	this->indexed = true;
+	if (size <= BinaryData::kSlotSize) {
+		return true;
+	}
+	void* map = cmman::mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	const char* base = (const char*)map;
+	std::size_t offset = BinaryData::kSlotSize, length;
+	const char* slot;
+	while (offset + BinaryData::kSlotSize <= size) {
+		slot = base + offset;
+		length = (std::size_t)(uint8_t)slot[1] * BinaryData::kSlotSize;
+		if (length == 0 || offset + length > size) {
+			break;
+		}
+		if (slot[0] == 'd') {
+			this->addressIndex[addressKey(((const hb::BinaryAddressRecord*)slot)->address, ((const hb::BinaryAddressRecord*)slot)->version)] = offset;
+		} else if (slot[0] == 'a') {
+			this->abuseIPDBIndex[addressKey(((const hb::BinaryAbuseIPDBRecord*)slot)->address, ((const hb::BinaryAbuseIPDBRecord*)slot)->version)] = offset;
+		} else if (slot[0] == 'f' && kPathOffset + ((const hb::BinaryFileRecord*)slot)->pathLength <= length) {
+			this->fileIndex[std::string(slot + kPathOffset, ((const hb::BinaryFileRecord*)slot)->pathLength)] = offset;
+		}
+		offset += length;
+	}
+	cmman::munmap(map, size);
+	return true;
+}
+
+/*
+ * Offset of record from offset index
+ */
+long long int BinaryData::findRecord(int fd, std::unordered_map<std::string, long long int>& index, char type, const std::string& key, bool scanMissing, bool& scanned)
+{
+	if (!this->indexed) {
+		scanned = true;
+		this->scan(fd);
+	}
+	std::unordered_map<std::string, long long int>::iterator it = index.find(key);
+	if (it != index.end()) {
+		// Path of log file can take more than one slot
+		char slot[BinaryData::kSlotSize * 256];
+		std::size_t recordLength = type == 'f' ? kPathOffset + key.length() : BinaryData::kSlotSize;
+		long int length = recordLength <= sizeof(slot) ? cunistd::pread(fd, slot, recordLength, it->second) : -1;
+		if (length > 0 && BinaryData::recordMatches(slot, length, type, key)) {
+			return it->second;
+		}
+	} else if (!scanMissing) {
+		return -1;
+	}
+	if (scanned) {
+		return -1;
+	}
+	// Datafile changed by other process
+	scanned = true;
+	this->scan(fd);
+	it = index.find(key);
+	return it != index.end() ? it->second : -1;
+}
+
+/*
+ * Whether slot(s) contain record with given type and key
+ */
+bool BinaryData::recordMatches(const char* slot, std::size_t length, char type, const std::string& key)
+{
+	if (length < BinaryData::kSlotSize || slot[0] != type) {
+		return false;
+	}
+	if (type == 'f') {
+		const hb::BinaryFileRecord* record = (const hb::BinaryFileRecord*)slot;
+		return record->pathLength == key.length() && kPathOffset + key.length() <= length && memcmp(slot + kPathOffset, key.data(), key.length()) == 0;
+	}
+	hb::Address address;
+	if (!hb::Address::parse(key, address)) {
+		return false;
+	}
+	const unsigned char* bytes = type == 'd' ? ((const hb::BinaryAddressRecord*)slot)->address : ((const hb::BinaryAbuseIPDBRecord*)slot)->address;
+	uint8_t version = type == 'd' ? ((const hb::BinaryAddressRecord*)slot)->version : ((const hb::BinaryAbuseIPDBRecord*)slot)->version;
+	return version == address.version && memcmp(bytes, address.bytes, 16) == 0;
+}
+
+/*
+ * Suspicious address record
+ */
+std::string BinaryData::addressRecord(const hb::Address& address, const hb::SuspiciosAddressType& data)
+{
+	hb::BinaryAddressRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type = 'd';
+	record.slots = 1;
+	record.version = address.version;
+	record.flags = (data.whitelisted ? 1 : 0) | (data.blacklisted ? 2 : 0);
+	record.activityScore = data.activityScore;
+	record.activityCount = data.activityCount;
+	record.refusedCount = data.refusedCount;
+	record.lastActivity = data.lastActivity;
+	record.lastReported = data.lastReported;
+	memcpy(record.address, address.bytes, 16);
+	return std::string((const char*)&record, sizeof(record));
+}
+
+/*
+ * AbuseIPDB blacklisted address record
+ */
+std::string BinaryData::abuseIPDBRecord(const hb::Address& address, const hb::AbuseIPDBBlacklistedAddressType& data)
+{
+	hb::BinaryAbuseIPDBRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type = 'a';
+	record.slots = 1;
+	record.version = address.version;
+	record.totalReports = data.totalReports;
+	record.abuseConfidenceScore = data.abuseConfidenceScore;
+	memcpy(record.address, address.bytes, 16);
+	return std::string((const char*)&record, sizeof(record));
+}
+
+/*
+ * Log file record, padded to whole slots
+ */
+std::string BinaryData::fileRecord(const hb::LogFile& logFile)
+{
+	std::size_t slots = (kPathOffset + logFile.path.length() + BinaryData::kSlotSize - 1) / BinaryData::kSlotSize;
+	if (slots > 255) {
+		return "";
+	}
+	hb::BinaryFileRecord record;
+	memset(&record, 0, sizeof(record));
+	record.type = 'f';
+	record.slots = slots;
+	record.pathLength = logFile.path.length();
+	record.fingerprintSize = logFile.fingerprintSize;
+	record.bookmark = logFile.bookmark;
+	record.size = logFile.size;
+	record.device = logFile.device;
+	record.inode = logFile.inode;
+	record.fingerprint = logFile.fingerprint;
+	std::string result((const char*)&record, kPathOffset);
+	result += logFile.path;
+	result.resize(slots * BinaryData::kSlotSize, '\0');
+	return result;
+}
+
+/*
+ * Write records
+ */
+bool BinaryData::putRecords(std::unordered_map<std::string, long long int>& index, char type, const std::vector<std::pair<std::string, std::string>>& records, uint64_t hb::BinaryHeader::* count)
+{
+	hb::BinaryHeader header;
+	struct cstat::stat fileStat;
+	std::vector<std::pair<std::string, std::string>>::const_iterator it;
+	std::vector<std::pair<std::string, long long int>> newRecords;
+	std::string appended;
+	long long int offset, end;
+	bool scanned = false, result = true;
+
+	if (records.size() == 0) {
+		return true;
+	}
+
+	int fd = this->openLocked(header);
+	if (fd == -1) {
+		return false;
+	}
+
+	// Append after last whole slot, incomplete record left by interrupted write is overwritten
+	if (cstat::fstat(fd, &fileStat) != 0) {
+		this->closeLocked(fd, header, false);
+		return false;
+	}
+	end = fileStat.st_size - (fileStat.st_size % BinaryData::kSlotSize);
+
+	for (it = records.begin(); it != records.end(); ++it) {
+		if (it->second.length() == 0) {
+			this->log->warning("Record " + it->first + " can not be stored in binary datafile!");
+			result = false;
+			continue;
+		}
+		offset = this->findRecord(fd, index, type, it->first, false, scanned);
+		if (offset >= 0) {
+			if (!writeAt(fd, it->second.data(), it->second.length(), offset)) {
+				this->log->error("Failed to update " + it->first + " in binary datafile! " + std::to_string(errno) + ": " + strerror(errno));
+				result = false;
+			}
+		} else {
+			newRecords.push_back(std::make_pair(it->first, end + appended.length()));
+			appended += it->second;
+		}
+	}
+
+	// New records are indexed and counted only when they are written
+	if (appended.length() > 0 && !writeAt(fd, appended.data(), appended.length(), end)) {
+		this->log->error("Failed to add records to binary datafile! " + std::to_string(errno) + ": " + strerror(errno));
+		appended.clear();
+		result = false;
+	}
+	if (appended.length() > 0) {
+		for (std::vector<std::pair<std::string, long long int>>::iterator itn = newRecords.begin(); itn != newRecords.end(); ++itn) {
+			index[itn->first] = itn->second;
+		}
+		header.*count += newRecords.size();
+	}
+
+	return this->closeLocked(fd, header, appended.length() > 0) && result;
+}
+
+/*
+ * Mark records for removal
+ */
+bool BinaryData::removeRecords(std::unordered_map<std::string, long long int>& index, char type, const std::vector<std::string>& keys, uint64_t hb::BinaryHeader::* count)
+{
+	hb::BinaryHeader header;
+	std::vector<std::string>::const_iterator it;
+	long long int offset;
+	bool scanned = false, result = true, changed = false;
+	const char removed = 'r';
+
+	if (keys.size() == 0) {
+		return true;
+	}
+
+	int fd = this->openLocked(header);
+	if (fd == -1) {
+		return false;
+	}
+
+	for (it = keys.begin(); it != keys.end(); ++it) {
+		offset = this->findRecord(fd, index, type, *it, true, scanned);
+		if (offset < 0) {
+			continue;
+		}
+		if (!writeAt(fd, &removed, 1, offset)) {
+			this->log->error("Failed to remove " + *it + " from binary datafile! " + std::to_string(errno) + ": " + strerror(errno));
+			result = false;
+			continue;
+		}
+		index.erase(*it);
+		if (header.*count > 0) header.*count -= 1;
+		header.removedCount++;
+		changed = true;
+	}
+
+	return this->closeLocked(fd, header, changed) && result;
+}
+
+/*
+ * Add or update suspicious addresses
+ */
+bool BinaryData::putAddresses(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const std::vector<std::string>& keys)
+{
+	std::vector<std::pair<std::string, std::string>> records;
+	hb::Address address;
+	const hb::SuspiciosAddressType* data;
+	for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+		if (hb::Address::parse(*it, address) && (data = addresses.find(address)) != NULL) {
+			records.push_back(std::make_pair(*it, BinaryData::addressRecord(address, *data)));
+		}
+	}
+	return this->putRecords(this->addressIndex, 'd', records, &hb::BinaryHeader::addressCount);
+}
+
+/*
+ * Add or update AbuseIPDB blacklisted addresses
+ */
+bool BinaryData::putAbuseIPDBAddresses(const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<std::string>& keys)
+{
+	std::vector<std::pair<std::string, std::string>> records;
+	hb::Address address;
+	const hb::AbuseIPDBBlacklistedAddressType* data;
+	for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+		if (hb::Address::parse(*it, address) && (data = blacklist.find(address)) != NULL) {
+			records.push_back(std::make_pair(*it, BinaryData::abuseIPDBRecord(address, *data)));
+		}
+	}
+	return this->putRecords(this->abuseIPDBIndex, 'a', records, &hb::BinaryHeader::abuseIPDBCount);
+}
+
+/*
+ * Add or update log file bookmark
+ */
+bool BinaryData::putFile(const hb::LogFile& logFile)
+{
+	std::vector<std::pair<std::string, std::string>> records;
+	records.push_back(std::make_pair(logFile.path, BinaryData::fileRecord(logFile)));
+	return this->putRecords(this->fileIndex, 'f', records, &hb::BinaryHeader::fileCount);
+}
+
+/*
+ * Mark suspicious addresses for removal
+ */
+bool BinaryData::removeAddresses(const std::vector<std::string>& keys)
+{
+	return this->removeRecords(this->addressIndex, 'd', keys, &hb::BinaryHeader::addressCount);
+}
+
+/*
+ * Mark AbuseIPDB blacklisted addresses for removal
+ */
+bool BinaryData::removeAbuseIPDBAddresses(const std::vector<std::string>& keys)
+{
+	return this->removeRecords(this->abuseIPDBIndex, 'a', keys, &hb::BinaryHeader::abuseIPDBCount);
+}
+
+/*
+ * Mark log file bookmark for removal
+ */
+bool BinaryData::removeFile(const std::string& filePath)
+{
+	return this->removeRecords(this->fileIndex, 'f', std::vector<std::string>(1, filePath), &hb::BinaryHeader::fileCount);
+}
+
+/*
+ * Update AbuseIPDB sync data in header
+ */
+bool BinaryData::putSyncData(unsigned long long int syncTime, unsigned long long int blacklistGenTime)
+{
+	hb::BinaryHeader header;
+	int fd = this->openLocked(header);
+	if (fd == -1) {
+		return false;
+	}
+	header.abuseIPDBSyncTime = syncTime;
+	header.abuseIPDBBlacklistGenTime = blacklistGenTime;
+	return this->closeLocked(fd, header, true);
+}
@@ -0,0 +1,219 @@
+/*
+ * Binary datafile (datafile.engine = binary), fixed size records with
+ * addresses in binary form, loaded with mmap
+ */
+
+#ifndef HBBINARYDATA_H
+#define HBBINARYDATA_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Map
+#include <map>
+// Unordered map
+#include <unordered_map>
+// Fixed width integer types
+#include <cstdint>
+// Logger
+#include "logger.h"
+// Util
+#include "util.h"
+// Address table
+#include "addresstable.h"
+
+namespace hb{
+
+/*
+ * File header, first slot of datafile
+ * Note, integers are in host byte order, datafile is not portable between architectures with different endianness
+ */
+struct BinaryHeader {
+	char magic[8];// HBDATA followed by two zero bytes
+	uint32_t version;// Format version, also detects datafile written with other byte order
+	uint32_t slotSize;// Record slot size
+	uint64_t addressCount;// Live record counts
+	uint64_t abuseIPDBCount;
+	uint64_t fileCount;
+	uint64_t removedCount;// Records marked for removal, datafile is rewritten on load if there are too many
+	uint64_t abuseIPDBSyncTime;
+	uint64_t abuseIPDBBlacklistGenTime;
+};
+
+/*
+ * Suspicious address record (type d), one slot
+ */
+struct BinaryAddressRecord {
+	char type;
+	uint8_t slots;
+	uint8_t version;// IP version
+	uint8_t flags;// Bit 0 - whitelisted, bit 1 - blacklisted
+	uint32_t activityScore;
+	uint32_t activityCount;
+	uint32_t refusedCount;
+	uint64_t lastActivity;
+	uint64_t lastReported;
+	unsigned char address[16];// Address bytes in network order, as in hb::Address
+	unsigned char reserved[16];
+};
+
+/*
+ * AbuseIPDB blacklisted address record (type a), one slot
+ */
+struct BinaryAbuseIPDBRecord {
+	char type;
+	uint8_t slots;
+	uint8_t version;
+	uint8_t reserved0;
+	uint32_t totalReports;
+	uint32_t abuseConfidenceScore;
+	uint32_t reserved1;
+	unsigned char address[16];
+	unsigned char reserved[32];
+};
+
+/*
+ * Log file record (type f), path continues in following slots if it does not fit in first one
+ */
+struct BinaryFileRecord {
+	char type;
+	uint8_t slots;
+	uint16_t pathLength;
+	uint32_t fingerprintSize;
+	uint64_t bookmark;
+	uint64_t size;
+	uint64_t device;
+	uint64_t inode;
+	uint64_t fingerprint;
+	char path[16];
+};
+
+class BinaryData{
+	private:
+
+		/*
+		 * Logger object
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Datafile path
+		 */
+		std::string path;
+
+		/*
+		 * Offset index of records by address or log file path, rebuilt with single scan if indexed record is not found
+		 * Index is not built on load, but with first update (scan of mmapped datafile)
+		 */
+		std::unordered_map<std::string, long long int> addressIndex;
+		std::unordered_map<std::string, long long int> abuseIPDBIndex;
+		std::unordered_map<std::string, long long int> fileIndex;
+		bool indexed = false;
+
+		/*
+		 * Open and lock datafile for update, header is read and checked, returns -1 on failure
+		 */
+		int openLocked(hb::BinaryHeader& header);
+
+		/*
+		 * Write header and unlock datafile
+		 */
+		bool closeLocked(int fd, const hb::BinaryHeader& header, bool writeHeader);
+
+		/*
+		 * Rebuild offset index from datafile
+		 */
+		bool scan(int fd);
+
+		/*
+		 * Offset of record from offset index, -1 if not found
+		 * If record at indexed offset has other key (datafile changed by other process) or record is not indexed and
+		 * scanMissing is set, index is rebuilt (once per update, scanned is set then)
+		 */
+		long long int findRecord(int fd, std::unordered_map<std::string, long long int>& index, char type, const std::string& key, bool scanMissing, bool& scanned);
+
+		/*
+		 * Whether slot(s) contain record with given type and key
+		 */
+		static bool recordMatches(const char* slot, std::size_t length, char type, const std::string& key);
+
+		/*
+		 * Record slot(s) as written to datafile, empty string if record can not be stored (too long path)
+		 */
+		static std::string addressRecord(const hb::Address& address, const hb::SuspiciosAddressType& data);
+		static std::string abuseIPDBRecord(const hb::Address& address, const hb::AbuseIPDBBlacklistedAddressType& data);
+		static std::string fileRecord(const hb::LogFile& logFile);
+
+		/*
+		 * Write records (key and slots), existing ones in place, new ones appended with single write
+		 */
+		bool putRecords(std::unordered_map<std::string, long long int>& index, char type, const std::vector<std::pair<std::string, std::string>>& records, uint64_t hb::BinaryHeader::* count);
+
+		/*
+		 * Mark records for removal
+		 */
+		bool removeRecords(std::unordered_map<std::string, long long int>& index, char type, const std::vector<std::string>& keys, uint64_t hb::BinaryHeader::* count);
+
+	public:
+
+		/*
+		 * Record slot size
+		 */
+		static const unsigned int kSlotSize = 64;
+
+		/*
+		 * Format version
+		 */
+		static const unsigned int kVersion = 1;
+
+		/*
+		 * Constructor
+		 */
+		BinaryData(hb::Logger* log);
+
+		/*
+		 * Set datafile path, offset index is cleared if path changes
+		 */
+		void setPath(const std::string& path);
+
+		/*
+		 * Whether file at path is binary datafile
+		 */
+		static bool isBinary(const std::string& path);
+
+		/*
+		 * Load datafile, tables are built directly from mmapped file
+		 * Log file records are returned in files, caller matches them with configuration
+		 */
+		bool load(hb::AddressTable<hb::SuspiciosAddressType>& addresses, hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, std::vector<hb::LogFile>& files, unsigned long long int& syncTime, unsigned long long int& blacklistGenTime, unsigned long long int& removedCount);
+
+		/*
+		 * Write whole datafile (temporary file renamed over datafile)
+		 */
+		bool save(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<hb::LogGroup>& logGroups, unsigned long long int syncTime, unsigned long long int blacklistGenTime);
+
+		/*
+		 * Add or update records
+		 */
+		bool putAddresses(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const std::vector<std::string>& keys);
+		bool putAbuseIPDBAddresses(const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<std::string>& keys);
+		bool putFile(const hb::LogFile& logFile);
+
+		/*
+		 * Mark records for removal
+		 */
+		bool removeAddresses(const std::vector<std::string>& keys);
+		bool removeAbuseIPDBAddresses(const std::vector<std::string>& keys);
+		bool removeFile(const std::string& filePath);
+
+		/*
+		 * Update AbuseIPDB sync data in header
+		 */
+		bool putSyncData(unsigned long long int syncTime, unsigned long long int blacklistGenTime);
+
+};
+
+}
+
+#endif
@@ -10,10 +10,14 @@
 #include <fstream>
 // Time library (time_t, time, localtime)
 #include <time.h>
+// C string (strerror)
+#include <cstring>
 // Logger
 #include "logger.h"
 // Util
 #include "util.h"
+// Pattern set
+#include "patternset.h"
 // Header
 #include "config.h"
 // Syslog
@@ -132,6 +136,67 @@ bool Config::load()
 								this->logCheckInterval = strtoul(line.c_str(), NULL, 10);
 								if (logDetails) this->log->debug("Interval for log file check: " + std::to_string(this->logCheckInterval));
 							}
+						} else if (line.substr(0, 12) == "regex.engine") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line == "re2") {
+									this->regexEngine = hb::RegexEngine::Re2Regex;
+								} else if (line == "std") {
+									this->regexEngine = hb::RegexEngine::StdRegex;
+								} else {
+									this->log->error("Unknown regex.engine " + line + ", will use default value.");
+									this->regexEngine = hb::RegexEngine::StdRegex;
+								}
+								if (logDetails) this->log->debug("Regex engine: " + PatternSet::engineName(this->regexEngine));
+							}
+						} else if (line.substr(0, 9) == "log.watch") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line == "false") {
+									this->logWatch = false;
+								} else {
+									this->logWatch = true;
+								}
+								if (logDetails) this->log->debug("Watch log files with inotify: " + std::to_string(this->logWatch));
+							}
+						} else if (line.substr(0, 13) == "log.cpu.limit") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->logCpuLimit = strtoul(line.c_str(), NULL, 10);
+								if (this->logCpuLimit < 1 || this->logCpuLimit > 100) {
+									this->log->error("log.cpu.limit must be from 1 to 100, will use default value.");
+									this->logCpuLimit = 100;
+								}
+								if (logDetails) this->log->debug("CPU limit for log file parsing: " + std::to_string(this->logCpuLimit) + "%");
+							}
+						} else if (line.substr(0, 14) == "log.cpu.window") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->logCpuWindow = strtoul(line.c_str(), NULL, 10);
+								if (this->logCpuWindow == 0) {
+									this->log->error("log.cpu.window must be greater than 0, will use default value.");
+									this->logCpuWindow = 100;
+								}
+								if (logDetails) this->log->debug("CPU usage measurement window for log file parsing: " + std::to_string(this->logCpuWindow) + "ms");
+							}
+						} else if (line.substr(0, 11) == "log.threads") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->logThreads = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Worker threads for log file checks: " + (this->logThreads == 0 ? std::string("one per CPU core") : std::to_string(this->logThreads)));
+							}
+						} else if (line.substr(0, 18) == "log.backfill.chunk") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->logBackfillChunk = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Chunk size for parallel backfill: " + std::to_string(this->logBackfillChunk) + "MiB");
+							}
 						} else if (line.substr(0, 19) == "address.block.score") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -158,6 +223,17 @@ bool Config::load()
 									this->log->error("Failed to parse iptables.rules.block, IP address placeholder not found! Will use default value.");
 								}
 							}
+						} else if (line.substr(0, 20) == "iptables.rules.chain") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (line.size() > 0 && line.size() < 29 && line.find_first_of(" \t") == std::string::npos && line[0] != '-') {
+									this->iptablesChain = line;
+									if (logDetails) this->log->debug("Iptables chain: " + this->iptablesChain);
+								} else {
+									this->log->error("Invalid iptables.rules.chain " + line + ", will use default value.");
+								}
+							}
 						} else if (line.substr(0, 18) == "iptables.rules.pos") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -169,6 +245,56 @@ bool Config::load()
 								}
 								if (logDetails) this->log->debug("Append iptables rule: " + std::to_string(this->iptablesAppend));
 							}
+						} else if (line.substr(0, 16) == "iptables.backend") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (!hb::Config::parseFirewallBackend(line, this->firewallBackend)) {
+									this->log->error("Unknown iptables.backend " + line + ", will use default value.");
+									this->firewallBackend = hb::FirewallBackend::BackendRules;
+								}
+								if (logDetails) this->log->debug("Firewall backend: " + line);
+							}
+						} else if (line.substr(0, 14) == "iptables.limit") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->firewallLimit = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Maximum count of blocked addresses: " + (this->firewallLimit == 0 ? std::string("no limit") : std::to_string(this->firewallLimit)));
+							}
+						} else if (line.substr(0, 19) == "iptables.ipset.name") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (line.size() > 0 && line.size() < 31 && line.find_first_of(" \t") == std::string::npos) {
+									this->ipsetName = line;
+									if (logDetails) this->log->debug("ipset name: " + this->ipsetName);
+								} else {
+									this->log->error("Invalid iptables.ipset.name " + line + ", will use default value.");
+								}
+							}
+						} else if (line.substr(0, 19) == "iptables.ipset.rule") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (line.find("%s") != std::string::npos) {
+									this->ipsetRule = line;
+									if (logDetails) this->log->debug("Iptables rule for ipset: " + this->ipsetRule);
+								} else {
+									this->log->error("Failed to parse iptables.ipset.rule, set name placeholder not found! Will use default value.");
+								}
+							}
+						} else if (line.substr(0, 14) == "nftables.table") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								if (line.size() > 0 && line.find_first_of(" \t;{}") == std::string::npos) {
+									this->nftablesTable = line;
+									if (logDetails) this->log->debug("nftables table: " + this->nftablesTable);
+								} else {
+									this->log->error("Invalid nftables.table " + line + ", will use default value.");
+								}
+							}
 						} else if (line.substr(0, 22) == "iptables.startup.check") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -190,6 +316,61 @@ bool Config::load()
 								this->dateTimeFormat = line;
 								if (logDetails) this->log->debug("Datetime format: " + this->dateTimeFormat);
 							}
+						} else if (line.substr(0, 15) == "datafile.engine") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (!hb::Config::parseDataFileEngine(line, this->dataFileEngine)) {
+									this->log->error("Unknown datafile.engine " + line + ", will use default value.");
+									this->dataFileEngine = hb::DataFileEngine::EngineText;
+								}
+								if (logDetails) this->log->debug("Datafile engine: " + line);
+							}
+						} else if (line.substr(0, 25) == "datafile.compact.interval") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->dataFileCompactInterval = strtoul(line.c_str(), NULL, 10);
+								if (logDetails) this->log->debug("Datafile compaction interval: " + std::to_string(this->dataFileCompactInterval));
+							}
+						} else if (line.substr(0, 22) == "datafile.sync.interval") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->dataFileSyncInterval = strtoul(line.c_str(), NULL, 10);
+								if (this->dataFileSyncInterval == 0) {
+									this->log->error("datafile.sync.interval must be greater than 0, will use default value.");
+									this->dataFileSyncInterval = 5;
+								}
+								if (logDetails) this->log->debug("Datafile sync interval: " + std::to_string(this->dataFileSyncInterval));
+							}
+						} else if (line.substr(0, 19) == "datafile.sync.dirty") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::ltrim(line.substr(pos + 1));
+								this->dataFileSyncDirty = strtoul(line.c_str(), NULL, 10);
+								if (this->dataFileSyncDirty == 0) {
+									this->log->error("datafile.sync.dirty must be greater than 0, will use default value.");
+									this->dataFileSyncDirty = 1000;
+								}
+								if (logDetails) this->log->debug("Datafile sync after changed records: " + std::to_string(this->dataFileSyncDirty));
+							}
+						} else if (line.substr(0, 13) == "datafile.sync") {
+							pos = line.find_first_of("=");
+							if (pos != std::string::npos) {
+								line = hb::Util::toLower(hb::Util::ltrim(line.substr(pos + 1)));
+								if (line == "immediate") {
+									this->dataFileSync = hb::DataFileSync::SyncImmediate;
+								} else if (line == "interval") {
+									this->dataFileSync = hb::DataFileSync::SyncInterval;
+								} else if (line == "shutdown") {
+									this->dataFileSync = hb::DataFileSync::SyncShutdown;
+								} else {
+									this->log->error("Unknown datafile.sync " + line + ", will use default value.");
+									this->dataFileSync = hb::DataFileSync::SyncImmediate;
+								}
+								if (logDetails) this->log->debug("Datafile sync: " + line);
+							}
 						} else if (line.substr(0, 13) == "datafile.path") {
 							pos = line.find_first_of("=");
 							if (pos != std::string::npos) {
@@ -475,7 +656,7 @@ bool Config::load()
 
 /*
  * Process patterns
- * std::string patternString -> std::regex pattern
+ * std::string patternString -> hb::PatternSet patternSet
  */
 bool Config::processPatterns()
 {
@@ -495,7 +676,9 @@ bool Config::processPatterns()
 						else itpa->portSearch = 2;
 					}
 
-					itpa->pattern = std::regex(itpa->patternString.replace(posip, 2, '(' + hb::kIpSearchPattern + ')'), std::regex_constants::icase);
+					// Only shape of address is matched with regex, address itself is parsed and validated by hb::Address
+					posip = itpa->patternString.find("%i");
+					itpa->patternString.replace(posip, 2, '(' + hb::kIpTokenPattern + ')');
 					// std::cout << "Regex pattern: " << itpa->patternString << std::endl;
 				} else {
 					this->log->error("Unable to find ip address placeholder \%i in pattern, failed to parse pattern: " + itpa->patternString);
@@ -511,19 +694,46 @@ bool Config::processPatterns()
 						if (posport > posip) itpa->portSearch = 1;
 						else itpa->portSearch = 2;
 					}
-					itpa->pattern = std::regex(itpa->patternString.replace(posip, 2, '(' + hb::kIpSearchPattern + ')'), std::regex_constants::icase);
+					// Only shape of address is matched with regex, address itself is parsed and validated by hb::Address
+					posip = itpa->patternString.find("%i");
+					itpa->patternString.replace(posip, 2, '(' + hb::kIpTokenPattern + ')');
 					// std::cout << "Regex pattern: " << itpa->patternString << std::endl;
 				} else {
 					this->log->error("Unable to find ip address placeholder \%i in pattern, failed to parse pattern: " + itpa->patternString);
 					return false;
 				}
 			}
+
+			// Compile all patterns of log group into single regex for single pass matching
+			itlg->patternSet = std::make_shared<hb::PatternSet>();
+			itlg->patternSet->compile(itlg->patterns, this->regexEngine);
+			itlg->refusedPatternSet = std::make_shared<hb::PatternSet>();
+			itlg->refusedPatternSet->compile(itlg->refusedPatterns, this->regexEngine);
+
+			// Literals used to skip lines before regex
+			for (std::size_t i = 0; i < itlg->patterns.size(); ++i) {
+				if (itlg->patternSet->literal(i).length() > 0) {
+					this->log->debug("Prefilter literal \"" + itlg->patternSet->literal(i) + "\" for pattern: " + itlg->patterns[i].patternString);
+				} else {
+					this->log->debug("No prefilter literal, prefilter disabled for log group " + itlg->name + " pattern: " + itlg->patterns[i].patternString);
+				}
+			}
+			for (std::size_t i = 0; i < itlg->refusedPatterns.size(); ++i) {
+				if (itlg->refusedPatternSet->literal(i).length() > 0) {
+					this->log->debug("Prefilter literal \"" + itlg->refusedPatternSet->literal(i) + "\" for refused pattern: " + itlg->refusedPatterns[i].patternString);
+				} else {
+					this->log->debug("No prefilter literal, prefilter disabled for log group " + itlg->name + " refused pattern: " + itlg->refusedPatterns[i].patternString);
+				}
+			}
 		}
 	} catch (std::regex_error& e){
 		std::string message = e.what();
 		this->log->error(message + ": " + std::to_string(e.code()));
 		this->log->error(Util::regexErrorCode2Text(e.code()));
 		return false;
+	} catch (std::runtime_error& e) {
+		this->log->error(e.what());
+		return false;
 	}
 	return true;
 }
@@ -546,18 +756,52 @@ void Config::print()
 	std::cout << "log.level = " << this->logLevel << std::endl << std::endl;
 	std::cout << "## Interval for log file check (seconds, default 30)" << std::endl;
 	std::cout << "log.check.interval = " << this->logCheckInterval << std::endl << std::endl;
+	std::cout << "## Watch log files with inotify, so that new lines are parsed as soon as they are written (true|false, default true)" << std::endl;
+	std::cout << "log.watch = " << (this->logWatch ? "true" : "false") << std::endl << std::endl;
+	std::cout << "## CPU usage limit for log file parsing (percent of one core, 1 to 100, default 100 - no limit)" << std::endl;
+	std::cout << "log.cpu.limit = " << this->logCpuLimit << std::endl << std::endl;
+	std::cout << "## How often CPU usage of log file parsing is measured and parser yields to other processes (milliseconds, default 100)" << std::endl;
+	std::cout << "log.cpu.window = " << this->logCpuWindow << std::endl << std::endl;
+	std::cout << "## Number of worker threads for log file checks (0 - one per CPU core, default 0)" << std::endl;
+	std::cout << "log.threads = " << this->logThreads << std::endl << std::endl;
+	std::cout << "## Chunk size for parallel backfill of large unread part of log file (MiB, 0 - disabled, default 16)" << std::endl;
+	std::cout << "log.backfill.chunk = " << this->logBackfillChunk << std::endl << std::endl;
+	std::cout << "## Regex engine to match log lines with patterns (std|re2, default std)" << std::endl;
+	std::cout << "regex.engine = " << PatternSet::engineName(this->regexEngine) << std::endl << std::endl;
 	std::cout << "Needed score to create iptables rule for IP address connection drop (default 10)" << std::endl;
 	std::cout << "address.block.score = " << this->activityScoreToBlock << std::endl << std::endl;
 	std::cout << "## Score multiplier to calculate time how long iptables rule should be kept (seconds, default 3600, 0 will not remove automatically)" << std::endl;
 	std::cout << "address.block.multiplier = " << this->keepBlockedScoreMultiplier << std::endl << std::endl;
 	std::cout << "## Rule to use in IP tables rule (use %i as placeholder to specify IP address)" << std::endl;
 	std::cout << "iptables.rules.block = " << this->iptablesRule << std::endl << std::endl;
-	std::cout << "## Whether to add iptables rule to the head or end of the chain (default head)" << std::endl;
+	std::cout << "## Chain for iptables rules, INPUT has single jump to it (default HOSTBLOCK)" << std::endl;
+	std::cout << "iptables.rules.chain = " << this->iptablesChain << std::endl << std::endl;
+	std::cout << "## Whether to add jump to chain (or ipset rule) to the head or end of INPUT chain (default head)" << std::endl;
 	std::cout << "iptables.rules.pos =  " << (this->iptablesAppend ? "tail" : "head") << std::endl << std::endl;
+	std::cout << "## How blocked addresses are added to firewall (rules|ipset|nftables|netlink, default rules)" << std::endl;
+	std::cout << "iptables.backend = " << hb::Config::firewallBackendName(this->firewallBackend) << std::endl << std::endl;
+	std::cout << "## Maximum count of blocked addresses, lowest score or oldest activity is unblocked first, blacklisted are kept (0 - no limit, default 0)" << std::endl;
+	std::cout << "iptables.limit = " << this->firewallLimit << std::endl << std::endl;
+	std::cout << "## ipset name for IPv4 addresses, IPv6 set name has suffix 6 (default hostblock)" << std::endl;
+	std::cout << "iptables.ipset.name = " << this->ipsetName << std::endl << std::endl;
+	std::cout << "## Rule that references ipset (use %s as placeholder to specify set name)" << std::endl;
+	std::cout << "iptables.ipset.rule = " << this->ipsetRule << std::endl << std::endl;
+	std::cout << "## nftables table for address sets and chain (default hostblock)" << std::endl;
+	std::cout << "nftables.table = " << this->nftablesTable << std::endl << std::endl;
 	std::cout << "## Datetime format (default %Y-%m-%d %H:%M:%S)" << std::endl;
 	std::cout << "datetime.format = " << this->dateTimeFormat << std::endl << std::endl;
 	std::cout << "## Datafile location" << std::endl;
 	std::cout << "datafile.path = " << this->dataFilePath << std::endl << std::endl;
+	std::cout << "## How datafile is stored (text|journal|binary|sqlite, default text)" << std::endl;
+	std::cout << "datafile.engine = " << hb::Config::dataFileEngineName(this->dataFileEngine) << std::endl << std::endl;
+	std::cout << "## Interval for merging journal into datafile (seconds, default 3600)" << std::endl;
+	std::cout << "datafile.compact.interval = " << this->dataFileCompactInterval << std::endl << std::endl;
+	std::cout << "## When changed data is written to datafile (immediate|interval|shutdown, default immediate)" << std::endl;
+	std::cout << "datafile.sync = " << (this->dataFileSync == hb::DataFileSync::SyncInterval ? "interval" : (this->dataFileSync == hb::DataFileSync::SyncShutdown ? "shutdown" : "immediate")) << std::endl << std::endl;
+	std::cout << "## Interval for writing changed data to datafile (seconds, default 5)" << std::endl;
+	std::cout << "datafile.sync.interval = " << this->dataFileSyncInterval << std::endl << std::endl;
+	std::cout << "## Changed record count after which changes are written without waiting (default 1000)" << std::endl;
+	std::cout << "datafile.sync.dirty = " << this->dataFileSyncDirty << std::endl << std::endl;
 	std::cout << "## AbuseIPDB URL" << std::endl;
 	std::cout << "abuseipdb.api.url = " << this->abuseipdbURL << std::endl << std::endl;
 	std::vector<unsigned int>::iterator itc;// AbuseipDB category iterator
@@ -716,3 +960,108 @@ void Config::print()
 		}
 	}
 }
+
+/*
+ * Datafile engine name as used in configuration file
+ */
+std::string Config::dataFileEngineName(hb::DataFileEngine engine)
+{
+	if (engine == hb::DataFileEngine::EngineJournal) {
+		return "journal";
+	} else if (engine == hb::DataFileEngine::EngineBinary) {
+		return "binary";
+	} else if (engine == hb::DataFileEngine::EngineSqlite) {
+		return "sqlite";
+	}
+	return "text";
+}
+
+/*
+ * Datafile engine by name
+ */
+bool Config::parseDataFileEngine(const std::string& name, hb::DataFileEngine& engine)
+{
+	if (name == "text") {
+		engine = hb::DataFileEngine::EngineText;
+	} else if (name == "journal") {
+		engine = hb::DataFileEngine::EngineJournal;
+	} else if (name == "binary") {
+		engine = hb::DataFileEngine::EngineBinary;
+	} else if (name == "sqlite") {
+		engine = hb::DataFileEngine::EngineSqlite;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Firewall backend name as used in configuration file
+ */
+std::string Config::firewallBackendName(hb::FirewallBackend backend)
+{
+	if (backend == hb::FirewallBackend::BackendIpset) {
+		return "ipset";
+	} else if (backend == hb::FirewallBackend::BackendNftables) {
+		return "nftables";
+	} else if (backend == hb::FirewallBackend::BackendNetlink) {
+		return "netlink";
+	}
+	return "rules";
+}
+
+/*
+ * Firewall backend by name
+ */
+bool Config::parseFirewallBackend(const std::string& name, hb::FirewallBackend& backend)
+{
+	if (name == "rules") {
+		backend = hb::FirewallBackend::BackendRules;
+	} else if (name == "ipset") {
+		backend = hb::FirewallBackend::BackendIpset;
+	} else if (name == "nftables") {
+		backend = hb::FirewallBackend::BackendNftables;
+	} else if (name == "netlink") {
+		backend = hb::FirewallBackend::BackendNetlink;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * ipset name for IP version
+ */
+std::string Config::ipsetNameFor(int version) const
+{
+	if (version == 6) {
+		return this->ipsetName + "6";
+	}
+	return this->ipsetName;
+}
+
+/*
+ * iptables rule that references ipset for IP version
+ */
+std::string Config::ipsetRuleFor(int version) const
+{
+	std::string rule = this->ipsetRule;
+	std::size_t pos = rule.find("%s");
+	if (pos != std::string::npos) {
+		rule.replace(pos, 2, this->ipsetNameFor(version));
+	}
+	return rule;
+}
+
+/*
+ * iptables rule for address
+ */
+std::string Config::iptablesRuleFor(const std::string& address) const
+{
+	std::string rule = this->iptablesRule;
+	std::size_t pos = rule.find("%i");
+	if (pos != std::string::npos) {
+		rule.replace(pos, 2, address);
+	}
+	return rule;
+}
@@ -18,6 +18,35 @@
 
 namespace hb{
 
+/*
+ * When changed data is written to datafile
+ */
+enum DataFileSync {
+	SyncImmediate,// Each change is written immediately
+	SyncInterval,// Changes are collected and written each datafile.sync.interval seconds or when datafile.sync.dirty records are changed
+	SyncShutdown// Changes are written on daemon stop, configuration reload and when datafile.sync.dirty records are changed
+};
+
+/*
+ * How datafile is stored
+ */
+enum DataFileEngine {
+	EngineText,// Records are updated in place in datafile
+	EngineJournal,// Datafile is snapshot, changes are appended to journal and merged into snapshot in background
+	EngineBinary,// Fixed size binary records updated in place, datafile is mmapped on load
+	EngineSqlite// SQLite database in WAL mode
+};
+
+/*
+ * How blocked addresses are added to firewall
+ */
+enum FirewallBackend {
+	BackendRules,// iptables rule for each address (iptables.rules.block)
+	BackendIpset,// Addresses in hash:ip ipsets (one per address family) referenced by single iptables rule
+	BackendNftables,// Addresses in nftables sets with timeout, kernel removes address when block time passes
+	BackendNetlink// Same nftables table as BackendNftables, changed over netlink socket instead of executing nft
+};
+
 class Config{
 	private:
 
@@ -39,10 +68,41 @@ class Config{
 		std::string iptablesRule = "-s %i -j DROP";
 
 		/*
-		 * Whether to append (add to the end) or insert (add to the beginning) iptables rule
+		 * Whether to append (add to the end) or insert (add to the beginning) jump to hostblock chain (or ipset rule)
 		 */
 		bool iptablesAppend = false;
 
+		/*
+		 * iptables chain with rules of blocked addresses, INPUT jumps to it (iptables.backend = rules)
+		 */
+		std::string iptablesChain = "HOSTBLOCK";
+
+		/*
+		 * How blocked addresses are added to firewall
+		 */
+		hb::FirewallBackend firewallBackend = hb::FirewallBackend::BackendRules;
+
+		/*
+		 * Maximum count of blocked addresses in firewall (0 - no limit), addresses with lowest score or oldest activity
+		 * are unblocked first when limit is reached, blacklisted addresses are always kept
+		 */
+		unsigned int firewallLimit = 0;
+
+		/*
+		 * ipset name for IPv4 addresses, IPv6 set has suffix 6 (iptables.backend = ipset)
+		 */
+		std::string ipsetName = "hostblock";
+
+		/*
+		 * iptables rule that references ipset (%s is replaced with set name)
+		 */
+		std::string ipsetRule = "-m set --match-set %s src -j DROP";
+
+		/*
+		 * nftables table with address sets and chain (iptables.backend = nftables or netlink)
+		 */
+		std::string nftablesTable = "hostblock";
+
 		/*
 		 * iptables rule to check during startup
 		 */
@@ -63,11 +123,41 @@ class Config{
 		 */
 		std::string configPath = "/etc/hostblock";
 
+		/*
+		 * Regex engine to match log lines with patterns
+		 */
+		hb::RegexEngine regexEngine = hb::RegexEngine::StdRegex;
+
 		/*
 		 * Interval for log file check
 		 */
 		unsigned int logCheckInterval = 30;
 
+		/*
+		 * Whether to watch log files with inotify (log files are polled each logCheckInterval if false or if inotify is not available)
+		 */
+		bool logWatch = true;
+
+		/*
+		 * CPU usage limit for log file parsing (percent of one core, 100 - no limit)
+		 */
+		unsigned int logCpuLimit = 100;
+
+		/*
+		 * How often CPU usage of log file parsing is measured and parser yields to other tasks (milliseconds)
+		 */
+		unsigned int logCpuWindow = 100;
+
+		/*
+		 * Number of worker threads for log file checks (0 - one per CPU core)
+		 */
+		unsigned int logThreads = 0;
+
+		/*
+		 * Chunk size for parallel backfill of large unread part of log file (MiB, 0 - disabled)
+		 */
+		unsigned int logBackfillChunk = 16;
+
 		/*
 		 * Needed suspicious activity score to block access (to create iptables rule)
 		 */
@@ -96,6 +186,31 @@ class Config{
 		 */
 		std::string dataFilePath = "/usr/share/hostblock/hostblock.data";
 
+		/*
+		 * How datafile is stored
+		 */
+		hb::DataFileEngine dataFileEngine = hb::DataFileEngine::EngineText;
+
+		/*
+		 * Interval for merging journal into datafile snapshot (seconds, datafile.engine = journal, 0 - only when journal grows larger than snapshot)
+		 */
+		unsigned int dataFileCompactInterval = 3600;
+
+		/*
+		 * When changed data is written to datafile
+		 */
+		hb::DataFileSync dataFileSync = hb::DataFileSync::SyncImmediate;
+
+		/*
+		 * Interval for writing changed data to datafile (seconds, datafile.sync = interval)
+		 */
+		unsigned int dataFileSyncInterval = 5;
+
+		/*
+		 * Changed record count after which changes are written to datafile without waiting for interval or shutdown
+		 */
+		unsigned int dataFileSyncDirty = 1000;
+
 		/*
 		 * AbuseIPDB API URL
 		 */
@@ -160,7 +275,7 @@ class Config{
 
 		/*
 		 * Process patterns
-		 * std::string patternString -> std::regex pattern
+		 * std::string patternString -> hb::PatternSet patternSet
 		 */
 		bool processPatterns();
 
@@ -168,6 +283,41 @@ class Config{
 		 * Print (stdout) currently loaded config
 		 */
 		void print();
+
+		/*
+		 * Datafile engine name as used in configuration file
+		 */
+		static std::string dataFileEngineName(hb::DataFileEngine engine);
+
+		/*
+		 * Datafile engine by name, returns false if name is unknown
+		 */
+		static bool parseDataFileEngine(const std::string& name, hb::DataFileEngine& engine);
+
+		/*
+		 * Firewall backend name as used in configuration file
+		 */
+		static std::string firewallBackendName(hb::FirewallBackend backend);
+
+		/*
+		 * Firewall backend by name, returns false if name is unknown
+		 */
+		static bool parseFirewallBackend(const std::string& name, hb::FirewallBackend& backend);
+
+		/*
+		 * ipset name for IP version
+		 */
+		std::string ipsetNameFor(int version) const;
+
+		/*
+		 * iptables rule that references ipset for IP version
+		 */
+		std::string ipsetRuleFor(int version) const;
+
+		/*
+		 * iptables rule (iptables.rules.block) for address
+		 */
+		std::string iptablesRuleFor(const std::string& address) const;
 };
 
 }
@@ -0,0 +1,104 @@
+/*
+ * CPU budget for long running work (log file parsing)
+ *
+ * Instead of sleeping after each line, CPU time of calling thread is
+ * measured every few hundred lines and added to account shared by all
+ * threads of the work (log parser workers). When account window (default
+ * 100ms) passes and threads together have used more CPU than allowed
+ * share of one core, all of them sleep until the difference is paid
+ * off. Once per window each thread yields, so on busy host other runnable
+ * tasks get the core, while on idle host the yield returns immediately
+ * and backlog is processed at full speed.
+ */
+
+// C time (clock_gettime, nanosleep)
+#include <time.h>
+// Scheduler (sched_yield)
+#include <sched.h>
+// Header
+#include "cpubudget.h"
+
+// Hostblock namespace
+using namespace hb;
+
+// Clock is checked only after this many calls to tick (clock_gettime is cheap, but not free)
+static const unsigned int kCheckEvery = 256;
+
+/*
+ * Constructor
+ */
+CpuBudget::CpuBudget(unsigned int percent, unsigned int windowMs, hb::CpuBudget::Account* account)
+: percent(percent), window((long long int)windowMs * 1000000), account(account)
+{
+	if (this->percent == 0) this->percent = 1;
+	if (this->percent > 100) this->percent = 100;
+	if (this->window <= 0) this->window = 100000000;
+}
+
+/*
+ * Current time of clock in nanoseconds
+ */
+long long int CpuBudget::now(int clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (long long int)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Start new measurement window
+ */
+void CpuBudget::start()
+{
+	this->calls = 0;
+	this->windowWallStart = CpuBudget::now(CLOCK_MONOTONIC);
+	this->accountedCpu = CpuBudget::now(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/*
+ * Call after each unit of work, sleep if over budget
+ */
+void CpuBudget::tick()
+{
+	if (++this->calls < kCheckEvery) return;
+	this->calls = 0;
+
+	long long int wall = CpuBudget::now(CLOCK_MONOTONIC);
+	if (this->percent < 100) {
+		long long int cpu = CpuBudget::now(CLOCK_THREAD_CPUTIME_ID);
+		long long int sleep = 0;
+		{
+			std::lock_guard<std::mutex> lock(this->account->mutex);
+			this->account->windowCpu += cpu - this->accountedCpu;
+			if (this->account->windowWallStart == 0) {
+				this->account->windowWallStart = wall;
+			}
+			if (this->account->pauseEnd <= wall && wall - this->account->windowWallStart >= this->window) {
+				// Wall time in which CPU time used by all threads would be within budget
+				long long int allowedWall = this->account->windowCpu * 100 / this->percent;
+				if (allowedWall > wall - this->account->windowWallStart) {
+					this->account->pauseEnd = this->account->windowWallStart + allowedWall;
+				}
+				this->account->windowWallStart = this->account->pauseEnd > wall ? this->account->pauseEnd : wall;
+				this->account->windowCpu = 0;
+			}
+			if (this->account->pauseEnd > wall) {
+				sleep = this->account->pauseEnd - wall;
+			}
+		}
+		this->accountedCpu = cpu;
+		if (sleep > 0) {
+			struct timespec ts;
+			ts.tv_sec = sleep / 1000000000;
+			ts.tv_nsec = sleep % 1000000000;
+			nanosleep(&ts, NULL);
+			wall += sleep;
+		}
+	}
+	if (wall - this->windowWallStart < this->window) return;
+
+	// Give other runnable tasks a chance once per window
+	sched_yield();
+
+	this->start();
+}
@@ -0,0 +1,90 @@
+/*
+ * CPU budget for long running work (log file parsing), limits CPU usage of all threads sharing account to configured
+ * share of one core
+ */
+
+#ifndef HBCPUBUDGET_H
+#define HBCPUBUDGET_H
+
+// Mutex
+#include <mutex>
+
+namespace hb{
+
+class CpuBudget{
+	public:
+
+		/*
+		 * CPU time used in current window by all threads sharing account, threads sleep together until pause ends
+		 * when they used more than allowed (nanoseconds, monotonic wall clock)
+		 */
+		struct Account {
+			std::mutex mutex;
+			long long int windowWallStart = 0;
+			long long int windowCpu = 0;
+			long long int pauseEnd = 0;
+		};
+
+	private:
+
+		/*
+		 * Allowed CPU usage, percent of one core (1-100)
+		 */
+		unsigned int percent;
+
+		/*
+		 * Measurement window, nanoseconds
+		 */
+		long long int window;
+
+		/*
+		 * Account shared with other threads
+		 */
+		hb::CpuBudget::Account* account;
+
+		/*
+		 * Window start of this thread (monotonic wall clock, nanoseconds), thread yields once per window
+		 */
+		long long int windowWallStart = 0;
+
+		/*
+		 * Thread CPU time already added to account (nanoseconds)
+		 */
+		long long int accountedCpu = 0;
+
+		/*
+		 * Calls since last clock check, clock is checked only each kCheckEvery calls
+		 */
+		unsigned int calls = 0;
+
+		/*
+		 * Current time of clock in nanoseconds
+		 */
+		static long long int now(int clock);
+
+	public:
+
+		/*
+		 * Constructor
+		 * percent - allowed CPU usage of all threads sharing account (percent of one core, 100 means no limit)
+		 * windowMs - how often CPU usage is measured and thread yields (milliseconds)
+		 * account - account shared by threads, one budget per thread
+		 */
+		CpuBudget(unsigned int percent, unsigned int windowMs, hb::CpuBudget::Account* account);
+
+		/*
+		 * Start new measurement window (call before work starts)
+		 */
+		void start();
+
+		/*
+		 * Call after each unit of work (line), sleeps if threads sharing account have used more CPU than allowed in
+		 * current window
+		 */
+		void tick();
+
+};
+
+}
+
+#endif
@@ -2,8 +2,10 @@
  * Class to work with suspicious activity and log file data. Read further for
  * small details about how data file looks like.
  *
- * What started as a simple file is now turning into a database. TODO Consider
- * switch to sqlite.
+ * Storage is chosen with datafile.engine: text (format below, records are
+ * overwritten in place), journal (text snapshot plus appended journal, see
+ * journal.h), binary (fixed size mmapped records, see binarydata.h) or sqlite
+ * (see sqlitedata.h). Format below applies to text and journal snapshot.
  *
  * First position means type of record, almost all data is in fixed position
  * left padded with space to fill specified len. As exception to fixed position
@@ -13,11 +15,19 @@
  * file is rewritten with latest data and lines starting with "r" are not saved
  * (to get rid of them eventually).
  *
+ * With datafile.engine = journal records are not updated in place, changes
+ * are appended to journal next to datafile instead (see journal.cpp). With
+ * datafile.engine = binary datafile has fixed size binary records instead of
+ * text lines (see binarydata.cpp).
+ *
  * Data about suspicious activity from address:
  * d|addr|lastact|actscore|actcount|refcount|whitelisted|blacklisted|lastreport|version
  *
  * Log file bookmark to check for log rotation and for seekg to read only new
  * lines:
+ * f|bookmark|size|device|inode|fprint|fprintsize|file_path
+ *
+ * Log file bookmark without file identity (older versions, upgraded to f):
  * b|bookmark|size|file_path
  *
  * Data about IP address received from AbuseIPDB (API blacklist endpoint)
@@ -44,6 +54,11 @@
  *
  * bookmark    - bookmark with how far this file is already parsed, len 20
  * size        - size of file when it was last read, len 20
+ * device      - device of file when it was last read, len 20
+ * inode       - inode of file when it was last read, len 20
+ * fprint      - hash (hex) of first bytes of file, to recognize file after
+ *               rename and to detect rewrite with the same inode, len 16
+ * fprintsize  - how many first bytes are hashed, len 5
  * file_path   - full path to log file, variable len (limits.h/PATH_MAX is not
  *               reliable so no max len here)
  *
@@ -63,12 +78,14 @@
 #include <fstream>
 // Parametric manipulators (setw, setfill)
 #include <iomanip>
-// RegEx
-#include <regex>
+// String stream
+#include <sstream>
 // Unordered map
 #include <unordered_map>
 // C Math
 #include <cmath>
+// C string (strerror)
+#include <cstring>
 // Linux stat
 namespace cstat{
 	#include <errno.h>
@@ -87,10 +104,16 @@ namespace cunistd{
 #include <ext/stdio_filebuf.h>
 // Limits
 #include <climits>
+// Sort
+#include <algorithm>
+// Iterators (back_inserter)
+#include <iterator>
 // Util
 #include "util.h"
 // Config
 #include "config.h"
+// Address
+#include "address.h"
 // Header
 #include "data.h"
 
@@ -101,7 +124,7 @@ using namespace hb;
  * Constructor
  */
 Data::Data(hb::Logger* log, hb::Config* config, hb::Iptables* iptables)
-: log(log), config(config), iptables(iptables)
+: journal(new hb::Journal(log)), binary(new hb::BinaryData(log)), sqlite(new hb::SqliteData(log)), firewallWorker(new hb::FirewallWorker(log)), log(log), config(config), iptables(iptables)
 {
 
 }
@@ -114,6 +137,25 @@ bool Data::loadData()
 {
 	this->log->debug("Loading data from " + this->config->dataFilePath);
 
+	// Changes collected in memory would be lost
+	this->flush();
+
+	// Snapshot and journal must not change while they are read
+	this->journal->setPath(this->config->dataFilePath);
+	this->journal->wait();
+
+	// Binary datafile is recognized by header, also when it is converted to other engine
+	this->binary->setPath(this->config->dataFilePath);
+	if (hb::BinaryData::isBinary(this->config->dataFilePath)) {
+		return this->loadBinary();
+	}
+
+	// SQLite datafile is recognized by header as well
+	this->sqlite->setPath(this->config->dataFilePath);
+	if (hb::SqliteData::isSqlite(this->config->dataFilePath)) {
+		return this->loadSqlite();
+	}
+
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r");
 	if (fp == NULL) {
@@ -162,182 +204,68 @@ bool Data::loadData()
 
 	// Init vars for parsing
 	std::string line;
-	char recordType;
-	std::string address;
-	hb::SuspiciosAddressType data;
-	std::pair<std::map<std::string, hb::SuspiciosAddressType>::iterator,bool> chk;
-	hb::AbuseIPDBBlacklistedAddressType abuseIPDBData;
-	std::pair<std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>::iterator,bool> chka;
-	bool duplicatesFound = false;
-	unsigned long long int bookmark, size;
-	std::string logFilePath;
-	bool logFileFound = false;
+	hb::Data::LoadState state;
+	long long int offset = 0;
 	std::vector<hb::LogGroup>::iterator itlg;
 	std::vector<hb::LogFile>::iterator itlf;
-	unsigned int removedRecords = 0;
-	bool needUpgrade = false;
 
 	// Clear this->suspiciousAddresses
 	this->suspiciousAddresses.clear();
+	this->expiry.clear();
+	this->eviction.clear();
+	this->keptRules.clear();
 
 	// Clear this->abuseIPDBBlacklist
 	this->abuseIPDBBlacklist.clear();
 
+	// Offset index is rebuilt
+	this->addressIndex.clear();
+	this->fileIndex.clear();
+	this->abuseIPDBIndex.clear();
+	this->syncRecordOffset = -1;
+
 	// Read data file line by line
 	while (std::getline(f, line)) {
-
-		// First position is record type
-		recordType = line[0];
-
-		if (recordType == 'd') {// Data about suspicious address
-
-			// IP address
-			address = hb::Util::ltrim(line.substr(1, 39));
-
-			// Timestamp of last activity
-			data.lastActivity = std::strtoull(hb::Util::ltrim(line.substr(40, 20)).c_str(), NULL, 10);
-
-			// Total score of activity calculated at last activity
-			data.activityScore = std::strtoul(hb::Util::ltrim(line.substr(60, 10)).c_str(), NULL, 10);
-
-			// Suspicious activity count
-			data.activityCount = std::strtoul(hb::Util::ltrim(line.substr(70, 10)).c_str(), NULL, 10);
-
-			// Refused connection count
-			data.refusedCount = std::strtoul(hb::Util::ltrim(line.substr(80, 10)).c_str(), NULL, 10);
-
-			// Whether IP address is in whitelist
-			if (line[90] == 'y') data.whitelisted = true;
-			else data.whitelisted = false;
-
-			// Whether IP address in in blacklist
-			if (line[91] == 'y') data.blacklisted = true;
-			else data.blacklisted = false;
-
-			// If IP address is in both, whitelist and blacklist, remove it from blacklist
-			if (data.whitelisted == true && data.blacklisted == true) {
-				this->log->warning("Address " + address + " is in whitelist and at the same time in blacklist! Removing address from blacklist...");
-				data.blacklisted = false;
-			}
-
-			// Timestamp of last report to 3rd party
-			if (line.length() >= 112) {
-				data.lastReported = std::strtoull(hb::Util::ltrim(line.substr(92, 20)).c_str(), NULL, 10);
-			}
-
-			// IP version
-			if (line.length() == 113) {
-				if (line[112] == '4') data.version = 4;
-				else if (line[112] == '6') data.version = 6;
-				else data.version = hb::Util::ipVersion(address);
-			} else {
-				data.version = hb::Util::ipVersion(address);
-				needUpgrade = true;
-			}
-
-			// When data is loaded from datafile we do not have yet info whether it has rule in iptables, this will be changed to true later if needed
-			data.iptableRule = false;
-
-			// Store in this->suspiciousAddresses
-			chk = this->suspiciousAddresses.insert(std::pair<std::string, hb::SuspiciosAddressType>(address, data));
-			if (chk.second == false) {
-				this->log->warning("Address" + address + " is duplicated in data file, new datafile without duplicates will be created!");
-				duplicatesFound = true;
-			}
-
-		} else if (recordType == 'b') {// Log file bookmarks
-
-			// Bookmark
-			bookmark = std::strtoull(hb::Util::ltrim(line.substr(1, 20)).c_str(), NULL, 10);
-
-			// Last known size to detect if log file has been rotated
-			size = std::strtoull(hb::Util::ltrim(line.substr(21, 20)).c_str(), NULL, 10);
-
-			// Path to log file
-			logFilePath = hb::Util::rtrim(hb::Util::ltrim(line.substr(41)));
-
-			// Update info about log file
-			logFileFound = false;
-			for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
-				for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
-					if (itlf->path == logFilePath) {
-						itlf->bookmark = bookmark;
-						itlf->size = size;
-						itlf->dataFileRecord = true;
-						logFileFound = true;
-						this->log->debug("Bookmark: " + std::to_string(bookmark) + " Size: " + std::to_string(size) + " Path: " + logFilePath);
-						break;
-					}
-				}
-				if (logFileFound) break;
-			}
-
-			// If log file is not found this->config
-			if (!logFileFound) {
-				this->log->warning("Bookmark information in datafile for log file " + logFilePath + " found, but file not present in configuration. Removing from datafile...");
-				this->removeFile(logFilePath);
-			}
-
-		} else if (recordType == 'a') {// AbuseIPDB blacklisted address
-
-			// IP address
-			address = hb::Util::ltrim(line.substr(1, 39));
-
-			// AbuseIPDB report count for this IP address according to specified interval
-			abuseIPDBData.totalReports = std::strtoul(hb::Util::ltrim(line.substr(40, 10)).c_str(), NULL, 10);
-
-			// AbuseIPDB confidence score
-			abuseIPDBData.abuseConfidenceScore = std::strtoul(hb::Util::ltrim(line.substr(50, 3)).c_str(), NULL, 10);
-
-			// IP version
-			if (line.length() == 54) {
-				if (line[53] == '4') abuseIPDBData.version = 4;
-				else if (line[53] == '6') abuseIPDBData.version = 6;
-				else abuseIPDBData.version = hb::Util::ipVersion(address);
-			} else {
-				abuseIPDBData.version = hb::Util::ipVersion(address);
-				needUpgrade = true;
-			}
-
-			// When data is loaded from datafile we do not have yet info whether it has rule in iptables, this will be changed to true later if needed
-			abuseIPDBData.iptableRule = false;
-
-			// Store in this->abuseIPDBBlacklist
-			chka = this->abuseIPDBBlacklist.insert(std::pair<std::string, hb::AbuseIPDBBlacklistedAddressType>(address, abuseIPDBData));
-			if (chka.second == false) {
-				this->log->warning("AbuseIPDB blacklisted address" + address + " is duplicated in data file, new datafile without duplicates will be created!");
-				duplicatesFound = true;
-			}
-
-		} else if (recordType == 's') {// AbuseIPDB sync bookmark
-
-			// Unix timestamp of last sync with AbuseIPDB using blacklist endpoint
-			this->abuseIPDBSyncTime = std::strtoull(hb::Util::ltrim(line.substr(1, 20)).c_str(), NULL, 10);
-
-			// Unix timestamp of AbuseIPDB blacklist generation (returned by AbuseIPDB)
-			this->abuseIPDBBlacklistGenTime =  std::strtoull(hb::Util::ltrim(line.substr(21, 20)).c_str(), NULL, 10);
-
-		} else if (recordType == 'r') {// Record marked for removal
-			removedRecords++;
-		}
+		this->loadRecord(line, offset, false, state);
+		offset += line.length() + 1;
 	}
 
 	// Finished reading file
 	filebuf.close();
 	std::fclose(fp);
 
-	// Check if all configured log files are present in datafile (add if needed)
+	// Changes appended to journal after snapshot was written, also when switching back to text engine
+	std::vector<std::string> journalRecords;
+	std::vector<std::string>::iterator itj;
+	bool journalFound = this->journal->exists();
+	if (journalFound) {
+		this->journal->read(journalRecords);
+		for (itj = journalRecords.begin(); itj != journalRecords.end(); ++itj) {
+			this->loadRecord(*itj, -1, true, state);
+		}
+		this->log->debug("Replayed " + std::to_string(journalRecords.size()) + " journal entries");
+	}
+
+	// Remove log files that are not in configuration, check if all configured log files are present in datafile (add if needed)
+	// Not needed when text datafile is converted to binary or SQLite, new datafile contains all configured log files
+	if (!this->binaryEngine() && !this->sqliteEngine()) {
+		for (std::vector<std::string>::iterator itu = state.unknownFiles.begin(); itu != state.unknownFiles.end(); ++itu) {
+			this->removeFile(*itu);
+		}
+	}
 	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
 		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
 			if (!itlf->dataFileRecord) {
-				this->addFile(itlf->path);
+				if (!this->binaryEngine() && !this->sqliteEngine()) {
+					this->addFile(itlf->path);
+				}
 				itlf->dataFileRecord = true;
 			}
 		}
 	}
 
 	// If duplicates found, rename current data file to serve as backup and save new data file without duplicates
-	if (duplicatesFound) {
+	if (state.duplicatesFound) {
 
 		// New filename for data file
 		std::time_t rtime;
@@ -375,7 +303,7 @@ bool Data::loadData()
 		}
 		this->log->warning("Duplicate data found while reading data file! Old data file stored as " + newDataFileName + ", new data file without duplicates saved! Merge manually if needed.");
 
-	} else if (removedRecords > 1000) {// If more than 1000 removed records detected in datafile
+	} else if (state.removedRecords > 1000) {// If more than 1000 removed records detected in datafile
 
 		// Save data without without removed records data file - small space saving
 		this->log->info("Datafile contains more than 1000 records marked for removal, performing datafile cleanup...");
@@ -383,12 +311,30 @@ bool Data::loadData()
 			this->log->error("Data file contains more than 1000 removed records, tried saving data file without records that are marked for removal, but failed!");
 			return false;
 		}
-	} else if (needUpgrade) {// Need to upgrade datafile
+	} else if (state.needUpgrade) {// Need to upgrade datafile
 		this->log->info("Datafile requires upgrade! Saving new datafile...");
 		if (this->saveData() == false) {
 			this->log->error("Data file requires upgrade, tried saving new data file, but failed!");
 			return false;
 		}
+	} else if (this->journalEngine() && !journalFound) {// One-shot conversion from text engine, snapshot must not contain records marked for removal
+		this->log->info("Converting datafile to journal engine...");
+		if (this->saveData() == false) {
+			this->log->error("Failed to convert datafile to journal engine!");
+			return false;
+		}
+	} else if (this->binaryEngine() || this->sqliteEngine()) {// One-shot conversion from text engine
+		this->log->info("Converting datafile to " + hb::Config::dataFileEngineName(this->config->dataFileEngine) + " engine...");
+		if (this->saveData() == false) {
+			this->log->error("Failed to convert datafile to " + hb::Config::dataFileEngineName(this->config->dataFileEngine) + " engine!");
+			return false;
+		}
+	} else if (!this->journalEngine() && journalFound) {// Journal is merged into datafile when switching back to text engine
+		this->log->info("Merging journal into datafile, datafile engine changed to text...");
+		if (this->saveData() == false) {
+			this->log->error("Failed to merge journal into datafile!");
+			return false;
+		}
 	}
 
 	// Data file processing finished
@@ -400,6 +346,438 @@ bool Data::loadData()
 	return true;
 }
 
+/*
+ * Load binary datafile
+ */
+bool Data::loadBinary()
+{
+	std::vector<hb::LogFile> files;
+	std::vector<hb::LogFile>::iterator it;
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+	unsigned long long int removedCount = 0;
+	bool logFileFound;
+
+	this->suspiciousAddresses.clear();
+	this->abuseIPDBBlacklist.clear();
+	this->expiry.clear();
+	this->eviction.clear();
+	this->keptRules.clear();
+
+	// Offset index of text datafile is not used
+	this->addressIndex.clear();
+	this->fileIndex.clear();
+	this->abuseIPDBIndex.clear();
+	this->syncRecordOffset = -1;
+
+	if (!this->binary->load(this->suspiciousAddresses, this->abuseIPDBBlacklist, files, this->abuseIPDBSyncTime, this->abuseIPDBBlacklistGenTime, removedCount)) {
+		this->log->error("Failed to load binary datafile!");
+		return false;
+	}
+
+	// Update info about log files
+	for (it = files.begin(); it != files.end(); ++it) {
+		logFileFound = false;
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (itlf->path == it->path) {
+					itlf->bookmark = it->bookmark;
+					itlf->size = it->size;
+					itlf->device = it->device;
+					itlf->inode = it->inode;
+					itlf->fingerprint = it->fingerprint;
+					itlf->fingerprintSize = it->fingerprintSize;
+					itlf->dataFileRecord = true;
+					logFileFound = true;
+					this->log->debug("Bookmark: " + std::to_string(it->bookmark) + " Size: " + std::to_string(it->size) + " Path: " + it->path);
+					break;
+				}
+			}
+			if (logFileFound) break;
+		}
+		if (!logFileFound && this->binaryEngine()) {
+			this->log->warning("Bookmark information in datafile for log file " + it->path + " found, but file not present in configuration. Removing from datafile...");
+			this->removeFile(it->path);
+		}
+	}
+
+	if (!this->binaryEngine()) {// One-shot conversion to configured engine
+		this->log->info("Converting binary datafile to " + hb::Config::dataFileEngineName(this->config->dataFileEngine) + " engine...");
+		if (this->saveData() == false) {
+			this->log->error("Failed to convert binary datafile!");
+			return false;
+		}
+	} else {
+		// Check if all configured log files are present in datafile (add if needed)
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (!itlf->dataFileRecord) {
+					this->addFile(itlf->path);
+					itlf->dataFileRecord = true;
+				}
+			}
+		}
+		if (removedCount > 1000) {
+			this->log->info("Datafile contains more than 1000 records marked for removal, performing datafile cleanup...");
+			if (this->saveData() == false) {
+				this->log->error("Data file contains more than 1000 removed records, tried saving data file without records that are marked for removal, but failed!");
+				return false;
+			}
+		}
+	}
+
+	this->log->debug("Loaded " + std::to_string(this->suspiciousAddresses.size()) + " suspicious address record(s)");
+	if (this->abuseIPDBBlacklist.size() > 0) {
+		this->log->debug("Loaded " + std::to_string(this->abuseIPDBBlacklist.size()) + " AbuseIPDB blacklist record(s)");
+	}
+
+	return true;
+}
+
+/*
+ * Load SQLite datafile
+ */
+bool Data::loadSqlite()
+{
+	std::vector<hb::LogFile> files;
+	std::vector<hb::LogFile>::iterator it;
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+	bool logFileFound;
+
+	this->suspiciousAddresses.clear();
+	this->abuseIPDBBlacklist.clear();
+	this->expiry.clear();
+	this->eviction.clear();
+	this->keptRules.clear();
+
+	// Offset index of text datafile is not used
+	this->addressIndex.clear();
+	this->fileIndex.clear();
+	this->abuseIPDBIndex.clear();
+	this->syncRecordOffset = -1;
+
+	if (!this->sqlite->load(this->suspiciousAddresses, this->abuseIPDBBlacklist, files, this->abuseIPDBSyncTime, this->abuseIPDBBlacklistGenTime)) {
+		this->log->error("Failed to load SQLite datafile!");
+		return false;
+	}
+
+	// Update info about log files
+	for (it = files.begin(); it != files.end(); ++it) {
+		logFileFound = false;
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (itlf->path == it->path) {
+					itlf->bookmark = it->bookmark;
+					itlf->size = it->size;
+					itlf->device = it->device;
+					itlf->inode = it->inode;
+					itlf->fingerprint = it->fingerprint;
+					itlf->fingerprintSize = it->fingerprintSize;
+					itlf->dataFileRecord = true;
+					logFileFound = true;
+					this->log->debug("Bookmark: " + std::to_string(it->bookmark) + " Size: " + std::to_string(it->size) + " Path: " + it->path);
+					break;
+				}
+			}
+			if (logFileFound) break;
+		}
+		if (!logFileFound && this->sqliteEngine()) {
+			this->log->warning("Bookmark information in datafile for log file " + it->path + " found, but file not present in configuration. Removing from datafile...");
+			this->removeFile(it->path);
+		}
+	}
+
+	if (!this->sqliteEngine()) {// One-shot conversion to configured engine, database is closed first so that WAL is merged and removed
+		this->sqlite->close();
+		this->log->info("Converting SQLite datafile to " + hb::Config::dataFileEngineName(this->config->dataFileEngine) + " engine...");
+		if (this->saveData() == false) {
+			this->log->error("Failed to convert SQLite datafile!");
+			return false;
+		}
+	} else {
+		// Check if all configured log files are present in datafile (add if needed)
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (!itlf->dataFileRecord) {
+					this->addFile(itlf->path);
+					itlf->dataFileRecord = true;
+				}
+			}
+		}
+	}
+
+	// Daemon forks after load, connection must not be inherited (SQLite locks are per process), it is reopened with first update
+	this->sqlite->close();
+
+	this->log->debug("Loaded " + std::to_string(this->suspiciousAddresses.size()) + " suspicious address record(s)");
+	if (this->abuseIPDBBlacklist.size() > 0) {
+		this->log->debug("Loaded " + std::to_string(this->abuseIPDBBlacklist.size()) + " AbuseIPDB blacklist record(s)");
+	}
+
+	return true;
+}
+
+/*
+ * Load single address, with SQLite datafile only this record is read
+ */
+bool Data::loadAddress(std::string address)
+{
+	if (!this->sqliteEngine() || !hb::SqliteData::isSqlite(this->config->dataFilePath)) {
+		return this->loadData();
+	}
+	this->flush();
+	this->suspiciousAddresses.clear();
+	this->expiry.clear();
+	this->eviction.clear();
+	this->keptRules.clear();
+	this->sqlite->setPath(this->config->dataFilePath);
+	return this->sqlite->loadAddress(address, this->suspiciousAddresses);
+}
+
+/*
+ * Load blocked addresses (same condition as printBlocked), with SQLite datafile only these records are read
+ */
+bool Data::loadBlocked(bool all)
+{
+	if (all || !this->sqliteEngine() || !hb::SqliteData::isSqlite(this->config->dataFilePath)) {
+		return this->loadData();
+	}
+	this->flush();
+	this->suspiciousAddresses.clear();
+	this->expiry.clear();
+	this->eviction.clear();
+	this->keptRules.clear();
+	this->sqlite->setPath(this->config->dataFilePath);
+	std::time_t currentTime;
+	std::time(&currentTime);
+	if (this->config->keepBlockedScoreMultiplier > 0) {
+		return this->sqlite->loadBlocked(this->suspiciousAddresses, true, (unsigned long long int)currentTime + (unsigned long long int)this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier);
+	}
+	return this->sqlite->loadBlocked(this->suspiciousAddresses, false, this->config->activityScoreToBlock);
+}
+
+/*
+ * Load single record from datafile or journal
+ */
+void Data::loadRecord(const std::string& line, long long int offset, bool journaled, hb::Data::LoadState& state)
+{
+
+	std::string address;
+	hb::Address key;
+	bool inserted;
+	std::string logFilePath;
+	hb::SuspiciosAddressType data;
+	hb::AbuseIPDBBlacklistedAddressType abuseIPDBData;
+	unsigned long long int bookmark, size, device, inode, fingerprint;
+	unsigned int fingerprintSize;
+	bool logFileFound = false;
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+
+	// First position is record type
+	char recordType = line[0];
+
+	if (recordType == 'd') {// Data about suspicious address
+
+		// IP address, datafile is rewritten if address is not in the same form as it is formatted now
+		address = hb::Util::ltrim(line.substr(1, 39));
+		if (!hb::Address::parse(address, key)) {
+			this->log->warning("Invalid IP address " + address + " in datafile, record ignored");
+			state.needUpgrade = true;
+			return;
+		}
+		if (key.toString() != address) {
+			address = key.toString();
+			state.needUpgrade = true;
+		}
+
+		// Timestamp of last activity
+		data.lastActivity = std::strtoull(hb::Util::ltrim(line.substr(40, 20)).c_str(), NULL, 10);
+
+		// Total score of activity calculated at last activity
+		data.activityScore = std::strtoul(hb::Util::ltrim(line.substr(60, 10)).c_str(), NULL, 10);
+
+		// Suspicious activity count
+		data.activityCount = std::strtoul(hb::Util::ltrim(line.substr(70, 10)).c_str(), NULL, 10);
+
+		// Refused connection count
+		data.refusedCount = std::strtoul(hb::Util::ltrim(line.substr(80, 10)).c_str(), NULL, 10);
+
+		// Whether IP address is in whitelist
+		if (line[90] == 'y') data.whitelisted = true;
+		else data.whitelisted = false;
+
+		// Whether IP address in in blacklist
+		if (line[91] == 'y') data.blacklisted = true;
+		else data.blacklisted = false;
+
+		// If IP address is in both, whitelist and blacklist, remove it from blacklist
+		if (data.whitelisted == true && data.blacklisted == true) {
+			this->log->warning("Address " + address + " is in whitelist and at the same time in blacklist! Removing address from blacklist...");
+			data.blacklisted = false;
+		}
+
+		// Timestamp of last report to 3rd party
+		if (line.length() >= 112) {
+			data.lastReported = std::strtoull(hb::Util::ltrim(line.substr(92, 20)).c_str(), NULL, 10);
+		}
+
+		// IP version
+		if (line.length() == 113) {
+			if (line[112] == '4') data.version = 4;
+			else if (line[112] == '6') data.version = 6;
+			else data.version = key.version;
+		} else {
+			data.version = key.version;
+			state.needUpgrade = true;
+		}
+
+		// When data is loaded from datafile we do not have yet info whether it has rule in iptables, this will be changed to true later if needed
+		data.iptableRule = false;
+
+		// Store in this->suspiciousAddresses, journal entry replaces earlier record
+		if (journaled) {
+			this->suspiciousAddresses[key] = data;
+		} else {
+			this->suspiciousAddresses.insert(key, data, inserted);
+			if (!inserted) {
+				this->log->warning("Address" + address + " is duplicated in data file, new datafile without duplicates will be created!");
+				state.duplicatesFound = true;
+			} else {
+				this->addressIndex[address] = offset;
+			}
+		}
+
+	} else if (recordType == 'b' || recordType == 'f') {// Log file bookmarks (b - without file identity, upgraded to f)
+
+		// Bookmark
+		bookmark = std::strtoull(hb::Util::ltrim(line.substr(1, 20)).c_str(), NULL, 10);
+
+		// Last known size to detect if log file has been rotated
+		size = std::strtoull(hb::Util::ltrim(line.substr(21, 20)).c_str(), NULL, 10);
+
+		// File identity - device, inode and fingerprint of first bytes
+		device = 0;
+		inode = 0;
+		fingerprint = 0;
+		fingerprintSize = 0;
+		if (recordType == 'f') {
+			device = std::strtoull(hb::Util::ltrim(line.substr(41, 20)).c_str(), NULL, 10);
+			inode = std::strtoull(hb::Util::ltrim(line.substr(61, 20)).c_str(), NULL, 10);
+			fingerprint = std::strtoull(hb::Util::ltrim(line.substr(81, 16)).c_str(), NULL, 16);
+			fingerprintSize = std::strtoul(hb::Util::ltrim(line.substr(97, 5)).c_str(), NULL, 10);
+		} else {
+			state.needUpgrade = true;
+		}
+
+		// Path to log file
+		logFilePath = hb::Util::rtrim(hb::Util::ltrim(line.substr(recordType == 'f' ? 102 : 41)));
+
+		// Update info about log file
+		logFileFound = false;
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (itlf->path == logFilePath) {
+					itlf->bookmark = bookmark;
+					itlf->size = size;
+					itlf->device = device;
+					itlf->inode = inode;
+					itlf->fingerprint = fingerprint;
+					itlf->fingerprintSize = fingerprintSize;
+					itlf->dataFileRecord = true;
+					logFileFound = true;
+					if (recordType == 'f' && !journaled) {
+						this->fileIndex[logFilePath] = offset;
+					}
+					this->log->debug("Bookmark: " + std::to_string(bookmark) + " Size: " + std::to_string(size) + " Path: " + logFilePath);
+					break;
+				}
+			}
+			if (logFileFound) break;
+		}
+
+		// If log file is not found this->config (journal can contain records of files removed later)
+		if (!logFileFound && !journaled) {
+			this->log->warning("Bookmark information in datafile for log file " + logFilePath + " found, but file not present in configuration. Removing from datafile...");
+			state.unknownFiles.push_back(logFilePath);
+		}
+
+	} else if (recordType == 'a') {// AbuseIPDB blacklisted address
+
+		// IP address
+		address = hb::Util::ltrim(line.substr(1, 39));
+		if (!hb::Address::parse(address, key)) {
+			this->log->warning("Invalid IP address " + address + " in datafile, AbuseIPDB record ignored");
+			state.needUpgrade = true;
+			return;
+		}
+		if (key.toString() != address) {
+			address = key.toString();
+			state.needUpgrade = true;
+		}
+
+		// AbuseIPDB report count for this IP address according to specified interval
+		abuseIPDBData.totalReports = std::strtoul(hb::Util::ltrim(line.substr(40, 10)).c_str(), NULL, 10);
+
+		// AbuseIPDB confidence score
+		abuseIPDBData.abuseConfidenceScore = std::strtoul(hb::Util::ltrim(line.substr(50, 3)).c_str(), NULL, 10);
+
+		// IP version
+		if (line.length() == 54) {
+			if (line[53] == '4') abuseIPDBData.version = 4;
+			else if (line[53] == '6') abuseIPDBData.version = 6;
+			else abuseIPDBData.version = key.version;
+		} else {
+			abuseIPDBData.version = key.version;
+			state.needUpgrade = true;
+		}
+
+		// When data is loaded from datafile we do not have yet info whether it has rule in iptables, this will be changed to true later if needed
+		abuseIPDBData.iptableRule = false;
+
+		// Store in this->abuseIPDBBlacklist, journal entry replaces earlier record
+		if (journaled) {
+			this->abuseIPDBBlacklist[key] = abuseIPDBData;
+		} else {
+			this->abuseIPDBBlacklist.insert(key, abuseIPDBData, inserted);
+			if (!inserted) {
+				this->log->warning("AbuseIPDB blacklisted address" + address + " is duplicated in data file, new datafile without duplicates will be created!");
+				state.duplicatesFound = true;
+			} else {
+				this->abuseIPDBIndex[address] = offset;
+			}
+		}
+
+	} else if (recordType == 's') {// AbuseIPDB sync bookmark
+
+		// Unix timestamp of last sync with AbuseIPDB using blacklist endpoint
+		this->abuseIPDBSyncTime = std::strtoull(hb::Util::ltrim(line.substr(1, 20)).c_str(), NULL, 10);
+
+		// Unix timestamp of AbuseIPDB blacklist generation (returned by AbuseIPDB)
+		this->abuseIPDBBlacklistGenTime =  std::strtoull(hb::Util::ltrim(line.substr(21, 20)).c_str(), NULL, 10);
+		if (!journaled) {
+			this->syncRecordOffset = offset;
+		}
+
+	} else if (recordType == 'r' && journaled) {// Journaled removal, record type and key follow
+
+		if (line.length() > 2 && line[1] == 'd') {
+			address = hb::Util::ltrim(line.substr(2, 39));
+			this->suspiciousAddresses.erase(address);
+			this->addressIndex.erase(address);
+		} else if (line.length() > 2 && line[1] == 'a') {
+			address = hb::Util::ltrim(line.substr(2, 39));
+			this->abuseIPDBBlacklist.erase(address);
+			this->abuseIPDBIndex.erase(address);
+		}
+		// Removed log file records are not needed, log files are taken from configuration
+
+	} else if (recordType == 'r') {// Record marked for removal
+		state.removedRecords++;
+	}
+}
+
 /*
  * Save this->suspiciousAddresses to data file, will replace if file already exists
  */
@@ -407,8 +785,52 @@ bool Data::saveData()
 {
 	this->log->info("Updating datafile " + this->config->dataFilePath);
 
+	// Journal is merged into new datafile, background compaction must not replace it
+	this->journal->setPath(this->config->dataFilePath);
+	this->journal->wait();
+
+	// SQLite datafile, all records are replaced in single transaction
+	if (this->sqliteEngine()) {
+		this->dirtyAddresses.clear();
+		this->newAddresses.clear();
+		this->dirtyFiles.clear();
+		this->addressIndex.clear();
+		this->fileIndex.clear();
+		this->abuseIPDBIndex.clear();
+		this->syncRecordOffset = -1;
+		this->sqlite->setPath(this->config->dataFilePath);
+		if (!this->sqlite->save(this->suspiciousAddresses, this->abuseIPDBBlacklist, this->config->logGroups, this->abuseIPDBSyncTime, this->abuseIPDBBlacklistGenTime)) {
+			return false;
+		}
+		this->journal->reset();
+		return true;
+	}
+
+	// Binary datafile
+	if (this->binaryEngine()) {
+		this->dirtyAddresses.clear();
+		this->newAddresses.clear();
+		this->dirtyFiles.clear();
+		this->addressIndex.clear();
+		this->fileIndex.clear();
+		this->abuseIPDBIndex.clear();
+		this->syncRecordOffset = -1;
+		this->binary->setPath(this->config->dataFilePath);
+		if (!this->binary->save(this->suspiciousAddresses, this->abuseIPDBBlacklist, this->config->logGroups, this->abuseIPDBSyncTime, this->abuseIPDBBlacklistGenTime)) {
+			return false;
+		}
+		this->journal->reset();
+		return true;
+	}
+
+	// With journal engine snapshot is written to temporary file and renamed over old one
+	std::string savePath = this->config->dataFilePath;
+	if (this->journalEngine()) {
+		savePath += ".tmp";
+	}
+
 	// Open file (overwrite)
-	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "w");
+	FILE* fp = std::fopen(savePath.c_str(), "w");
 	if (fp == NULL) {
 		this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
 		this->log->error("Unable to open datafile for writing!");
@@ -448,11 +870,26 @@ bool Data::saveData()
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::out);
 	std::ostream f(&filebuf);
 
-	// Loop through all addresses
-	std::map<std::string, SuspiciosAddressType>::iterator it;
+	// All changes are written
+	this->dirtyAddresses.clear();
+	this->newAddresses.clear();
+	this->dirtyFiles.clear();
+
+	// Offset index is rebuilt, records have fixed length (except path of log file)
+	long long int offset = 0;
+	this->addressIndex.clear();
+	this->fileIndex.clear();
+	this->abuseIPDBIndex.clear();
+
+	// Loop through all addresses
+	hb::AddressTable<hb::SuspiciosAddressType>::iterator it;
+	std::string address;
 	for (it = this->suspiciousAddresses.begin(); it != this->suspiciousAddresses.end(); ++it) {
+		address = it->first.toString();
+		this->addressIndex[address] = offset;
+		offset += 114;
 		f << 'd';
-		f << std::right << std::setw(39) << it->first;// Address, left padded with spaces
+		f << std::right << std::setw(39) << address;// Address, left padded with spaces
 		f << std::right << std::setw(20) << it->second.lastActivity;// Last activity, left padded with spaces
 		f << std::right << std::setw(10) << it->second.activityScore;// Current activity score, left padded with spaces
 		f << std::right << std::setw(10) << it->second.activityCount;// Total activity count, left padded with spaces
@@ -471,19 +908,28 @@ bool Data::saveData()
 	std::vector<hb::LogFile>::iterator itlf;
 	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
 		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
-			f << 'b';
+			this->fileIndex[itlf->path] = offset;
+			offset += 103 + itlf->path.length();
+			f << 'f';
 			f << std::right << std::setw(20) << itlf->bookmark;
 			f << std::right << std::setw(20) << itlf->size;
+			f << std::right << std::setw(20) << itlf->device;
+			f << std::right << std::setw(20) << itlf->inode;
+			f << std::right << std::setw(16) << std::hex << itlf->fingerprint << std::dec;
+			f << std::right << std::setw(5) << itlf->fingerprintSize;
 			f << itlf->path;
 			f << std::endl;// endl should flush buffer
 		}
 	}
 
 	// Loop all AbuseIPDB blacklisted addresses
-	std::map<std::string, AbuseIPDBBlacklistedAddressType>::iterator itb;
+	hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::iterator itb;
 	for (itb = this->abuseIPDBBlacklist.begin(); itb != this->abuseIPDBBlacklist.end(); ++itb) {
+		address = itb->first.toString();
+		this->abuseIPDBIndex[address] = offset;
+		offset += 55;
 		f << 'a';
-		f << std::right << std::setw(39) << itb->first;// Address, left padded with spaces
+		f << std::right << std::setw(39) << address;// Address, left padded with spaces
 		f << std::right << std::setw(10) << itb->second.totalReports;
 		if (itb->second.abuseConfidenceScore <= 100) {
 			f << std::right << std::setw(3) << itb->second.abuseConfidenceScore;
@@ -495,11 +941,20 @@ bool Data::saveData()
 	}
 
 	// Bookmark of last sync with AbuseIPDB and blacklist generation timestamp
+	this->syncRecordOffset = offset;
 	f << 's';
 	f << std::right << std::setw(20) << this->abuseIPDBSyncTime;
 	f << std::right << std::setw(20) << this->abuseIPDBBlacklistGenTime;
 	f << std::endl;// endl should flush buffer
 
+	// Snapshot must be on disk before journal is removed
+	bool result = true;
+	if (this->journalEngine() && cunistd::fsync(fd) != 0) {
+		this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
+		this->log->error("Failed to sync datafile to disk!");
+		result = false;
+	}
+
 	// Unlock file
 	fs = cfcntl::lockf(fd, F_ULOCK, 0);
 	if (fs == -1) {
@@ -510,7 +965,18 @@ bool Data::saveData()
 	filebuf.close();
 	std::fclose(fp);
 
-	return true;
+	if (this->journalEngine() && result && std::rename(savePath.c_str(), this->config->dataFilePath.c_str()) != 0) {
+		this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
+		this->log->error("Failed to replace datafile!");
+		result = false;
+	}
+
+	// All journaled changes are in datafile now
+	if (result) {
+		this->journal->reset();
+	}
+
+	return result;
 }
 
 /*
@@ -519,79 +985,189 @@ bool Data::saveData()
 bool Data::checkIptables()
 {
 	this->log->info("Checking iptables rules...");
-	std::vector<std::string> rules;
-	this->iptables->listRules("INPUT", rules, 4);
-	this->iptables->listRules("INPUT", rules, 6);
+	this->waitFirewall();
+	this->expiry.clear();
+	this->eviction.clear();
+	this->keptRules.clear();
+	this->firewallTimeouts.clear();
+
+	// Addresses that currently are blocked
+	hb::Firewall* firewall = this->getFirewall();
+	std::vector<hb::Address> blocked;
+	std::vector<hb::Address>::iterator bit;
+	bool incomplete = false;
 	try {
+		incomplete = firewall->setup(blocked, [this](const hb::Address& address){ return this->inDatafile(address); });
+	} catch (std::runtime_error& e) {
+		std::string message = e.what();
+		this->log->error(message);
+		this->log->error("Failed to set up " + hb::Config::firewallBackendName(this->config->firewallBackend) + " firewall backend!");
+		return false;
+	}
+	std::sort(blocked.begin(), blocked.end());
+	blocked.erase(std::unique(blocked.begin(), blocked.end()), blocked.end());
+
+	// Mark suspicious addresses which have iptables rule
+	hb::SuspiciosAddressType* sa;
+	hb::AbuseIPDBBlacklistedAddressType* ab;
+	for (bit = blocked.begin(); bit != blocked.end(); ++bit) {
+		sa = this->suspiciousAddresses.find(*bit);
+		ab = this->abuseIPDBBlacklist.find(*bit);
+		if (sa != NULL) {
+			sa->iptableRule = true;
+		}
+		if (ab != NULL) {
+			ab->iptableRule = true;
+		}
+		if (sa == NULL && ab == NULL && !firewall->replaces()) {
+			this->log->warning("Found iptables rule for " + bit->toString() + " but don't have any information about this address in datafile, please review manually.");
+		}
+	}
 
-		// Regex to search for IP address
-		std::regex ipSearchPattern(hb::kIpSearchPattern);
-
-		// Loop through current rules and mark suspcious addresses which have iptables rule
-		std::vector<std::string>::iterator rit;
-		std::size_t checkStart = 0, checkEnd = 0;
-		std::map<std::string, hb::SuspiciosAddressType>::iterator sait;
-		std::map<std::string, AbuseIPDBBlacklistedAddressType>::iterator sbit;
-		std::smatch regexSearchResults;
-		std::string regexSearchResult;
-		std::size_t posip = this->config->iptablesRule.find("%i");
-		std::string ruleStart = "";
-		std::string ruleEnd = "";
-		if (posip != std::string::npos) {
-			ruleStart = this->config->iptablesRule.substr(0, posip);
-			ruleEnd = this->config->iptablesRule.substr(posip + 2);
-		}
-
-		for (rit = rules.begin(); rit != rules.end(); ++rit) {
-
-			// Searching for rules similar to ones that are in hostblock configuration to detect if address has iptables rule
-			checkStart = (*rit).find(ruleStart);
-			checkEnd = (*rit).find(ruleEnd);
-			if (checkStart != std::string::npos && checkEnd != std::string::npos) {
-
-				// Find address in rule
-				if (std::regex_search((*rit), regexSearchResults, ipSearchPattern)) {
-					if (regexSearchResults.size() == 1) {
-						regexSearchResult = regexSearchResults[0].str();
-
-						// Search for address in map
-						sait = this->suspiciousAddresses.find(regexSearchResult);
-						sbit = this->abuseIPDBBlacklist.find(regexSearchResult);
-						if (sait != this->suspiciousAddresses.end()) {
-							if (sait->second.iptableRule == false) {
-								sait->second.iptableRule = true;
-							}
-						}
-						if (sbit != this->abuseIPDBBlacklist.end()) {
-							if (sbit->second.iptableRule == false) {
-								sbit->second.iptableRule = true;
-							}
-						}
-						if (sait == this->suspiciousAddresses.end() && sbit == this->abuseIPDBBlacklist.end()) {
-							this->log->warning("Found iptables rule for " + regexSearchResult + " but don't have any information about this address in datafile, please review manually.");
-						}
+	// Rules are changed in single transaction
+	this->beginFirewallBatch();
 
-					}
-				}
+	// Loop through all suspicious address and add iptables rules that are missing
+	hb::AddressTable<hb::SuspiciosAddressType>::iterator sait;
+	for (sait = this->suspiciousAddresses.begin(); sait!=this->suspiciousAddresses.end(); ++sait) {
+		this->updateIptables(sait->first.toString());
+	}
 
-			}
+	// Loop through AbuseIPDB blacklist and add iptables rules that are missing
+	hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::iterator sbit;
+	for (sbit = this->abuseIPDBBlacklist.begin(); sbit!=this->abuseIPDBBlacklist.end(); ++sbit) {
+		this->updateIptables(sbit->first.toString());
+	}
+
+	// Rules over iptables.limit (e.g. limit was lowered) are evicted
+	this->enforceRuleLimit();
+
+	if (firewall->replaces()) {
+		// Collected changes (also ones of outer batch) are already marked in data, blocked addresses are replaced from data instead
+		this->pendingFirewallChanges.clear();
+		this->commitFirewallBatch();
+		std::vector<hb::Address> blocked4, blocked6;
+		for (bit = blocked.begin(); bit != blocked.end(); ++bit) {
+			(bit->version == 6 ? blocked6 : blocked4).push_back(*bit);
 		}
+		bool result = this->replaceBlocked(blocked4, 4, incomplete);
+		return this->replaceBlocked(blocked6, 6, incomplete) && result;
+	}
+
+	this->commitFirewallBatch();
+	return true;
+}
+
+/*
+ * Rebuild hostblock chain from data
+ */
+bool Data::rebuildIptables()
+{
+	hb::Firewall* firewall = this->getFirewall();
+	if (!firewall->replaces()) {
+		return true;
+	}
+	this->log->info("Rebuilding iptables chain " + this->config->iptablesChain + "...");
+
+	// Collected changes are already marked in data, blocked addresses are replaced from data instead
+	this->waitFirewall();
+	this->pendingFirewallChanges.clear();
+	std::vector<hb::Address> blocked;
+	try {
+		firewall->setup(blocked, [this](const hb::Address& address){ return this->inDatafile(address); });
+	} catch (std::runtime_error& e) {
+		std::string message = e.what();
+		this->log->error(message);
+		return false;
+	}
+	std::sort(blocked.begin(), blocked.end());
+	blocked.erase(std::unique(blocked.begin(), blocked.end()), blocked.end());
+	std::vector<hb::Address> blocked4, blocked6;
+	std::vector<hb::Address>::iterator it;
+	for (it = blocked.begin(); it != blocked.end(); ++it) {
+		(it->version == 6 ? blocked6 : blocked4).push_back(*it);
+	}
+	bool result = this->replaceBlocked(blocked4, 4, true);
+	return this->replaceBlocked(blocked6, 6, true) && result;
+}
+
+/*
+ * Whether address is in datafile
+ */
+bool Data::inDatafile(const hb::Address& address)
+{
+	return this->suspiciousAddresses.find(address) != NULL || this->abuseIPDBBlacklist.find(address) != NULL;
+}
+
+/*
+ * Replace blocked addresses of IP version
+ */
+bool Data::replaceBlocked(std::vector<hb::Address>& blocked, int version, bool force)
+{
+	// Addresses that should have rule
+	std::vector<hb::Address> wanted;
+	hb::AddressTable<hb::SuspiciosAddressType>::iterator sait;
+	for (sait = this->suspiciousAddresses.begin(); sait != this->suspiciousAddresses.end(); ++sait) {
+		if (sait->second.iptableRule && sait->first.version == version) {
+			wanted.push_back(sait->first);
+		}
+	}
+	hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::iterator abit;
+	for (abit = this->abuseIPDBBlacklist.begin(); abit != this->abuseIPDBBlacklist.end(); ++abit) {
+		if (abit->second.iptableRule && abit->first.version == version) {
+			wanted.push_back(abit->first);
+		}
+	}
+	std::sort(wanted.begin(), wanted.end());
+	wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+
+	// Both lists are sorted, difference is found in single pass
+	std::vector<hb::Address> added, removed;
+	std::set_difference(wanted.begin(), wanted.end(), blocked.begin(), blocked.end(), std::back_inserter(added));
+	std::set_difference(blocked.begin(), blocked.end(), wanted.begin(), wanted.end(), std::back_inserter(removed));
+	std::string tables = version == 6 ? "ip6tables" : "iptables";
+	if (!force && added.size() == 0 && removed.size() == 0) {
+		this->log->debug(tables + " chain " + this->config->iptablesChain + " is up to date (" + std::to_string(wanted.size()) + " rules)");
+		return true;
+	}
 
-		// Loop through all suspicious address and add iptables rules that are missing
-		for (sait = this->suspiciousAddresses.begin(); sait!=this->suspiciousAddresses.end(); ++sait) {
-			this->updateIptables(sait->first);
+	std::vector<hb::Address>::iterator it;
+	for (it = removed.begin(); it != removed.end(); ++it) {
+		if (this->suspiciousAddresses.find(*it) == NULL && this->abuseIPDBBlacklist.find(*it) == NULL) {
+			this->log->warning("Removing rule for " + it->toString() + " from " + tables + " chain " + this->config->iptablesChain + ", address is not in datafile");
 		}
+	}
 
-		// Loop through AbuseIPDB blacklist and add iptables rules that are missing
-		for (sbit = this->abuseIPDBBlacklist.begin(); sbit!=this->abuseIPDBBlacklist.end(); ++sbit) {
-			this->updateIptables(sbit->first);
+	try {
+		if (this->getFirewall()->replace(wanted, version)) {
+			this->log->info("Rebuilt " + tables + " chain " + this->config->iptablesChain + " with " + std::to_string(wanted.size()) + " rules ("
+				+ std::to_string(added.size()) + " added, " + std::to_string(removed.size()) + " removed)");
+			blocked.swap(wanted);
+			return true;
 		}
-	} catch (std::regex_error& e) {
+	} catch (std::runtime_error& e) {
 		std::string message = e.what();
-		this->log->error(message + ": " + std::to_string(e.code()));
-		this->log->error(hb::Util::regexErrorCode2Text(e.code()));
+		this->log->error(message);
 	}
-	return true;
+	this->log->error("Failed to rebuild " + tables + " chain " + this->config->iptablesChain + "!");
+
+	// Chain is not changed, keep data in line with rules that are in chain
+	hb::SuspiciosAddressType* sa;
+	hb::AbuseIPDBBlacklistedAddressType* ab;
+	removed.insert(removed.end(), added.begin(), added.end());
+	for (it = removed.begin(); it != removed.end(); ++it) {
+		sa = this->suspiciousAddresses.find(*it);
+		ab = this->abuseIPDBBlacklist.find(*it);
+		bool hasRule = std::binary_search(blocked.begin(), blocked.end(), *it);
+		if (sa != NULL) {
+			sa->iptableRule = hasRule;
+		}
+		if (ab != NULL) {
+			ab->iptableRule = hasRule;
+		}
+		this->scheduleExpiry(*it, sa, ab);
+	}
+	return false;
 }
 
 /*
@@ -600,6 +1176,21 @@ bool Data::checkIptables()
 bool Data::addAddress(std::string address)
 {
 	this->log->debug("Adding record to " + this->config->dataFilePath + ", adding address " + address);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->putAddresses(this->suspiciousAddresses, std::vector<std::string>(1, address));
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->putAddresses(this->suspiciousAddresses, std::vector<std::string>(1, address));
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		return this->journalAppend(this->addressRecord(address));
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "a");
@@ -643,18 +1234,20 @@ bool Data::addAddress(std::string address)
 	std::ostream f(&filebuf);
 
 	// Write record to the end of datafile
+	this->addressIndex[address] = Data::endOffset(fd);
 	f << 'd';
 	f << std::right << std::setw(39) << address;// Address, left padded with spaces
-	f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastActivity;// Last activity, left padded with spaces
-	f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityScore;// Current activity score, left padded with spaces
-	f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityCount;// Total activity count, left padded with spaces
-	f << std::right << std::setw(10) << this->suspiciousAddresses[address].refusedCount;// Total refused connection count, left padded with spaces
-	if(this->suspiciousAddresses[address].whitelisted == true) f << 'y';
+	hb::SuspiciosAddressType& record = this->suspiciousAddresses[address];
+	f << std::right << std::setw(20) << record.lastActivity;// Last activity, left padded with spaces
+	f << std::right << std::setw(10) << record.activityScore;// Current activity score, left padded with spaces
+	f << std::right << std::setw(10) << record.activityCount;// Total activity count, left padded with spaces
+	f << std::right << std::setw(10) << record.refusedCount;// Total refused connection count, left padded with spaces
+	if(record.whitelisted == true) f << 'y';
 	else f << 'n';
-	if(this->suspiciousAddresses[address].blacklisted == true) f << 'y';
+	if(record.blacklisted == true) f << 'y';
 	else f << 'n';
-	f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastReported;// Last report, left padded with spaces
-	f << (this->suspiciousAddresses[address].version > 0 ? this->suspiciousAddresses[address].version : ' ');// IP version
+	f << std::right << std::setw(20) << record.lastReported;// Last report, left padded with spaces
+	f << (record.version > 0 ? record.version : ' ');// IP version
 	f << std::endl;
 
 	// Unlock file
@@ -678,8 +1271,24 @@ bool Data::updateAddress(std::string address)
 	bool recordFound = false;
 	char c;
 	char fAddress[40];
+	long long int offset;
 
 	this->log->debug("Updating record in " + this->config->dataFilePath + ", updating address " + address);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->putAddresses(this->suspiciousAddresses, std::vector<std::string>(1, address));
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->putAddresses(this->suspiciousAddresses, std::vector<std::string>(1, address));
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		return this->journalAppend(this->addressRecord(address));
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -702,6 +1311,12 @@ bool Data::updateAddress(std::string address)
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
+	// Go directly to record if it is in offset index, otherwise search whole datafile
+	offset = this->indexedOffset(fd, this->addressIndex, 'd', address);
+	if (offset >= 0) {
+		f.seekg(offset, f.beg);
+	}
+
 	while (f.get(c)) {
 		// std::cerr << "Record type: " << c << " tellg: " << std::to_string(f.tellg()) << std::endl;
 		if (c == 'd') {// Data record, check if address matches
@@ -711,6 +1326,7 @@ bool Data::updateAddress(std::string address)
 
 			// If we have found address that we need to update
 			if (hb::Util::ltrim(std::string(fAddress)) == address) {
+				this->addressIndex[address] = (long long int)f.tellg() - 40;
 
 				// Lock file
 				int fs = cfcntl::lockf(fd, F_LOCK, 73);
@@ -733,16 +1349,17 @@ bool Data::updateAddress(std::string address)
 					return false;
 				}
 
-				f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastActivity;// Last activity, left padded with spaces
-				f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityScore;// Current activity score, left padded with spaces
-				f << std::right << std::setw(10) << this->suspiciousAddresses[address].activityCount;// Total activity count, left padded with spaces
-				f << std::right << std::setw(10) << this->suspiciousAddresses[address].refusedCount;// Total refused connection count, left padded with spaces
-				if(this->suspiciousAddresses[address].whitelisted == true) f << 'y';
+				hb::SuspiciosAddressType& record = this->suspiciousAddresses[address];
+				f << std::right << std::setw(20) << record.lastActivity;// Last activity, left padded with spaces
+				f << std::right << std::setw(10) << record.activityScore;// Current activity score, left padded with spaces
+				f << std::right << std::setw(10) << record.activityCount;// Total activity count, left padded with spaces
+				f << std::right << std::setw(10) << record.refusedCount;// Total refused connection count, left padded with spaces
+				if(record.whitelisted == true) f << 'y';
 				else f << 'n';
-				if(this->suspiciousAddresses[address].blacklisted == true) f << 'y';
+				if(record.blacklisted == true) f << 'y';
 				else f << 'n';
-				f << std::right << std::setw(20) << this->suspiciousAddresses[address].lastReported;// Last report, left padded with spaces
-				f << (this->suspiciousAddresses[address].version > 0 ? this->suspiciousAddresses[address].version : ' ');// IP version
+				f << std::right << std::setw(20) << record.lastReported;// Last report, left padded with spaces
+				f << (record.version > 0 ? record.version : ' ');// IP version
 				f << std::endl;// endl should flush buffer
 				recordFound = true;
 
@@ -787,8 +1404,24 @@ bool Data::removeAddress(std::string address)
 	bool recordFound = false;
 	char c;
 	char fAddress[40];
+	long long int offset;
 
 	this->log->debug("Removing record from " + this->config->dataFilePath + ", removing address " + address);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->removeAddresses(std::vector<std::string>(1, address));
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->removeAddresses(std::vector<std::string>(1, address));
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		return this->journalAppend(Data::removalRecord('d', address));
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -811,6 +1444,12 @@ bool Data::removeAddress(std::string address)
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
+	// Go directly to record if it is in offset index, otherwise search whole datafile
+	offset = this->indexedOffset(fd, this->addressIndex, 'd', address);
+	if (offset >= 0) {
+		f.seekg(offset, f.beg);
+	}
+
 	while (f.get(c)) {
 		// std::cout << "Record type: " << c << " tellg: " << std::to_string(f.tellg()) << std::endl;
 		if (c == 'd') {// Data record, check if address matches
@@ -821,6 +1460,7 @@ bool Data::removeAddress(std::string address)
 			// If we have found address that we need to remove
 			if (hb::Util::ltrim(std::string(fAddress)) == address) {
 				f.seekg(-40, f.cur);
+				this->addressIndex.erase(address);
 
 				// Lock file
 				int fs = cfcntl::lockf(fd, F_LOCK, 1);
@@ -886,6 +1526,27 @@ bool Data::removeAddress(std::string address)
 bool Data::addFile(std::string filePath)
 {
 	this->log->debug("Adding record to " + this->config->dataFilePath + ", adding log file " + filePath);
+	// Journal engine appends record to journal, binary and SQLite engines update record in datafile
+	if (this->journalEngine() || this->binaryEngine() || this->sqliteEngine()) {
+		std::vector<hb::LogGroup>::iterator itlg;
+		std::vector<hb::LogFile>::iterator itlf;
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (itlf->path == filePath) {
+					if (this->sqliteEngine()) {
+						return this->sqlite->putFiles(std::vector<hb::LogFile>(1, *itlf));
+					}
+					if (this->binaryEngine()) {
+						return this->binary->putFile(*itlf);
+					}
+					return this->journalAppend(Data::fileRecord(*itlf) + itlf->path + "\n");
+				}
+			}
+		}
+		this->log->error("Unable to save log file " + filePath + ", file not present in configuration!");
+		return false;
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "a");
@@ -905,7 +1566,7 @@ bool Data::addFile(std::string filePath)
 	}
 
 	// Lock file
-	int fs = cfcntl::lockf(fd, F_LOCK, filePath.length() + 41);
+	int fs = cfcntl::lockf(fd, F_LOCK, filePath.length() + 102);
 	unsigned int retryCounter = 1;
 	while (fs == -1) {
 		if (retryCounter >= 3) {
@@ -914,7 +1575,7 @@ bool Data::addFile(std::string filePath)
 		// Sleep
 		cunistd::usleep(500000);
 		// Retry
-		fs = cfcntl::lockf(fd, F_LOCK, filePath.length() + 41);
+		fs = cfcntl::lockf(fd, F_LOCK, filePath.length() + 102);
 		++retryCounter;
 	}
 	if (fs == -1) {
@@ -936,9 +1597,14 @@ bool Data::addFile(std::string filePath)
 		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
 			if (itlf->path == filePath) {
 				// Write record to the end of datafile
-				f << 'b';
+				this->fileIndex[filePath] = Data::endOffset(fd);
+				f << 'f';
 				f << std::right << std::setw(20) << itlf->bookmark;
 				f << std::right << std::setw(20) << itlf->size;
+				f << std::right << std::setw(20) << itlf->device;
+				f << std::right << std::setw(20) << itlf->inode;
+				f << std::right << std::setw(16) << std::hex << itlf->fingerprint << std::dec;
+				f << std::right << std::setw(5) << itlf->fingerprintSize;
 				f << itlf->path;
 				f << std::endl;// endl should flush buffer
 				logFileFound = true;
@@ -978,11 +1644,33 @@ bool Data::updateFile(std::string filePath)
 {
 	bool recordFound = false;
 	bool logFileFound = false;
-	char c;
+	char c, recordType;
 	std::string fPath;
 	int tmppos;// To temporarly store current position in file
+	long long int offset;
 
 	this->log->debug("Updating record in " + this->config->dataFilePath + ", updating log file " + filePath);
+	// Journal engine appends record to journal, binary and SQLite engines update record in datafile
+	if (this->journalEngine() || this->binaryEngine() || this->sqliteEngine()) {
+		std::vector<hb::LogGroup>::iterator itlg;
+		std::vector<hb::LogFile>::iterator itlf;
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (itlf->path == filePath) {
+					if (this->sqliteEngine()) {
+						return this->sqlite->putFiles(std::vector<hb::LogFile>(1, *itlf));
+					}
+					if (this->binaryEngine()) {
+						return this->binary->putFile(*itlf);
+					}
+					return this->journalAppend(Data::fileRecord(*itlf) + itlf->path + "\n");
+				}
+			}
+		}
+		this->log->error("Unable to save log file " + filePath + ", file not present in configuration!");
+		return false;
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -1005,16 +1693,23 @@ bool Data::updateFile(std::string filePath)
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
+	// Go directly to record if it is in offset index, otherwise search whole datafile
+	offset = this->indexedOffset(fd, this->fileIndex, 'f', filePath);
+	if (offset >= 0) {
+		f.seekg(offset, f.beg);
+	}
+
 	while (f.get(c)) {
 		// std::cerr << "Record type: " << c << " tellg: " << std::to_string(f.tellg()) << std::endl;
 		if (c == 'd') {// Address record, skip to next one
 			f.seekg(113, f.cur);
-		} else if (c == 'b') {// Log file record, check if path matches needed one
+		} else if (c == 'b' || c == 'f') {// Log file record, check if path matches needed one
 			// Save current position, will need later if file path will match needed one
 			tmppos = f.tellg();
+			recordType = c;
 
-			// Skip bookmark and size
-			f.seekg(40, f.cur);
+			// Skip bookmark and size (and file identity)
+			f.seekg(recordType == 'f' ? 101 : 40, f.cur);
 
 			// Read until end of line
 			std::getline(f, fPath);
@@ -1022,6 +1717,9 @@ bool Data::updateFile(std::string filePath)
 			if (fPath == filePath) {
 				// Go back to bookmark position
 				f.seekg(tmppos, f.beg);
+				if (recordType == 'f') {
+					this->fileIndex[filePath] = tmppos - 1;
+				}
 
 				// Search for log file in config
 				std::vector<hb::LogGroup>::iterator itlg;
@@ -1030,7 +1728,7 @@ bool Data::updateFile(std::string filePath)
 					for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
 						if (itlf->path == filePath) {
 							// Lock file
-							int fs = cfcntl::lockf(fd, F_LOCK, 40);
+							int fs = cfcntl::lockf(fd, F_LOCK, recordType == 'f' ? 101 : 40);
 							unsigned int retryCounter = 1;
 							while (fs == -1) {
 								if (retryCounter >= 3) {
@@ -1039,7 +1737,7 @@ bool Data::updateFile(std::string filePath)
 								// Sleep
 								cunistd::usleep(500000);
 								// Retry
-								fs = cfcntl::lockf(fd, F_LOCK, 40);
+								fs = cfcntl::lockf(fd, F_LOCK, recordType == 'f' ? 101 : 40);
 								++retryCounter;
 							}
 							if (fs == -1) {
@@ -1050,9 +1748,15 @@ bool Data::updateFile(std::string filePath)
 								return false;
 							}
 
-							// Update bookmark and size in datafile
+							// Update bookmark and size in datafile (old record without file identity keeps only these until datafile is upgraded)
 							f << std::right << std::setw(20) << itlf->bookmark;
 							f << std::right << std::setw(20) << itlf->size;
+							if (recordType == 'f') {
+								f << std::right << std::setw(20) << itlf->device;
+								f << std::right << std::setw(20) << itlf->inode;
+								f << std::right << std::setw(16) << std::hex << itlf->fingerprint << std::dec;
+								f << std::right << std::setw(5) << itlf->fingerprintSize;
+							}
 							logFileFound = true;
 
 							// Unlock file
@@ -1105,8 +1809,24 @@ bool Data::removeFile(std::string filePath)
 	char c;
 	std::string fPath;
 	int tmppos;// To temporarly store current position in file
+	long long int offset;
 
 	this->log->debug("Removing record from " + this->config->dataFilePath + ", removing log file " + filePath);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->removeFile(filePath);
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->removeFile(filePath);
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		return this->journalAppend(Data::removalRecord('f', filePath));
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -1129,16 +1849,22 @@ bool Data::removeFile(std::string filePath)
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
+	// Go directly to record if it is in offset index, otherwise search whole datafile
+	offset = this->indexedOffset(fd, this->fileIndex, 'f', filePath);
+	if (offset >= 0) {
+		f.seekg(offset, f.beg);
+	}
+
 	while (f.get(c)) {
 		// std::cout << "Record type: " << c << " tellg: " << std::to_string(f.tellg()) << std::endl;
 		if (c == 'd') {// Address record, skip to next one
 			f.seekg(113, f.cur);
-		} else if (c == 'b') {// Log file record, check if path matches needed one
+		} else if (c == 'b' || c == 'f') {// Log file record, check if path matches needed one
 			// Save current position, will need later if file path will match needed one
 			tmppos = f.tellg();
 
-			// Skip bookmark and size
-			f.seekg(40, f.cur);
+			// Skip bookmark and size (and file identity)
+			f.seekg(c == 'f' ? 101 : 40, f.cur);
 
 			// Read until end of line
 			std::getline(f, fPath);
@@ -1146,6 +1872,7 @@ bool Data::removeFile(std::string filePath)
 			if (fPath == filePath) {
 				// Go back to record type position
 				f.seekg(tmppos-1, f.beg);
+				this->fileIndex.erase(filePath);
 
 				// Lock file
 				int fs = cfcntl::lockf(fd, F_LOCK, 1);
@@ -1214,6 +1941,21 @@ bool Data::addAbuseIPDBAddress(std::string address)
 		this->log->error("Unable to add record to datafile, data about address " + address + " not available!");
 		return false;
 	}
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, std::vector<std::string>(1, address));
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, std::vector<std::string>(1, address));
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		return this->journalAppend(this->abuseIPDBRecord(address));
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "a");
@@ -1257,14 +1999,16 @@ bool Data::addAbuseIPDBAddress(std::string address)
 	std::ostream f(&filebuf);
 
 	// Write record to the end of datafile
+	this->abuseIPDBIndex[address] = Data::endOffset(fd);
 	f << 'a';
 	f << std::right << std::setw(39) << address;
-	f << std::right << std::setw(10) << this->abuseIPDBBlacklist[address].totalReports;
-	if (this->abuseIPDBBlacklist[address].abuseConfidenceScore > 999) {
-		this->abuseIPDBBlacklist[address].abuseConfidenceScore = 999;
+	hb::AbuseIPDBBlacklistedAddressType& record = this->abuseIPDBBlacklist[address];
+	f << std::right << std::setw(10) << record.totalReports;
+	if (record.abuseConfidenceScore > 999) {
+		record.abuseConfidenceScore = 999;
 	}
-	f << std::right << std::setw(3) << this->abuseIPDBBlacklist[address].abuseConfidenceScore;
-	f << (this->abuseIPDBBlacklist[address].version > 0 ? this->abuseIPDBBlacklist[address].version : ' ');// IP version
+	f << std::right << std::setw(3) << record.abuseConfidenceScore;
+	f << (record.version > 0 ? record.version : ' ');// IP version
 	f << std::endl;
 
 	// Unlock file
@@ -1286,6 +2030,28 @@ bool Data::addAbuseIPDBAddress(std::string address)
 bool Data::addAbuseIPDBAddresses(std::vector<std::string>* addressList)
 {
 	this->log->debug("Adding " + std::to_string(addressList->size()) + " AbuseIPDB blacklist record(s) to " + this->config->dataFilePath);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, *addressList);
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, *addressList);
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		std::string records;
+		std::vector<std::string>::iterator it;
+		for (it = addressList->begin(); it != addressList->end(); ++it) {
+			if (this->abuseIPDBBlacklist.count(*it) > 0) {
+				records += this->abuseIPDBRecord(*it);
+			}
+		}
+		return this->journalAppend(records);
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "a");
@@ -1327,6 +2093,7 @@ bool Data::addAbuseIPDBAddresses(std::vector<std::string>* addressList)
 	// Associate stream buffer with an open POSIX file descriptor
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::out | std::ios::app);
 	std::ostream f(&filebuf);
+	long long int offset = Data::endOffset(fd);
 
 	for (auto it = addressList->begin(); it != addressList->end(); ++it) {
 		if (this->abuseIPDBBlacklist.count(*it) == 0) {
@@ -1335,14 +2102,19 @@ bool Data::addAbuseIPDBAddresses(std::vector<std::string>* addressList)
 		}
 
 		// Write record to the end of datafile
+		if (offset >= 0) {
+			this->abuseIPDBIndex[*it] = offset;
+			offset += 55;
+		}
 		f << 'a';
 		f << std::right << std::setw(39) << *it;
-		f << std::right << std::setw(10) << this->abuseIPDBBlacklist[*it].totalReports;
-		if (this->abuseIPDBBlacklist[*it].abuseConfidenceScore > 999) {
-			this->abuseIPDBBlacklist[*it].abuseConfidenceScore = 999;
+		hb::AbuseIPDBBlacklistedAddressType& record = this->abuseIPDBBlacklist[*it];
+		f << std::right << std::setw(10) << record.totalReports;
+		if (record.abuseConfidenceScore > 999) {
+			record.abuseConfidenceScore = 999;
 		}
-		f << std::right << std::setw(3) << this->abuseIPDBBlacklist[*it].abuseConfidenceScore;
-		f << (this->abuseIPDBBlacklist[*it].version > 0 ? this->abuseIPDBBlacklist[*it].version : ' ');// IP version
+		f << std::right << std::setw(3) << record.abuseConfidenceScore;
+		f << (record.version > 0 ? record.version : ' ');// IP version
 		f << std::endl;
 	}
 
@@ -1367,6 +2139,7 @@ bool Data::updateAbuseIPDBAddress(std::string address)
 	bool recordFound = false;
 	char c;
 	char fAddress[40];
+	long long int offset;
 
 	this->log->debug("Updating record in " + this->config->dataFilePath + ", updating AbuseIPDB blacklist address " + address);
 
@@ -1374,6 +2147,21 @@ bool Data::updateAbuseIPDBAddress(std::string address)
 		this->log->error("Cannot update record in datafile, data about address " + address + " not available!");
 		return false;
 	}
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, std::vector<std::string>(1, address));
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, std::vector<std::string>(1, address));
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		return this->journalAppend(this->abuseIPDBRecord(address));
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -1396,6 +2184,12 @@ bool Data::updateAbuseIPDBAddress(std::string address)
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
+	// Go directly to record if it is in offset index, otherwise search whole datafile
+	offset = this->indexedOffset(fd, this->abuseIPDBIndex, 'a', address);
+	if (offset >= 0) {
+		f.seekg(offset, f.beg);
+	}
+
 	while (f.get(c)) {
 		// std::cerr << "Record type: " << c << " tellg: " << std::to_string(f.tellg()) << std::endl;
 		if (c == 'a') {// AbuseIPDB blacklist record, check if address matches
@@ -1405,6 +2199,7 @@ bool Data::updateAbuseIPDBAddress(std::string address)
 
 			// If we have found address that we need to update
 			if (hb::Util::ltrim(std::string(fAddress)) == address) {
+				this->abuseIPDBIndex[address] = (long long int)f.tellg() - 40;
 
 				// Lock file
 				int fs = cfcntl::lockf(fd, F_LOCK, 13);
@@ -1427,12 +2222,13 @@ bool Data::updateAbuseIPDBAddress(std::string address)
 					return false;
 				}
 
-				f << std::right << std::setw(10) << this->abuseIPDBBlacklist[address].totalReports;
-				if (this->abuseIPDBBlacklist[address].abuseConfidenceScore > 999) {
-					this->abuseIPDBBlacklist[address].abuseConfidenceScore = 999;
+				hb::AbuseIPDBBlacklistedAddressType& record = this->abuseIPDBBlacklist[address];
+				f << std::right << std::setw(10) << record.totalReports;
+				if (record.abuseConfidenceScore > 999) {
+					record.abuseConfidenceScore = 999;
 				}
-				f << std::right << std::setw(3) << this->abuseIPDBBlacklist[address].abuseConfidenceScore;
-				f << (this->abuseIPDBBlacklist[address].version > 0 ? this->abuseIPDBBlacklist[address].version : ' ');// IP version
+				f << std::right << std::setw(3) << record.abuseConfidenceScore;
+				f << (record.version > 0 ? record.version : ' ');// IP version
 				f << std::endl;// endl should flush buffer
 				recordFound = true;
 
@@ -1478,6 +2274,28 @@ bool Data::updateAbuseIPDBAddresses(std::vector<std::string>* addressList)
 	char fAddress[40];
 
 	this->log->debug("Updating " + std::to_string(addressList->size()) + " AbuseIPDB blacklist record(s) in " + this->config->dataFilePath);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, *addressList);
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->putAbuseIPDBAddresses(this->abuseIPDBBlacklist, *addressList);
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		std::string records;
+		std::vector<std::string>::iterator it;
+		for (it = addressList->begin(); it != addressList->end(); ++it) {
+			if (this->abuseIPDBBlacklist.count(*it) > 0) {
+				records += this->abuseIPDBRecord(*it);
+			}
+		}
+		return this->journalAppend(records);
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -1536,12 +2354,13 @@ bool Data::updateAbuseIPDBAddresses(std::vector<std::string>* addressList)
 						return false;
 					}
 
-					f << std::right << std::setw(10) << this->abuseIPDBBlacklist[*it].totalReports;
-					if (this->abuseIPDBBlacklist[*it].abuseConfidenceScore > 999) {
-						this->abuseIPDBBlacklist[*it].abuseConfidenceScore = 999;
+					hb::AbuseIPDBBlacklistedAddressType& record = this->abuseIPDBBlacklist[*it];
+					f << std::right << std::setw(10) << record.totalReports;
+					if (record.abuseConfidenceScore > 999) {
+						record.abuseConfidenceScore = 999;
 					}
-					f << std::right << std::setw(3) << this->abuseIPDBBlacklist[*it].abuseConfidenceScore;
-					f << (this->abuseIPDBBlacklist[*it].version > 0 ? this->abuseIPDBBlacklist[*it].version : ' ');// IP version
+					f << std::right << std::setw(3) << record.abuseConfidenceScore;
+					f << (record.version > 0 ? record.version : ' ');// IP version
 					f << std::endl;// endl should flush buffer
 					recordFound = true;
 
@@ -1583,8 +2402,24 @@ bool Data::removeAbuseIPDBAddress(std::string address)
 	bool recordFound = false;
 	char c;
 	char fAddress[40];
+	long long int offset;
 
 	this->log->debug("Removing AbuseIPDB blacklist record from " + this->config->dataFilePath + ", removing address " + address);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->removeAbuseIPDBAddresses(std::vector<std::string>(1, address));
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->removeAbuseIPDBAddresses(std::vector<std::string>(1, address));
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		return this->journalAppend(Data::removalRecord('a', address));
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -1607,6 +2442,12 @@ bool Data::removeAbuseIPDBAddress(std::string address)
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
+	// Go directly to record if it is in offset index, otherwise search whole datafile
+	offset = this->indexedOffset(fd, this->abuseIPDBIndex, 'a', address);
+	if (offset >= 0) {
+		f.seekg(offset, f.beg);
+	}
+
 	while (f.get(c)) {
 		if (c == 'a') {// AbuseIPDB blacklist record, check if address matches
 
@@ -1616,6 +2457,7 @@ bool Data::removeAbuseIPDBAddress(std::string address)
 			// If we have found address that we need to remove
 			if (hb::Util::ltrim(std::string(fAddress)) == address) {
 				f.seekg(-40, f.cur);
+				this->abuseIPDBIndex.erase(address);
 
 				// Lock file
 				int fs = cfcntl::lockf(fd, F_LOCK, 1);
@@ -1684,6 +2526,26 @@ bool Data::removeAbuseIPDBAddresses(std::vector<std::string>* addressList)
 	char fAddress[40];
 
 	this->log->debug("Removing " + std::to_string(addressList->size()) + " AbuseIPDB blacklist record(s) from " + this->config->dataFilePath);
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->removeAbuseIPDBAddresses(*addressList);
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->removeAbuseIPDBAddresses(*addressList);
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		std::string records;
+		std::vector<std::string>::iterator it;
+		for (it = addressList->begin(); it != addressList->end(); ++it) {
+			records += Data::removalRecord('a', *it);
+		}
+		return this->journalAppend(records);
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -1717,6 +2579,7 @@ bool Data::removeAbuseIPDBAddresses(std::vector<std::string>* addressList)
 			for (auto it = addressList->begin(); it != addressList->end(); ++it) {
 				if (hb::Util::ltrim(std::string(fAddress)) == *it) {
 					f.seekg(-40, f.cur);
+					this->abuseIPDBIndex.erase(*it);
 
 					// Lock file
 					int fs = cfcntl::lockf(fd, F_LOCK, 1);
@@ -1790,6 +2653,26 @@ bool Data::updateAbuseIPDBSyncData(unsigned long long int syncTime, unsigned lon
 	unsigned int retryCounter;
 
 	this->log->debug("Updating AbuseIPDB sync data");
+	// SQLite engine updates record in database
+	if (this->sqliteEngine()) {
+		return this->sqlite->putSyncData(syncTime, blacklistGenTime);
+	}
+
+	// Binary engine updates record in binary datafile
+	if (this->binaryEngine()) {
+		return this->binary->putSyncData(syncTime, blacklistGenTime);
+	}
+
+	// Journal engine appends record to journal
+	if (this->journalEngine()) {
+		std::ostringstream record;
+		record << 's';
+		record << std::right << std::setw(20) << syncTime;
+		record << std::right << std::setw(20) << blacklistGenTime;
+		record << "\n";
+		return this->journalAppend(record.str());
+	}
+
 
 	// Open file
 	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
@@ -1812,8 +2695,14 @@ bool Data::updateAbuseIPDBSyncData(unsigned long long int syncTime, unsigned lon
 	__gnu_cxx::stdio_filebuf<char> filebuf(fd, std::ios::in | std::ios::out);
 	std::iostream f(&filebuf);
 
+	// Go directly to record if its offset is known
+	if (this->syncRecordOffset >= 0 && cunistd::pread(fd, &c, 1, this->syncRecordOffset) == 1 && c == 's') {
+		f.seekg(this->syncRecordOffset, f.beg);
+	}
+
 	while (f.get(c)) {
 		if (c == 's') {
+			this->syncRecordOffset = (long long int)f.tellg() - 1;
 
 			// Lock file
 			fs = cfcntl::lockf(fd, F_LOCK, 40);
@@ -1911,6 +2800,7 @@ bool Data::updateAbuseIPDBSyncData(unsigned long long int syncTime, unsigned lon
 		}
 
 		// Bookmark of last sync with AbuseIPDB and blacklist generation timestamp
+		this->syncRecordOffset = Data::endOffset(fd);
 		f << 's';
 		f << std::right << std::setw(20) << syncTime;
 		f << std::right << std::setw(20) << blacklistGenTime;
@@ -1937,54 +2827,65 @@ bool Data::updateIptables(std::string address)
 {
 	bool createRule = false;
 	bool removeRule = false;
+	bool expiredRule = false;
 	int version = 4;
 
 	std::time_t currentRawTime;
 	std::time(&currentRawTime);
 	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
 
+	// Address is looked up once in both tables
+	hb::Address key;
+	hb::SuspiciosAddressType* sa = NULL;
+	hb::AbuseIPDBBlacklistedAddressType* ab = NULL;
+	if (hb::Address::parse(address, key)) {
+		sa = this->suspiciousAddresses.find(key);
+		ab = this->abuseIPDBBlacklist.find(key);
+	}
+
 	// Remove rule if address not present in local data file and is not listed in AbuseIPDB blacklist
-	if (this->suspiciousAddresses.count(address) == 0 && this->abuseIPDBBlacklist.count(address) == 0) {
+	if (sa == NULL && ab == NULL) {
 		removeRule = true;
 	}
 
 	// Sync AbuseIPDB blacklist iptables rule status with suspicious address list to avoid getting duplicate iptables rules
-	if (this->abuseIPDBBlacklist.count(address) > 0 && !this->abuseIPDBBlacklist[address].iptableRule && this->suspiciousAddresses.count(address) > 0 && this->suspiciousAddresses[address].iptableRule) {
-		this->abuseIPDBBlacklist[address].iptableRule = true;
+	if (ab != NULL && !ab->iptableRule && sa != NULL && sa->iptableRule) {
+		ab->iptableRule = true;
 	}
-	if (this->suspiciousAddresses.count(address) > 0 && !this->suspiciousAddresses[address].iptableRule && this->abuseIPDBBlacklist.count(address) > 0 && this->abuseIPDBBlacklist[address].iptableRule) {
-		this->suspiciousAddresses[address].iptableRule = true;
+	if (sa != NULL && !sa->iptableRule && ab != NULL && ab->iptableRule) {
+		sa->iptableRule = true;
 	}
 
 	// Check whether need to create rule based on AbuseIPDB blacklist
-	if (this->abuseIPDBBlacklist.count(address) > 0) {
-		if (this->abuseIPDBBlacklist[address].iptableRule == false) {
-			if (this->abuseIPDBBlacklist[address].abuseConfidenceScore >= this->config->abuseipdbBlockScore) {
+	if (ab != NULL) {
+		if (ab->iptableRule == false) {
+			if (ab->abuseConfidenceScore >= this->config->abuseipdbBlockScore) {
 				createRule = true;
 			}
 		}
 	}
 
 	// Check whether need to add/remove rule for address based on hostblock data
-	if (this->suspiciousAddresses.count(address) > 0) {
+	if (sa != NULL) {
 		// Check new score and see if need to add to/remove from iptables
-		if (this->suspiciousAddresses[address].iptableRule) {// Rule exists, check if need to remove
+		if (sa->iptableRule) {// Rule exists, check if need to remove
 
 			// Whitelisted addresses must not have rule
-			if (this->suspiciousAddresses[address].whitelisted == true) {
+			if (sa->whitelisted == true) {
 				removeRule = true;
 			}
 
 			// Keep rule for locally blacklisted addresses or if address is in AbuseIPDB blacklist
-			if (this->suspiciousAddresses[address].blacklisted == false && this->abuseIPDBBlacklist.count(address) == 0) {
+			if (sa->blacklisted == false && ab == NULL) {
 				if (this->config->keepBlockedScoreMultiplier > 0) {
 					// Score multiplier configured, recheck if score is no longer high enough to keep this rule
-					if (currentTime > this->suspiciousAddresses[address].lastActivity + this->suspiciousAddresses[address].activityScore) {
+					if (currentTime > sa->lastActivity + sa->activityScore) {
 						removeRule = true;
+						expiredRule = sa->whitelisted == false;
 					}
 				} else {
 					// Without score multiplier rules are kept unless score is 0
-					if (this->suspiciousAddresses[address].activityScore == 0) {
+					if (sa->activityScore == 0) {
 						removeRule = true;
 					}
 				}
@@ -1992,155 +2893,480 @@ bool Data::updateIptables(std::string address)
 		} else {// Rule does not exist, check if need to add
 
 			// Blacklisted addresses must have rule
-			if (this->suspiciousAddresses[address].blacklisted == true && this->suspiciousAddresses[address].whitelisted == false) {
+			if (sa->blacklisted == true && sa->whitelisted == false) {
 				createRule = true;
 			}
 
 			// Whitelisted addresses must not have rule
-			if (this->suspiciousAddresses[address].whitelisted == false && createRule == false) {
+			if (sa->whitelisted == false && createRule == false) {
 				if (this->config->keepBlockedScoreMultiplier > 0) {
 					// Score multiplier configured, check if score is high enough to create rule
-					if (this->suspiciousAddresses[address].activityScore > 0
-							&& this->suspiciousAddresses[address].lastActivity + this->suspiciousAddresses[address].activityScore > this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier
-							&& currentTime < (this->suspiciousAddresses[address].lastActivity + this->suspiciousAddresses[address].activityScore) - (this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier)) {
+					if (sa->activityScore > 0
+							&& sa->lastActivity + sa->activityScore > this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier
+							&& currentTime < (sa->lastActivity + sa->activityScore) - (this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier)) {
 						createRule = true;
 					}
 				} else {
 					// Without score multiplier rules are created unless score is 0
-					if (this->suspiciousAddresses[address].activityScore > this->config->activityScoreToBlock) {
+					if (sa->activityScore > this->config->activityScoreToBlock) {
 						createRule = true;
 					}
 				}
-			} else if (this->suspiciousAddresses[address].whitelisted == true && createRule == true) {
+			} else if (sa->whitelisted == true && createRule == true) {
 				createRule = false;
 			}
 		}
 	}
 
-	// Adjust iptables rules
-	std::string ruleStart = "";
-	std::string ruleEnd = "";
-	if (createRule == true || removeRule == true) {
-		std::size_t posip = this->config->iptablesRule.find("%i");
-		if (posip != std::string::npos) {
-			ruleStart = this->config->iptablesRule.substr(0, posip);
-			ruleEnd = this->config->iptablesRule.substr(posip + 2);
+	// Rule count is limited by iptables.limit, rule with lower priority is evicted to make room
+	if (createRule == true && !this->reserveRule(sa, ab)) {
+		this->log->debug("Limit of " + std::to_string(this->config->firewallLimit) + " blocked addresses reached, address " + address + " is not blocked");
+		createRule = false;
+	}
+
+	// With nftables address is added to set with timeout, so timeout is updated while rule is kept and address removed
+	// from set by kernel does not need to be removed
+	bool useNftables = this->getFirewall()->timeouts();
+	bool refreshRule = useNftables && createRule == false && removeRule == false && ((sa != NULL && sa->iptableRule) || (ab != NULL && ab->iptableRule));
+	if (useNftables && expiredRule) {
+		this->log->info("Address " + address + " block time passed, removed from nftables set by kernel");
+		removeRule = false;
+		if (sa != NULL) {
+			sa->iptableRule = false;
+		}
+	}
+	unsigned long long int timeout = 0;
+	if (useNftables && (createRule == true || refreshRule == true)) {
+		timeout = this->blockTimeout(sa, ab, currentTime);
+	}
+
+	// Timeout of kept element is not refreshed with every match, only when less than half of block time is left in set,
+	// when it must be shortened or when element with timeout becomes permanent (or the other way round)
+	unsigned long long int deadline = timeout > 0 ? currentTime + timeout : 0;
+	if (refreshRule == true) {
+		const unsigned long long int* sent = this->firewallTimeouts.find(key);
+		refreshRule = sent == NULL || (*sent == 0) != (deadline == 0) || deadline < *sent
+			|| (deadline > 0 && (*sent <= currentTime || *sent - currentTime < (deadline - currentTime) / 2));
+	}
+	if (useNftables && key.version != 0) {
+		if (createRule == true || refreshRule == true) {
+			this->firewallTimeouts[key] = deadline;
+		} else if (removeRule == true || expiredRule == true) {
+			this->firewallTimeouts.erase(key);
 		}
+	}
+
+	// Adjust iptables rules (or ipset), in batch changes are collected and applied with commitFirewallBatch
+	if (createRule == true || removeRule == true || refreshRule == true) {
 		// Check IP version
-		if (this->suspiciousAddresses.count(address) > 0) {
-			version = this->suspiciousAddresses[address].version;
-		} else if (this->abuseIPDBBlacklist.count(address) > 0) {
-			version = this->abuseIPDBBlacklist[address].version;
+		if (sa != NULL) {
+			version = sa->version;
+		} else if (ab != NULL) {
+			version = ab->version;
 		} else {
 			version = hb::Util::ipVersion(address);
 		}
 	}
 	if (createRule == true) {
 		this->log->info("Adding rule for " + address + " to iptables chain!");
-		try {
-			bool res = false;
-			if (this->config->iptablesAppend) {
-				res = this->iptables->append("INPUT", ruleStart + address + ruleEnd, version);
-			} else {
-				res = this->iptables->insert("INPUT", ruleStart + address + ruleEnd, version);
-			}
-			if (res == false) {
-				this->log->error("Address " + address + " should have iptables rule, but hostblock failed to add rule to chain!");
-				return false;
-			} else {
-				if (this->suspiciousAddresses.count(address) > 0) {
-					this->suspiciousAddresses[address].iptableRule = true;
-				}
-				if (this->abuseIPDBBlacklist.count(address) > 0) {
-					this->abuseIPDBBlacklist[address].iptableRule = true;
-				}
-			}
-		} catch (std::runtime_error& e) {
-			std::string message = e.what();
-			this->log->error(message);
-			this->log->error("Address " + address + " should have iptables rule, but hostblock failed to add rule to chain!");
+		if (this->firewallBatchDepth > 0) {
+			this->pendingFirewallChanges.push_back(hb::FirewallChange{address, version, true, timeout, ++this->firewallSequence, false});
+		} else if (!this->applyFirewallChange(hb::FirewallChange{address, version, true, timeout, ++this->firewallSequence, false})) {
 			return false;
 		}
+		if (sa != NULL) {
+			sa->iptableRule = true;
+		}
+		if (ab != NULL) {
+			ab->iptableRule = true;
+		}
 	}
 	if (removeRule == true) {
 		this->log->info("Removing rule for " + address + " from iptables chain!");
-		try {
-			if (this->iptables->remove("INPUT", ruleStart + address + ruleEnd, version) == false) {
-				this->log->error("Address " + address + " no longer needs iptables rule, but failed to remove rule from chain!");
-				return false;
-			} else {
-				if (this->suspiciousAddresses.count(address) > 0) {
-					this->suspiciousAddresses[address].iptableRule = false;
-				}
-				if (this->abuseIPDBBlacklist.count(address) > 0) {
-					this->abuseIPDBBlacklist[address].iptableRule = false;
-				}
-			}
-		} catch (std::runtime_error& e) {
-			std::string message = e.what();
-			this->log->error(message);
-			this->log->error("Address " + address + " no longer needs iptables rule, but failed to remove rule from chain!");
+		if (this->firewallBatchDepth > 0) {
+			this->pendingFirewallChanges.push_back(hb::FirewallChange{address, version, false, 0, ++this->firewallSequence, false});
+		} else if (!this->applyFirewallChange(hb::FirewallChange{address, version, false, 0, ++this->firewallSequence, false})) {
+			this->scheduleExpiry(key, sa, ab);
+			return false;
+		}
+		if (sa != NULL) {
+			sa->iptableRule = false;
+		}
+		if (ab != NULL) {
+			ab->iptableRule = false;
+		}
+	}
+	if (refreshRule == true) {
+		this->log->debug("Updating nftables set element timeout for " + address + " to " + std::to_string(timeout) + " seconds");
+		if (this->firewallBatchDepth > 0) {
+			this->pendingFirewallChanges.push_back(hb::FirewallChange{address, version, true, timeout, ++this->firewallSequence, false});
+		} else if (!this->applyFirewallChange(hb::FirewallChange{address, version, true, timeout, ++this->firewallSequence, false})) {
 			return false;
 		}
 	}
 
+	// Removal is checked again when it is due
+	this->scheduleExpiry(key, sa, ab);
+
 	return true;
 }
 
 /*
- * Save suspicious activity to data->suspiciousAddreses and datafile (add new or update existing)
- * Additionally add/remove iptables rule
+ * Time left until rule should be removed (seconds, nftables set element timeout), 0 if rule is kept until removed
  */
-void Data::saveActivity(std::string address, unsigned int activityScore, unsigned int activityCount, unsigned int refusedCount)
+unsigned long long int Data::blockTimeout(const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab, unsigned long long int currentTime)
 {
-	std::time_t currentRawTime;
-	std::time(&currentRawTime);
-	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
-
-	// Check if new record needs to be added or we need to update existing data
-	bool newEntry = false;
-	if (this->suspiciousAddresses.count(address) > 0) {
+	if (sa == NULL || sa->blacklisted == true || ab != NULL || this->config->keepBlockedScoreMultiplier == 0) {
+		return 0;
+	}
+	if (sa->lastActivity + sa->activityScore > currentTime) {
+		return sa->lastActivity + sa->activityScore - currentTime;
+	}
+	return 1;
+}
 
-		// This address already had some activity previously, need to recalculate score
-		this->log->debug("Previous activity: " + std::to_string(this->suspiciousAddresses[address].lastActivity));
+/*
+ * Add or remove iptables rule (or ipset/nftables set element) for single address
+ */
+bool Data::applyFirewallChange(const hb::FirewallChange& change)
+{
+	std::vector<hb::FirewallChange> changes(1, change);
+	this->getFirewall()->apply(changes);
+	return changes[0].applied;
+}
 
-		// Adjust old score according to time passed
-		if (this->config->keepBlockedScoreMultiplier > 0 && this->suspiciousAddresses[address].activityScore > 0) {
-			this->log->debug("Adjusting previous score according to time passed...");
-			if (this->suspiciousAddresses[address].activityScore < currentTime - this->suspiciousAddresses[address].lastActivity) {
-				this->suspiciousAddresses[address].activityScore = 0;
-			} else {
-				this->suspiciousAddresses[address].activityScore -= currentTime - this->suspiciousAddresses[address].lastActivity;
-			}
-		}
+/*
+ * Backend in use
+ */
+hb::Firewall* Data::getFirewall()
+{
+	if (this->firewall == NULL) {
+		this->ownFirewall.reset(hb::Firewall::create(this->log, this->config, this->iptables));
+		this->firewall = this->ownFirewall.get();
+	}
+	return this->firewall;
+}
 
-		// Last activity is now
-		this->suspiciousAddresses[address].lastActivity = currentTime;
+/*
+ * Use given backend
+ */
+void Data::setFirewall(hb::Firewall* firewall)
+{
+	this->waitFirewall();
+	this->firewall = firewall;
+}
 
-		// Use score multiplier for score that needs to be added to old one
-		if (this->config->keepBlockedScoreMultiplier > 0) {
-			this->log->debug("Adjusting new score according to multiplier...");
-			activityScore = activityScore * this->config->keepBlockedScoreMultiplier;
+/*
+ * Revert rule mark of addresses whose latest change failed
+ */
+void Data::firewallResults()
+{
+	std::vector<hb::FirewallChange> results;
+	this->firewallWorker->takeResults(results);
+	hb::Address key;
+	unsigned long long int* latest;
+	hb::SuspiciosAddressType* sa;
+	hb::AbuseIPDBBlacklistedAddressType* ab;
+	std::vector<hb::FirewallChange>::iterator it;
+	for (it = results.begin(); it != results.end(); ++it) {
+		if (!hb::Address::parse(it->address, key)) {
+			continue;
 		}
 
-		// Increase score
-		if (this->suspiciousAddresses[address].activityScore + activityScore < this->suspiciousAddresses[address].activityScore) {
-			this->suspiciousAddresses[address].activityScore = UINT_MAX;
-		} else {
-			this->suspiciousAddresses[address].activityScore += activityScore;
-		}
-		if (this->suspiciousAddresses[address].activityCount + activityCount < this->suspiciousAddresses[address].activityCount) {
-			this->suspiciousAddresses[address].activityCount = UINT_MAX;
-		} else {
-			this->suspiciousAddresses[address].activityCount += activityCount;
+		// Address with newer change is marked according to that change
+		latest = this->firewallLatest.find(key);
+		if (latest == NULL || *latest != it->sequence) {
+			continue;
 		}
-		if (this->suspiciousAddresses[address].refusedCount + refusedCount < this->suspiciousAddresses[address].refusedCount) {
-			this->suspiciousAddresses[address].refusedCount = UINT_MAX;
-		} else {
-			this->suspiciousAddresses[address].refusedCount += refusedCount;
+		this->firewallLatest.erase(key);
+		if (it->applied) {
+			continue;
 		}
 
-	} else {
+		// Rule was marked as changed when change was collected
+		sa = this->suspiciousAddresses.find(key);
+		ab = this->abuseIPDBBlacklist.find(key);
+		if (sa != NULL) {
+			sa->iptableRule = !it->create;
+		}
+		if (ab != NULL) {
+			ab->iptableRule = !it->create;
+		}
+		this->firewallTimeouts.erase(key);
+		this->scheduleExpiry(key, sa, ab);
+	}
+}
+
+/*
+ * Start collecting firewall changes
+ */
+void Data::beginFirewallBatch()
+{
+	++this->firewallBatchDepth;
+}
+
+/*
+ * Submit collected firewall changes to worker
+ */
+void Data::commitFirewallBatch()
+{
+	if (this->firewallBatchDepth > 0) {
+		--this->firewallBatchDepth;
+	}
+	if (this->firewallBatchDepth > 0) {
+		return;
+	}
+	this->firewallResults();
+	if (this->pendingFirewallChanges.size() == 0) {
+		return;
+	}
+
+	hb::Address key;
+	std::vector<hb::FirewallChange>::iterator it;
+	for (it = this->pendingFirewallChanges.begin(); it != this->pendingFirewallChanges.end(); ++it) {
+		if (hb::Address::parse(it->address, key)) {
+			this->firewallLatest[key] = it->sequence;
+		}
+	}
+
+	// Worker only uses backend, so that data is not accessed from worker thread
+	hb::Firewall* firewall = this->getFirewall();
+	this->firewallWorker->submit(this->pendingFirewallChanges, [firewall](std::vector<hb::FirewallChange>& changes){
+		firewall->apply(changes);
+	}, firewall->timeouts());
+}
+
+/*
+ * Wait until submitted firewall changes are applied
+ */
+void Data::waitFirewall()
+{
+	this->firewallWorker->wait();
+	this->firewallResults();
+}
+
+/*
+ * Schedule removal of iptables rule, conditions match rule removal in updateIptables
+ */
+void Data::scheduleExpiry(const hb::Address& key, const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab)
+{
+	if (key.version == 0) {
+		return;
+	}
+	this->countRule(key, sa, ab);
+	if (sa == NULL || sa->iptableRule == false) {
+		this->expiry.cancel(key);
+	} else if (sa->whitelisted == true) {
+		// Failed removal is retried with next check
+		this->expiry.schedule(key, 0);
+	} else if (sa->blacklisted == true || ab != NULL) {
+		this->expiry.cancel(key);
+	} else if (this->config->keepBlockedScoreMultiplier > 0) {
+		// Rule is removed when current time is past last activity + score, nftables set element that expires earlier is
+		// checked when half of block time is left in set, so that its timeout is refreshed before kernel removes it
+		unsigned long long int deadline = sa->lastActivity + sa->activityScore;
+		const unsigned long long int* sent = this->firewallTimeouts.find(key);
+		if (sent != NULL && *sent > 0 && *sent < deadline) {
+			deadline = 2 * *sent > deadline ? 2 * *sent - deadline : 0;
+		}
+		this->expiry.schedule(key, deadline);
+	} else if (sa->activityScore == 0) {
+		this->expiry.schedule(key, 0);
+	} else {
+		// Without score multiplier score does not decrease over time, rule is kept
+		this->expiry.cancel(key);
+	}
+}
+
+/*
+ * Count rule of address for iptables.limit
+ */
+void Data::countRule(const hb::Address& key, const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab)
+{
+	if ((sa == NULL || sa->iptableRule == false) && (ab == NULL || ab->iptableRule == false)) {
+		this->eviction.cancel(key);
+		this->keptRules.erase(key);
+	} else if (ab != NULL || sa->blacklisted == true) {
+		this->eviction.cancel(key);
+		this->keptRules[key] = true;
+	} else {
+		this->keptRules.erase(key);
+		this->eviction.schedule(key, sa->lastActivity + sa->activityScore);
+	}
+}
+
+/*
+ * Evict rules until there is room for rule of address
+ */
+bool Data::reserveRule(const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab)
+{
+	if (this->config->firewallLimit == 0) {
+		return true;
+	}
+	bool kept = ab != NULL || (sa != NULL && sa->blacklisted == true);
+	hb::Address lowest;
+	unsigned long long int priority;
+	while (this->eviction.size() + this->keptRules.size() >= this->config->firewallLimit) {
+		if (!this->eviction.first(lowest, priority)) {
+			// Only rules that are never evicted are left
+			return kept;
+		}
+		if (!kept && sa->lastActivity + sa->activityScore <= priority) {
+			return false;
+		}
+		if (!this->evictRule()) {
+			return kept;
+		}
+	}
+	return true;
+}
+
+/*
+ * Remove rule of address with lowest priority
+ */
+bool Data::evictRule()
+{
+	hb::Address key;
+	unsigned long long int priority;
+	if (!this->eviction.first(key, priority)) {
+		return false;
+	}
+	std::string address = key.toString();
+	hb::SuspiciosAddressType* sa = this->suspiciousAddresses.find(key);
+	hb::AbuseIPDBBlacklistedAddressType* ab = this->abuseIPDBBlacklist.find(key);
+	++this->evictedRules;
+	this->log->info("Limit of " + std::to_string(this->config->firewallLimit) + " blocked addresses reached, removing rule for " + address + " from iptables chain (" + std::to_string(this->evictedRules) + " evicted since start)");
+	if (this->firewallBatchDepth > 0) {
+		this->pendingFirewallChanges.push_back(hb::FirewallChange{address, key.version, false, 0, ++this->firewallSequence, false});
+	} else if (!this->applyFirewallChange(hb::FirewallChange{address, key.version, false, 0, ++this->firewallSequence, false})) {
+		return false;
+	}
+	if (sa != NULL) {
+		sa->iptableRule = false;
+	}
+	this->firewallTimeouts.erase(key);
+	this->scheduleExpiry(key, sa, ab);
+	return true;
+}
+
+/*
+ * Evict rules over iptables.limit
+ */
+void Data::enforceRuleLimit()
+{
+	if (this->config->firewallLimit == 0 || this->eviction.size() + this->keptRules.size() <= this->config->firewallLimit) {
+		return;
+	}
+	if (this->keptRules.size() > this->config->firewallLimit) {
+		this->log->warning("Blacklisted addresses alone have " + std::to_string(this->keptRules.size()) + " rules, more than iptables.limit " + std::to_string(this->config->firewallLimit) + ", their rules are kept");
+	}
+	this->beginFirewallBatch();
+	while (this->eviction.size() + this->keptRules.size() > this->config->firewallLimit && this->evictRule());
+	this->commitFirewallBatch();
+}
+
+/*
+ * Update iptables rules of addresses which removal time has passed
+ */
+void Data::expireRules()
+{
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+
+	std::vector<hb::Address> expired;
+	this->expiry.takeExpired((unsigned long long int)currentRawTime, expired);
+	std::vector<hb::Address>::iterator it;
+	this->beginFirewallBatch();
+	for (it = expired.begin(); it != expired.end(); ++it) {
+		this->updateIptables(it->toString());
+	}
+	this->commitFirewallBatch();
+}
+
+/*
+ * Schedule removal of all current iptables rules again
+ */
+void Data::scheduleExpiries()
+{
+	this->expiry.clear();
+	this->eviction.clear();
+	this->keptRules.clear();
+	hb::AddressTable<hb::SuspiciosAddressType>::iterator it;
+	for (it = this->suspiciousAddresses.begin(); it != this->suspiciousAddresses.end(); ++it) {
+		if (it->second.iptableRule) {
+			this->scheduleExpiry(it->first, &it->second, this->abuseIPDBBlacklist.find(it->first));
+		}
+	}
+	hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::iterator abit;
+	for (abit = this->abuseIPDBBlacklist.begin(); abit != this->abuseIPDBBlacklist.end(); ++abit) {
+		if (abit->second.iptableRule) {
+			this->countRule(abit->first, this->suspiciousAddresses.find(abit->first), &abit->second);
+		}
+	}
+	this->enforceRuleLimit();
+}
+
+/*
+ * Save suspicious activity to data->suspiciousAddreses and datafile (add new or update existing)
+ * Additionally add/remove iptables rule
+ */
+void Data::saveActivity(std::string address, unsigned int activityScore, unsigned int activityCount, unsigned int refusedCount)
+{
+	std::time_t currentRawTime;
+	std::time(&currentRawTime);
+	unsigned long long int currentTime = (unsigned long long int)currentRawTime;
+
+	hb::Address key;
+	if (!hb::Address::parse(address, key)) {
+		this->log->warning("Invalid IP address " + address + ", activity not saved!");
+		return;
+	}
+
+	// Check if new record needs to be added or we need to update existing data
+	bool newEntry = false;
+	hb::SuspiciosAddressType* record = this->suspiciousAddresses.find(key);
+	if (record != NULL) {
+
+		// This address already had some activity previously, need to recalculate score
+		this->log->debug("Previous activity: " + std::to_string(record->lastActivity));
+
+		// Adjust old score according to time passed
+		if (this->config->keepBlockedScoreMultiplier > 0 && record->activityScore > 0) {
+			this->log->debug("Adjusting previous score according to time passed...");
+			if (record->activityScore < currentTime - record->lastActivity) {
+				record->activityScore = 0;
+			} else {
+				record->activityScore -= currentTime - record->lastActivity;
+			}
+		}
+
+		// Last activity is now
+		record->lastActivity = currentTime;
+
+		// Use score multiplier for score that needs to be added to old one
+		if (this->config->keepBlockedScoreMultiplier > 0) {
+			this->log->debug("Adjusting new score according to multiplier...");
+			activityScore = activityScore * this->config->keepBlockedScoreMultiplier;
+		}
+
+		// Increase score
+		if (record->activityScore + activityScore < record->activityScore) {
+			record->activityScore = UINT_MAX;
+		} else {
+			record->activityScore += activityScore;
+		}
+		if (record->activityCount + activityCount < record->activityCount) {
+			record->activityCount = UINT_MAX;
+		} else {
+			record->activityCount += activityCount;
+		}
+		if (record->refusedCount + refusedCount < record->refusedCount) {
+			record->refusedCount = UINT_MAX;
+		} else {
+			record->refusedCount += refusedCount;
+		}
+
+	} else {
 
 		// First time activity from this address
 		SuspiciosAddressType data;
@@ -2158,22 +3384,35 @@ void Data::saveActivity(std::string address, unsigned int activityScore, unsigne
 		data.whitelisted = false;
 		data.blacklisted = false;
 		data.lastReported = 0;
-		data.version = hb::Util::ipVersion(address);
-		this->suspiciousAddresses.insert(std::pair<std::string,SuspiciosAddressType>(address,data));
+		data.version = key.version;
+		record = this->suspiciousAddresses.insert(key, data);
 		newEntry = true;
 	}
 
 	// Few details for debug
-	this->log->debug("Last activity: " + std::to_string(this->suspiciousAddresses[address].lastActivity));
-	this->log->debug("Activity score: " + std::to_string(this->suspiciousAddresses[address].activityScore));
-	this->log->debug("Activity count: " + std::to_string(this->suspiciousAddresses[address].activityCount));
-	this->log->debug("Refused count: " + std::to_string(this->suspiciousAddresses[address].refusedCount));
-	if (this->suspiciousAddresses[address].whitelisted) this->log->debug("Address is in whitelist!");
-	if (this->suspiciousAddresses[address].blacklisted) this->log->debug("Address is in blacklist!");
-	this->log->debug("Last reported: " + std::to_string(this->suspiciousAddresses[address].lastReported));
+	this->log->debug("Last activity: " + std::to_string(record->lastActivity));
+	this->log->debug("Activity score: " + std::to_string(record->activityScore));
+	this->log->debug("Activity count: " + std::to_string(record->activityCount));
+	this->log->debug("Refused count: " + std::to_string(record->refusedCount));
+	if (record->whitelisted) this->log->debug("Address is in whitelist!");
+	if (record->blacklisted) this->log->debug("Address is in blacklist!");
+	this->log->debug("Last reported: " + std::to_string(record->lastReported));
 
 	this->updateIptables(address);
 
+	// Write-behind, collect change and write with other changes later
+	if (this->writeBehind()) {
+		if (newEntry == true) {
+			this->newAddresses.insert(address);
+		} else if (this->newAddresses.count(address) == 0) {
+			this->dirtyAddresses.insert(address);
+		}
+		if (this->dirtyAddresses.size() + this->newAddresses.size() >= this->config->dataFileSyncDirty) {
+			this->flush();
+		}
+		return;
+	}
+
 	// Update data file
 	if (newEntry == true) {
 		// Add new entry to end of data file
@@ -2184,6 +3423,374 @@ void Data::saveActivity(std::string address, unsigned int activityScore, unsigne
 	}
 }
 
+/*
+ * Save log file bookmark
+ */
+void Data::saveBookmark(std::string filePath)
+{
+	if (this->writeBehind()) {
+		this->dirtyFiles.insert(filePath);
+		return;
+	}
+	this->updateFile(filePath);
+}
+
+/*
+ * Whether changes are collected in memory
+ */
+bool Data::writeBehind() const
+{
+	return this->config->dataFileSync != hb::DataFileSync::SyncImmediate;
+}
+
+/*
+ * Address record line
+ */
+std::string Data::addressRecord(const std::string& address)
+{
+	std::ostringstream f;
+	hb::SuspiciosAddressType& record = this->suspiciousAddresses[address];
+	f << 'd';
+	f << std::right << std::setw(39) << address;// Address, left padded with spaces
+	f << std::right << std::setw(20) << record.lastActivity;// Last activity, left padded with spaces
+	f << std::right << std::setw(10) << record.activityScore;// Current activity score, left padded with spaces
+	f << std::right << std::setw(10) << record.activityCount;// Total activity count, left padded with spaces
+	f << std::right << std::setw(10) << record.refusedCount;// Total refused connection count, left padded with spaces
+	if (record.whitelisted == true) f << 'y';
+	else f << 'n';
+	if (record.blacklisted == true) f << 'y';
+	else f << 'n';
+	f << std::right << std::setw(20) << record.lastReported;// Last report, left padded with spaces
+	f << (record.version > 0 ? record.version : ' ');// IP version
+	f << "\n";
+	return f.str();
+}
+
+/*
+ * AbuseIPDB blacklist record line
+ */
+std::string Data::abuseIPDBRecord(const std::string& address)
+{
+	std::ostringstream f;
+	hb::AbuseIPDBBlacklistedAddressType& record = this->abuseIPDBBlacklist[address];
+	f << 'a';
+	f << std::right << std::setw(39) << address;
+	f << std::right << std::setw(10) << record.totalReports;
+	if (record.abuseConfidenceScore > 999) {
+		record.abuseConfidenceScore = 999;
+	}
+	f << std::right << std::setw(3) << record.abuseConfidenceScore;
+	f << (record.version > 0 ? record.version : ' ');// IP version
+	f << "\n";
+	return f.str();
+}
+
+/*
+ * Journal entry of removed record
+ */
+std::string Data::removalRecord(char type, const std::string& key)
+{
+	std::ostringstream f;
+	f << 'r' << type;
+	if (type == 'f') {
+		f << key;
+	} else {
+		f << std::right << std::setw(39) << key;
+	}
+	f << "\n";
+	return f.str();
+}
+
+/*
+ * Whether datafile engine is journal
+ */
+bool Data::journalEngine() const
+{
+	return this->config->dataFileEngine == hb::DataFileEngine::EngineJournal;
+}
+
+/*
+ * Whether datafile engine is binary
+ */
+bool Data::binaryEngine() const
+{
+	return this->config->dataFileEngine == hb::DataFileEngine::EngineBinary;
+}
+
+/*
+ * Whether datafile engine is SQLite
+ */
+bool Data::sqliteEngine() const
+{
+	return this->config->dataFileEngine == hb::DataFileEngine::EngineSqlite;
+}
+
+/*
+ * Append records to journal of current datafile
+ */
+bool Data::journalAppend(const std::string& records)
+{
+	this->journal->setPath(this->config->dataFilePath);
+	return this->journal->append(records);
+}
+
+/*
+ * Log file record line without path
+ */
+std::string Data::fileRecord(const hb::LogFile& logFile)
+{
+	std::ostringstream f;
+	f << 'f';
+	f << std::right << std::setw(20) << logFile.bookmark;
+	f << std::right << std::setw(20) << logFile.size;
+	f << std::right << std::setw(20) << logFile.device;
+	f << std::right << std::setw(20) << logFile.inode;
+	f << std::right << std::setw(16) << std::hex << logFile.fingerprint << std::dec;
+	f << std::right << std::setw(5) << logFile.fingerprintSize;
+	return f.str();
+}
+
+/*
+ * Write changed records to datafile
+ * Records with known offset are overwritten in place, new records are appended with single write,
+ * records that are not found with offset index are updated with search in datafile
+ */
+bool Data::flush()
+{
+	std::set<std::string>::iterator it;
+	std::vector<std::string> searchAddresses, searchFiles;
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+	std::string record, appended;
+	long long int offset, end;
+	bool result = true;
+
+	time(&this->lastFlush);
+	if (this->dirtyAddresses.size() == 0 && this->newAddresses.size() == 0 && this->dirtyFiles.size() == 0) {
+		return true;
+	}
+
+	this->log->debug("Writing " + std::to_string(this->dirtyAddresses.size() + this->newAddresses.size()) + " changed address record(s) and " + std::to_string(this->dirtyFiles.size()) + " log file record(s) to " + this->config->dataFilePath);
+
+	// SQLite engine writes all changed addresses in single transaction, log files in next one
+	if (this->sqliteEngine()) {
+		std::vector<std::string> keys(this->dirtyAddresses.begin(), this->dirtyAddresses.end());
+		keys.insert(keys.end(), this->newAddresses.begin(), this->newAddresses.end());
+		std::vector<hb::LogFile> files;
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (this->dirtyFiles.count(itlf->path) > 0) {
+					files.push_back(*itlf);
+				}
+			}
+		}
+		// Changes stay dirty until their transaction is committed, bookmark must not be ahead of saved activity
+		if (!this->sqlite->putAddresses(this->suspiciousAddresses, keys)) {
+			return false;
+		}
+		this->dirtyAddresses.clear();
+		this->newAddresses.clear();
+		if (!this->sqlite->putFiles(files)) {
+			return false;
+		}
+		this->dirtyFiles.clear();
+		return true;
+	}
+
+	// Binary engine writes all changed addresses with single lock, new ones with single write
+	if (this->binaryEngine()) {
+		std::vector<std::string> keys(this->dirtyAddresses.begin(), this->dirtyAddresses.end());
+		keys.insert(keys.end(), this->newAddresses.begin(), this->newAddresses.end());
+		// Changes stay dirty until they are written, bookmark must not be ahead of saved activity
+		if (!this->binary->putAddresses(this->suspiciousAddresses, keys)) {
+			return false;
+		}
+		this->dirtyAddresses.clear();
+		this->newAddresses.clear();
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (this->dirtyFiles.count(itlf->path) > 0) {
+					if (this->binary->putFile(*itlf)) {
+						this->dirtyFiles.erase(itlf->path);
+					} else {
+						result = false;
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	// Journal engine appends all changed records with single write, addresses before log files
+	if (this->journalEngine()) {
+		for (it = this->dirtyAddresses.begin(); it != this->dirtyAddresses.end(); ++it) {
+			appended += this->addressRecord(*it);
+		}
+		for (it = this->newAddresses.begin(); it != this->newAddresses.end(); ++it) {
+			appended += this->addressRecord(*it);
+		}
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (this->dirtyFiles.count(itlf->path) > 0) {
+					appended += Data::fileRecord(*itlf) + itlf->path + "\n";
+				}
+			}
+		}
+		// Changes stay dirty if journal append fails (file is locked or disk is full) and are appended with next flush
+		if (!this->journalAppend(appended)) {
+			return false;
+		}
+		this->dirtyAddresses.clear();
+		this->newAddresses.clear();
+		this->dirtyFiles.clear();
+		return true;
+	}
+
+	// Open file
+	FILE* fp = std::fopen(this->config->dataFilePath.c_str(), "r+");
+	if (fp == NULL) {
+		this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
+		this->log->error("Unable to open datafile for update!");
+		return false;
+	}
+
+	// Get file descriptor
+	int fd = fileno(fp);
+	if (fd == -1) {
+		std::fclose(fp);
+		this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
+		this->log->error("Unable to update datafile, failed to get file descriptor!");
+		return false;
+	}
+
+	// Lock whole file
+	int fs = cfcntl::lockf(fd, F_LOCK, 0);
+	unsigned int retryCounter = 1;
+	while (fs == -1) {
+		if (retryCounter >= 3) {
+			break;
+		}
+		// Sleep
+		cunistd::usleep(500000);
+		// Retry
+		fs = cfcntl::lockf(fd, F_LOCK, 0);
+		++retryCounter;
+	}
+	if (fs == -1) {
+		std::fclose(fp);
+		this->log->error("Error " + std::to_string(errno) + ": " + strerror(errno));
+		this->log->error("Unable to update datafile, file is locked!");
+		return false;
+	}
+
+	// Changed addresses, records that failed to be written stay dirty and are written with next flush
+	std::set<std::string> failedAddresses, failedFiles;
+	for (it = this->dirtyAddresses.begin(); it != this->dirtyAddresses.end(); ++it) {
+		offset = this->indexedOffset(fd, this->addressIndex, 'd', *it);
+		if (offset < 0) {
+			searchAddresses.push_back(*it);
+			continue;
+		}
+		record = this->addressRecord(*it);
+		if (cunistd::pwrite(fd, record.data(), record.length(), offset) != (long int)record.length()) {
+			this->log->error("Failed to update address " + *it + " in datafile! " + std::to_string(errno) + ": " + strerror(errno));
+			failedAddresses.insert(*it);
+			result = false;
+		}
+	}
+
+	// New addresses, appended at once, indexed only when they are written
+	end = Data::endOffset(fd);
+	std::vector<long long int> newOffsets;
+	for (it = this->newAddresses.begin(); it != this->newAddresses.end(); ++it) {
+		newOffsets.push_back(end + appended.length());
+		appended += this->addressRecord(*it);
+	}
+	bool appendedNew = appended.length() == 0 || cunistd::pwrite(fd, appended.data(), appended.length(), end) == (long int)appended.length();
+	if (appendedNew) {
+		std::vector<long long int>::iterator ito = newOffsets.begin();
+		for (it = this->newAddresses.begin(); it != this->newAddresses.end(); ++it, ++ito) {
+			this->addressIndex[*it] = *ito;
+		}
+	} else {
+		this->log->error("Failed to add new addresses to datafile! " + std::to_string(errno) + ": " + strerror(errno));
+		result = false;
+	}
+
+	// Log file bookmarks, after addresses, bookmark must not be ahead of activity that is not written yet
+	for (it = this->dirtyFiles.begin(); it != this->dirtyFiles.end(); ++it) {
+		if (result == false) {
+			failedFiles.insert(*it);
+			continue;
+		}
+		offset = this->indexedOffset(fd, this->fileIndex, 'f', *it);
+		if (offset < 0) {
+			searchFiles.push_back(*it);
+			continue;
+		}
+		for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+			for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+				if (itlf->path == *it) {
+					record = Data::fileRecord(*itlf);
+					if (cunistd::pwrite(fd, record.data(), record.length(), offset) != (long int)record.length()) {
+						this->log->error("Failed to update log file " + *it + " in datafile! " + std::to_string(errno) + ": " + strerror(errno));
+						failedFiles.insert(*it);
+						result = false;
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	// Unlock file
+	fs = cfcntl::lockf(fd, F_ULOCK, 0);
+	if (fs == -1) {
+		this->log->warning("Failed to unlock datafile after update!");
+	}
+
+	// Close datafile
+	std::fclose(fp);
+
+	this->dirtyAddresses.swap(failedAddresses);
+	if (appendedNew) {
+		this->newAddresses.clear();
+	}
+	this->dirtyFiles.swap(failedFiles);
+
+	// Records not found with offset index (datafile changed by other process)
+	for (std::vector<std::string>::iterator its = searchAddresses.begin(); its != searchAddresses.end(); ++its) {
+		if (!this->updateAddress(*its)) {
+			this->dirtyAddresses.insert(*its);
+			result = false;
+		}
+	}
+	for (std::vector<std::string>::iterator its = searchFiles.begin(); its != searchFiles.end(); ++its) {
+		if (result == false || !this->updateFile(*its)) {
+			this->dirtyFiles.insert(*its);
+			result = false;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Flush changes each datafile.sync.interval seconds
+ */
+void Data::sync()
+{
+	time_t now;
+	time(&now);
+	if (this->config->dataFileSync == hb::DataFileSync::SyncInterval && (unsigned long long int)(now - this->lastFlush) >= this->config->dataFileSyncInterval) {
+		this->flush();
+	}
+	if (this->journalEngine()) {
+		this->journal->setPath(this->config->dataFilePath);
+		this->journal->compactIfNeeded(this->config->dataFileCompactInterval);
+	}
+}
+
 /*
  * Save AbuseIPDB blacklist record in data->abuseIPDBBlacklist and datafile (add new or update existing)
  */
@@ -2196,16 +3803,23 @@ void Data::saveAbuseIPDBRecord(std::string address, unsigned int totalReports, u
 		abuseConfidenceScore = 100;
 	}
 
-	if (this->abuseIPDBBlacklist.count(address) > 0) {
-		this->abuseIPDBBlacklist[address].totalReports = totalReports;
-		this->abuseIPDBBlacklist[address].abuseConfidenceScore = abuseConfidenceScore;
+	hb::Address key;
+	if (!hb::Address::parse(address, key)) {
+		this->log->warning("Invalid IP address " + address + ", AbuseIPDB record not saved!");
+		return;
+	}
+
+	hb::AbuseIPDBBlacklistedAddressType* record = this->abuseIPDBBlacklist.find(key);
+	if (record != NULL) {
+		record->totalReports = totalReports;
+		record->abuseConfidenceScore = abuseConfidenceScore;
 	} else {
 		AbuseIPDBBlacklistedAddressType data;
 		data.totalReports = totalReports;
 		data.abuseConfidenceScore = abuseConfidenceScore;
 		data.iptableRule = false;
-		data.version = hb::Util::ipVersion(address);
-		this->abuseIPDBBlacklist.insert(std::pair<std::string,AbuseIPDBBlacklistedAddressType>(address, data));
+		data.version = key.version;
+		this->abuseIPDBBlacklist.insert(key, data);
 		newEntry = true;
 	}
 
@@ -2217,6 +3831,52 @@ void Data::saveAbuseIPDBRecord(std::string address, unsigned int totalReports, u
 	}
 }
 
+/*
+ * Offset of record from offset index, verified by reading record type and key from datafile
+ */
+long long int Data::indexedOffset(int fd, const std::unordered_map<std::string, long long int>& index, char type, const std::string& key)
+{
+	std::unordered_map<std::string, long long int>::const_iterator it = index.find(key);
+	std::string expected;
+	std::size_t keyPosition;
+	char buffer[512];
+
+	if (it == index.end()) {
+		return -1;
+	}
+
+	// Address is left padded to 39 characters after record type, log file path is after bookmark, size and file identity
+	if (type == 'f') {
+		keyPosition = 102;
+		expected = key + "\n";
+	} else {
+		keyPosition = 1;
+		expected = std::string(key.length() < 39 ? 39 - key.length() : 0, ' ') + key;
+	}
+	if (keyPosition + expected.length() > sizeof(buffer)) {
+		return -1;
+	}
+
+	if (cunistd::pread(fd, buffer, keyPosition + expected.length(), it->second) != (long int)(keyPosition + expected.length()) || buffer[0] != type || memcmp(buffer + keyPosition, expected.data(), expected.length()) != 0) {
+		this->log->debug("Offset index does not match datafile for " + key + ", searching whole datafile...");
+		return -1;
+	}
+
+	return it->second;
+}
+
+/*
+ * Current end of datafile
+ */
+long long int Data::endOffset(int fd)
+{
+	struct cstat::stat buffer;
+	if (cstat::fstat(fd, &buffer) != 0) {
+		return -1;
+	}
+	return (long long int)buffer.st_size;
+}
+
 /*
  * Sort std::vector<hb::SuspiciosAddressStatType> descending by activityCount
  */
@@ -2249,6 +3909,23 @@ std::string Data::centerString(std::string str, unsigned int len)
 	return str;
 }
 
+/*
+ * Suspicious addresses sorted by address
+ */
+std::vector<std::pair<hb::Address, const hb::SuspiciosAddressType*>> Data::sortedAddresses() const
+{
+	std::vector<std::pair<hb::Address, const hb::SuspiciosAddressType*>> sorted;
+	hb::AddressTable<hb::SuspiciosAddressType>::const_iterator it;
+	sorted.reserve(this->suspiciousAddresses.size());
+	for (it = this->suspiciousAddresses.begin(); it != this->suspiciousAddresses.end(); ++it) {
+		sorted.push_back(std::make_pair(it->first, &it->second));
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<hb::Address, const hb::SuspiciosAddressType*>& a, const std::pair<hb::Address, const hb::SuspiciosAddressType*>& b) {
+		return a.first < b.first;
+	});
+	return sorted;
+}
+
 /*
  * Print (stdout) some statistics about data
  */
@@ -2273,7 +3950,8 @@ void Data::printStats()
 	}
 
 	if (this->suspiciousAddresses.size() > 0) {
-		std::map<std::string, SuspiciosAddressType>::iterator sait;
+		std::vector<std::pair<hb::Address, const hb::SuspiciosAddressType*>> sorted = this->sortedAddresses();
+		std::vector<std::pair<hb::Address, const hb::SuspiciosAddressType*>>::iterator sait;
 		std::vector<hb::SuspiciosAddressStatType> top5;
 		std::vector<hb::SuspiciosAddressStatType>::iterator t5it;
 		hb::SuspiciosAddressStatType address;
@@ -2293,18 +3971,19 @@ void Data::printStats()
 		unsigned long long int lastActivityMin = ULLONG_MAX;
 		bool replace = false;
 		unsigned int totalBlocked = 0;
+		unsigned int totalEvictable = 0;
 		unsigned int totalWhitelisted = 0;
 		unsigned int totalBlacklisted = 0;
 		unsigned int totalActivityCout = 0;
 		unsigned int totalRefusedCount = 0;
 
 		// Get top 5 addresses by activity count and last 5 addresses by last activity time
-		for (sait = this->suspiciousAddresses.begin(); sait!=this->suspiciousAddresses.end(); ++sait) {
-			address.address = sait->first;
-			address.lastActivity = sait->second.lastActivity;
-			address.activityScore = sait->second.activityScore;
-			address.activityCount = sait->second.activityCount;
-			address.refusedCount = sait->second.refusedCount;
+		for (sait = sorted.begin(); sait != sorted.end(); ++sait) {
+			address.address = sait->first.toString();
+			address.lastActivity = sait->second->lastActivity;
+			address.activityScore = sait->second->activityScore;
+			address.activityCount = sait->second->activityCount;
+			address.refusedCount = sait->second->refusedCount;
 
 			if (top5.size() < 5) {
 				// First fill up top5
@@ -2374,24 +4053,30 @@ void Data::printStats()
 			}
 
 			// Totals
-			if (sait->second.whitelisted) {
+			if (sait->second->whitelisted) {
 				++totalWhitelisted;
-			} else if (sait->second.blacklisted) {
+			} else if (sait->second->blacklisted) {
 				++totalBlacklisted;
 				++totalBlocked;
 			} else if (this->config->keepBlockedScoreMultiplier > 0) {
 				// Score multiplier used
-				if (currentTime < (sait->second.lastActivity + sait->second.activityScore) - (this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier)) {
+				if (currentTime < (sait->second->lastActivity + sait->second->activityScore) - (this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier)) {
 					++totalBlocked;
+					if (this->abuseIPDBBlacklist.count(sait->first) == 0) {
+						++totalEvictable;
+					}
 				}
 			} else {
 				// Score multiplier not used
-				if (sait->second.activityScore > this->config->activityScoreToBlock) {
+				if (sait->second->activityScore > this->config->activityScoreToBlock) {
 					++totalBlocked;
+					if (this->abuseIPDBBlacklist.count(sait->first) == 0) {
+						++totalEvictable;
+					}
 				}
 			}
-			totalActivityCout += sait->second.activityCount;
-			totalRefusedCount += sait->second.refusedCount;
+			totalActivityCout += sait->second->activityCount;
+			totalRefusedCount += sait->second->refusedCount;
 		}
 
 		std::cout << "Total suspicious activity: " << totalActivityCout << std::endl;
@@ -2400,6 +4085,20 @@ void Data::printStats()
 		std::cout << "Total blacklisted: " << totalBlacklisted << std::endl;
 		std::cout << "Total blocked: " << totalBlocked << std::endl;
 
+		// With iptables.limit rules of addresses with lowest score are evicted, blacklisted ones are kept
+		if (this->config->firewallLimit > 0) {
+			// Blacklisted locally or in AbuseIPDB blacklist (addresses in both lists are already counted above)
+			unsigned int totalKept = totalBlocked - totalEvictable;
+			hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::iterator abit;
+			for (abit = this->abuseIPDBBlacklist.begin(); abit != this->abuseIPDBBlacklist.end(); ++abit) {
+				if (abit->second.abuseConfidenceScore >= this->config->abuseipdbBlockScore && this->suspiciousAddresses.count(abit->first) == 0) {
+					++totalKept;
+				}
+			}
+			unsigned int room = totalKept < this->config->firewallLimit ? this->config->firewallLimit - totalKept : 0;
+			std::cout << "Total evicted (iptables.limit = " << this->config->firewallLimit << "): " << (totalEvictable > room ? totalEvictable - room : 0) << std::endl;
+		}
+
 		// Sort top5 addresses
 		std::sort(top5.begin(), top5.end(), this->sortByActivityCount);
 
@@ -2534,7 +4233,8 @@ void Data::printStats()
 void Data::printBlocked(bool count, bool time, bool all)
 {
 	if (this->suspiciousAddresses.size() > 0) {
-		std::map<std::string, SuspiciosAddressType>::iterator sait;
+		std::vector<std::pair<hb::Address, const hb::SuspiciosAddressType*>> sorted = this->sortedAddresses();
+		std::vector<std::pair<hb::Address, const hb::SuspiciosAddressType*>>::iterator it;
 		unsigned int addressMaxLen = 7;
 		unsigned int lastActivityMaxLen = 13;
 		unsigned int activityCountMaxLen = 1;
@@ -2545,38 +4245,38 @@ void Data::printBlocked(bool count, bool time, bool all)
 		std::time(&currentRawTime);
 		unsigned long long int currentTime = (unsigned long long int)currentRawTime;
 		// Find max for padding
-		for (sait = this->suspiciousAddresses.begin(); sait!=this->suspiciousAddresses.end(); ++sait) {
+		for (it = sorted.begin(); it != sorted.end(); ++it) {
 			if (tmp == 0) {
-				tmp = Util::formatDateTime((const time_t)sait->second.lastActivity, this->config->dateTimeFormat.c_str()).length();
+				tmp = Util::formatDateTime((const time_t)it->second->lastActivity, this->config->dateTimeFormat.c_str()).length();
 				if (tmp > lastActivityMaxLen) lastActivityMaxLen = tmp;
 			}
-			tmp = sait->first.length();
+			tmp = it->first.toString().length();
 			if (tmp > addressMaxLen) addressMaxLen = tmp;
-			tmp = std::to_string(sait->second.activityCount).length();
+			tmp = std::to_string(it->second->activityCount).length();
 			if (tmp > activityCountMaxLen) activityCountMaxLen = tmp;
-			tmp = std::to_string(sait->second.activityScore).length();
+			tmp = std::to_string(it->second->activityScore).length();
 			if (tmp > activityScoreMaxLen) activityScoreMaxLen = tmp;
-			tmp = std::to_string(sait->second.refusedCount).length();
+			tmp = std::to_string(it->second->refusedCount).length();
 			if (tmp > refusedCountMaxLen) refusedCountMaxLen = tmp;
 		}
 		// Output all blockecd addresses
-		for (sait = this->suspiciousAddresses.begin(); sait!=this->suspiciousAddresses.end(); ++sait) {
+		for (it = sorted.begin(); it != sorted.end(); ++it) {
 			// Whitelisted addresses are not blocked
-			if (sait->second.whitelisted && all == false) {
+			if (it->second->whitelisted && all == false) {
 				continue;
 			}
-			if (sait->second.blacklisted
-				|| (this->config->keepBlockedScoreMultiplier > 0 && currentTime < (sait->second.lastActivity + sait->second.activityScore) - (this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier))
-				|| (this->config->keepBlockedScoreMultiplier == 0 && sait->second.activityScore > this->config->activityScoreToBlock)
+			if (it->second->blacklisted
+				|| (this->config->keepBlockedScoreMultiplier > 0 && currentTime < (it->second->lastActivity + it->second->activityScore) - (this->config->activityScoreToBlock * this->config->keepBlockedScoreMultiplier))
+				|| (this->config->keepBlockedScoreMultiplier == 0 && it->second->activityScore > this->config->activityScoreToBlock)
 				|| all) {
-				std::cout << std::left << std::setw(addressMaxLen) << sait->first;
+				std::cout << std::left << std::setw(addressMaxLen) << it->first.toString();
 				if (count) {
-					std::cout << ' ' << std::left << std::setw(activityCountMaxLen) << sait->second.activityCount;
-					std::cout << ' ' << std::left << std::setw(activityScoreMaxLen) << sait->second.activityScore;
-					std::cout << ' ' << std::left << std::setw(refusedCountMaxLen) << sait->second.refusedCount;
+					std::cout << ' ' << std::left << std::setw(activityCountMaxLen) << it->second->activityCount;
+					std::cout << ' ' << std::left << std::setw(activityScoreMaxLen) << it->second->activityScore;
+					std::cout << ' ' << std::left << std::setw(refusedCountMaxLen) << it->second->refusedCount;
 				}
 				if (time) {
-					std::cout << ' ' << Util::formatDateTime((const time_t)sait->second.lastActivity, this->config->dateTimeFormat.c_str());
+					std::cout << ' ' << Util::formatDateTime((const time_t)it->second->lastActivity, this->config->dateTimeFormat.c_str());
 				}
 				std::cout << std::endl;
 			}
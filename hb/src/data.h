@@ -7,16 +7,36 @@
 
 // Map
 #include <map>
+// Unordered map
+#include <unordered_map>
+// Set
+#include <set>
 // String
 #include <string>
+// Unique pointer
+#include <memory>
 // Logger
 #include "logger.h"
 // Config
 #include "config.h"
 // Iptables
 #include "iptables.h"
+// Firewall backends
+#include "firewall.h"
+// Firewall worker
+#include "firewallworker.h"
 // Util
 #include "util.h"
+// Address table
+#include "addresstable.h"
+// Expiry queue
+#include "expiryqueue.h"
+// Journal
+#include "journal.h"
+// Binary datafile
+#include "binarydata.h"
+// SQLite datafile
+#include "sqlitedata.h"
 
 namespace hb{
 
@@ -29,6 +49,227 @@ class Data{
 
 		static std::string centerString(std::string str, unsigned int len);
 
+		/*
+		 * Offset index - byte offset of record in datafile (position of record type) by address or log file path
+		 * Built by loadData and saveData, kept current by add/remove methods, so that single record update does
+		 * not need to search whole datafile
+		 */
+		std::unordered_map<std::string, long long int> addressIndex;
+		std::unordered_map<std::string, long long int> fileIndex;
+		std::unordered_map<std::string, long long int> abuseIPDBIndex;
+		long long int syncRecordOffset = -1;
+
+		/*
+		 * Offset of record from offset index, -1 if record is not indexed or datafile at indexed offset has other record
+		 * (datafile changed by other process), record is then searched in whole datafile
+		 */
+		long long int indexedOffset(int fd, const std::unordered_map<std::string, long long int>& index, char type, const std::string& key);
+
+		/*
+		 * Current end of datafile, offset of record that will be appended
+		 */
+		static long long int endOffset(int fd);
+
+		/*
+		 * Write-behind - changed records not written to datafile yet (datafile.sync is interval or shutdown)
+		 */
+		std::set<std::string> dirtyAddresses;// Changed addresses that already have record in datafile
+		std::set<std::string> newAddresses;// Addresses without record in datafile
+		std::set<std::string> dirtyFiles;// Log files with changed bookmark
+		time_t lastFlush = 0;
+
+		/*
+		 * Whether changes are collected in memory instead of written immediately
+		 */
+		bool writeBehind() const;
+
+		/*
+		 * Address record line as written to datafile
+		 */
+		std::string addressRecord(const std::string& address);
+
+		/*
+		 * Log file record line as written to datafile (without path and new line)
+		 */
+		static std::string fileRecord(const hb::LogFile& logFile);
+
+		/*
+		 * AbuseIPDB blacklist record line as written to datafile
+		 */
+		std::string abuseIPDBRecord(const std::string& address);
+
+		/*
+		 * Journal entry for removed record, type of removed record (d, a or f) and address or log file path
+		 */
+		static std::string removalRecord(char type, const std::string& key);
+
+		/*
+		 * Journal of changes (datafile.engine = journal), also read when switching back to text engine
+		 */
+		std::unique_ptr<hb::Journal> journal;
+
+		/*
+		 * Whether changes are appended to journal instead of updated in datafile
+		 */
+		bool journalEngine() const;
+
+		/*
+		 * Binary datafile (datafile.engine = binary), also used to read binary datafile when switching to other engine
+		 */
+		std::unique_ptr<hb::BinaryData> binary;
+
+		/*
+		 * Whether datafile is binary
+		 */
+		bool binaryEngine() const;
+
+		/*
+		 * Load binary datafile, converted to configured engine if it is not binary
+		 */
+		bool loadBinary();
+
+		/*
+		 * SQLite datafile (datafile.engine = sqlite), also used to read SQLite datafile when switching to other engine
+		 */
+		std::unique_ptr<hb::SqliteData> sqlite;
+
+		/*
+		 * Whether datafile is SQLite database
+		 */
+		bool sqliteEngine() const;
+
+		/*
+		 * Load SQLite datafile, converted to configured engine if it is not sqlite
+		 */
+		bool loadSqlite();
+
+		/*
+		 * Append records to journal
+		 */
+		bool journalAppend(const std::string& records);
+
+		/*
+		 * State collected while records are loaded
+		 */
+		struct LoadState {
+			bool duplicatesFound = false;
+			bool needUpgrade = false;
+			unsigned int removedRecords = 0;
+			std::vector<std::string> unknownFiles;// Log files not present in configuration
+		};
+
+		/*
+		 * Load single record, offset is position of record in datafile
+		 * Journal entries (journaled = true) replace loaded records or remove them
+		 */
+		void loadRecord(const std::string& line, long long int offset, bool journaled, hb::Data::LoadState& state);
+
+		/*
+		 * Suspicious addresses sorted by address, address table is not ordered
+		 */
+		std::vector<std::pair<hb::Address, const hb::SuspiciosAddressType*>> sortedAddresses() const;
+
+		/*
+		 * Backend created from configuration (kept in pointer so that data stays movable), and backend in use
+		 */
+		std::unique_ptr<hb::Firewall> ownFirewall;
+		hb::Firewall* firewall = NULL;
+
+		/*
+		 * Backend in use, backend selected by iptables.backend is created with first use
+		 */
+		hb::Firewall* getFirewall();
+
+		/*
+		 * Whether there is information about address in datafile (suspicious or AbuseIPDB blacklisted), firewall
+		 * backend takes over blocks of such addresses only
+		 */
+		bool inDatafile(const hb::Address& address);
+
+		/*
+		 * Replace blocked addresses of IP version (sorted, as found by backend setup) with addresses marked as having
+		 * rule in single transaction, unless they already match (or force is set)
+		 */
+		bool replaceBlocked(std::vector<hb::Address>& blocked, int version, bool force);
+
+		/*
+		 * Firewall changes collected since beginFirewallBatch, batch can be nested, changes are applied when outermost
+		 * batch is committed
+		 */
+		std::vector<hb::FirewallChange> pendingFirewallChanges;
+		unsigned int firewallBatchDepth = 0;
+
+		/*
+		 * Applies committed batches in background (kept in pointer so that data stays movable)
+		 */
+		std::unique_ptr<hb::FirewallWorker> firewallWorker;
+
+		/*
+		 * Sequence number of last collected change, and of last change submitted to worker for each address
+		 */
+		unsigned long long int firewallSequence = 0;
+		hb::AddressTable<unsigned long long int> firewallLatest;
+
+		/*
+		 * Revert rule mark of addresses whose latest change failed
+		 */
+		void firewallResults();
+
+		/*
+		 * Time left until rule should be removed (seconds, nftables set element timeout), 0 if rule is kept until removed
+		 */
+		unsigned long long int blockTimeout(const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab, unsigned long long int currentTime);
+
+		/*
+		 * Time when nftables removes set element of address as last sent (0 - element without timeout), unknown after
+		 * firewall check, so that every element is refreshed once
+		 */
+		hb::AddressTable<unsigned long long int> firewallTimeouts;
+
+		/*
+		 * Add or remove iptables rule (or ipset/nftables set element) for single address
+		 */
+		bool applyFirewallChange(const hb::FirewallChange& change);
+
+		/*
+		 * Addresses with iptables rule by time when rule should be removed, kept by updateIptables
+		 */
+		hb::ExpiryQueue expiry;
+
+		/*
+		 * Schedule removal of iptables rule for address (or cancel if rule should be kept), rule is counted for
+		 * iptables.limit
+		 */
+		void scheduleExpiry(const hb::Address& key, const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab);
+
+		/*
+		 * Addresses with rule that can be evicted when iptables.limit is reached, by last activity + score (lowest score
+		 * or oldest activity first), and addresses with rule that are never evicted (blacklisted locally or in AbuseIPDB)
+		 */
+		hb::ExpiryQueue eviction;
+		hb::AddressTable<bool> keptRules;
+
+		/*
+		 * Count of rules evicted because of iptables.limit since start
+		 */
+		unsigned long long int evictedRules = 0;
+
+		/*
+		 * Count rule of address for iptables.limit (or stop counting it if address no longer has rule)
+		 */
+		void countRule(const hb::Address& key, const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab);
+
+		/*
+		 * Evict rules until there is room for rule of address, returns false if address has lower priority than all
+		 * rules that could be evicted (blacklisted address always gets rule)
+		 */
+		bool reserveRule(const hb::SuspiciosAddressType* sa, const hb::AbuseIPDBBlacklistedAddressType* ab);
+
+		/*
+		 * Remove rule of address with lowest priority, returns false if there is no rule that can be evicted
+		 */
+		bool evictRule();
+
 	public:
 
 		/*
@@ -49,7 +290,7 @@ class Data{
 		/*
 		 * Data about suspicious, whitelisted and blacklisted addresses
 		 */
-		std::map<std::string, hb::SuspiciosAddressType> suspiciousAddresses;
+		hb::AddressTable<hb::SuspiciosAddressType> suspiciousAddresses;
 
 		/*
 		 * Timestamp of last syncrhonization with AbuseIPDB blacklist
@@ -64,7 +305,7 @@ class Data{
 		/*
 		 * Data about AbuseIPDB blacklisted addresses
 		 */
-		std::map<std::string, hb::AbuseIPDBBlacklistedAddressType> abuseIPDBBlacklist;
+		hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType> abuseIPDBBlacklist;
 
 		/*
 		 * Constructor
@@ -76,6 +317,17 @@ class Data{
 		 */
 		bool loadData();
 
+		/*
+		 * Load only given address (-b, -w, -r), with SQLite datafile this is single indexed query,
+		 * other engines load whole datafile
+		 */
+		bool loadAddress(std::string address);
+
+		/*
+		 * Load only blocked addresses (-l), with SQLite datafile this is indexed query, other engines load whole datafile
+		 */
+		bool loadBlocked(bool all);
+
 		/*
 		 * Save this->suspiciousAddresses to data file, will replace if file already exists
 		 * Warhing, this rewrites whole file, should not be used for single record updates
@@ -89,6 +341,11 @@ class Data{
 		 */
 		bool checkIptables();
 
+		/*
+		 * Rebuild hostblock chain from data in single transaction (after iptables.rules.block change)
+		 */
+		bool rebuildIptables();
+
 		/*
 		 * Add new record to datafile based on this->suspiciousAddresses
 		 */
@@ -159,6 +416,44 @@ class Data{
 		 */
 		bool updateIptables(std::string address);
 
+		/*
+		 * Collect iptables rule changes instead of applying each one immediately
+		 */
+		void beginFirewallBatch();
+
+		/*
+		 * Submit collected changes to background worker, which applies them with single iptables-restore
+		 * (ip6tables-restore, ipset restore, nft) transaction, results of previously submitted changes are taken
+		 */
+		void commitFirewallBatch();
+
+		/*
+		 * Wait until submitted firewall changes are applied and take their results
+		 */
+		void waitFirewall();
+
+		/*
+		 * Use given backend instead of one selected by iptables.backend (backend is not owned, e.g. in-memory backend
+		 * of benchmark), must be set before first firewall change
+		 */
+		void setFirewall(hb::Firewall* firewall);
+
+		/*
+		 * Update iptables rules of addresses which removal time has passed
+		 */
+		void expireRules();
+
+		/*
+		 * Schedule removal of all current iptables rules again (removal time depends on configuration), rules over
+		 * iptables.limit are evicted
+		 */
+		void scheduleExpiries();
+
+		/*
+		 * Evict rules until their count is within iptables.limit
+		 */
+		void enforceRuleLimit();
+
 		/*
 		 * Save suspicious activity (add new or update existing) and create/remove iptables rule if needed
 		 */
@@ -169,6 +464,22 @@ class Data{
 		 */
 		void saveAbuseIPDBRecord(std::string address, unsigned int totalReports, unsigned int abuseConfidenceScore);
 
+		/*
+		 * Save log file bookmark (immediately or with next flush, depending on datafile.sync)
+		 */
+		void saveBookmark(std::string filePath);
+
+		/*
+		 * Write all changed records to datafile, changed addresses are written before log file bookmarks,
+		 * so that bookmark is never ahead of saved activity
+		 */
+		bool flush();
+
+		/*
+		 * Flush if datafile.sync interval has passed, to be called from daemon main loop
+		 */
+		void sync();
+
 		/*
 		 * Print (stdout) some statistics about data
 		 */
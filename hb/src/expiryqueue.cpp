@@ -0,0 +1,143 @@
+/*
+ * Queue of addresses by time when their iptables rule expires
+ *
+ * Binary min-heap by deadline, so that expiry check touches only addresses
+ * whose deadline has passed. Deadline of address usually only moves later
+ * (new activity raises score), then just the deadline kept per address is
+ * changed and heap entry is pushed again with new deadline when the old one
+ * passes. Earlier deadline adds new heap entry, cancelled addresses leave
+ * their entries in heap. Such outdated entries are skipped when taken from
+ * heap and heap is rebuilt if they are majority of it.
+ */
+
+// Heap algorithms
+#include <algorithm>
+// Header
+#include "expiryqueue.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Heap order
+ */
+bool ExpiryQueue::later(const hb::ExpiryQueue::Entry& a, const hb::ExpiryQueue::Entry& b)
+{
+	return a.deadline > b.deadline;
+}
+
+/*
+ * Add heap entry
+ */
+void ExpiryQueue::push(unsigned long long int deadline, const hb::Address& address)
+{
+	this->heap.push_back(hb::ExpiryQueue::Entry{deadline, address});
+	std::push_heap(this->heap.begin(), this->heap.end(), ExpiryQueue::later);
+}
+
+/*
+ * Rebuild heap from current deadlines
+ */
+void ExpiryQueue::compact()
+{
+	this->heap.clear();
+	hb::AddressTable<unsigned long long int>::iterator it;
+	for (it = this->deadlines.begin(); it != this->deadlines.end(); ++it) {
+		this->heap.push_back(hb::ExpiryQueue::Entry{it->second, it->first});
+	}
+	std::make_heap(this->heap.begin(), this->heap.end(), ExpiryQueue::later);
+}
+
+/*
+ * Schedule address
+ */
+void ExpiryQueue::schedule(const hb::Address& address, unsigned long long int deadline)
+{
+	bool inserted;
+	unsigned long long int* current = this->deadlines.insert(address, deadline, inserted);
+	if (inserted || deadline < *current) {
+		*current = deadline;
+		this->push(deadline, address);
+		if (this->heap.size() > 2 * this->deadlines.size() + 64) {
+			this->compact();
+		}
+	} else {
+		*current = deadline;
+	}
+}
+
+/*
+ * Remove address from queue
+ */
+void ExpiryQueue::cancel(const hb::Address& address)
+{
+	this->deadlines.erase(address);
+}
+
+/*
+ * Take addresses with passed deadline
+ */
+void ExpiryQueue::takeExpired(unsigned long long int currentTime, std::vector<hb::Address>& expired)
+{
+	hb::ExpiryQueue::Entry entry;
+	unsigned long long int* current;
+	while (this->heap.size() > 0 && this->heap.front().deadline < currentTime) {
+		std::pop_heap(this->heap.begin(), this->heap.end(), ExpiryQueue::later);
+		entry = this->heap.back();
+		this->heap.pop_back();
+
+		current = this->deadlines.find(entry.address);
+		if (current == NULL || *current < entry.deadline) {// Cancelled, or rescheduled to earlier time (other entry)
+			continue;
+		}
+		if (*current >= currentTime) {// Rescheduled to later time
+			this->push(*current, entry.address);
+			continue;
+		}
+		this->deadlines.erase(entry.address);
+		expired.push_back(entry.address);
+	}
+}
+
+/*
+ * Address with earliest deadline
+ */
+bool ExpiryQueue::first(hb::Address& address, unsigned long long int& deadline)
+{
+	hb::ExpiryQueue::Entry entry;
+	unsigned long long int* current;
+	while (this->heap.size() > 0) {
+		entry = this->heap.front();
+		current = this->deadlines.find(entry.address);
+		if (current != NULL && *current == entry.deadline) {
+			address = entry.address;
+			deadline = entry.deadline;
+			return true;
+		}
+
+		// Outdated entry, rescheduled to later time is pushed again
+		std::pop_heap(this->heap.begin(), this->heap.end(), ExpiryQueue::later);
+		this->heap.pop_back();
+		if (current != NULL && *current > entry.deadline) {
+			this->push(*current, entry.address);
+		}
+	}
+	return false;
+}
+
+/*
+ * Remove all addresses
+ */
+void ExpiryQueue::clear()
+{
+	this->heap.clear();
+	this->deadlines.clear();
+}
+
+/*
+ * Scheduled address count
+ */
+std::size_t ExpiryQueue::size() const
+{
+	return this->deadlines.size();
+}
@@ -0,0 +1,90 @@
+/*
+ * Queue of addresses by time when their iptables rule expires (min-heap)
+ */
+
+#ifndef HBEXPIRYQUEUE_H
+#define HBEXPIRYQUEUE_H
+
+// Vector
+#include <vector>
+// Address
+#include "address.h"
+// Address table
+#include "addresstable.h"
+
+namespace hb{
+
+class ExpiryQueue{
+	private:
+
+		/*
+		 * Heap entry, there can be outdated entries for address (rescheduled or cancelled), current deadline is in deadlines
+		 */
+		struct Entry {
+			unsigned long long int deadline;
+			hb::Address address;
+		};
+
+		/*
+		 * Min-heap by deadline
+		 */
+		std::vector<hb::ExpiryQueue::Entry> heap;
+
+		/*
+		 * Current deadline of each scheduled address
+		 */
+		hb::AddressTable<unsigned long long int> deadlines;
+
+		/*
+		 * Heap order, entry with earliest deadline on top
+		 */
+		static bool later(const hb::ExpiryQueue::Entry& a, const hb::ExpiryQueue::Entry& b);
+
+		/*
+		 * Add heap entry
+		 */
+		void push(unsigned long long int deadline, const hb::Address& address);
+
+		/*
+		 * Rebuild heap from current deadlines when most of heap entries are outdated
+		 */
+		void compact();
+
+	public:
+
+		/*
+		 * Schedule address (or change its deadline)
+		 * Later deadline only updates deadline of address, heap entry is moved when its old deadline passes
+		 */
+		void schedule(const hb::Address& address, unsigned long long int deadline);
+
+		/*
+		 * Remove address from queue
+		 */
+		void cancel(const hb::Address& address);
+
+		/*
+		 * Remove addresses with deadline before currentTime from queue and append them to expired
+		 */
+		void takeExpired(unsigned long long int currentTime, std::vector<hb::Address>& expired);
+
+		/*
+		 * Address with earliest deadline (address stays in queue), returns false if queue is empty
+		 */
+		bool first(hb::Address& address, unsigned long long int& deadline);
+
+		/*
+		 * Remove all addresses
+		 */
+		void clear();
+
+		/*
+		 * Scheduled address count
+		 */
+		std::size_t size() const;
+
+};
+
+}
+
+#endif
@@ -0,0 +1,488 @@
+/*
+ * Firewall backends that block addresses
+ *
+ * Data decides which addresses are blocked and backend applies changes. Each
+ * backend commits changes in single transaction (iptables-restore, ipset
+ * restore, nft -f or netlink batch), if transaction is rejected changes are
+ * committed one by one, so that single invalid change does not fail others.
+ */
+
+// Map
+#include <map>
+// Exceptions
+#include <stdexcept>
+// Header
+#include "firewall.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+Firewall::Firewall(hb::Logger* log, hb::Config* config)
+: log(log), config(config)
+{
+
+}
+
+/*
+ * Destructor
+ */
+Firewall::~Firewall()
+{
+
+}
+
+/*
+ * Backend selected by iptables.backend
+ */
+hb::Firewall* Firewall::create(hb::Logger* log, hb::Config* config, hb::Iptables* iptables)
+{
+	if (config->firewallBackend == hb::FirewallBackend::BackendIpset) {
+		return new hb::IpsetFirewall(log, config, iptables);
+	} else if (config->firewallBackend == hb::FirewallBackend::BackendNftables) {
+		return new hb::NftablesFirewall(log, config);
+	} else if (config->firewallBackend == hb::FirewallBackend::BackendNetlink) {
+		return new hb::NetlinkFirewall(log, config);
+	}
+	return new hb::RulesFirewall(log, config, iptables);
+}
+
+/*
+ * All changes in single transaction
+ */
+int Firewall::transactionGroup(const hb::FirewallChange& change) const
+{
+	return 0;
+}
+
+/*
+ * Apply changes
+ */
+void Firewall::apply(std::vector<hb::FirewallChange>& changes)
+{
+	// Changes of each transaction group in order they were collected
+	std::map<int, std::vector<hb::FirewallChange*>> groups;
+	std::vector<hb::FirewallChange>::iterator it;
+	for (it = changes.begin(); it != changes.end(); ++it) {
+		groups[this->transactionGroup(*it)].push_back(&(*it));
+	}
+
+	std::vector<hb::FirewallChange> transaction;
+	std::map<int, std::vector<hb::FirewallChange*>>::iterator git;
+	std::vector<hb::FirewallChange*>::iterator cit;
+	for (git = groups.begin(); git != groups.end(); ++git) {
+		transaction.clear();
+		for (cit = git->second.begin(); cit != git->second.end(); ++cit) {
+			transaction.push_back(**cit);
+		}
+		try {
+			if (this->commit(transaction)) {
+				if (transaction.size() > 1) {
+					this->log->debug("Applied " + std::to_string(transaction.size()) + " firewall changes in single transaction");
+				}
+				for (cit = git->second.begin(); cit != git->second.end(); ++cit) {
+					(*cit)->applied = true;
+				}
+				continue;
+			}
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+		}
+
+		// Transaction is rejected as whole (e.g. rule to delete does not exist), apply changes separately
+		if (transaction.size() > 1) {
+			this->log->warning("Failed to apply " + std::to_string(transaction.size()) + " firewall changes in single transaction, applying one by one...");
+		}
+		for (cit = git->second.begin(); cit != git->second.end(); ++cit) {
+			(*cit)->applied = false;
+			if (transaction.size() > 1) {
+				try {
+					(*cit)->applied = this->commit(std::vector<hb::FirewallChange>(1, **cit));
+				} catch (std::runtime_error& e) {
+					std::string message = e.what();
+					this->log->error(message);
+				}
+			}
+			if (!(*cit)->applied) {
+				if ((*cit)->create) {
+					this->log->error("Address " + (*cit)->address + " should have iptables rule, but hostblock failed to add rule to chain!");
+				} else {
+					this->log->error("Address " + (*cit)->address + " no longer needs iptables rule, but failed to remove rule from chain!");
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Remove block of single address
+ */
+bool Firewall::unblock(const std::string& address, int version)
+{
+	return this->commit(std::vector<hb::FirewallChange>(1, hb::FirewallChange{address, version, false, 0, 0, false}));
+}
+
+/*
+ * Blocked addresses can not be replaced by default
+ */
+bool Firewall::replaces() const
+{
+	return false;
+}
+
+/*
+ * Replace blocked addresses
+ */
+bool Firewall::replace(const std::vector<hb::Address>& addresses, int version)
+{
+	throw std::runtime_error("Firewall backend " + hb::Config::firewallBackendName(this->config->firewallBackend) + " does not support replacing of blocked addresses!");
+}
+
+/*
+ * Blocks without timeout by default
+ */
+bool Firewall::timeouts() const
+{
+	return false;
+}
+
+/*
+ * Constructor
+ */
+RulesFirewall::RulesFirewall(hb::Logger* log, hb::Config* config, hb::Iptables* iptables)
+: Firewall(log, config), iptables(iptables)
+{
+
+}
+
+/*
+ * iptables and ip6tables have separate transactions
+ */
+int RulesFirewall::transactionGroup(const hb::FirewallChange& change) const
+{
+	return change.version;
+}
+
+/*
+ * Apply changes with iptables-restore
+ */
+bool RulesFirewall::commit(const std::vector<hb::FirewallChange>& changes)
+{
+	// Order of rules in hostblock chain does not matter, iptables.rules.pos applies to jump from INPUT
+	std::vector<std::string> commands;
+	std::vector<hb::FirewallChange>::const_iterator it;
+	for (it = changes.begin(); it != changes.end(); ++it) {
+		commands.push_back((it->create ? "-A " : "-D ") + this->config->iptablesChain + " " + this->config->iptablesRuleFor(it->address));
+	}
+	return this->iptables->restore(commands, changes[0].version);
+}
+
+/*
+ * List hostblock chain of both IP versions
+ */
+bool RulesFirewall::setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known)
+{
+	bool incomplete = this->listChain(4, blocked, known);
+	return this->listChain(6, blocked, known) || incomplete;
+}
+
+/*
+ * List hostblock chain and INPUT chain rules
+ */
+bool RulesFirewall::listChain(int version, std::vector<hb::Address>& blocked, const hb::Firewall::Known& known)
+{
+	std::vector<std::string>& commands = this->setupCommands[version == 6 ? 1 : 0];
+	commands.clear();
+	const std::string& chain = this->config->iptablesChain;
+	std::vector<std::string> rules;
+	std::vector<std::string> tokens;
+	std::vector<std::string>::iterator rit;
+	std::vector<std::string>::iterator tit;
+	hb::Address address;
+	bool exists = false;
+
+	// Every rule in hostblock chain is rule of single address
+	this->iptables->listRules(chain, rules, version);
+	for (rit = rules.begin(); rit != rules.end(); ++rit) {
+		hb::Iptables::tokenize(*rit, tokens);
+		if (tokens.size() < 2 || tokens[1] != chain) {
+			continue;
+		}
+		if (tokens[0] == "-N") {
+			exists = true;
+		} else if (tokens[0] == "-A") {
+			for (tit = tokens.begin() + 2; tit != tokens.end(); ++tit) {
+				if (hb::RulesFirewall::tokenAddress(*tit, address)) {
+					blocked.push_back(address);
+					break;
+				}
+			}
+		}
+	}
+
+	// Rules of previous versions were added to INPUT directly, rules that match iptables.rules.block are moved to chain
+	// if address is in datafile, other rules might be added by admin, they are left as they are
+	std::vector<std::string> ruleTokens;
+	hb::Iptables::tokenize(this->config->iptablesRule, ruleTokens);
+	std::size_t i = 0;
+	bool jump = false, legacy = false;
+	rules.clear();
+	this->iptables->listRules("INPUT", rules, version);
+	for (rit = rules.begin(); rit != rules.end(); ++rit) {
+		hb::Iptables::tokenize(*rit, tokens);
+		if (tokens.size() < 2 || tokens[0] != "-A" || tokens[1] != "INPUT") {
+			continue;
+		}
+		if (tokens.size() == 4 && tokens[2] == "-j" && tokens[3] == chain) {
+			jump = true;
+			continue;
+		}
+		if (tokens.size() != ruleTokens.size() + 2) {
+			continue;
+		}
+		legacy = false;
+		for (i = 0; i < ruleTokens.size(); ++i) {
+			if (ruleTokens[i] == "%i") {
+				legacy = hb::RulesFirewall::tokenAddress(tokens[i + 2], address);
+			} else if (ruleTokens[i] != tokens[i + 2]) {
+				legacy = false;
+				break;
+			}
+		}
+		if (legacy && known(address)) {
+			blocked.push_back(address);
+			commands.push_back("-D" + rit->substr(rit->find("-A") + 2));
+		} else if (legacy) {
+			this->log->warning("Found iptables rule for " + address.toString() + " but don't have any information about this address in datafile, please review manually.");
+		}
+	}
+	if (!jump) {
+		commands.push_back((this->config->iptablesAppend ? "-A INPUT" : "-I INPUT 1") + std::string(" -j ") + chain);
+	}
+	return !exists || commands.size() > 0;
+}
+
+/*
+ * Remove rule if there is one
+ */
+bool RulesFirewall::unblock(const std::string& address, int version)
+{
+	if (this->iptables->command("-C " + this->config->iptablesChain + " " + this->config->iptablesRuleFor(address) + " 2>/dev/null", version) != 0) {
+		return true;
+	}
+	return this->commit(std::vector<hb::FirewallChange>(1, hb::FirewallChange{address, version, false, 0, 0, false}));
+}
+
+/*
+ * Hostblock chain is rebuilt in single transaction
+ */
+bool RulesFirewall::replaces() const
+{
+	return true;
+}
+
+/*
+ * Replace rules in hostblock chain
+ */
+bool RulesFirewall::replace(const std::vector<hb::Address>& addresses, int version)
+{
+	std::vector<std::string> rules;
+	rules.reserve(addresses.size());
+	std::vector<hb::Address>::const_iterator it;
+	for (it = addresses.begin(); it != addresses.end(); ++it) {
+		rules.push_back(this->config->iptablesRuleFor(it->toString()));
+	}
+	std::vector<std::string>& commands = this->setupCommands[version == 6 ? 1 : 0];
+	if (!this->iptables->rebuildChain(this->config->iptablesChain, rules, commands, version)) {
+		return false;
+	}
+	commands.clear();
+	return true;
+}
+
+/*
+ * Address of rule token
+ */
+bool RulesFirewall::tokenAddress(const std::string& token, hb::Address& address)
+{
+	std::size_t end = token.find('/');
+	if (end == std::string::npos) {
+		end = token.size();
+	}
+	if (!hb::Address::parse(token.data(), token.data() + end, address)) {
+		return false;
+	}
+	return end == token.size() || token.substr(end + 1) == (address.version == 6 ? "128" : "32");
+}
+
+/*
+ * Constructor
+ */
+IpsetFirewall::IpsetFirewall(hb::Logger* log, hb::Config* config, hb::Iptables* iptables)
+: Firewall(log, config), iptables(iptables)
+{
+
+}
+
+/*
+ * Apply changes with ipset restore
+ */
+bool IpsetFirewall::commit(const std::vector<hb::FirewallChange>& changes)
+{
+	std::vector<std::string> commands;
+	std::vector<hb::FirewallChange>::const_iterator it;
+	for (it = changes.begin(); it != changes.end(); ++it) {
+		commands.push_back((it->create ? "add " : "del ") + this->config->ipsetNameFor(it->version) + " " + it->address);
+	}
+	return this->ipset.restore(commands);
+}
+
+/*
+ * Create ipsets and rules that reference them if missing
+ */
+bool IpsetFirewall::setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known)
+{
+	int versions[] = {4, 6};
+	std::string rule;
+	std::vector<std::string> members;
+	for (int version : versions) {
+		try {
+			this->ipset.create(this->config->ipsetNameFor(version), version);
+			rule = this->config->ipsetRuleFor(version);
+			if (this->iptables->command("-C INPUT " + rule, version) != 0) {
+				this->log->info("Adding rule " + rule + " to ip" + (version == 6 ? "6" : "") + "tables chain!");
+				if (this->config->iptablesAppend) {
+					this->iptables->append("INPUT", rule, version);
+				} else {
+					this->iptables->insert("INPUT", rule, version);
+				}
+			}
+			this->ipset.listMembers(this->config->ipsetNameFor(version), members);
+		} catch (std::runtime_error& e) {
+			std::string message = e.what();
+			this->log->error(message);
+			throw std::runtime_error("Failed to set up ipset " + this->config->ipsetNameFor(version) + "!");
+		}
+	}
+	hb::Address address;
+	std::vector<std::string>::iterator it;
+	for (it = members.begin(); it != members.end(); ++it) {
+		if (hb::Address::parse(*it, address)) {
+			blocked.push_back(address);
+		}
+	}
+	return false;
+}
+
+/*
+ * Constructor
+ */
+NftablesFirewall::NftablesFirewall(hb::Logger* log, hb::Config* config)
+: Firewall(log, config)
+{
+
+}
+
+/*
+ * Apply changes with nft
+ */
+bool NftablesFirewall::commit(const std::vector<hb::FirewallChange>& changes)
+{
+	std::vector<std::string> commands;
+	std::vector<hb::FirewallChange>::const_iterator it;
+	for (it = changes.begin(); it != changes.end(); ++it) {
+		if (it->create) {
+			commands.push_back(hb::Nftables::addElement(this->config->nftablesTable, it->address, it->version, it->timeout));
+		} else {
+			commands.push_back(hb::Nftables::removeElement(this->config->nftablesTable, it->address, it->version));
+		}
+	}
+	return this->nftables.apply(commands);
+}
+
+/*
+ * Create table, sets and chain
+ */
+bool NftablesFirewall::setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known)
+{
+	std::vector<std::string> elements;
+	this->nftables.setup(this->config->nftablesTable);
+	this->nftables.listElements(this->config->nftablesTable, 4, elements);
+	this->nftables.listElements(this->config->nftablesTable, 6, elements);
+	hb::Address address;
+	std::vector<std::string>::iterator it;
+	for (it = elements.begin(); it != elements.end(); ++it) {
+		if (hb::Address::parse(*it, address)) {
+			blocked.push_back(address);
+		}
+	}
+	return false;
+}
+
+/*
+ * Set elements have timeout
+ */
+bool NftablesFirewall::timeouts() const
+{
+	return true;
+}
+
+/*
+ * Constructor
+ */
+NetlinkFirewall::NetlinkFirewall(hb::Logger* log, hb::Config* config)
+: Firewall(log, config)
+{
+
+}
+
+/*
+ * Apply changes with netlink batch
+ */
+bool NetlinkFirewall::commit(const std::vector<hb::FirewallChange>& changes)
+{
+	std::vector<hb::FirewallChange>::const_iterator it;
+	try {
+		for (it = changes.begin(); it != changes.end(); ++it) {
+			if (it->create) {
+				this->netlink.addElement(this->config->nftablesTable, it->address, it->version, it->timeout);
+			} else {
+				this->netlink.removeElement(this->config->nftablesTable, it->address, it->version);
+			}
+		}
+	} catch (std::runtime_error& e) {
+		this->netlink.discard();
+		throw;
+	}
+	return this->netlink.commit();
+}
+
+/*
+ * Create table, sets and chain
+ */
+bool NetlinkFirewall::setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known)
+{
+	std::vector<std::string> elements;
+	this->netlink.setup(this->config->nftablesTable);
+	this->netlink.listElements(this->config->nftablesTable, 4, elements);
+	this->netlink.listElements(this->config->nftablesTable, 6, elements);
+	hb::Address address;
+	std::vector<std::string>::iterator it;
+	for (it = elements.begin(); it != elements.end(); ++it) {
+		if (hb::Address::parse(*it, address)) {
+			blocked.push_back(address);
+		}
+	}
+	return false;
+}
+
+/*
+ * Set elements have timeout
+ */
+bool NetlinkFirewall::timeouts() const
+{
+	return true;
+}
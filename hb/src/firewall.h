@@ -0,0 +1,236 @@
+/*
+ * Firewall backends that block addresses (iptables.backend)
+ */
+
+#ifndef HBFIREWALL_H
+#define HBFIREWALL_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Function
+#include <functional>
+// Logger
+#include "logger.h"
+// Config
+#include "config.h"
+// Address
+#include "address.h"
+// Iptables
+#include "iptables.h"
+// Ipset
+#include "ipset.h"
+// Nftables
+#include "nftables.h"
+// Netlink
+#include "netlink.h"
+// Firewall change
+#include "firewallworker.h"
+
+namespace hb{
+
+/*
+ * Backend interface, Data collects changes and backend applies them
+ */
+class Firewall{
+	public:
+
+		/*
+		 * Whether there is information about address in datafile
+		 */
+		typedef std::function<bool(const hb::Address&)> Known;
+
+	protected:
+
+		/*
+		 * Logger object
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Config object
+		 */
+		hb::Config* config;
+
+		/*
+		 * Apply changes in single transaction (none of changes is applied if one fails), returns false or throws on failure
+		 */
+		virtual bool commit(const std::vector<hb::FirewallChange>& changes) = 0;
+
+		/*
+		 * Changes with different group are committed in separate transactions (0 for all changes by default)
+		 */
+		virtual int transactionGroup(const hb::FirewallChange& change) const;
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		Firewall(hb::Logger* log, hb::Config* config);
+
+		/*
+		 * Destructor
+		 */
+		virtual ~Firewall();
+
+		/*
+		 * Backend selected by iptables.backend
+		 */
+		static hb::Firewall* create(hb::Logger* log, hb::Config* config, hb::Iptables* iptables);
+
+		/*
+		 * Create chains, sets and rules that are missing, blocked addresses are appended to blocked, throws on failure
+		 * Blocks found outside of backend (rules of previous versions) are taken over only for known addresses
+		 * Returns true if blocked addresses must be replaced (backend setup is completed with replace)
+		 */
+		virtual bool setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known) = 0;
+
+		/*
+		 * Apply changes, changes of each transaction group are committed together, if transaction fails changes are
+		 * committed one by one, applied is set for each change
+		 */
+		void apply(std::vector<hb::FirewallChange>& changes);
+
+		/*
+		 * Remove block of single address (e.g. address removed from datafile), address that is not blocked is not an error
+		 */
+		virtual bool unblock(const std::string& address, int version);
+
+		/*
+		 * Whether all blocked addresses of IP version can be replaced in single transaction
+		 */
+		virtual bool replaces() const;
+
+		/*
+		 * Replace blocked addresses of IP version with addresses, throws on failure
+		 */
+		virtual bool replace(const std::vector<hb::Address>& addresses, int version);
+
+		/*
+		 * Whether created block has timeout, so that firewall removes it when timeout passes (create of blocked address
+		 * sets new timeout)
+		 */
+		virtual bool timeouts() const;
+
+};
+
+/*
+ * iptables rule for each address in hostblock chain (iptables.backend = rules)
+ */
+class RulesFirewall : public hb::Firewall{
+	private:
+
+		/*
+		 * Iptables object
+		 */
+		hb::Iptables* iptables;
+
+		/*
+		 * Commands found by setup that are applied with replace of IP version (remove rules of previous versions from
+		 * INPUT, add jump to chain)
+		 */
+		std::vector<std::string> setupCommands[2];
+
+		/*
+		 * List hostblock chain and INPUT chain of IP version, returns true if chain is missing or needs setup commands
+		 */
+		bool listChain(int version, std::vector<hb::Address>& blocked, const hb::Firewall::Known& known);
+
+		/*
+		 * Address of rule token (address with optional /32 or /128 mask)
+		 */
+		static bool tokenAddress(const std::string& token, hb::Address& address);
+
+	protected:
+
+		bool commit(const std::vector<hb::FirewallChange>& changes) override;
+		int transactionGroup(const hb::FirewallChange& change) const override;
+
+	public:
+
+		RulesFirewall(hb::Logger* log, hb::Config* config, hb::Iptables* iptables);
+		bool setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known) override;
+		bool unblock(const std::string& address, int version) override;
+		bool replaces() const override;
+		bool replace(const std::vector<hb::Address>& addresses, int version) override;
+
+};
+
+/*
+ * Addresses in ipsets referenced by iptables rule (iptables.backend = ipset)
+ */
+class IpsetFirewall : public hb::Firewall{
+	private:
+
+		/*
+		 * Iptables object
+		 */
+		hb::Iptables* iptables;
+
+		/*
+		 * Ipset object
+		 */
+		hb::Ipset ipset;
+
+	protected:
+
+		bool commit(const std::vector<hb::FirewallChange>& changes) override;
+
+	public:
+
+		IpsetFirewall(hb::Logger* log, hb::Config* config, hb::Iptables* iptables);
+		bool setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known) override;
+
+};
+
+/*
+ * Addresses in nftables sets with timeout, changed with nft (iptables.backend = nftables)
+ */
+class NftablesFirewall : public hb::Firewall{
+	private:
+
+		/*
+		 * Nftables object
+		 */
+		hb::Nftables nftables;
+
+	protected:
+
+		bool commit(const std::vector<hb::FirewallChange>& changes) override;
+
+	public:
+
+		NftablesFirewall(hb::Logger* log, hb::Config* config);
+		bool setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known) override;
+		bool timeouts() const override;
+
+};
+
+/*
+ * Same nftables table as NftablesFirewall, changed over netlink socket (iptables.backend = netlink)
+ */
+class NetlinkFirewall : public hb::Firewall{
+	private:
+
+		/*
+		 * Netlink object
+		 */
+		hb::Netlink netlink;
+
+	protected:
+
+		bool commit(const std::vector<hb::FirewallChange>& changes) override;
+
+	public:
+
+		NetlinkFirewall(hb::Logger* log, hb::Config* config);
+		bool setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known) override;
+		bool timeouts() const override;
+
+};
+
+}
+
+#endif
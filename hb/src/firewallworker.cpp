@@ -0,0 +1,174 @@
+/*
+ * Background thread that applies firewall changes
+ *
+ * Main thread marks address as blocked or unblocked right away and submits
+ * change to worker. Worker takes all changes queued since its last pass,
+ * coalesces them per address and applies them with single transaction.
+ * Processed changes are returned with results, so that main thread can
+ * revert mark of address if its latest change failed.
+ */
+
+// Unordered map
+#include <unordered_map>
+// Header
+#include "firewallworker.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+FirewallWorker::FirewallWorker(hb::Logger* log)
+: log(log)
+{
+
+}
+
+/*
+ * Destructor
+ */
+FirewallWorker::~FirewallWorker()
+{
+	this->stop();
+}
+
+/*
+ * Worker thread loop
+ */
+void FirewallWorker::run()
+{
+	std::vector<hb::FirewallChange> changes, dropped;
+	hb::FirewallWorker::Apply apply;
+	bool replace;
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (true) {
+		this->queued.wait(lock, [this]{ return this->stopping || this->queue.size() > 0; });
+		if (this->queue.size() == 0) {// Stopping and all changes are processed
+			break;
+		}
+		changes.clear();
+		changes.swap(this->queue);
+		apply = this->apply;
+		replace = this->replace;
+		this->busy = true;
+		lock.unlock();
+
+		dropped.clear();
+		hb::FirewallWorker::coalesce(changes, replace, dropped);
+		if (dropped.size() > 0) {
+			this->log->debug("Coalesced " + std::to_string(dropped.size()) + " firewall changes, applying " + std::to_string(changes.size()));
+		}
+		if (changes.size() > 0) {
+			apply(changes);
+		}
+
+		lock.lock();
+		this->results.insert(this->results.end(), changes.begin(), changes.end());
+		this->results.insert(this->results.end(), dropped.begin(), dropped.end());
+		this->busy = false;
+		this->idle.notify_all();
+	}
+}
+
+/*
+ * Queue changes for worker
+ */
+void FirewallWorker::submit(std::vector<hb::FirewallChange>& changes, const hb::FirewallWorker::Apply& apply, bool replace)
+{
+	if (changes.size() == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (this->queue.size() == 0) {
+		this->queue.swap(changes);
+	} else {
+		this->queue.insert(this->queue.end(), changes.begin(), changes.end());
+	}
+	changes.clear();
+	this->apply = apply;
+	this->replace = replace;
+	this->stopping = false;
+
+	// Thread is started when it is needed, so that it is not started before daemon forks
+	if (!this->thread.joinable()) {
+		this->thread = std::thread(&FirewallWorker::run, this);
+	}
+	this->queued.notify_one();
+}
+
+/*
+ * Wait until all submitted changes are processed
+ */
+void FirewallWorker::wait()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->idle.wait(lock, [this]{ return this->queue.size() == 0 && !this->busy; });
+}
+
+/*
+ * Move processed changes to results
+ */
+void FirewallWorker::takeResults(std::vector<hb::FirewallChange>& results)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	if (results.size() == 0) {
+		results.swap(this->results);
+	} else {
+		results.insert(results.end(), this->results.begin(), this->results.end());
+		this->results.clear();
+	}
+}
+
+/*
+ * Apply submitted changes and stop worker thread
+ */
+void FirewallWorker::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+		this->queued.notify_one();
+	}
+	if (this->thread.joinable()) {
+		this->thread.join();
+	}
+}
+
+/*
+ * Keep only changes that are needed to get to state after last change of each address
+ */
+void FirewallWorker::coalesce(std::vector<hb::FirewallChange>& changes, bool replace, std::vector<hb::FirewallChange>& dropped)
+{
+	// First and last change of each address
+	std::unordered_map<std::string, std::pair<std::size_t, std::size_t>> addresses;
+	addresses.reserve(changes.size());
+	std::unordered_map<std::string, std::pair<std::size_t, std::size_t>>::iterator ait;
+	std::size_t i;
+	for (i = 0; i < changes.size(); ++i) {
+		ait = addresses.find(changes[i].address);
+		if (ait == addresses.end()) {
+			addresses.emplace(changes[i].address, std::make_pair(i, i));
+		} else {
+			ait->second.second = i;
+		}
+	}
+	if (addresses.size() == changes.size()) {
+		return;
+	}
+
+	std::vector<hb::FirewallChange> kept;
+	kept.reserve(addresses.size());
+	for (i = 0; i < changes.size(); ++i) {
+		ait = addresses.find(changes[i].address);
+		if (ait->second.second != i
+			|| (!replace && changes[ait->second.first].create != changes[i].create)) {
+			// Overridden by later change, or address has rule before and after changes (or has none)
+			changes[i].applied = true;
+			dropped.push_back(changes[i]);
+		} else {
+			kept.push_back(changes[i]);
+		}
+	}
+	changes.swap(kept);
+}
@@ -0,0 +1,144 @@
+/*
+ * Background thread that applies firewall changes (iptables rules, ipset or nftables set elements), so that log
+ * parsing does not wait for iptables
+ */
+
+#ifndef HBFIREWALLWORKER_H
+#define HBFIREWALLWORKER_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Thread
+#include <thread>
+// Mutex
+#include <mutex>
+// Condition variable
+#include <condition_variable>
+// Function
+#include <functional>
+// Logger
+#include "logger.h"
+
+namespace hb{
+
+/*
+ * Firewall change of single address
+ */
+struct FirewallChange {
+	std::string address;
+	int version;
+	bool create;
+	unsigned long long int timeout;// nftables set element timeout (seconds, 0 - none)
+	unsigned long long int sequence;// Order in which changes were collected
+	bool applied;// Set when change is processed
+};
+
+class FirewallWorker{
+	public:
+
+		/*
+		 * Applies changes (in worker thread), sets applied for each change
+		 */
+		typedef std::function<void(std::vector<hb::FirewallChange>&)> Apply;
+
+	private:
+
+		/*
+		 * Logger object
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Worker thread, started with first submitted changes
+		 */
+		std::thread thread;
+
+		/*
+		 * Guards all members below
+		 */
+		std::mutex mutex;
+
+		/*
+		 * Signaled when changes are submitted or worker is stopped
+		 */
+		std::condition_variable queued;
+
+		/*
+		 * Signaled when worker has processed all submitted changes
+		 */
+		std::condition_variable idle;
+
+		/*
+		 * Submitted changes that are not processed yet
+		 */
+		std::vector<hb::FirewallChange> queue;
+
+		/*
+		 * Processed changes that are not taken yet
+		 */
+		std::vector<hb::FirewallChange> results;
+
+		/*
+		 * How changes are applied and whether create replaces existing rule, as passed with last submit
+		 */
+		hb::FirewallWorker::Apply apply;
+		bool replace = false;
+
+		/*
+		 * Worker is applying changes, worker is stopping
+		 */
+		bool busy = false;
+		bool stopping = false;
+
+		/*
+		 * Worker thread loop
+		 */
+		void run();
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		FirewallWorker(hb::Logger* log);
+
+		/*
+		 * Destructor, applies submitted changes and stops worker
+		 */
+		~FirewallWorker();
+
+		/*
+		 * Queue changes for worker (changes are moved from vector)
+		 * Create that replaces existing rule (nftables set element with new timeout) is kept by coalescing even if address
+		 * has rule before and after queued changes
+		 */
+		void submit(std::vector<hb::FirewallChange>& changes, const hb::FirewallWorker::Apply& apply, bool replace);
+
+		/*
+		 * Wait until all submitted changes are processed
+		 */
+		void wait();
+
+		/*
+		 * Move processed changes to results
+		 */
+		void takeResults(std::vector<hb::FirewallChange>& results);
+
+		/*
+		 * Apply submitted changes and stop worker thread
+		 */
+		void stop();
+
+		/*
+		 * Keep only last change of each address, last change is dropped too if it does not change whether address has
+		 * rule (first change of address is opposite to the state address had), dropped changes are moved to dropped
+		 */
+		static void coalesce(std::vector<hb::FirewallChange>& changes, bool replace, std::vector<hb::FirewallChange>& dropped);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Simple class to work with ipset
+ * Same as with iptables, ipset command is executed, set type is hash:ip, so
+ * that kernel checks address with single hash lookup regardless of how many
+ * addresses are blocked.
+ */
+
+// Standard string library
+#include <string>
+// String stream library
+#include <sstream>
+// Vector
+#include <vector>
+// Exceptions (runtime_error)
+#include <stdexcept>
+// Standard input/output C library (popen, fgets, fwrite, pclose)
+#include <cstdio>
+// C standard library (system)
+#include <cstdlib>
+// POSIX (getuid)
+namespace cunistd{
+	#include <unistd.h>
+}
+// Header
+#include "ipset.h"
+
+// Hostblock namespace
+using namespace hb;
+
+Ipset::Ipset()
+{
+
+}
+
+/*
+ * Exec ipset command
+ */
+int Ipset::command(std::string options)
+{
+	// Need root access to work with ipset
+	if (cunistd::getuid() != 0) {
+		throw std::runtime_error("Error, root access required to work with ipset!");
+	}
+
+	if (!std::system(NULL)) {
+		throw std::runtime_error("Command processor not available.");
+	}
+
+	// Exec command
+	std::string cmd = "ipset " + options;
+	return std::system(cmd.c_str());
+}
+
+/*
+ * Create hash:ip set
+ */
+bool Ipset::create(std::string set, int version)
+{
+	int response = this->command("create " + set + " hash:ip family " + (version == 6 ? "inet6" : "inet") + " -exist");
+	if (response == 0) {
+		return true;
+	} else {
+		throw std::runtime_error("Failed to execute ipset, returned code: " + std::to_string(response));
+	}
+}
+
+/*
+ * Apply commands in single ipset restore
+ */
+bool Ipset::restore(const std::vector<std::string>& commands)
+{
+	// Need root access to work with ipset
+	if (cunistd::getuid() != 0) {
+		throw std::runtime_error("Error, root access required to work with ipset!");
+	}
+
+	if (commands.size() == 0) {
+		return true;
+	}
+
+	std::string input = "";
+	for (std::vector<std::string>::const_iterator it = commands.begin(); it != commands.end(); ++it) {
+		input += *it + "\n";
+	}
+
+	// Open pipe stream, with -exist adding address that is in set or deleting one that is not is not an error
+	FILE* pipe = popen("ipset restore -exist", "w");
+	if (!pipe) {
+		throw std::runtime_error("Unable to open pipe to ipset restore.");
+	}
+	std::size_t written = fwrite(input.data(), 1, input.size(), pipe);
+
+	// Close stream
+	int response = pclose(pipe);
+
+	if (written == input.size() && response == 0) {
+		return true;
+	} else {
+		throw std::runtime_error("Failed to execute ipset restore, returned code: " + std::to_string(response));
+	}
+}
+
+/*
+ * List set members
+ */
+void Ipset::listMembers(std::string set, std::vector<std::string>& members)
+{
+	// Need root access to work with ipset
+	if (cunistd::getuid() != 0) {
+		throw std::runtime_error("Error, root access required to work with ipset!");
+	}
+
+	// Command
+	std::string cmd = "ipset list " + set;
+
+	// Open pipe stream
+	FILE* pipe = popen(cmd.c_str(), "r");
+	if (!pipe) {
+		throw std::runtime_error("Unable to open pipe to ipset for member listing.");
+	}
+	char buffer[128];
+	std::string result = "";
+
+	// Read pipe stream
+	while (!feof(pipe)) {
+		if(fgets(buffer, 128, pipe) != NULL) result += buffer;
+	}
+
+	// Close stream
+	pclose(pipe);
+
+	// Members are listed one per line after header, address is first word (entry can have options, e.g. timeout)
+	std::istringstream iss(result);
+	std::string line;
+	bool membersStarted = false;
+	std::size_t end;
+	for (line = ""; std::getline(iss, line);) {
+		if (!membersStarted) {
+			if (line == "Members:") {
+				membersStarted = true;
+			}
+			continue;
+		}
+		end = line.find(' ');
+		if (end != std::string::npos) {
+			line = line.substr(0, end);
+		}
+		if (line.size() > 0) {
+			members.push_back(line);
+		}
+	}
+	return;
+}
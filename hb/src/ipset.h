@@ -0,0 +1,49 @@
+/*
+ * Simple class to work with ipset
+ */
+
+// Vector
+#include <vector>
+// Standard string library
+#include <string>
+
+#ifndef HBIPSET_H
+#define HBIPSET_H
+
+namespace hb{
+
+class Ipset{
+	private:
+
+		/*
+		 * Exec ipset command, throws if command can not be executed
+		 */
+		int command(std::string options);
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		Ipset();
+
+		/*
+		 * Create hash:ip set for IP version, existing set is kept
+		 */
+		bool create(std::string set, int version = 4);
+
+		/*
+		 * Apply commands (e.g. "add hostblock 10.0.0.1") with single ipset restore
+		 */
+		bool restore(const std::vector<std::string>& commands);
+
+		/*
+		 * Get addresses in set
+		 */
+		void listMembers(std::string set, std::vector<std::string>& members);
+
+};
+
+}
+
+#endif
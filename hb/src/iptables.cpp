@@ -95,32 +95,15 @@ bool Iptables::append(std::string chain, std::string rule, int version)
 }
 
 /*
- * Append multiple rules to the end of the chain
+ * Append multiple rules to the end of the chain (single iptables-restore transaction)
  */
 bool Iptables::append(std::string chain, std::vector<std::string>* rules, int version)
 {
-	// Need root access to work with iptables
-	if (cunistd::getuid() != 0) {
-		throw std::runtime_error("Error, root access required to work with iptables!");
-	}
-
-	int response = 0;
-	if (!std::system(NULL)) {
-		throw std::runtime_error("Command processor not available.");
-	}
-
-	std::string cmd;
+	std::vector<std::string> commands;
 	for (std::vector<std::string>::iterator it = rules->begin(); it != rules->end(); ++it) {
-		cmd = "ip";
-		if (version == 6) cmd += "6";
-		cmd += "tables -A " + chain + " " + *it;
-		response = std::system(cmd.c_str());
-		if (response != 0) {
-			throw std::runtime_error("Failed to execute iptables, returned code: " + std::to_string(response));
-		}
+		commands.push_back("-A " + chain + " " + *it);
 	}
-
-	return true;
+	return this->restore(commands, version);
 }
 
 /*
@@ -154,32 +137,15 @@ bool Iptables::insert(std::string chain, std::string rule, int version, int pos)
 }
 
 /*
- * Insert multiple rules at specified position in chain
+ * Insert multiple rules at specified position in chain (single iptables-restore transaction)
  */
 bool Iptables::insert(std::string chain, std::vector<std::string>* rules, int version, int pos)
 {
-	// Need root access to work with iptables
-	if (cunistd::getuid() != 0) {
-		throw std::runtime_error("Error, root access required to work with iptables!");
-	}
-
-	int response = 0;
-	if (!std::system(NULL)) {
-		throw std::runtime_error("Command processor not available.");
-	}
-
-	std::string cmd;
+	std::vector<std::string> commands;
 	for (std::vector<std::string>::iterator it = rules->begin(); it != rules->end(); ++it) {
-		cmd = "ip";
-		if (version == 6) cmd += "6";
-		cmd += "tables -I " + chain + " " + std::to_string(pos) + " " + *it;
-		response = std::system(cmd.c_str());
-		if (response != 0) {
-			throw std::runtime_error("Failed to execute iptables, returned code: " + std::to_string(response));
-		}
+		commands.push_back("-I " + chain + " " + std::to_string(pos) + " " + *it);
 	}
-
-	return true;
+	return this->restore(commands, version);
 }
 
 /*
@@ -213,32 +179,101 @@ bool Iptables::remove(std::string chain, std::string rule, int version)
 }
 
 /*
- * Delete rules from chain
+ * Delete rules from chain (single iptables-restore transaction)
  */
 bool Iptables::remove(std::string chain, std::vector<std::string>* rules, int version)
+{
+	std::vector<std::string> commands;
+	for (std::vector<std::string>::iterator it = rules->begin(); it != rules->end(); ++it) {
+		commands.push_back("-D " + chain + " " + *it);
+	}
+	return this->restore(commands, version);
+}
+
+/*
+ * Apply rule commands to filter table in single transaction
+ */
+bool Iptables::restore(const std::vector<std::string>& commands, int version)
 {
 	// Need root access to work with iptables
 	if (cunistd::getuid() != 0) {
 		throw std::runtime_error("Error, root access required to work with iptables!");
 	}
 
-	int response = 0;
-	if (!std::system(NULL)) {
-		throw std::runtime_error("Command processor not available.");
+	if (commands.size() == 0) {
+		return true;
 	}
 
-	std::string cmd;
-	for (std::vector<std::string>::iterator it = rules->begin(); it != rules->end(); ++it) {
-		cmd = "ip";
-		if (version == 6) cmd += "6";
-		cmd += "tables -D " + chain + " " + *it;
-		response = std::system(cmd.c_str());
-		if (response != 0) {
-			throw std::runtime_error("Failed to execute iptables, returned code: " + std::to_string(response));
-		}
+	// Whole transaction is written to iptables-restore, other rules are kept (--noflush)
+	std::string cmd = "ip";
+	if (version == 6) cmd += "6";
+	cmd += "tables-restore --noflush";
+	std::string input = "*filter\n";
+	for (std::vector<std::string>::const_iterator it = commands.begin(); it != commands.end(); ++it) {
+		input += *it + "\n";
+	}
+	input += "COMMIT\n";
+
+	// Open pipe stream
+	FILE* pipe = popen(cmd.c_str(), "w");
+	if (!pipe) {
+		throw std::runtime_error("Unable to open pipe to iptables-restore.");
+	}
+	std::size_t written = fwrite(input.data(), 1, input.size(), pipe);
+
+	// Close stream, rules are applied when iptables-restore reads whole input
+	int response = pclose(pipe);
+
+	// Check response
+	if (written == input.size() && response == 0) {
+		return true;
+	} else {
+		throw std::runtime_error("Failed to execute iptables-restore, returned code: " + std::to_string(response));
 	}
+}
 
-	return true;
+/*
+ * Replace chain rules in single transaction
+ */
+bool Iptables::rebuildChain(const std::string& chain, const std::vector<std::string>& rules, const std::vector<std::string>& commands, int version)
+{
+	// With --noflush chain declaration creates chain or flushes existing one
+	std::vector<std::string> input;
+	input.reserve(rules.size() + commands.size() + 1);
+	input.push_back(":" + chain + " - [0:0]");
+	for (std::vector<std::string>::const_iterator it = rules.begin(); it != rules.end(); ++it) {
+		input.push_back("-A " + chain + " " + *it);
+	}
+	input.insert(input.end(), commands.begin(), commands.end());
+	return this->restore(input, version);
+}
+
+/*
+ * Split listed rule into tokens
+ */
+void Iptables::tokenize(const std::string& rule, std::vector<std::string>& tokens)
+{
+	tokens.clear();
+	std::size_t pos = 0, end = 0;
+	while (pos < rule.size()) {
+		if (rule[pos] == ' ' || rule[pos] == '\t' || rule[pos] == '\r' || rule[pos] == '\n') {
+			++pos;
+		} else if (rule[pos] == '"') {
+			end = rule.find('"', pos + 1);
+			if (end == std::string::npos) {
+				end = rule.size();
+			}
+			tokens.push_back(rule.substr(pos + 1, end - pos - 1));
+			pos = end + 1;
+		} else {
+			end = rule.find_first_of(" \t\r\n", pos);
+			if (end == std::string::npos) {
+				end = rule.size();
+			}
+			tokens.push_back(rule.substr(pos, end - pos));
+			pos = end;
+		}
+	}
 }
 
 /*
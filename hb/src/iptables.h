@@ -28,23 +28,40 @@ class Iptables{
 		bool newChain(std::string chain, int version = 4);
 
 		/*
-		 * Append new rule(s) to the end of the chain
+		 * Append new rule(s) to the end of the chain, multiple rules are added in single transaction
 		 */
 		bool append(std::string chain, std::string rule, int version = 4);
 		bool append(std::string chain, std::vector<std::string>* rules, int version = 4);
 
 		/*
-		 * Insert rule(s) to the chain at specified position
+		 * Insert rule(s) to the chain at specified position, multiple rules are added in single transaction
 		 */
 		bool insert(std::string chain, std::string rule, int version = 4, int pos = 1);
 		bool insert(std::string chain, std::vector<std::string>* rules, int version = 4, int pos = 1);
 
 		/*
-		 * Delete rule from chain
+		 * Delete rule(s) from chain, multiple rules are deleted in single transaction
 		 */
 		bool remove(std::string chain, std::string rule, int version = 4);
 		bool remove(std::string chain, std::vector<std::string>* rules, int version = 4);
 
+		/*
+		 * Apply rule commands (e.g. "-A INPUT -s 10.0.0.1 -j DROP") to filter table in single iptables-restore transaction,
+		 * none of commands is applied if one fails
+		 */
+		bool restore(const std::vector<std::string>& commands, int version = 4);
+
+		/*
+		 * Replace all rules of chain (chain is created if missing) and apply other commands (e.g. jump to chain) in
+		 * single iptables-restore transaction
+		 */
+		bool rebuildChain(const std::string& chain, const std::vector<std::string>& rules, const std::vector<std::string>& commands, int version = 4);
+
+		/*
+		 * Split rule as listed by iptables -S into tokens (separated by whitespace, quoted string is single token)
+		 */
+		static void tokenize(const std::string& rule, std::vector<std::string>& tokens);
+
 		/*
 		 * Get rule list
 		 */
@@ -0,0 +1,464 @@
+/*
+ * Append-only journal of datafile changes (datafile.engine = journal)
+ *
+ * Snapshot is datafile in the same format as with text engine (see data.cpp),
+ * only it never contains records marked for removal. Journal contains datafile
+ * lines of changed records, each prefixed with checksum:
+ * crc|record
+ *
+ * Removed record is journaled as "r" followed by record type and key:
+ * rd|addr
+ * ra|addr
+ * rf|file_path
+ *
+ * crc         - CRC-32 of record (without new line) in hex, len 8
+ *
+ * Entries are appended with single write while journal is locked. If daemon
+ * is killed in the middle of write, last entry is incomplete or its checksum
+ * does not match, such tail is discarded on next load.
+ *
+ * Compaction renames journal to <journal>.old (new entries go to new journal),
+ * background thread merges snapshot and old journal into <snapshot>.tmp,
+ * renames it over snapshot and removes old journal. If compaction is
+ * interrupted, old journal is replayed again on next load, entries contain
+ * whole records, so replaying them twice gives the same result.
+ */
+
+// Standard string library
+#include <string>
+// Map
+#include <map>
+// File stream library (ifstream)
+#include <fstream>
+// Iterator (istreambuf_iterator)
+#include <iterator>
+// C standard input/output (rename)
+#include <cstdio>
+// C standard library (strtoul)
+#include <cstdlib>
+// C string (strerror)
+#include <cstring>
+// Linux stat
+namespace cstat{
+	#include <errno.h>
+	#include <sys/types.h>
+	#include <sys/stat.h>
+}
+// File control options (open, lockf)
+namespace cfcntl{
+	#include <fcntl.h>
+}
+// Miscellaneous UNIX symbolic constants, types and functions (write, fsync, unlink)
+namespace cunistd{
+	#include <unistd.h>
+}
+// Util
+#include "util.h"
+// Header
+#include "journal.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * CRC-32 (IEEE 802.3) lookup table
+ */
+struct CrcTable {
+	unsigned int values[256];
+	CrcTable()
+	{
+		unsigned int c;
+		for (unsigned int n = 0; n < 256; ++n) {
+			c = n;
+			for (int k = 0; k < 8; ++k) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			this->values[n] = c;
+		}
+	}
+};
+static const CrcTable crcTable;
+
+/*
+ * Constructor
+ */
+Journal::Journal(hb::Logger* log)
+: log(log), compactionRunning(false)
+{
+
+}
+
+/*
+ * Destructor
+ */
+Journal::~Journal()
+{
+	this->wait();
+}
+
+/*
+ * Set snapshot path
+ */
+void Journal::setPath(const std::string& snapshotPath)
+{
+	if (this->snapshotPath == snapshotPath) {
+		return;
+	}
+	// Compaction of previous datafile must finish first
+	this->wait();
+	this->snapshotPath = snapshotPath;
+	time(&this->lastCompaction);
+}
+
+/*
+ * Journal file path
+ */
+std::string Journal::path() const
+{
+	return this->snapshotPath + ".journal";
+}
+
+/*
+ * Whether journal exists
+ */
+bool Journal::exists() const
+{
+	struct cstat::stat buffer;
+	return cstat::stat(this->path().c_str(), &buffer) == 0 || cstat::stat((this->path() + ".old").c_str(), &buffer) == 0;
+}
+
+/*
+ * Open and lock journal for appending
+ */
+int Journal::openLocked()
+{
+	struct cstat::stat opened, current;
+	int fd;
+	// Journal could be rotated by other process between open and lock, then reopen
+	for (unsigned int attempt = 0; attempt < 10; ++attempt) {
+		fd = cfcntl::open(this->path().c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+		if (fd == -1) {
+			this->log->error("Unable to open journal " + this->path() + "! " + std::to_string(errno) + ": " + strerror(errno));
+			return -1;
+		}
+		if (cfcntl::lockf(fd, F_LOCK, 0) == -1) {
+			this->log->error("Unable to lock journal " + this->path() + "! " + std::to_string(errno) + ": " + strerror(errno));
+			cunistd::close(fd);
+			return -1;
+		}
+		if (cstat::fstat(fd, &opened) == 0 && cstat::stat(this->path().c_str(), &current) == 0 && opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+			return fd;
+		}
+		cunistd::close(fd);
+	}
+	this->log->error("Unable to open journal " + this->path() + ", journal keeps changing!");
+	return -1;
+}
+
+/*
+ * Append records
+ */
+bool Journal::append(const std::string& records)
+{
+	static const char hex[] = "0123456789abcdef";
+	std::string entries;
+	std::size_t begin = 0, end;
+	unsigned int crc;
+
+	// Checksum before each record
+	entries.reserve(records.length() + records.length() / 8);
+	while (begin < records.length()) {
+		end = records.find('\n', begin);
+		if (end == std::string::npos) {
+			end = records.length();
+		}
+		crc = Journal::checksum(records.data() + begin, end - begin);
+		for (int shift = 28; shift >= 0; shift -= 4) {
+			entries += hex[(crc >> shift) & 0xf];
+		}
+		entries.append(records, begin, end - begin);
+		entries += '\n';
+		begin = end + 1;
+	}
+	if (entries.length() == 0) {
+		return true;
+	}
+
+	int fd = this->openLocked();
+	if (fd == -1) {
+		return false;
+	}
+	const char* data = entries.data();
+	std::size_t left = entries.length();
+	long int written;
+	bool result = true;
+	while (left > 0) {
+		written = cunistd::write(fd, data, left);
+		if (written <= 0) {
+			if (written == -1 && errno == EINTR) continue;
+			this->log->error("Failed to append to journal " + this->path() + "! " + std::to_string(errno) + ": " + strerror(errno));
+			result = false;
+			break;
+		}
+		data += written;
+		left -= written;
+	}
+	cfcntl::lockf(fd, F_ULOCK, 0);
+	cunistd::close(fd);
+	return result;
+}
+
+/*
+ * Read valid entries of journal file
+ */
+long long int Journal::readFile(const std::string& path, std::vector<std::string>& records, long long int& size)
+{
+	size = 0;
+	std::ifstream f(path, std::ios::in | std::ios::binary);
+	if (!f.is_open()) {
+		return 0;
+	}
+	std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	size = content.length();
+
+	std::size_t begin = 0, end;
+	unsigned int crc;
+	while (begin < content.length()) {
+		end = content.find('\n', begin);
+		// Incomplete entry
+		if (end == std::string::npos || end - begin < 9) {
+			break;
+		}
+		crc = std::strtoul(content.substr(begin, 8).c_str(), NULL, 16);
+		if (crc != Journal::checksum(content.data() + begin + 8, end - begin - 8)) {
+			break;
+		}
+		records.push_back(content.substr(begin + 8, end - begin - 8));
+		begin = end + 1;
+	}
+	return begin;
+}
+
+/*
+ * Read records from rotated and current journal
+ */
+bool Journal::read(std::vector<std::string>& records)
+{
+	long long int valid, size;
+
+	// Left by interrupted compaction, older than current journal
+	valid = this->readFile(this->path() + ".old", records, size);
+	if (valid < size) {
+		this->log->warning("Journal " + this->path() + ".old contains invalid entries, ignoring last " + std::to_string(size - valid) + " byte(s)");
+	}
+
+	valid = this->readFile(this->path(), records, size);
+	if (valid < size) {
+		this->log->warning("Journal " + this->path() + " ends with incomplete or corrupted entry, discarding last " + std::to_string(size - valid) + " byte(s)");
+		if (cunistd::truncate(this->path().c_str(), valid) != 0) {
+			this->log->error("Failed to truncate journal " + this->path() + "! " + std::to_string(errno) + ": " + strerror(errno));
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Remove journal files
+ */
+bool Journal::reset()
+{
+	this->wait();
+	bool result = true;
+	if (cunistd::unlink((this->path() + ".old").c_str()) != 0 && errno != ENOENT) {
+		result = false;
+	}
+	if (cunistd::unlink(this->path().c_str()) != 0 && errno != ENOENT) {
+		result = false;
+	}
+	if (!result) {
+		this->log->error("Failed to remove journal " + this->path() + "! " + std::to_string(errno) + ": " + strerror(errno));
+	}
+	return result;
+}
+
+/*
+ * Start compaction in background thread if needed
+ */
+void Journal::compactIfNeeded(unsigned int interval)
+{
+	struct cstat::stat journalStat, snapshotStat;
+	time_t now;
+
+	if (this->compactionRunning) {
+		return;
+	}
+	if (this->compactor.joinable()) {
+		this->compactor.join();
+	}
+	time(&now);
+
+	// Old journal left by failed compaction is compacted without rotating current one
+	if (cstat::stat((this->path() + ".old").c_str(), &journalStat) != 0) {
+		if (cstat::stat(this->path().c_str(), &journalStat) != 0 || journalStat.st_size == 0) {
+			this->lastCompaction = now;
+			return;
+		}
+		// Journal larger than snapshot (at least 1MiB) is compacted without waiting for interval
+		long long int sizeLimit = 1048576;
+		if (cstat::stat(this->snapshotPath.c_str(), &snapshotStat) == 0 && snapshotStat.st_size > sizeLimit) {
+			sizeLimit = snapshotStat.st_size;
+		}
+		if ((interval == 0 || now - this->lastCompaction < interval) && journalStat.st_size <= sizeLimit) {
+			return;
+		}
+
+		// Rotate journal, lock so that no other process is in the middle of append
+		int fd = this->openLocked();
+		if (fd == -1) {
+			return;
+		}
+		if (std::rename(this->path().c_str(), (this->path() + ".old").c_str()) != 0) {
+			this->log->error("Failed to rotate journal " + this->path() + "! " + std::to_string(errno) + ": " + strerror(errno));
+			cunistd::close(fd);
+			this->lastCompaction = now;
+			return;
+		}
+		cunistd::close(fd);
+	}
+
+	this->lastCompaction = now;
+	this->compactionRunning = true;
+	this->compactor = std::thread(&Journal::compact, this, this->snapshotPath);
+}
+
+/*
+ * Merge snapshot and rotated journal into new snapshot
+ */
+void Journal::compact(std::string snapshotPath)
+{
+	std::map<std::string, std::string> records;
+	std::vector<std::string> entries;
+	std::vector<std::string>::iterator it;
+	std::string line, key;
+	std::string journalPath = snapshotPath + ".journal.old";
+	std::string tmpPath = snapshotPath + ".tmp";
+	long long int valid, size;
+
+	this->log->debug("Compacting datafile " + snapshotPath + " with journal " + journalPath);
+
+	// Snapshot
+	std::ifstream snapshot(snapshotPath);
+	while (std::getline(snapshot, line)) {
+		if (line.length() == 0 || line[0] == 'r') continue;
+		key = Journal::recordKey(line);
+		if (key.length() > 0) {
+			records[key] = line;
+		}
+	}
+	snapshot.close();
+
+	// Journal entries in order they were appended
+	valid = this->readFile(journalPath, entries, size);
+	if (valid < size) {
+		this->log->warning("Journal " + journalPath + " contains invalid entries, ignoring last " + std::to_string(size - valid) + " byte(s)");
+	}
+	for (it = entries.begin(); it != entries.end(); ++it) {
+		key = Journal::recordKey(*it);
+		if (key.length() == 0) continue;
+		if ((*it)[0] == 'r') {
+			records.erase(key);
+		} else {
+			records[key] = *it;
+		}
+	}
+
+	// Write new snapshot
+	std::string content;
+	std::map<std::string, std::string>::iterator itr;
+	for (itr = records.begin(); itr != records.end(); ++itr) {
+		content += itr->second;
+		content += '\n';
+	}
+	bool result = false;
+	int fd = cfcntl::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd != -1) {
+		const char* data = content.data();
+		std::size_t left = content.length();
+		long int written = 0;
+		while (left > 0) {
+			written = cunistd::write(fd, data, left);
+			if (written <= 0) {
+				if (written == -1 && errno == EINTR) continue;
+				break;
+			}
+			data += written;
+			left -= written;
+		}
+		// Snapshot must be on disk before journal is removed
+		result = left == 0 && cunistd::fsync(fd) == 0;
+		cunistd::close(fd);
+	}
+	if (result && std::rename(tmpPath.c_str(), snapshotPath.c_str()) != 0) {
+		result = false;
+	}
+
+	if (result) {
+		cunistd::unlink(journalPath.c_str());
+		this->log->info("Datafile compacted, " + std::to_string(entries.size()) + " journal entries merged into " + std::to_string(records.size()) + " record(s)");
+	} else {
+		this->log->error("Datafile compaction failed! " + std::to_string(errno) + ": " + strerror(errno));
+		cunistd::unlink(tmpPath.c_str());
+	}
+
+	this->compactionRunning = false;
+}
+
+/*
+ * Wait for running compaction to finish
+ */
+void Journal::wait()
+{
+	if (this->compactor.joinable()) {
+		this->compactor.join();
+	}
+}
+
+/*
+ * Key of record, records are ordered by key as in datafile (addresses, log files, AbuseIPDB blacklist, sync bookmark)
+ */
+std::string Journal::recordKey(const std::string& record)
+{
+	// Removed records have type after "r"
+	std::size_t pos = 1;
+	char type = record[0];
+	if (type == 'r') {
+		if (record.length() < 2) return "";
+		type = record[1];
+		pos = 2;
+	}
+	if (type == 'd' && record.length() >= pos + 39) {
+		return "0" + hb::Util::ltrim(record.substr(pos, 39));
+	} else if (type == 'f') {
+		if (pos == 1) pos = 102;
+		if (record.length() <= pos) return "";
+		return "1" + hb::Util::rtrim(hb::Util::ltrim(record.substr(pos)));
+	} else if (type == 'a' && record.length() >= pos + 39) {
+		return "2" + hb::Util::ltrim(record.substr(pos, 39));
+	} else if (type == 's') {
+		return "3";
+	}
+	return "";
+}
+
+/*
+ * CRC-32 (IEEE 802.3)
+ */
+unsigned int Journal::checksum(const char* data, std::size_t length)
+{
+	unsigned int crc = 0xffffffffu;
+	for (std::size_t i = 0; i < length; ++i) {
+		crc = crcTable.values[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc ^ 0xffffffffu;
+}
@@ -0,0 +1,130 @@
+/*
+ * Append-only journal of datafile changes (datafile.engine = journal)
+ *
+ * Datafile is used as snapshot, changed records are appended to journal file
+ * next to it, so that each update is sequential write. Background thread
+ * periodically merges snapshot and journal into new snapshot.
+ */
+
+#ifndef HBJOURNAL_H
+#define HBJOURNAL_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Thread
+#include <thread>
+// Atomic
+#include <atomic>
+// Logger
+#include "logger.h"
+
+namespace hb{
+
+class Journal{
+	private:
+
+		/*
+		 * Logger object
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Snapshot (datafile) path, journal is <snapshot>.journal, journal being compacted is <snapshot>.journal.old
+		 */
+		std::string snapshotPath;
+
+		/*
+		 * Background compaction
+		 */
+		std::thread compactor;
+		std::atomic<bool> compactionRunning;
+		time_t lastCompaction = 0;
+
+		/*
+		 * Open and lock journal for appending (create if needed), returns -1 on failure
+		 * Journal is opened for each append, so that appends of other processes are not lost when journal is rotated
+		 */
+		int openLocked();
+
+		/*
+		 * Merge snapshot and rotated journal into new snapshot, runs in background thread
+		 */
+		void compact(std::string snapshotPath);
+
+		/*
+		 * Read valid entries of journal file, entries after first invalid one (torn write) are ignored
+		 * Returns offset after last valid entry, size is set to file size (0 if file does not exist)
+		 */
+		long long int readFile(const std::string& path, std::vector<std::string>& records, long long int& size);
+
+		/*
+		 * Key of record - record type and address or log file path, empty for records without key
+		 */
+		static std::string recordKey(const std::string& record);
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		Journal(hb::Logger* log);
+
+		/*
+		 * Destructor, waits for compaction to finish
+		 */
+		~Journal();
+
+		/*
+		 * Set snapshot path, journal is kept next to it
+		 */
+		void setPath(const std::string& snapshotPath);
+
+		/*
+		 * Journal file path
+		 */
+		std::string path() const;
+
+		/*
+		 * Whether journal exists (also rotated one left by interrupted compaction)
+		 */
+		bool exists() const;
+
+		/*
+		 * Append records (datafile lines, each ending with new line) with single write, each record gets checksum
+		 */
+		bool append(const std::string& records);
+
+		/*
+		 * Read records from rotated and current journal in order they were appended
+		 * Torn tail of current journal (partially written entry or checksum mismatch) is cut off
+		 */
+		bool read(std::vector<std::string>& records);
+
+		/*
+		 * Remove journal files after all records are written to new snapshot
+		 */
+		bool reset();
+
+		/*
+		 * Start compaction in background thread if interval has passed or journal has grown larger than snapshot
+		 * Journal is rotated before thread is started, so appends can continue during compaction
+		 */
+		void compactIfNeeded(unsigned int interval);
+
+		/*
+		 * Wait for running compaction to finish
+		 */
+		void wait();
+
+		/*
+		 * Checksum of record
+		 */
+		static unsigned int checksum(const char* data, std::size_t length);
+
+};
+
+}
+
+#endif
@@ -1,16 +1,25 @@
 /*
  * Log file parser, match patterns with lines in log files
  *
+ * Log files are independent of each other, so each check is split in jobs (one per log file) which are run
+ * on worker threads. Worker reads file and matches lines, found matches are collected as events. Events are
+ * handed over to calling thread in batches (after each read block) and applied to data as they arrive, so data
+ * is never accessed from workers, addresses are blocked while large log file is still being read and memory
+ * used for events does not grow with log size. Job keeps bookmark of its file, it is copied to log file only
+ * after last batch is applied, so bookmark in datafile never gets ahead of saved activity.
+ *
  * TODO Check out systemd-journald functions: sd_journal_get_cursor, sd_journal_seek_cursor, sd_journal_seek_head, sd_journal_test_cursor
  */
 
 // Standard input/output stream library (cin, cout, cerr, clog)
 #include <iostream>
-// File stream library (ifstream)
-#include <fstream>
 // Limits (HOST_NAME_MAX)
 #include <limits.h>
-// Miscellaneous UNIX symbolic constants, types and functions
+// C string (strerror)
+#include <cstring>
+// Algorithms (find)
+#include <algorithm>
+// Miscellaneous UNIX symbolic constants, types and functions (pread, close)
 namespace cunistd{
 	#include <unistd.h>
 }
@@ -20,14 +29,105 @@ namespace cstat{
 	#include <sys/types.h>
 	#include <sys/stat.h>
 }
+// File control (open)
+namespace cfcntl{
+	#include <fcntl.h>
+}
+// Directory entries (opendir, readdir)
+namespace cdirent{
+	#include <dirent.h>
+}
 // Util
 #include "util.h"
+// CPU budget
+#include "cpubudget.h"
+// Pattern set
+#include "patternset.h"
 // Header
 #include "logparser.h"
 
 // Hostblock namespace
 using namespace hb;
 
+// Size of block read from log file at once
+static const std::size_t kReadBlockSize = 1048576;
+
+// How many first bytes of log file are hashed for fingerprint
+static const unsigned int kFingerprintSize = 256;
+
+/*
+ * Fingerprint of log file - FNV-1a hash of first size bytes, false if file is shorter
+ */
+static bool fingerprint(int fd, unsigned int size, unsigned long long int& hash)
+{
+	unsigned char buffer[kFingerprintSize];
+	ssize_t bytesRead;
+	unsigned int i;
+
+	if (size > kFingerprintSize) {
+		return false;
+	}
+	do {
+		bytesRead = cunistd::pread(fd, buffer, size, 0);
+	} while (bytesRead < 0 && errno == EINTR);
+	if (bytesRead < 0 || (unsigned int)bytesRead != size) {
+		return false;
+	}
+	hash = 14695981039346656037ULL;
+	for (i = 0; i < size; ++i) {
+		hash ^= buffer[i];
+		hash *= 1099511628211ULL;
+	}
+	return true;
+}
+
+/*
+ * Whether file content starts with the same bytes as when fingerprint was saved
+ */
+static bool fingerprintMatches(int fd, const hb::LogFileJob& job)
+{
+	unsigned long long int hash = 0;
+	if (job.fingerprintSize == 0) {
+		return true;
+	}
+	return fingerprint(fd, job.fingerprintSize, hash) && hash == job.fingerprint;
+}
+
+/*
+ * Find rotated log file (renamed to path.1, path-20240101 and similar) by device and inode, empty string if not found
+ */
+static std::string findRotatedFile(const std::string& path, unsigned long long int device, unsigned long long int inode)
+{
+	std::string directory = ".", name = path, candidate, result = "";
+	std::size_t pos = path.find_last_of('/');
+	struct cstat::stat buffer;
+	cdirent::DIR* dir;
+	struct cdirent::dirent* entry;
+
+	if (pos != std::string::npos) {
+		directory = pos > 0 ? path.substr(0, pos) : "/";
+		name = path.substr(pos + 1);
+	}
+
+	dir = cdirent::opendir(directory.c_str());
+	if (dir == NULL) {
+		return result;
+	}
+	while ((entry = cdirent::readdir(dir)) != NULL) {
+		candidate = entry->d_name;
+		if (candidate.length() <= name.length() || candidate.compare(0, name.length(), name) != 0) {
+			continue;
+		}
+		candidate = directory + "/" + candidate;
+		if (cstat::stat(candidate.c_str(), &buffer) == 0 && (unsigned long long int)buffer.st_dev == device && (unsigned long long int)buffer.st_ino == inode) {
+			result = candidate;
+			break;
+		}
+	}
+	cdirent::closedir(dir);
+	return result;
+}
+
 /*
  * Constructor
  */
@@ -38,439 +138,897 @@ LogParser::LogParser(hb::Logger* log, hb::Config* config, hb::Data* data, std::q
 }
 
 /*
- * Check all configured log files for suspicious activity
+ * Destructor
+ */
+LogParser::~LogParser()
+{
+	this->closeFiles();
+}
+
+/*
+ * Number of workers, configured or one per CPU core
+ */
+unsigned int LogParser::workerCount() const
+{
+	unsigned int count = this->config->logThreads;
+	if (count == 0) {
+		count = std::thread::hardware_concurrency();
+	}
+	if (count == 0) {
+		count = 1;
+	}
+	return count;
+}
+
+/*
+ * Check configured log files for suspicious activity
  */
-void LogParser::checkFiles()
+void LogParser::checkFiles(const std::set<std::string>* paths)
 {
 	this->log->debug("Checking log files for suspicious activity...");
 	std::vector<hb::LogGroup>::iterator itlg;
 	std::vector<hb::LogFile>::iterator itlf;
-	std::vector<hb::Pattern>::iterator itlp;
+	std::vector<hb::LogFileJob> deferred;
+	std::set<std::string> jobPaths;
+	std::vector<hb::LogEvent>::iterator itev;
+	std::size_t finished, i;
+	unsigned int threads;
+
+	time(&this->currentTime);
+	this->currentTimeFormatted = Util::formatDateTime((const time_t)this->currentTime, this->config->dateTimeFormat.c_str());
+	this->keepLines = this->config->abuseipdbKey.size() > 0;
+
+	// Create job for each log file
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+			if (paths != nullptr && paths->count(itlf->path) == 0) {
+				continue;
+			}
+			hb::LogFileJob job;
+			job.itlg = itlg;
+			job.itlf = itlf;
+			job.bookmark = itlf->bookmark;
+			job.size = itlf->size;
+			job.device = itlf->device;
+			job.inode = itlf->inode;
+			job.fingerprint = itlf->fingerprint;
+			job.fingerprintSize = itlf->fingerprintSize;
+			// Same file in several log groups shares open file, such jobs are not run at the same time
+			if (jobPaths.insert(itlf->path).second) {
+				this->jobs.push_back(job);
+			} else {
+				deferred.push_back(job);
+			}
+		}
+	}
+
+	while (this->jobs.size() > 0) {
+		// Open files are created here, map is not changed while workers run
+		for (i = 0; i < this->jobs.size(); ++i) {
+			this->jobs[i].index = i;
+			this->jobs[i].openFile = &this->openFiles[this->jobs[i].itlf->path];
+		}
+
+		// Pool starts with one worker per job, backfill adds workers up to pool size
+		this->poolSize = this->workerCount();
+		threads = this->poolSize;
+		if (threads > this->jobs.size()) {
+			threads = this->jobs.size();
+		}
+		if (this->readBuffers.size() < this->poolSize) {
+			this->readBuffers.resize(this->poolSize);
+		}
+		this->nextJob = 0;
+		this->checkedJobs = 0;
+
+		// Even single worker runs on its own thread, calling thread applies events while file is read
+		this->log->debug("Checking " + std::to_string(this->jobs.size()) + " log files with " + std::to_string(threads) + " workers");
+		this->jobsMutex.lock();
+		for (i = 0; i < threads; ++i) {
+			this->workers.push_back(std::thread(&LogParser::worker, this, i));
+		}
+		this->jobsMutex.unlock();
+
+		// Apply events as they are handed over, job is finished with its last batch
+		for (finished = 0; finished < this->jobs.size();) {
+			std::unique_lock<std::mutex> lock(this->jobsMutex);
+			this->jobsCondition.wait(lock, [this]{ return !this->batches.empty(); });
+			hb::LogEventBatch batch = std::move(this->batches.front());
+			this->batches.pop();
+			lock.unlock();
+			for (itev = batch.events.begin(); itev != batch.events.end(); ++itev) {
+				this->applyEvent(this->jobs[batch.jobIndex].itlg, *itev);
+			}
+			if (batch.last) {
+				this->applyJob(this->jobs[batch.jobIndex]);
+				++finished;
+			}
+		}
+
+		// All jobs are checked, so pool does not grow anymore
+		for (i = 0; i < this->workers.size(); ++i) {
+			this->workers[i].join();
+		}
+		this->workers.clear();
+
+		// Files that were closed by workers (rotation, errors)
+		for (std::map<std::string, hb::OpenLogFile>::iterator itof = this->openFiles.begin(); itof != this->openFiles.end();) {
+			if (itof->second.fd == -1) {
+				itof = this->openFiles.erase(itof);
+			} else {
+				++itof;
+			}
+		}
+
+		// Next round with jobs for files that were already checked in this round
+		this->jobs.clear();
+		jobPaths.clear();
+		std::vector<hb::LogFileJob> next;
+		for (i = 0; i < deferred.size(); ++i) {
+			deferred[i].bookmark = deferred[i].itlf->bookmark;
+			deferred[i].size = deferred[i].itlf->size;
+			deferred[i].device = deferred[i].itlf->device;
+			deferred[i].inode = deferred[i].itlf->inode;
+			deferred[i].fingerprint = deferred[i].itlf->fingerprint;
+			deferred[i].fingerprintSize = deferred[i].itlf->fingerprintSize;
+			if (jobPaths.insert(deferred[i].itlf->path).second) {
+				this->jobs.push_back(deferred[i]);
+			} else {
+				next.push_back(deferred[i]);
+			}
+		}
+		deferred.swap(next);
+	}
+}
+
+/*
+ * Worker of pool, reads chunks of running backfills and takes next job, hands over rest of job events as last batch
+ * Worker waits until all jobs are checked, as backfill of other job can still need it
+ * Each worker has its own read buffer, CPU budget is shared by all workers
+ */
+void LogParser::worker(std::size_t workerIndex)
+{
+	std::size_t jobIndex;
+	std::vector<char>& readBuffer = this->readBuffers[workerIndex];
+	hb::CpuBudget cpuBudget(this->config->logCpuLimit, this->config->logCpuWindow, &this->cpuAccount);
+	cpuBudget.start();
+
+	std::unique_lock<std::mutex> lock(this->jobsMutex);
+	while (this->checkedJobs < this->jobs.size()) {
+		// Chunks first, they hold back events of their log file
+		if (this->readChunk(lock, readBuffer, cpuBudget)) {
+			continue;
+		}
+		if (this->nextJob < this->jobs.size()) {
+			jobIndex = this->nextJob++;
+			lock.unlock();
+			this->checkFile(this->jobs[jobIndex], readBuffer, cpuBudget);
+			this->handOver(this->jobs[jobIndex], true);
+			lock.lock();
+			continue;
+		}
+		this->jobsCondition.wait(lock);
+	}
+}
+
+/*
+ * Hand over collected events of job to main thread
+ */
+void LogParser::handOver(hb::LogFileJob& job, bool last)
+{
+	hb::LogEventBatch batch;
+	batch.jobIndex = job.index;
+	batch.events.swap(job.events);
+	batch.last = last;
+
+	this->jobsMutex.lock();
+	this->batches.push(std::move(batch));
+	if (last) {
+		++this->checkedJobs;
+	}
+	this->jobsMutex.unlock();
+	this->jobsCondition.notify_all();
+}
+
+/*
+ * Check single log file for suspicious activity
+ * File is kept open between checks, if file at path is replaced (rotation), rest of old file is read before new one
+ */
+void LogParser::checkFile(hb::LogFileJob& job, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget)
+{
 	struct cstat::stat buffer;
 	unsigned long long int fileSize = 0;
-	unsigned long long int initialBookmark = 0;
-	std::string line;
-	std::string ipAddress, port;
-	std::smatch patternMatchResults;
-	time_t currentTime, lastInfo;
-	time(&currentTime);
-	lastInfo = currentTime;
-	unsigned long long int jobTotal = 0, jobDone = 0;
+	unsigned long long int chunkSize = 0;
+	unsigned int fingerprintSize;
+	std::string rotatedPath;
+	int rotatedFd;
+	hb::OpenLogFile& openFile = *job.openFile;
+	const std::string& path = job.itlf->path;
+
+	this->log->debug("Checking log file: " + path);
+	time(&job.lastInfo);
+
+	if (cstat::stat(path.c_str(), &buffer) != 0) {
+		if (openFile.fd != -1) {
+			// File is moved away or removed, keep reading it until new file is created at path
+			this->log->debug("Log file " + path + " is moved or removed, reading old file until new one is created");
+			this->readLines(job, openFile.fd, false, readBuffer, cpuBudget);
+		} else {
+			this->log->error("Unable to open file " + path + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+		}
+		return;
+	}
+
+	// Log rotation check, file at path is different file than open one
+	if (openFile.fd != -1 && (openFile.device != buffer.st_dev || openFile.inode != buffer.st_ino)) {
+		this->log->info("Log file " + path + " is rotated, reading rest of old file...");
+		this->readLines(job, openFile.fd, true, readBuffer, cpuBudget);
+		cunistd::close(openFile.fd);
+		openFile.fd = -1;
+		job.bookmark = 0;
+		job.size = 0;
+		job.fingerprintSize = 0;
+		job.reset = true;
+	}
+
+	// Log rotation check on first check after start, file at path is different file than one in datafile
+	if (openFile.fd == -1 && job.inode != 0 && job.bookmark > 0 && (job.device != (unsigned long long int)buffer.st_dev || job.inode != (unsigned long long int)buffer.st_ino)) {
+		rotatedPath = findRotatedFile(path, job.device, job.inode);
+		rotatedFd = -1;
+		if (rotatedPath.length() > 0) {
+			rotatedFd = cfcntl::open(rotatedPath.c_str(), O_RDONLY | O_CLOEXEC);
+		}
+		if (rotatedFd != -1 && fingerprintMatches(rotatedFd, job)) {
+			this->log->info("Log file " + path + " was rotated to " + rotatedPath + ", reading rest of it...");
+			this->readLines(job, rotatedFd, true, readBuffer, cpuBudget);
+		} else {
+			this->log->warning("Log file " + path + " was rotated, but rotated file is not found, lines after last check might be lost!");
+		}
+		if (rotatedFd != -1) {
+			cunistd::close(rotatedFd);
+		}
+		job.bookmark = 0;
+		job.size = 0;
+		job.fingerprintSize = 0;
+		job.reset = true;
+	}
+
+	// Simple log rotation check (based on file size change)
+	fileSize = (intmax_t)buffer.st_size;
+	if (fileSize < job.size) {
+		job.bookmark = 0;
+		job.fingerprintSize = 0;
+		job.reset = true;
+		this->log->warning("Last known size reset for " + path);
+	}
+	this->log->debug("Current size: " + std::to_string(fileSize) + " Last known size: " + std::to_string(job.size));
+
+	// Open file, it stays open for next checks
+	if (openFile.fd == -1) {
+		openFile.fd = cfcntl::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (openFile.fd == -1) {
+			this->log->error("Unable to open file " + path + " for reading! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+			return;
+		}
+		openFile.device = buffer.st_dev;
+		openFile.inode = buffer.st_ino;
+	}
+
+	// File with the same inode, but different first bytes - truncated and written again (copytruncate) before size was checked
+	if (job.bookmark > 0 && !fingerprintMatches(openFile.fd, job)) {
+		this->log->warning("Log file " + path + " is rewritten, reading it from beginning");
+		job.bookmark = 0;
+		job.fingerprintSize = 0;
+		job.reset = true;
+	}
+
+	// File identity for datafile, fingerprint grows until it covers kFingerprintSize bytes
+	job.device = buffer.st_dev;
+	job.inode = buffer.st_ino;
+	if (job.fingerprintSize < kFingerprintSize && fileSize > job.fingerprintSize) {
+		fingerprintSize = fileSize < kFingerprintSize ? (unsigned int)fileSize : kFingerprintSize;
+		if (fingerprint(openFile.fd, fingerprintSize, job.fingerprint)) {
+			job.fingerprintSize = fingerprintSize;
+		}
+	}
+
+	// Calculate total job to do
+	job.total = fileSize - job.bookmark;
+
+	// Large unread part (first start on existing log), split it in chunks for workers of pool
+	chunkSize = (unsigned long long int)this->config->logBackfillChunk * 1048576;
+	if (chunkSize > 0 && this->poolSize > 1 && fileSize > job.bookmark && fileSize - job.bookmark >= 2 * chunkSize) {
+		this->backfill(job, openFile.fd, fileSize, chunkSize, readBuffer, cpuBudget);
+	}
+
+	// Read new lines until end of file
+	this->readLines(job, openFile.fd, false, readBuffer, cpuBudget);
+	this->log->debug("Finished reading until end of file, pos: " + std::to_string(job.bookmark));
+
+	// Update last known file size
+	job.size = fileSize;
+}
+
+/*
+ * Read lines from bookmark until end of file
+ * File is read in large blocks, lines are found with memchr and passed to matching without copying
+ * Bookmark is advanced by length of each processed line, incomplete last line (without new line character)
+ * is left for next check, unless file will not be read again (final)
+ * Events are handed over after each block, except in backfill chunk, which hands over when whole chunk is read
+ * With limit only lines starting before limit are read (limit must be at line start)
+ */
+void LogParser::readLines(hb::LogFileJob& job, int fd, bool final, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget, unsigned long long int limit)
+{
+	unsigned long long int initialBookmark = job.bookmark;
+	unsigned long long int jobDone = 0;
 	float jobPercentage = 0;
+	std::size_t carry = 0;// Bytes of incomplete line at the beginning of buffer
+	std::size_t readSize;
+	ssize_t bytesRead;
+	time_t now;
+	char* pos;
+	char* end;
+	char* newLine;
+
+	if (readBuffer.size() < kReadBlockSize) {
+		readBuffer.resize(kReadBlockSize);
+	}
+
+	while (true) {
+		// Read next block after incomplete line from previous block
+		readSize = readBuffer.size() - carry;
+		if (limit - (job.bookmark + carry) < readSize) {
+			readSize = limit - (job.bookmark + carry);
+		}
+		bytesRead = cunistd::pread(fd, readBuffer.data() + carry, readSize, (off_t)(job.bookmark + carry));
+		if (bytesRead < 0) {
+			if (errno == EINTR) continue;
+			this->log->error("Failed to read log file " + job.itlf->path + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+			break;
+		}
+		if (bytesRead == 0) {
+			break;
+		}
+
+		pos = readBuffer.data();
+		end = pos + carry + bytesRead;
+		while ((newLine = (char*)memchr(pos, '\n', end - pos)) != nullptr) {
+
+			this->processLine(job, pos, newLine);
+
+			// Update bookmark
+			job.bookmark += (newLine - pos) + 1;
+			pos = newLine + 1;
+
+			// TODO Respond on daemon main loop quit request
+
+			// Stay within CPU budget
+			cpuBudget.tick();
+		}
+
+		// Move incomplete line to the beginning of buffer, if line does not fit in buffer, make buffer bigger
+		carry = end - pos;
+		if (carry == readBuffer.size()) {
+			readBuffer.resize(readBuffer.size() * 2);
+		} else if (carry > 0) {
+			memmove(readBuffer.data(), pos, carry);
+		}
+
+		// Let main thread save activity found in this block
+		if (!job.part && job.events.size() > 0) {
+			this->handOver(job, false);
+		}
+
+		// Output some info to log file each min
+		time(&now);
+		if (now - job.lastInfo >= 60 && job.total > 0) {
+			jobDone = job.bookmark - initialBookmark;
+			jobPercentage = (float)jobDone * 100 / (float)job.total;
+			this->log->info("Processing " + job.itlf->path + ", progress: " + std::to_string(jobPercentage) + "%");
+			job.lastInfo = now;
+		}
+	}
+
+	// Line without new line at the end of file, writer might not be finished with it yet
+	if (final && carry > 0) {
+		this->processLine(job, readBuffer.data(), readBuffer.data() + carry);
+		job.bookmark += carry;
+		if (!job.part && job.events.size() > 0) {
+			this->handOver(job, false);
+		}
+	}
+}
+
+/*
+ * Find start of first line at or after offset
+ */
+unsigned long long int LogParser::alignToLine(int fd, unsigned long long int offset, unsigned long long int limit)
+{
+	char buffer[4096];
+	ssize_t bytesRead;
+	char* newLine;
+
+	// Offset is line start if previous character is new line
+	offset--;
+	while (offset < limit) {
+		bytesRead = cunistd::pread(fd, buffer, sizeof(buffer), (off_t)offset);
+		if (bytesRead < 0 && errno == EINTR) continue;
+		if (bytesRead <= 0) break;
+		newLine = (char*)memchr(buffer, '\n', bytesRead);
+		if (newLine != nullptr) {
+			offset += (newLine - buffer) + 1;
+			return offset < limit ? offset : limit;
+		}
+		offset += bytesRead;
+	}
+	return limit;
+}
+
+/*
+ * Backfill - read unread part of file in chunks in parallel
+ * Chunk boundaries are moved to line starts, chunks are read by workers of pool (this one, idle ones and new ones while
+ * pool is smaller than log.threads), so count of threads does not grow with count of backfilled files. Chunks are
+ * taken in file order, at most pool size ahead of first chunk that is not handed over, events of chunk are handed over
+ * as soon as it and all chunks before it are read, so data sees events in the same order as with sequential read and
+ * memory for events is bounded. Bookmark in datafile is updated after job is finished, so if daemon is stopped in
+ * the middle, backfill starts from the beginning next time.
+ */
+void LogParser::backfill(hb::LogFileJob& job, int fd, unsigned long long int fileSize, unsigned long long int chunkSize, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget)
+{
+	hb::Backfill backfill;
+	unsigned long long int length = fileSize - job.bookmark;
+	unsigned long long int begin = job.bookmark;
+
+	// Line aligned chunks, last one takes the rest (less than two chunks)
+	backfill.job = &job;
+	backfill.fd = fd;
+	while (begin < fileSize) {
+		hb::BackfillChunk chunk;
+		chunk.part.index = job.index;
+		chunk.part.itlg = job.itlg;
+		chunk.part.itlf = job.itlf;
+		chunk.part.bookmark = begin;
+		chunk.part.part = true;// No progress info from chunks (total is 0)
+		chunk.limit = fileSize - begin >= 2 * chunkSize ? this->alignToLine(fd, begin + chunkSize, fileSize) : fileSize;
+		begin = chunk.limit;
+		backfill.chunks.push_back(std::move(chunk));
+	}
+
+	this->log->info("Backfilling " + std::to_string(length) + " bytes of " + job.itlf->path + " in " + std::to_string(backfill.chunks.size()) + " chunks...");
+
+	std::unique_lock<std::mutex> lock(this->jobsMutex);
+	this->backfills.push_back(&backfill);
+	while (this->workers.size() < this->poolSize && this->workers.size() < backfill.chunks.size()) {
+		this->workers.push_back(std::thread(&LogParser::worker, this, this->workers.size()));
+	}
+	this->jobsCondition.notify_all();
+
+	// Read chunks together with other workers until all chunks of this backfill are handed over
+	while (backfill.handedOver < backfill.chunks.size()) {
+		if (!this->readChunk(lock, readBuffer, cpuBudget)) {
+			this->jobsCondition.wait(lock);
+		}
+	}
+	this->backfills.erase(std::find(this->backfills.begin(), this->backfills.end(), &backfill));
+	lock.unlock();
+
+	this->log->info("Backfill of " + job.itlf->path + " finished, " + std::to_string(backfill.matches) + " matches");
+}
+
+/*
+ * Read next chunk of any running backfill, jobs mutex is unlocked while chunk is read
+ * Finished chunks are handed over in file order, after chunk that did not reach its end (read error) events are
+ * dropped, job bookmark stays at that chunk and rest of file is read again
+ */
+bool LogParser::readChunk(std::unique_lock<std::mutex>& lock, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget)
+{
+	std::vector<hb::Backfill*>::iterator itbf;
+	hb::Backfill* backfill = nullptr;
+	hb::BackfillChunk* chunk;
+
+	for (itbf = this->backfills.begin(); itbf != this->backfills.end(); ++itbf) {
+		if ((*itbf)->nextChunk < (*itbf)->chunks.size() && (*itbf)->nextChunk < (*itbf)->handedOver + this->poolSize) {
+			backfill = *itbf;
+			break;
+		}
+	}
+	if (backfill == nullptr) {
+		return false;
+	}
+
+	chunk = &backfill->chunks[backfill->nextChunk++];
+	lock.unlock();
+	this->readLines(chunk->part, backfill->fd, false, readBuffer, cpuBudget, chunk->limit);
+	lock.lock();
+	chunk->done = true;
+
+	while (backfill->handedOver < backfill->chunks.size() && backfill->chunks[backfill->handedOver].done) {
+		chunk = &backfill->chunks[backfill->handedOver++];
+		if (backfill->failed) {
+			chunk->part.events.clear();
+			continue;
+		}
+		backfill->job->prefilterHits += chunk->part.prefilterHits;
+		backfill->job->prefilterMisses += chunk->part.prefilterMisses;
+		backfill->job->bookmark = chunk->part.bookmark;
+		backfill->failed = chunk->part.bookmark != chunk->limit;
+		backfill->matches += chunk->part.events.size();
+		if (chunk->part.events.size() > 0) {
+			hb::LogEventBatch batch;
+			batch.jobIndex = chunk->part.index;
+			batch.events.swap(chunk->part.events);
+			this->batches.push(std::move(batch));
+		}
+	}
+	this->jobsCondition.notify_all();
+	return true;
+}
+
+/*
+ * Match line with patterns of log group, matches are collected as events
+ */
+void LogParser::processLine(hb::LogFileJob& job, const char* begin, const char* end)
+{
+	std::vector<hb::LogGroup>::iterator itlg = job.itlg;
+	hb::PatternMatch patternMatch;
+	int patternIndex = -1;
+	bool candidate = false, refusedCandidate = false;
+
+	// Patterns not compiled (Config::processPatterns not called)
+	if (!itlg->patternSet || !itlg->refusedPatternSet) {
+		return;
+	}
+
+	// Literal prefilter, skip regex if line does not contain any literal required by patterns
+	candidate = itlg->patternSet->candidate(begin, end);
+	refusedCandidate = itlg->refusedPatternSet->candidate(begin, end);
+	if (candidate || refusedCandidate) {
+		job.prefilterHits++;
+	} else {
+		job.prefilterMisses++;
+	}
+
+	for (int refused = 0; refused < 2; ++refused) {
+		if (!(refused ? refusedCandidate : candidate)) {
+			continue;
+		}
+
+		// Match patterns
+		patternIndex = -1;
+		try {
+
+			/*
+			 * Match line with all patterns of log group at once
+			 * Note, pattern set keeps track of regex groups to get IP address and port
+			 * http://www.cplusplus.com/reference/regex/ECMAScript/#groups
+			 */
+			patternIndex = (refused ? itlg->refusedPatternSet : itlg->patternSet)->match(begin, end, patternMatch);
+
+		} catch (std::regex_error& e) {
+			std::string message = e.what();
+			this->log->error(message + ": " + std::to_string(e.code()));
+			this->log->error(hb::Util::regexErrorCode2Text(e.code()));
+		}
+		if (patternIndex >= 0) {
+			hb::LogEvent event;
+			event.patternIndex = patternIndex;
+			event.refused = refused;
+			event.score = (refused ? itlg->refusedPatterns : itlg->patterns)[patternIndex].score;
+			event.address = patternMatch.address;
+			event.port = std::string(patternMatch.portBegin, patternMatch.portEnd);
+			if (this->keepLines) {
+				event.line = std::string(begin, end);
+			}
+			job.events.push_back(std::move(event));
+		}
+	}
+}
+
+/*
+ * Save bookmark of finished job, all its events are already applied
+ */
+void LogParser::applyJob(hb::LogFileJob& job)
+{
+	std::vector<hb::LogGroup>::iterator itlg = job.itlg;
+
+	// Prefilter effect for this check
+	itlg->prefilterHits += job.prefilterHits;
+	itlg->prefilterMisses += job.prefilterMisses;
+	if (job.prefilterHits > 0 || job.prefilterMisses > 0) {
+		this->log->debug("Log file " + job.itlf->path + " prefilter: " + std::to_string(job.prefilterHits) + " lines matched with regex, " + std::to_string(job.prefilterMisses) + " lines skipped");
+	}
+
+	// Update datafile
+	if (job.reset || job.bookmark != job.itlf->bookmark || job.device != job.itlf->device || job.inode != job.itlf->inode || job.fingerprintSize != job.itlf->fingerprintSize) {
+		job.itlf->bookmark = job.bookmark;
+		job.itlf->size = job.size;
+		job.itlf->device = job.device;
+		job.itlf->inode = job.inode;
+		job.itlf->fingerprint = job.fingerprint;
+		job.itlf->fingerprintSize = job.fingerprintSize;
+		this->data->saveBookmark(job.itlf->path);
+	} else {
+		job.itlf->size = job.size;
+	}
+}
+
+/*
+ * Save activity of single event and enqueue report about it
+ */
+void LogParser::applyEvent(std::vector<hb::LogGroup>::iterator itlg, const hb::LogEvent& event)
+{
+	std::vector<hb::Pattern>::iterator itlp;
+	std::string ipAddress, port;
+	hb::SuspiciosAddressType* record;
 	bool sendReport = false;
-	ReportToAbuseIPDB reportToSend;
 	std::vector<unsigned int> reportCategories;
 	std::string reportComment = "";
 	std::size_t posc;
-	std::map<std::string, hb::SuspiciosAddressType>::iterator itsa;
-	std::string currentTimeFormatted = Util::formatDateTime((const time_t)currentTime, this->config->dateTimeFormat.c_str());
 
-	// Loop log groups
-	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
-		this->log->debug("Checking log group: " + itlg->name);
+	// Address is already parsed, format it from binary form (IPv6 is compressed same as inet_ntop)
+	ipAddress = event.address.toString();
+	port = event.port;
 
-		// Loop log files in each group
-		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
-			this->log->debug("Checking log file: " + itlf->path);
-
-			// Simple log rotation check (based on file size change)
-			if (cstat::stat(itlf->path.c_str(), &buffer) == 0) {
-				fileSize = (intmax_t)buffer.st_size;
-				if (fileSize < itlf->size) {
-					itlf->bookmark = 0;
-					this->log->warning("Last known size reset for " + itlf->path);
-					this->data->updateFile(itlf->path);
+	if (!event.refused) {
+		itlp = itlg->patterns.begin() + event.patternIndex;
+
+		this->log->debug("Suspicious acitivity pattern match! Address: " + ipAddress + " Score: " + std::to_string(event.score));
+
+		// Update address data
+		this->data->saveActivity(ipAddress, event.score, 1, 0);
+
+		// Check whether need to send report about match
+		sendReport = false;
+		reportCategories.clear();
+		reportComment = "";
+		if (this->config->abuseipdbKey.size() > 0) {
+			// Need to send if have global setting
+			if (this->config->abuseipdbReportAll) {
+				sendReport = true;
+			}
+			reportCategories = this->config->abuseipdbDefaultCategories;
+			if (this->config->abuseipdbDefaultCommentIsSet) {
+				reportComment = this->config->abuseipdbDefaultComment;
+			}
+			// Log group setting overrides global setting
+			if (itlg->abuseipdbReport == Report::True) {
+				sendReport = true;
+			} else if (itlg->abuseipdbReport == Report::False) {
+				sendReport = false;
+			}
+			if (itlg->abuseipdbCategories.size() > 0) {
+				reportCategories = itlg->abuseipdbCategories;
+			}
+			if (itlg->abuseipdbCommentIsSet) {
+				reportComment = itlg->abuseipdbComment;
+			}
+			// Pattern setting overrides log group setting
+			if (itlp->abuseipdbReport == Report::True) {
+				sendReport = true;
+			} else if (itlp->abuseipdbReport == Report::False) {
+				sendReport = false;
+			}
+			if (itlp->abuseipdbCategories.size() > 0) {
+				reportCategories = itlp->abuseipdbCategories;
+			}
+			if (itlp->abuseipdbCommentIsSet) {
+				reportComment = itlp->abuseipdbComment;
+			}
+		}
+
+		// Do not report whitelisted addresses
+		record = this->data->suspiciousAddresses.find(event.address);
+		if (record != NULL && record->whitelisted) {
+			sendReport = false;
+		}
+
+		// Check whether 15 minutes are passed since last report
+		// TODO implement config parameter and use 15 minutes as min with default 1h
+		if (sendReport) {
+			if (record != NULL) {
+				if (this->currentTime - record->lastReported < 900) {
+					this->log->debug("Not enqueuing report about " + ipAddress + " more often than each 15 minutes!");
+					sendReport = false;
+				} else {
+					record->lastReported = this->currentTime;
+					// this->data->updateAddress(ipAddress);
 				}
-				this->log->debug("Current size: " + std::to_string(fileSize) + " Last known size: " + std::to_string(itlf->size));
 			} else {
-				this->log->error("Unable to open file " + itlf->path + "! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
-				continue;
+				this->log->warning("Need to send report about address " + ipAddress + ", but data about it is not found in data file! Skipping!");
+				sendReport = false;
 			}
+		}
 
-			// Check log file
-			std::ifstream is(itlf->path, std::ifstream::binary);
-			if (is && is.is_open()) {
-				// Seek to last known position
-				is.seekg(itlf->bookmark, is.beg);
-
-				// For comparision after log check to see if bookmark has changed and datafile needs to be updated
-				initialBookmark = itlf->bookmark;
-
-				// Calculate total job to do
-				jobTotal = fileSize - initialBookmark;
-
-				// Read new lines until end of file
-				while (std::getline(is, line)) {
-
-					// Match patterns
-					for (itlp = itlg->patterns.begin(); itlp != itlg->patterns.end(); ++itlp) {
-						try {
-
-							/*
-							 * Match line with pattern
-							 * Note, using regex groups to get IP address and port
-							 * http://www.cplusplus.com/reference/regex/ECMAScript/#groups
-							 * Match results:
-							 *   index 0 - whole match
-							 *   index 1, 2 - IP address, port (optionally)
-							 */
-							if (std::regex_match(line, patternMatchResults, itlp->pattern)) {
-								if (patternMatchResults.size() > 1) {
-
-									// Handle address and port order in results
-									if (itlp->portSearch != -1 && patternMatchResults.size() > 2) {
-										if (itlp->portSearch == 1) {
-											// Port is after IP address
-											ipAddress = std::string(patternMatchResults[1]);
-											port = std::string(patternMatchResults[2]);
-										} else {
-											// Port is before IP address
-											ipAddress = std::string(patternMatchResults[2]);
-											port = std::string(patternMatchResults[1]);
-										}
-									} else {
-										ipAddress = std::string(patternMatchResults[1]);
-									}
-
-									if (ipAddress.find(':') != std::string::npos) {
-										ipAddress = hb::Util::ip6Format(ipAddress);
-									}
-
-									this->log->debug("Suspicious acitivity pattern match! Address: " + ipAddress + " Score: " + std::to_string(itlp->score));
-
-									// Update address data
-									this->data->saveActivity(ipAddress, itlp->score, 1, 0);
-
-									// Check whether need to send report about match
-									sendReport = false;
-									reportCategories.clear();
-									reportComment = "";
-									if (this->config->abuseipdbKey.size() > 0) {
-										// Need to send if have global setting
-										if (this->config->abuseipdbReportAll) {
-											sendReport = true;
-										}
-										reportCategories = this->config->abuseipdbDefaultCategories;
-										if (this->config->abuseipdbDefaultCommentIsSet) {
-											reportComment = this->config->abuseipdbDefaultComment;
-										}
-										// Log group setting overrides global setting
-										if (itlg->abuseipdbReport == Report::True) {
-											sendReport = true;
-										} else if (itlg->abuseipdbReport == Report::False) {
-											sendReport = false;
-										}
-										if (itlg->abuseipdbCategories.size() > 0) {
-											reportCategories = itlg->abuseipdbCategories;
-										}
-										if (itlg->abuseipdbCommentIsSet) {
-											reportComment = itlg->abuseipdbComment;
-										}
-										// Pattern setting overrides log group setting
-										if (itlp->abuseipdbReport == Report::True) {
-											sendReport = true;
-										} else if (itlp->abuseipdbReport == Report::False) {
-											sendReport = false;
-										}
-										if (itlp->abuseipdbCategories.size() > 0) {
-											reportCategories = itlp->abuseipdbCategories;
-										}
-										if (itlp->abuseipdbCommentIsSet) {
-											reportComment = itlp->abuseipdbComment;
-										}
-									}
-
-									// Do not report whitelisted addresses
-									if (this->data->suspiciousAddresses.count(ipAddress) > 0 && this->data->suspiciousAddresses[ipAddress].whitelisted) {
-										sendReport = false;
-									}
-
-									// Check whether 15 minutes are passed since last report
-									// TODO implement config parameter and use 15 minutes as min with default 1h
-									if (sendReport) {
-										if (this->data->suspiciousAddresses.count(ipAddress) > 0) {
-											if (currentTime - this->data->suspiciousAddresses[ipAddress].lastReported < 900) {
-												this->log->debug("Not enqueuing report about " + ipAddress + " more often than each 15 minutes!");
-												sendReport = false;
-											} else {
-												this->data->suspiciousAddresses[ipAddress].lastReported = currentTime;
-												// this->data->updateAddress(ipAddress);
-											}
-										} else {
-											this->log->warning("Need to send report about address " + ipAddress + ", but data about it is not found in data file! Skipping!");
-											sendReport = false;
-										}
-									}
-
-									// Search for %i, %p and %m placeholders in comment and replace with data if needed
-									if (sendReport) {
-										posc = reportComment.find("%i");
-										if (posc != std::string::npos) {
-											reportComment = reportComment.replace(posc, 2, ipAddress);
-										}
-										posc = reportComment.find("%p");
-										if (posc != std::string::npos) {
-											if (itlp->portSearch) {
-												reportComment = reportComment.replace(posc, 2, port);
-											} else {
-												this->log->warning("Comment template contains port placeholder, but port is not found in matched line! Adjust pattern or comment to avoid this warning!");
-											}
-										}
-										posc = reportComment.find("%m");
-										if (posc != std::string::npos) {
-											reportComment = reportComment.replace(posc, 2, line);
-										}
-										posc = reportComment.find("%d");
-										if (posc != std::string::npos) {
-											reportComment = reportComment.replace(posc, 2, currentTimeFormatted);
-										}
-									}
-
-									// Strip comment to 1500 characters
-									if (sendReport) {
-										if (reportComment.length() > 1500) {
-											reportComment = reportComment.substr(0, 1500);
-											this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
-										}
-									}
-
-									// Put report into queue for sending to AbuseIPDB
-									if (sendReport) {
-										ReportToAbuseIPDB reportToSend;
-										reportToSend.ip = ipAddress;
-										reportToSend.categories = reportCategories;
-										reportToSend.comment = reportComment;
-										this->abuseipdbReportingQueueMutex->lock();
-										this->abuseipdbReportingQueue->push(reportToSend);
-										this->abuseipdbReportingQueueMutex->unlock();
-										this->log->debug("Information about " + ipAddress + " is put into queue for sending to AbuseIPDB...");
-									}
-
-									this->log->debug("Match with pattern: " + itlp->patternString);
-
-									// Line matched with suspicious activity pattern, break the loop
-									break;
-								}
-
-							}
-
-						} catch (std::regex_error& e) {
-							std::string message = e.what();
-							this->log->error(message + ": " + std::to_string(e.code()));
-							this->log->error(hb::Util::regexErrorCode2Text(e.code()));
-						}
-					}
+		// Search for %i, %p and %m placeholders in comment and replace with data if needed
+		if (sendReport) {
+			posc = reportComment.find("%i");
+			if (posc != std::string::npos) {
+				reportComment = reportComment.replace(posc, 2, ipAddress);
+			}
+			posc = reportComment.find("%p");
+			if (posc != std::string::npos) {
+				if (itlp->portSearch) {
+					reportComment = reportComment.replace(posc, 2, port);
+				} else {
+					this->log->warning("Comment template contains port placeholder, but port is not found in matched line! Adjust pattern or comment to avoid this warning!");
+				}
+			}
+			posc = reportComment.find("%m");
+			if (posc != std::string::npos) {
+				reportComment = reportComment.replace(posc, 2, event.line);
+			}
+			posc = reportComment.find("%d");
+			if (posc != std::string::npos) {
+				reportComment = reportComment.replace(posc, 2, this->currentTimeFormatted);
+			}
+		}
 
-					// Check refused patterns
-					for (itlp = itlg->refusedPatterns.begin(); itlp != itlg->refusedPatterns.end(); ++itlp) {
-						try {
-
-							/*
-							 * Match line with pattern
-							 * Note, using regex groups to get IP address and port
-							 * http://www.cplusplus.com/reference/regex/ECMAScript/#groups
-							 * Match results:
-							 *   index 0 - whole match
-							 *   index 1, 2 - IP address, port (optional)
-							 */
-							if (std::regex_match(line, patternMatchResults, itlp->pattern)) {
-								if (patternMatchResults.size() > 1) {
-
-									// Handle address and port order in results
-									if (itlp->portSearch != -1 && patternMatchResults.size() > 2) {
-										if (itlp->portSearch == 1) {
-											// Port is after IP address
-											ipAddress = std::string(patternMatchResults[1]);
-											port = std::string(patternMatchResults[2]);
-										} else {
-											// Port is before IP address
-											ipAddress = std::string(patternMatchResults[2]);
-											port = std::string(patternMatchResults[1]);
-										}
-									} else {
-										ipAddress = std::string(patternMatchResults[1]);
-									}
-
-									if (ipAddress.find(':') != std::string::npos) {
-										ipAddress = hb::Util::ip6Format(ipAddress);
-									}
-
-									this->log->debug("Blocked access pattern match! Address: " + ipAddress + " Score: " + std::to_string(itlp->score));
-
-									// Update address data
-									if (this->data->suspiciousAddresses.count(ipAddress) > 0 || this->data->abuseIPDBBlacklist.count(ipAddress) > 0) {
-										this->data->saveActivity(ipAddress, itlp->score, 0, 1);
-
-										// Check whether need to send report about match
-										sendReport = false;
-										reportCategories.clear();
-										reportComment = "";
-										if (this->config->abuseipdbKey.size() > 0) {
-											// Need to send if have global setting
-											if (this->config->abuseipdbReportAll) {
-												sendReport = true;
-											}
-											reportCategories = this->config->abuseipdbDefaultCategories;
-											if (this->config->abuseipdbDefaultCommentIsSet) {
-												reportComment = this->config->abuseipdbDefaultComment;
-											}
-											// Log group setting overrides global setting
-											if (itlg->abuseipdbReport == Report::True) {
-												sendReport = true;
-											} else if (itlg->abuseipdbReport == Report::False) {
-												sendReport = false;
-											}
-											if (itlg->abuseipdbCategories.size() > 0) {
-												reportCategories = itlg->abuseipdbCategories;
-											}
-											if (itlg->abuseipdbCommentIsSet) {
-												reportComment = itlg->abuseipdbComment;
-											}
-											// Pattern setting overrides log group setting
-											if (itlp->abuseipdbReport == Report::True) {
-												sendReport = true;
-											} else if (itlp->abuseipdbReport == Report::False) {
-												sendReport = false;
-											}
-											if (itlp->abuseipdbCategories.size() > 0) {
-												reportCategories = itlp->abuseipdbCategories;
-											}
-											if (itlp->abuseipdbCommentIsSet) {
-												reportComment = itlp->abuseipdbComment;
-											}
-										}
-
-										// Do not report whitelisted addresses
-										if (this->data->suspiciousAddresses.count(ipAddress) > 0 && this->data->suspiciousAddresses[ipAddress].whitelisted) {
-											sendReport = false;
-										}
-
-										// Check whether 15 minutes are passed since last report
-										// TODO implement config parameter and use 15 minutes as min with default 1h
-										if (sendReport) {
-											if (this->data->suspiciousAddresses.count(ipAddress) > 0) {
-												if (currentTime - this->data->suspiciousAddresses[ipAddress].lastReported < 900) {
-													this->log->debug("Not enqueuing report about " + ipAddress + " more often than each 15 minutes!");
-													sendReport = false;
-												} else {
-													this->data->suspiciousAddresses[ipAddress].lastReported = currentTime;
-													// this->data->updateAddress(ipAddress);
-												}
-											} else {
-												this->log->warning("Need to send report about address " + ipAddress + ", but data about it is not found in data file! Skipping!");
-												sendReport = false;
-											}
-										}
-
-										// Search for %i, %p and %m placeholders in comment and replace with data if needed
-										if (sendReport) {
-											posc = reportComment.find("%i");
-											if (posc != std::string::npos) {
-												reportComment = reportComment.replace(posc, 2, ipAddress);
-											}
-											posc = reportComment.find("%p");
-											if (posc != std::string::npos) {
-												if (itlp->portSearch) {
-													reportComment = reportComment.replace(posc, 2, port);
-												} else {
-													this->log->warning("Comment template contains port placeholder, but port is not found in matched line! Adjust pattern or comment to avoid this warning!");
-												}
-											}
-											posc = reportComment.find("%m");
-											if (posc != std::string::npos) {
-												reportComment = reportComment.replace(posc, 2, line);
-											}
-											posc = reportComment.find("%d");
-											if (posc != std::string::npos) {
-												reportComment = reportComment.replace(posc, 2, currentTimeFormatted);
-											}
-										}
-
-										// Strip comment to 1500 characters
-										if (sendReport) {
-											if (reportComment.length() > 1500) {
-												reportComment = reportComment.substr(0, 1500);
-												this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
-											}
-										}
-
-										// Put report into queue for sending to AbuseIPDB
-										if (sendReport) {
-											ReportToAbuseIPDB reportToSend;
-											reportToSend.ip = ipAddress;
-											reportToSend.categories = reportCategories;
-											reportToSend.comment = reportComment;
-											this->abuseipdbReportingQueueMutex->lock();
-											this->abuseipdbReportingQueue->push(reportToSend);
-											this->abuseipdbReportingQueueMutex->unlock();
-											this->log->debug("Information about " + ipAddress + " is put into queue for sending to AbuseIPDB...");
-										}
-									} else {
-										this->log->warning(ipAddress + " matched blocked access pattern, but no previous information about suspicious activity, skipping...");
-									}
-
-									this->log->debug("Match with pattern: " + itlp->patternString);
-
-									// Line matched with blocked access pattern, break the loop
-									break;
-								}
-
-							}
-
-						} catch (std::regex_error& e) {
-							std::string message = e.what();
-							this->log->error(message + ": " + std::to_string(e.code()));
-							this->log->error(hb::Util::regexErrorCode2Text(e.code()));
-						}
-					}
+		// Strip comment to 1500 characters
+		if (sendReport) {
+			if (reportComment.length() > 1500) {
+				reportComment = reportComment.substr(0, 1500);
+				this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
+			}
+		}
 
-					// Update bookmark
-					itlf->bookmark = is.tellg();
-
-					// TODO Check log rotation after each 500 lines (this process can be long running)
-					// if (cstat::stat(itlf->path.c_str(), &buffer) == 0) {
-
-					// }
-
-					// TODO Respond on daemon main loop quit request
-					// if (!running) {
-					// 	// Update datafile
-					// 	if (initialBookmark != itlf->bookmark) {
-					// 		this->data->updateFile(itlf->path);
-					// 	}
-					// 	// Break the loop
-					// 	break;
-					// }
-
-					// Sleep
-					cunistd::usleep(10);
-
-					// Output some info to log file each min
-					time(&currentTime);
-					if (currentTime - lastInfo >= 60) {
-						jobDone = itlf->bookmark - initialBookmark;
-						jobPercentage = (float)jobDone * 100 / (float)jobTotal;
-						this->log->info("Processing " + itlf->path + ", progress: " + std::to_string(jobPercentage) + "%");
-						lastInfo = currentTime;
-					}
+		// Put report into queue for sending to AbuseIPDB
+		if (sendReport) {
+			ReportToAbuseIPDB reportToSend;
+			reportToSend.ip = ipAddress;
+			reportToSend.categories = reportCategories;
+			reportToSend.comment = reportComment;
+			this->abuseipdbReportingQueueMutex->lock();
+			this->abuseipdbReportingQueue->push(reportToSend);
+			this->abuseipdbReportingQueueMutex->unlock();
+			this->log->debug("Information about " + ipAddress + " is put into queue for sending to AbuseIPDB...");
+		}
+
+		this->log->debug("Match with pattern: " + itlp->patternString);
+	} else {
+		itlp = itlg->refusedPatterns.begin() + event.patternIndex;
+
+		this->log->debug("Blocked access pattern match! Address: " + ipAddress + " Score: " + std::to_string(event.score));
+
+		// Update address data
+		if (this->data->suspiciousAddresses.count(event.address) > 0 || this->data->abuseIPDBBlacklist.count(event.address) > 0) {
+			this->data->saveActivity(ipAddress, event.score, 0, 1);
+
+			// Check whether need to send report about match
+			sendReport = false;
+			reportCategories.clear();
+			reportComment = "";
+			if (this->config->abuseipdbKey.size() > 0) {
+				// Need to send if have global setting
+				if (this->config->abuseipdbReportAll) {
+					sendReport = true;
+				}
+				reportCategories = this->config->abuseipdbDefaultCategories;
+				if (this->config->abuseipdbDefaultCommentIsSet) {
+					reportComment = this->config->abuseipdbDefaultComment;
 				}
-				this->log->debug("Finished reading until end of file, pos: " + std::to_string(itlf->bookmark));
+				// Log group setting overrides global setting
+				if (itlg->abuseipdbReport == Report::True) {
+					sendReport = true;
+				} else if (itlg->abuseipdbReport == Report::False) {
+					sendReport = false;
+				}
+				if (itlg->abuseipdbCategories.size() > 0) {
+					reportCategories = itlg->abuseipdbCategories;
+				}
+				if (itlg->abuseipdbCommentIsSet) {
+					reportComment = itlg->abuseipdbComment;
+				}
+				// Pattern setting overrides log group setting
+				if (itlp->abuseipdbReport == Report::True) {
+					sendReport = true;
+				} else if (itlp->abuseipdbReport == Report::False) {
+					sendReport = false;
+				}
+				if (itlp->abuseipdbCategories.size() > 0) {
+					reportCategories = itlp->abuseipdbCategories;
+				}
+				if (itlp->abuseipdbCommentIsSet) {
+					reportComment = itlp->abuseipdbComment;
+				}
+			}
 
-				// Close file
-				is.close();
+			// Do not report whitelisted addresses
+			record = this->data->suspiciousAddresses.find(event.address);
+			if (record != NULL && record->whitelisted) {
+				sendReport = false;
+			}
 
-				// Update last known file size
-				itlf->size = fileSize;
+			// Check whether 15 minutes are passed since last report
+			// TODO implement config parameter and use 15 minutes as min with default 1h
+			if (sendReport) {
+				if (record != NULL) {
+					if (this->currentTime - record->lastReported < 900) {
+						this->log->debug("Not enqueuing report about " + ipAddress + " more often than each 15 minutes!");
+						sendReport = false;
+					} else {
+						record->lastReported = this->currentTime;
+						// this->data->updateAddress(ipAddress);
+					}
+				} else {
+					this->log->warning("Need to send report about address " + ipAddress + ", but data about it is not found in data file! Skipping!");
+					sendReport = false;
+				}
+			}
 
-				// Update datafile
-				if (initialBookmark != itlf->bookmark) {
-					this->data->updateFile(itlf->path);
+			// Search for %i, %p and %m placeholders in comment and replace with data if needed
+			if (sendReport) {
+				posc = reportComment.find("%i");
+				if (posc != std::string::npos) {
+					reportComment = reportComment.replace(posc, 2, ipAddress);
+				}
+				posc = reportComment.find("%p");
+				if (posc != std::string::npos) {
+					if (itlp->portSearch) {
+						reportComment = reportComment.replace(posc, 2, port);
+					} else {
+						this->log->warning("Comment template contains port placeholder, but port is not found in matched line! Adjust pattern or comment to avoid this warning!");
+					}
+				}
+				posc = reportComment.find("%m");
+				if (posc != std::string::npos) {
+					reportComment = reportComment.replace(posc, 2, event.line);
+				}
+				posc = reportComment.find("%d");
+				if (posc != std::string::npos) {
+					reportComment = reportComment.replace(posc, 2, this->currentTimeFormatted);
 				}
-			} else {
-				this->log->error("Unable to open file " + itlf->path + " for reading!");
-				continue;
 			}
 
+			// Strip comment to 1500 characters
+			if (sendReport) {
+				if (reportComment.length() > 1500) {
+					reportComment = reportComment.substr(0, 1500);
+					this->log->warning("Comment for AbuseIPDB report is too long, length was reduced by removing characters from end!");
+				}
+			}
+
+			// Put report into queue for sending to AbuseIPDB
+			if (sendReport) {
+				ReportToAbuseIPDB reportToSend;
+				reportToSend.ip = ipAddress;
+				reportToSend.categories = reportCategories;
+				reportToSend.comment = reportComment;
+				this->abuseipdbReportingQueueMutex->lock();
+				this->abuseipdbReportingQueue->push(reportToSend);
+				this->abuseipdbReportingQueueMutex->unlock();
+				this->log->debug("Information about " + ipAddress + " is put into queue for sending to AbuseIPDB...");
+			}
+		} else {
+			this->log->warning(ipAddress + " matched blocked access pattern, but no previous information about suspicious activity, skipping...");
+		}
+
+		this->log->debug("Match with pattern: " + itlp->patternString);
+	}
+}
+
+/*
+ * Close all open log files
+ */
+void LogParser::closeFiles()
+{
+	for (std::map<std::string, hb::OpenLogFile>::iterator itof = this->openFiles.begin(); itof != this->openFiles.end(); ++itof) {
+		if (itof->second.fd != -1) {
+			cunistd::close(itof->second.fd);
 		}
 	}
+	this->openFiles.clear();
+}
+
+/*
+ * Write literal prefilter statistics of all log groups to log
+ */
+void LogParser::logPrefilterStatistics()
+{
+	std::vector<hb::LogGroup>::iterator itlg;
+	unsigned long long int total;
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+		total = itlg->prefilterHits + itlg->prefilterMisses;
+		if (total == 0) continue;
+		this->log->info("Log group " + itlg->name + " prefilter: " + std::to_string(total) + " lines, " + std::to_string(itlg->prefilterHits) + " hits (matched with regex), " + std::to_string(itlg->prefilterMisses) + " misses (skipped), " + std::to_string((float)itlg->prefilterMisses * 100 / (float)total) + "% skipped");
+	}
 }
@@ -9,6 +9,20 @@
 #include <queue>
 // Mutex
 #include <mutex>
+// Condition variable
+#include <condition_variable>
+// Map
+#include <map>
+// Set
+#include <set>
+// Vector
+#include <vector>
+// Threads
+#include <thread>
+// Limits (ULLONG_MAX)
+#include <climits>
+// Linux types (dev_t, ino_t)
+#include <sys/types.h>
 // Util
 #include "util.h"
 // Logger
@@ -17,12 +31,191 @@
 #include "config.h"
 // Data
 #include "data.h"
+// CPU budget
+#include "cpubudget.h"
 
 namespace hb{
 
+/*
+ * Log file kept open between checks
+ */
+struct OpenLogFile {
+	int fd = -1;
+	dev_t device = 0;// Device and inode of open file, to detect when file at path is replaced (rotation)
+	ino_t inode = 0;
+};
+
+/*
+ * Pattern match found in log file, (address, pattern, score) is applied to data on main thread
+ */
+struct LogEvent {
+	int patternIndex = -1;// Index of matched pattern in log group patterns or refused patterns
+	bool refused = false;// Whether matched pattern is refused pattern
+	unsigned int score = 0;
+	hb::Address address;
+	std::string port;
+	std::string line;// Matched line, kept only when AbuseIPDB reporting is enabled (for %m in comment)
+};
+
+/*
+ * Check of single log file, worker thread reads file and collects events, main thread applies them
+ */
+struct LogFileJob {
+	std::size_t index = 0;// Index of job in current check, batches of events refer to it
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+	hb::OpenLogFile* openFile = nullptr;
+	unsigned long long int bookmark = 0;// Bookmark, size and file identity, copied to log file after events are applied
+	unsigned long long int size = 0;
+	unsigned long long int device = 0;
+	unsigned long long int inode = 0;
+	unsigned long long int fingerprint = 0;
+	unsigned int fingerprintSize = 0;
+	bool reset = false;// Bookmark was reset (rotation, truncation), datafile needs update even if bookmark is the same
+	unsigned long long int prefilterHits = 0;
+	unsigned long long int prefilterMisses = 0;
+	std::vector<hb::LogEvent> events;// Events not handed over to main thread yet
+	bool part = false;// Backfill chunk, its events are handed over only when chunk is read
+	time_t lastInfo = 0;// Time of last progress info and size of job for progress info
+	unsigned long long int total = 0;
+};
+
+/*
+ * Events handed over from worker to main thread, applied as they arrive, so activity is saved while file is read
+ */
+struct LogEventBatch {
+	std::size_t jobIndex = 0;
+	std::vector<hb::LogEvent> events;
+	bool last = false;// Last batch of job, file is read and job bookmark can be saved
+};
+
+/*
+ * Line aligned chunk of backfill, read by any worker of pool
+ */
+struct BackfillChunk {
+	hb::LogFileJob part;// Chunk is read as separate job, from its bookmark until limit
+	unsigned long long int limit = 0;
+	bool done = false;
+};
+
+/*
+ * Backfill of large unread part of log file, its chunks are read by workers in file order and handed over in file order
+ */
+struct Backfill {
+	hb::LogFileJob* job = nullptr;
+	int fd = -1;
+	std::vector<hb::BackfillChunk> chunks;
+	std::size_t nextChunk = 0;// Next chunk to read
+	std::size_t handedOver = 0;// Count of chunks handed over to main thread
+	bool failed = false;// Chunk did not reach its end (read error), events of later chunks are dropped
+	std::size_t matches = 0;
+};
+
 class LogParser{
 	private:
 
+		/*
+		 * Open log files (path as key)
+		 */
+		std::map<std::string, hb::OpenLogFile> openFiles;
+
+		/*
+		 * Time of current check (and formatted for reports)
+		 */
+		time_t currentTime = 0;
+		std::string currentTimeFormatted;
+
+		/*
+		 * Whether matched lines are needed for AbuseIPDB report comments
+		 */
+		bool keepLines = false;
+
+		/*
+		 * Buffers for reading log files in large blocks, one per worker
+		 */
+		std::vector<std::vector<char>> readBuffers;
+
+		/*
+		 * CPU time of all workers, log.cpu.limit applies to workers together
+		 */
+		hb::CpuBudget::Account cpuAccount;
+
+		/*
+		 * Jobs of current check, index of next job to take, count of checked jobs and batches of events waiting to be applied
+		 */
+		std::vector<hb::LogFileJob> jobs;
+		std::size_t nextJob = 0;
+		std::size_t checkedJobs = 0;
+		std::queue<hb::LogEventBatch> batches;
+
+		/*
+		 * Worker pool of current check, it grows up to pool size when backfill needs more workers
+		 */
+		std::vector<std::thread> workers;
+		std::size_t poolSize = 0;
+
+		/*
+		 * Running backfills, their chunks are read by any worker of pool
+		 */
+		std::vector<hb::Backfill*> backfills;
+		std::mutex jobsMutex;
+		std::condition_variable jobsCondition;
+
+		/*
+		 * Number of workers for log file checks
+		 */
+		unsigned int workerCount() const;
+
+		/*
+		 * Worker, reads backfill chunks and takes jobs until all jobs are checked
+		 */
+		void worker(std::size_t workerIndex);
+
+		/*
+		 * Check single log file for suspicious activity (worker thread, does not touch data)
+		 */
+		void checkFile(hb::LogFileJob& job, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget);
+
+		/*
+		 * Read lines from bookmark until end of file (or until limit, lines starting before limit are read)
+		 */
+		void readLines(hb::LogFileJob& job, int fd, bool final, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget, unsigned long long int limit = ULLONG_MAX);
+
+		/*
+		 * Offset of first line starting at or after offset (limit if there is no new line before limit)
+		 */
+		unsigned long long int alignToLine(int fd, unsigned long long int offset, unsigned long long int limit);
+
+		/*
+		 * Read unread part of large file in line aligned chunks on all workers of pool, events are handed over in file order
+		 */
+		void backfill(hb::LogFileJob& job, int fd, unsigned long long int fileSize, unsigned long long int chunkSize, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget);
+
+		/*
+		 * Read next chunk of running backfill (called with jobs mutex locked), false if there is no chunk to read
+		 */
+		bool readChunk(std::unique_lock<std::mutex>& lock, std::vector<char>& readBuffer, hb::CpuBudget& cpuBudget);
+
+		/*
+		 * Hand over collected events of job to main thread (last - job is finished)
+		 */
+		void handOver(hb::LogFileJob& job, bool last);
+
+		/*
+		 * Match line (without new line character) with patterns of log group, add event if it matches
+		 */
+		void processLine(hb::LogFileJob& job, const char* begin, const char* end);
+
+		/*
+		 * Save bookmark and statistics of finished job to data (main thread, after all its events are applied)
+		 */
+		void applyJob(hb::LogFileJob& job);
+
+		/*
+		 * Save activity of single event and enqueue report about it
+		 */
+		void applyEvent(std::vector<hb::LogGroup>::iterator itlg, const hb::LogEvent& event);
+
 	public:
 
 		/*
@@ -52,9 +245,25 @@ class LogParser{
 		LogParser(hb::Logger* log, hb::Config* config, hb::Data* data, std::queue<ReportToAbuseIPDB>* abuseipdbReportingQueue, std::mutex* abuseipdbReportingQueueMutex);
 
 		/*
-		 * Check all log files for suspicious activity
+		 * Destructor
+		 */
+		~LogParser();
+
+		/*
+		 * Check log files for suspicious activity, only files in paths if specified
+		 * Files are checked on worker threads (log.threads), activity is saved to data on calling thread
+		 */
+		void checkFiles(const std::set<std::string>* paths = nullptr);
+
+		/*
+		 * Close all open log files (they are reopened on next check)
+		 */
+		void closeFiles();
+
+		/*
+		 * Write literal prefilter hit/miss statistics of all log groups to log
 		 */
-		void checkFiles();
+		void logPrefilterStatistics();
 
 };
 
@@ -0,0 +1,278 @@
+/*
+ * Log file watcher, uses inotify to find out which log files have changed
+ *
+ * Each log file is watched for IN_MODIFY (new lines), IN_MOVE_SELF and
+ * IN_DELETE_SELF (rotation). Directory of each log file is watched for
+ * IN_CREATE and IN_MOVED_TO, so that new file created in place of rotated
+ * one is picked up. If inotify is not available (or watch can not be added,
+ * for example on some network filesystems or if watch limit is reached),
+ * file is polled each log.check.interval as before.
+ */
+
+// Vector
+#include <vector>
+// C string (strerror)
+#include <cstring>
+// inotify
+#include <sys/inotify.h>
+// poll
+#include <poll.h>
+// errno
+#include <errno.h>
+// Types (ssize_t)
+#include <sys/types.h>
+// Miscellaneous UNIX symbolic constants, types and functions
+namespace cunistd{
+	#include <unistd.h>
+}
+// Header
+#include "logwatcher.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Directory part of path
+ */
+static std::string dirName(const std::string& path)
+{
+	std::size_t pos = path.find_last_of('/');
+	if (pos == std::string::npos) return ".";
+	if (pos == 0) return "/";
+	return path.substr(0, pos);
+}
+
+/*
+ * File name part of path
+ */
+static std::string baseName(const std::string& path)
+{
+	std::size_t pos = path.find_last_of('/');
+	if (pos == std::string::npos) return path;
+	return path.substr(pos + 1);
+}
+
+/*
+ * Constructor
+ */
+LogWatcher::LogWatcher(hb::Logger* log, hb::Config* config)
+: log(log), config(config)
+{
+
+}
+
+/*
+ * Destructor
+ */
+LogWatcher::~LogWatcher()
+{
+	this->close();
+}
+
+/*
+ * Set up watches for all configured log files
+ */
+bool LogWatcher::init()
+{
+	std::vector<hb::LogGroup>::iterator itlg;
+	std::vector<hb::LogFile>::iterator itlf;
+	std::string dir;
+	int wd;
+
+	this->close();
+
+	for (itlg = this->config->logGroups.begin(); itlg != this->config->logGroups.end(); ++itlg) {
+		for (itlf = itlg->logFiles.begin(); itlf != itlg->logFiles.end(); ++itlf) {
+			this->polled.insert(itlf->path);
+		}
+	}
+
+	if (!this->config->logWatch) {
+		this->log->info("Log file watching is disabled, log files are checked each " + std::to_string(this->config->logCheckInterval) + " seconds");
+		return false;
+	}
+
+	this->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->inotifyFd == -1) {
+		this->log->warning("Unable to initialize inotify, log files will be polled! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+		return false;
+	}
+
+	std::set<std::string> paths = this->polled;
+	for (std::set<std::string>::iterator itp = paths.begin(); itp != paths.end(); ++itp) {
+		// Watch directory, to notice when file is created again after rotation
+		dir = dirName(*itp);
+		if (this->dirFiles.count(dir) == 0) {
+			wd = inotify_add_watch(this->inotifyFd, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+			if (wd == -1) {
+				this->log->warning("Unable to watch directory " + dir + ", log file " + *itp + " will be polled! " + std::to_string(errno) + ": " + std::string(strerror(errno)));
+				continue;
+			}
+			this->dirWatches[wd] = dir;
+		}
+		this->dirFiles[dir][baseName(*itp)] = *itp;
+
+		// Watch file itself
+		if (!this->addFileWatch(*itp)) {
+			this->log->debug("Log file " + *itp + " does not exist yet, waiting for it to be created");
+		}
+		this->polled.erase(*itp);
+	}
+
+	this->log->debug("Watching " + std::to_string(this->fileWatches.size()) + " log files in " + std::to_string(this->dirWatches.size()) + " directories with inotify, " + std::to_string(this->polled.size()) + " log files are polled");
+	return true;
+}
+
+/*
+ * Remove all watches and close inotify
+ */
+void LogWatcher::close()
+{
+	if (this->inotifyFd != -1) {
+		// Closing inotify descriptor removes all watches
+		cunistd::close(this->inotifyFd);
+		this->inotifyFd = -1;
+	}
+	this->fileWatches.clear();
+	this->dirWatches.clear();
+	this->dirFiles.clear();
+	this->changed.clear();
+	this->polled.clear();
+}
+
+/*
+ * Whether inotify is used
+ */
+bool LogWatcher::active() const
+{
+	return this->inotifyFd != -1;
+}
+
+/*
+ * Add inotify watch for log file
+ */
+bool LogWatcher::addFileWatch(const std::string& path)
+{
+	int wd = inotify_add_watch(this->inotifyFd, path.c_str(), IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+	if (wd == -1) {
+		return false;
+	}
+	this->fileWatches[wd] = path;
+	return true;
+}
+
+/*
+ * Remove inotify watches for log file
+ */
+void LogWatcher::removeFileWatch(const std::string& path)
+{
+	std::map<int, std::string>::iterator itw = this->fileWatches.begin();
+	while (itw != this->fileWatches.end()) {
+		if (itw->second == path) {
+			inotify_rm_watch(this->inotifyFd, itw->first);
+			itw = this->fileWatches.erase(itw);
+		} else {
+			++itw;
+		}
+	}
+}
+
+/*
+ * Read and process pending inotify events
+ */
+void LogWatcher::readEvents()
+{
+	// Buffer aligned for inotify_event
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event* event;
+	std::map<int, std::string>::iterator itw;
+	std::string path;
+	ssize_t length;
+	char* ptr;
+
+	while (true) {
+		length = cunistd::read(this->inotifyFd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			break;
+		}
+		for (ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event*)ptr;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// Some events are lost, check all files
+				this->log->warning("inotify event queue overflow, checking all log files");
+				for (itw = this->fileWatches.begin(); itw != this->fileWatches.end(); ++itw) {
+					this->changed.insert(itw->second);
+				}
+				continue;
+			}
+
+			itw = this->fileWatches.find(event->wd);
+			if (itw != this->fileWatches.end()) {
+				path = itw->second;
+				this->changed.insert(path);
+				if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) {
+					// Rotated, watch follows old file (it might still be written to), new file gets its own watch
+					this->log->debug("Log file " + path + " moved or removed");
+					// New file might be already created before this event is read
+					this->addFileWatch(path);
+				}
+				if (event->mask & IN_IGNORED) {
+					// Watch removed by kernel (file deleted)
+					this->fileWatches.erase(itw);
+				}
+				continue;
+			}
+
+			itw = this->dirWatches.find(event->wd);
+			if (itw != this->dirWatches.end() && event->len > 0 && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+				if (this->dirFiles[itw->second].count(event->name) > 0) {
+					path = this->dirFiles[itw->second][event->name];
+					this->log->debug("Log file " + path + " created");
+					this->removeFileWatch(path);
+					this->addFileWatch(path);
+					this->changed.insert(path);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Wait for changes in log files
+ */
+bool LogWatcher::wait(int timeout)
+{
+	if (this->inotifyFd == -1) {
+		cunistd::usleep(timeout * 1000);
+		return false;
+	}
+
+	struct pollfd pfd;
+	pfd.fd = this->inotifyFd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN)) {
+		this->readEvents();
+	}
+
+	return this->changed.size() > 0;
+}
+
+/*
+ * Get and clear set of changed files
+ */
+std::set<std::string> LogWatcher::takeChanged()
+{
+	std::set<std::string> result;
+	result.swap(this->changed);
+	return result;
+}
+
+/*
+ * Files that need to be polled
+ */
+std::set<std::string> LogWatcher::polledFiles() const
+{
+	return this->polled;
+}
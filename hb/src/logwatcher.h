@@ -0,0 +1,128 @@
+/*
+ * Log file watcher, uses inotify to find out which log files have changed, files that can not be watched are polled
+ */
+
+#ifndef HBLOGWATCHER_H
+#define HBLOGWATCHER_H
+
+// Map
+#include <map>
+// Set
+#include <set>
+// Standard string library
+#include <string>
+// Logger
+#include "logger.h"
+// Config
+#include "config.h"
+
+namespace hb{
+
+class LogWatcher{
+	private:
+
+		/*
+		 * Logger object
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Config object
+		 */
+		hb::Config* config;
+
+		/*
+		 * inotify file descriptor, -1 if inotify is not used
+		 */
+		int inotifyFd = -1;
+
+		/*
+		 * Watches on log files (watch descriptor as key, path as value)
+		 */
+		std::map<int, std::string> fileWatches;
+
+		/*
+		 * Watches on directories where log files are (watch descriptor as key, directory as value)
+		 * Needed to notice when log file is created again after rotation
+		 */
+		std::map<int, std::string> dirWatches;
+
+		/*
+		 * Log files in each watched directory (directory as key, file name and configured path as value)
+		 */
+		std::map<std::string, std::map<std::string, std::string>> dirFiles;
+
+		/*
+		 * Files changed since last takeChanged call
+		 */
+		std::set<std::string> changed;
+
+		/*
+		 * Files that can not be watched with inotify and need to be polled
+		 */
+		std::set<std::string> polled;
+
+		/*
+		 * Add inotify watch for log file, returns false if file can not be watched (file might not exist yet)
+		 */
+		bool addFileWatch(const std::string& path);
+
+		/*
+		 * Remove inotify watches for log file (also watch of rotated file, if it is still watched)
+		 */
+		void removeFileWatch(const std::string& path);
+
+		/*
+		 * Read and process pending inotify events
+		 */
+		void readEvents();
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		LogWatcher(hb::Logger* log, hb::Config* config);
+
+		/*
+		 * Destructor
+		 */
+		~LogWatcher();
+
+		/*
+		 * Set up watches for all configured log files (also after config reload)
+		 * Returns false if inotify is not available, then all files are polled
+		 */
+		bool init();
+
+		/*
+		 * Remove all watches and close inotify
+		 */
+		void close();
+
+		/*
+		 * Whether inotify is used
+		 */
+		bool active() const;
+
+		/*
+		 * Wait up to timeout (milliseconds) for changes in log files
+		 * Returns true if some file has changed
+		 */
+		bool wait(int timeout);
+
+		/*
+		 * Get and clear set of files changed since last call
+		 */
+		std::set<std::string> takeChanged();
+
+		/*
+		 * Files that need to be polled (all configured files if inotify is not used)
+		 */
+		std::set<std::string> polledFiles() const;
+
+};
+
+}
+
+#endif
@@ -22,6 +22,8 @@
 #include <string>
 // Date and time manipulation
 #include <chrono>
+// C string (strerror, strncmp, strlen)
+#include <cstring>
 // For libcurl in abuseipdb.h
 // Note, suspecting that unistd.h includes some headers that are also needed for socket.h, but it gets under cunistd namespace and cannot find type socklen_t...?
 #include <sys/socket.h>
@@ -35,6 +37,8 @@ namespace cunistd{
 namespace csignal{
 	#include <signal.h>
 }
+// SIG_IGN expands to unqualified handler type
+using csignal::__sighandler_t;
 // C getopt
 namespace cgetopt{
 	#include <getopt.h>
@@ -53,12 +57,22 @@ namespace cstat{
 #include "logger.h"
 // Iptables
 #include "iptables.h"
+// Firewall backends
+#include "firewall.h"
+// Nftables
+#include "nftables.h"
+// Netlink
+#include "netlink.h"
 // Config
 #include "config.h"
 // Data
 #include "data.h"
+// Address
+#include "address.h"
 // LogParser
 #include "logparser.h"
+// LogWatcher
+#include "logwatcher.h"
 // AbuseIPDB
 #include "abuseipdb.h"
 
@@ -103,6 +117,7 @@ void printUsage()
 	std::cout << " -r<IP address> | --remove=<IP address>    - remove IP address from data file (excluding AbuseIPDB blacklist)" << std::endl;
 	std::cout << " -d             | --daemon                 - run as daemon" << std::endl;
 	std::cout << "                | --sync-blacklist         - sync AbuseIPDB blacklist" << std::endl;
+	std::cout << "                | --convert=<engine>       - convert datafile to text, journal, binary or sqlite format" << std::endl;
 }
 
 /*
@@ -177,7 +192,7 @@ void blacklistSync(hb::Logger* log, hb::Config* config, hb::Data* data, hb::Ipta
 
 	hb::AbuseIPDB apiClient = hb::AbuseIPDB(log, config);
 
-	std::map<std::string, hb::AbuseIPDBBlacklistedAddressType> newBlacklist;
+	hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType> newBlacklist;
 	unsigned long long int blacklistGenTime;
 
 	if (apiClient.getBlacklist(config->abuseipdbBlockScore, &blacklistGenTime, &newBlacklist) == false) {
@@ -187,7 +202,7 @@ void blacklistSync(hb::Logger* log, hb::Config* config, hb::Data* data, hb::Ipta
 		std::time(&currentRawTime);
 		unsigned long long int currentTime = (unsigned long long int)currentRawTime;
 		data->abuseIPDBSyncTime = currentTime;
-		std::map<std::string, hb::AbuseIPDBBlacklistedAddressType>::iterator itb;
+		hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::iterator itb;
 
 		log->info("AbuseIPDB blacklist generation time: " + hb::Util::formatDateTime((const time_t)blacklistGenTime, config->dateTimeFormat.c_str()) + " AbuseIPDB blacklist size: " + std::to_string(newBlacklist.size()));
 
@@ -202,19 +217,19 @@ void blacklistSync(hb::Logger* log, hb::Config* config, hb::Data* data, hb::Ipta
 		std::vector<std::string> forAppend;
 		std::vector<std::string> forUpdate;
 		std::vector<std::string> forRemoval;
-		for (itb = data->abuseIPDBBlacklist.begin(); itb!=data->abuseIPDBBlacklist.end(); ++itb) {
-			if (newBlacklist.count(itb->first) > 0) {
+		hb::AbuseIPDBBlacklistedAddressType* newRecord;
+		itb = data->abuseIPDBBlacklist.begin();
+		while (itb != data->abuseIPDBBlacklist.end()) {
+			if ((newRecord = newBlacklist.find(itb->first)) != NULL) {
 				// Address in old blacklist is also found in new blacklist
-				forUpdate.push_back(itb->first);
-				itb->second.totalReports = newBlacklist[itb->first].totalReports;
-				itb->second.abuseConfidenceScore = newBlacklist[itb->first].abuseConfidenceScore;
+				forUpdate.push_back(itb->first.toString());
+				itb->second.totalReports = newRecord->totalReports;
+				itb->second.abuseConfidenceScore = newRecord->abuseConfidenceScore;
+				++itb;
 			} else {
 				// Address in old blacklist is not found in new blacklist
-				forRemoval.push_back(itb->first);
-				itb = data->abuseIPDBBlacklist.erase(itb);// Returns next item after removed one
-				if (itb != data->abuseIPDBBlacklist.begin()) {
-					--itb;// Don't skip the next item
-				}
+				forRemoval.push_back(itb->first.toString());
+				itb = data->abuseIPDBBlacklist.erase(itb);// Returns next item (last item is moved in place of removed one)
 			}
 		}
 
@@ -232,14 +247,15 @@ void blacklistSync(hb::Logger* log, hb::Config* config, hb::Data* data, hb::Ipta
 
 		// Loop new blacklist
 		hb::AbuseIPDBBlacklistedAddressType record;
+		bool inserted;
 		for (itb = newBlacklist.begin(); itb != newBlacklist.end(); ++itb) {
-			if (data->abuseIPDBBlacklist.count(itb->first) == 0) {
-				forAppend.push_back(itb->first);
-				record.totalReports = itb->second.totalReports;
-				record.abuseConfidenceScore = itb->second.abuseConfidenceScore;
-				record.iptableRule = false;
-				record.version = hb::Util::ipVersion(itb->first);
-				data->abuseIPDBBlacklist.insert(std::pair<std::string,hb::AbuseIPDBBlacklistedAddressType>(itb->first, record));
+			record.totalReports = itb->second.totalReports;
+			record.abuseConfidenceScore = itb->second.abuseConfidenceScore;
+			record.iptableRule = false;
+			record.version = itb->first.version;
+			data->abuseIPDBBlacklist.insert(itb->first, record, inserted);
+			if (inserted) {
+				forAppend.push_back(itb->first.toString());
 			}
 		}
 
@@ -269,6 +285,10 @@ int main(int argc, char *argv[])
 	clock_t cpuStart = clock(), cpuEnd = cpuStart;
 	auto wallStart = std::chrono::steady_clock::now(), wallEnd = wallStart;
 
+	// Failed iptables-restore/ipset/nft can close pipe before whole transaction is written, write error is handled
+	// instead of process being killed
+	csignal::signal(SIGPIPE, SIG_IGN);
+
 	// Must have at least one argument
 	if (argc < 2) {
 		printUsage();
@@ -287,7 +307,10 @@ int main(int argc, char *argv[])
 	bool whitelistFlag = false;
 	bool removeFlag = false;
 	bool syncBlacklistFlag = false;
+	bool convertFlag = false;
+	std::string convertEngine = "";
 	std::string ipAddress = "";
+	hb::Address address;
 	bool daemonFlag = false;
 
 	// Options
@@ -305,6 +328,7 @@ int main(int argc, char *argv[])
 		{"remove",         required_argument, 0, 'r'},
 		{"daemon",         no_argument,       0, 'd'},
 		{"sync-blacklist", no_argument,       0, 0},
+		{"convert",        required_argument, 0, 0},
 	};
 
 	// Option index
@@ -316,6 +340,9 @@ int main(int argc, char *argv[])
 			case 0:
 				if (strncmp("sync-blacklist", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
 					syncBlacklistFlag = true;
+				} else if (strncmp("convert", long_options[option_index].name, strlen(long_options[option_index].name)) == 0) {
+					convertFlag = true;
+					convertEngine = cunistd::optarg;
 				} else {
 					printUsage();
 					exit(0);
@@ -363,6 +390,15 @@ int main(int argc, char *argv[])
 				exit(0);
 		}
 
+	// Address is used in the same form as addresses found in log files
+	if (blacklistFlag || whitelistFlag || removeFlag) {
+		if (!hb::Address::parse(ipAddress, address)) {
+			std::cerr << "Invalid IP address " << ipAddress << "!" << std::endl;
+			exit(1);
+		}
+		ipAddress = address.toString();
+	}
+
 	// Syslog writter
 	hb::Logger log = hb::Logger(LOG_USER);
 
@@ -399,16 +435,37 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	// Datafile is converted when it is loaded with other engine than it was saved with
+	if (convertFlag) {
+		if (!hb::Config::parseDataFileEngine(hb::Util::toLower(convertEngine), config.dataFileEngine)) {
+			std::cerr << "Unknown datafile engine " << convertEngine << ", use text, journal, binary or sqlite!" << std::endl;
+			exit(1);
+		}
+	}
+
 	// To work with datafile
 	hb::Data data = hb::Data(&log, &config, &iptables);
 
-	// Load datafile
-	if (!data.loadData()) {
+	// Load datafile, single address and list operations read only records they need (SQLite datafile)
+	bool dataLoaded;
+	if (convertFlag || printConfigFlag || statisticsFlag) {
+		dataLoaded = data.loadData();
+	} else if (listFlag) {
+		dataLoaded = data.loadBlocked(allFlag);
+	} else if (blacklistFlag || whitelistFlag || removeFlag) {
+		dataLoaded = data.loadAddress(ipAddress);
+	} else {
+		dataLoaded = data.loadData();
+	}
+	if (!dataLoaded) {
 		std::cerr << "Failed to load data!" << std::endl;
 		exit(1);
 	}
 
-	if (printConfigFlag) {// Output configuration
+	if (convertFlag) {// Datafile converted while loading
+		std::cout << "Datafile " << config.dataFilePath << " saved with " << hb::Config::dataFileEngineName(config.dataFileEngine) << " engine, set datafile.engine accordingly, otherwise it is converted back on next start" << std::endl;
+		exit(0);
+	} else if (printConfigFlag) {// Output configuration
 		config.print();
 		if (config.logLevel == "DEBUG") {
 			cpuEnd = clock();
@@ -434,31 +491,33 @@ int main(int argc, char *argv[])
 		exit(0);
 	} else if (blacklistFlag) {// Toggle whether address is in blacklist
 		// Save address if there is no previous activity from this address
-		if (data.suspiciousAddresses.count(ipAddress) == 0) {
+		hb::SuspiciosAddressType* record = data.suspiciousAddresses.find(address);
+		if (record == NULL) {
 			std::time_t currentTime;
 			std::time(&currentTime);
 			hb::SuspiciosAddressType dataRecord;
 			dataRecord.lastActivity = (unsigned long long int)currentTime;
-			data.suspiciousAddresses.insert(std::pair<std::string,hb::SuspiciosAddressType>(ipAddress, dataRecord));
+			dataRecord.version = address.version;
+			record = data.suspiciousAddresses.insert(address, dataRecord);
 			data.addAddress(ipAddress);
 		}
 
-		if (data.suspiciousAddresses[ipAddress].whitelisted) {
+		if (record->whitelisted) {
 			// If address is in whitelist, ask user to confirm
 			std::cout << "Address is already whitelisted, would you like to remove it from whitelist and add to blacklist instead? [y/n]";
 			char choice = 'n';
 			std::cin >> choice;
 			if (choice == 'y') {
-				data.suspiciousAddresses[ipAddress].whitelisted = false;
-				data.suspiciousAddresses[ipAddress].blacklisted = true;
+				record->whitelisted = false;
+				record->blacklisted = true;
 				data.updateAddress(ipAddress);
 			}
 		} else {
 			// Address not in whitelist, just change blacklisted flag
-			if (data.suspiciousAddresses[ipAddress].blacklisted) {
-				data.suspiciousAddresses[ipAddress].blacklisted = false;
+			if (record->blacklisted) {
+				record->blacklisted = false;
 			} else {
-				data.suspiciousAddresses[ipAddress].blacklisted = true;
+				record->blacklisted = true;
 			}
 			data.updateAddress(ipAddress);
 		}
@@ -491,31 +550,33 @@ int main(int argc, char *argv[])
 		exit(0);
 	} else if (whitelistFlag) {// Toggle whether address is in whitelist
 		// Save address if there is no previous activity from this address
-		if (data.suspiciousAddresses.count(ipAddress) == 0) {
+		hb::SuspiciosAddressType* record = data.suspiciousAddresses.find(address);
+		if (record == NULL) {
 			std::time_t currentTime;
 			std::time(&currentTime);
 			hb::SuspiciosAddressType dataRecord;
 			dataRecord.lastActivity = (unsigned long long int)currentTime;
-			data.suspiciousAddresses.insert(std::pair<std::string,hb::SuspiciosAddressType>(ipAddress, dataRecord));
+			dataRecord.version = address.version;
+			record = data.suspiciousAddresses.insert(address, dataRecord);
 			data.addAddress(ipAddress);
 		}
 
-		if (data.suspiciousAddresses[ipAddress].blacklisted) {
+		if (record->blacklisted) {
 			// If address is in whitelist, ask user to confirm
 			std::cout << "Address is already blacklisted, would you like to remove it from blacklist and add to whitelist instead? [y/n]";
 			char choice = 'n';
 			std::cin >> choice;
 			if (choice == 'y') {
-				data.suspiciousAddresses[ipAddress].blacklisted = false;
-				data.suspiciousAddresses[ipAddress].whitelisted = true;
+				record->blacklisted = false;
+				record->whitelisted = true;
 				data.updateAddress(ipAddress);
 			}
 		} else {
 			// Address not in whitelist, just change blacklisted flag
-			if (data.suspiciousAddresses[ipAddress].whitelisted) {
-				data.suspiciousAddresses[ipAddress].whitelisted = false;
+			if (record->whitelisted) {
+				record->whitelisted = false;
 			} else {
-				data.suspiciousAddresses[ipAddress].whitelisted = true;
+				record->whitelisted = true;
 			}
 			data.updateAddress(ipAddress);
 		}
@@ -547,57 +608,22 @@ int main(int argc, char *argv[])
 		}
 		exit(0);
 	} else if (removeFlag) {// Remove address from datafile
-		if (data.suspiciousAddresses.count(ipAddress) > 0) {
+		if (data.suspiciousAddresses.count(address) > 0) {
 			if (!data.removeAddress(ipAddress)) {
 				std::cerr << "Failed to remove address!" << std::endl;
 				exit(1);
 			} else {
-				// Check if there is iptables rule for this address
-				std::vector<std::string> rules;
-				iptables.listRules("INPUT", rules, 4);
-				iptables.listRules("INPUT", rules, 6);
+				// Remove iptables rule (ipset or nftables set element) if there is one
+				std::unique_ptr<hb::Firewall> firewall(hb::Firewall::create(&log, &config, &iptables));
+				bool removed = false;
 				try {
-
-					// Regex to search for IP address
-					std::regex ipSearchPattern(hb::kIpSearchPattern);
-
-					// Loop through all rules
-					std::vector<std::string>::iterator rit;
-					std::size_t checkStart = 0, checkEnd = 0;
-					std::smatch regexSearchResults;
-					std::string regexSearchResult;
-					std::size_t posip = config.iptablesRule.find("%i");
-					std::string ruleStart = "";
-					std::string ruleEnd = "";
-					if (posip != std::string::npos) {
-						ruleStart = config.iptablesRule.substr(0, posip);
-						ruleEnd = config.iptablesRule.substr(posip + 2);
-					}
-					for (rit = rules.begin(); rit != rules.end(); ++rit) {
-						checkStart = (*rit).find(ruleStart);
-						checkEnd = (*rit).find(ruleEnd);
-						if (checkStart != std::string::npos && checkEnd != std::string::npos) {
-							if (std::regex_search((*rit), regexSearchResults, ipSearchPattern)) {
-								if (regexSearchResults.size() == 1) {
-									regexSearchResult = regexSearchResults[0].str();
-									if (regexSearchResult == ipAddress) {
-										// iptables rule found, remove from iptables
-										if (iptables.remove("INPUT", ruleStart + ipAddress + ruleEnd) == false) {
-											std::cerr << "Address " << ipAddress << " no longer needs iptables rule, but failed to remove rule from chain!" << std::endl;
-											log.error("Address " + ipAddress + " no longer needs iptables rule, but failed to remove rule from chain!");
-											exit(1);
-										}
-									}
-								}
-							}
-						}
-					}
-
-				} catch (std::regex_error& e) {
-					std::string message = e.what();
-					log.error(message + ": " + std::to_string(e.code()));
-					log.error(hb::Util::regexErrorCode2Text(e.code()));
-					std::cerr << "iptables check failed!" << std::endl;
+					removed = firewall->unblock(ipAddress, address.version);
+				} catch (std::runtime_error& e) {
+					log.error(e.what());
+				}
+				if (!removed) {
+					std::cerr << "Address " << ipAddress << " no longer needs to be blocked, but failed to remove block from " << hb::Config::firewallBackendName(config.firewallBackend) << " firewall backend!" << std::endl;
+					log.error("Address " + ipAddress + " no longer needs to be blocked, but failed to remove block from " + hb::Config::firewallBackendName(config.firewallBackend) + " firewall backend!");
 					exit(1);
 				}
 			}
@@ -767,21 +793,13 @@ int main(int argc, char *argv[])
 				}
 			}
 
-			// For iptables rule check
-			std::size_t posip = config.iptablesRule.find("%i");
-			std::string ruleStart = "";
-			std::string ruleEnd = "";
-			if (posip != std::string::npos) {
-				ruleStart = config.iptablesRule.substr(0, posip);
-				ruleEnd = config.iptablesRule.substr(posip + 2);
-			}
-			std::vector<std::string> rules;
-			std::vector<std::string>::iterator rit;
-			std::size_t checkStart = 0, checkEnd = 0;
-			std::smatch regexSearchResults;
-			std::regex ipSearchPattern(hb::kIpSearchPattern);
-			std::string regexSearchResult;
-			std::map<std::string, hb::SuspiciosAddressType>::iterator sait;
+			// For firewall changes on configuration reload
+			std::string iptablesRule = config.iptablesRule;
+			std::string iptablesChain = config.iptablesChain;
+			hb::FirewallBackend firewallBackend = config.firewallBackend;
+			std::string ipsetRule4 = config.ipsetRuleFor(4);
+			std::string ipsetRule6 = config.ipsetRuleFor(6);
+			std::string nftablesTable = config.nftablesTable;
 
 			// Compare data with iptables rules and add/remove rules if needed
 			if (!data.checkIptables()) {
@@ -802,7 +820,13 @@ int main(int argc, char *argv[])
 			cunistd::close(STDERR_FILENO);
 
 			// Init object to work with log files (check for suspicious activity)
-			hb::LogParser logParser = hb::LogParser(&log, &config, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
+			hb::LogParser logParser(&log, &config, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
+
+			// Init log file watcher (inotify), files that can not be watched are polled each logCheckInterval
+			hb::LogWatcher logWatcher(&log, &config);
+			logWatcher.init();
+			std::set<std::string> changedFiles, polledFiles;
+			bool checkAllFiles = true;// Check all files on startup and after config reload, later only changed or polled files
 
 			time_t lastFileMCheck, currentTime, lastLogCheck;
 			time(&lastFileMCheck);
@@ -820,11 +844,15 @@ int main(int argc, char *argv[])
 				// Get current time
 				time(&currentTime);
 
+				// iptables changes of this iteration are applied in single transaction
+				data.beginFirewallBatch();
+
 				// Reload configuration
 				if (reloadConfig) {
 					log.info("Daemon configuration reload...");
-					ruleStart = config.iptablesRule.substr(0, posip);
-					ruleEnd = config.iptablesRule.substr(posip + 2);
+					data.waitFirewall();// Worker uses configuration
+					data.flush();
+					logParser.logPrefilterStatistics();
 					if (!config.load()) {
 						log.error("Failed to reload configuration for daemon!");
 					}
@@ -834,74 +862,77 @@ int main(int argc, char *argv[])
 						log.error("Failed to parse configured patterns for daemon!");
 					}
 
+					// Log files might be changed, reopen and watch again
+					logParser.closeFiles();
+					logWatcher.init();
+					checkAllFiles = true;
+
 					// Reset config relad flag (so that it is not reladed again on next iteration)
 					reloadConfig = false;
 
+					// Switching backend while running would leave blocked addresses in previous backend
+					if (config.firewallBackend != firewallBackend) {
+						log.warning("iptables.backend changed in configuration, restart daemon to apply it!");
+						config.firewallBackend = firewallBackend;
+					}
+
+					// Renaming chain while running would leave rules in previous chain
+					if (config.iptablesChain != iptablesChain) {
+						log.warning("iptables.rules.chain changed in configuration, restart daemon to apply it!");
+						config.iptablesChain = iptablesChain;
+					}
+
 					// Recheck iptables rule after config reload (it might be changed)
-					posip = config.iptablesRule.find("%i");
-					if (posip != std::string::npos) {
+					if (config.firewallBackend == hb::FirewallBackend::BackendRules) {
 
-						// If rule has changed
-						if (ruleStart != config.iptablesRule.substr(0, posip)
-							|| ruleEnd != config.iptablesRule.substr(posip + 2)) {
+						// If rule has changed, chain is rebuilt with rules based on new configuration in single transaction
+						if (iptablesRule != config.iptablesRule) {
 							log.warning("iptables rule changed in configuration, updating iptables...");
-
-							// Get all current rules for INPUT chain
-							rules.clear();
-							iptables.listRules("INPUT", rules, 4);
-							iptables.listRules("INPUT", rules, 6);
-
-							// Loop all rules
-							for (rit = rules.begin(); rit != rules.end(); ++rit) {
-								checkStart = (*rit).find(ruleStart);
-								checkEnd = (*rit).find(ruleEnd);
-								checkEnd = (*rit).find(ruleEnd);
-								if (checkStart != std::string::npos && checkEnd != std::string::npos) {
-
-									// Find address in rule
-									if (std::regex_search((*rit), regexSearchResults, ipSearchPattern)) {
-										if (regexSearchResults.size() == 1) {
-											regexSearchResult = regexSearchResults[0].str();
-
-											// Remove rule based on old config
-											try {
-												if (iptables.remove("INPUT", ruleStart + regexSearchResult + ruleEnd) == false) {
-													log.error("Trying to update rule for address " + regexSearchResult + " based on updated configuraiton, but failed to remove current rule!");
-												} else {
-													sait->second.iptableRule = false;
-												}
-											} catch (std::runtime_error& e) {
-												std::string message = e.what();
-												log.error(message);
-												log.error("Trying to update rule for address " + regexSearchResult + " based on updated configuraiton, but failed to remove current rule!");
-											}
-
-											// Add rule based on new config
-											try {
-												bool res = false;
-												if (config.iptablesAppend) {
-													res = iptables.append("INPUT", config.iptablesRule.substr(0, posip) + regexSearchResult + config.iptablesRule.substr(posip + 2));
-												} else {
-													res = iptables.insert("INPUT", config.iptablesRule.substr(0, posip) + regexSearchResult + config.iptablesRule.substr(posip + 2));
-												}
-												if (res == false) {
-													log.error("Trying to update rule for address " + regexSearchResult + " based on updated configuraiton, but failed to add rule based on new configuration!");
-												} else {
-													sait->second.iptableRule = true;
-												}
-											} catch (std::runtime_error& e) {
-												std::string message = e.what();
-												log.error(message);
-												log.error("Trying to update rule for address " + regexSearchResult + " based on updated configuraiton, but failed to add rule based on new configuration!");
-											}
-
-										}
-									}
-								}
+							if (!data.rebuildIptables()) {
+								log.error("Failed to update iptables rules based on updated configuration!");
 							}
+							iptablesRule = config.iptablesRule;
 						}
 
+					} else if (config.firewallBackend == hb::FirewallBackend::BackendIpset
+						&& (ipsetRule4 != config.ipsetRuleFor(4) || ipsetRule6 != config.ipsetRuleFor(6))) {
+						log.warning("ipset rule changed in configuration, updating iptables...");
+
+						// Remove rules that reference previous sets, new sets are created and filled with datafile reload
+						try {
+							iptables.remove("INPUT", ipsetRule4, 4);
+						} catch (std::runtime_error& e) {
+							log.error(e.what());
+						}
+						try {
+							iptables.remove("INPUT", ipsetRule6, 6);
+						} catch (std::runtime_error& e) {
+							log.error(e.what());
+						}
+						ipsetRule4 = config.ipsetRuleFor(4);
+						ipsetRule6 = config.ipsetRuleFor(6);
+						reloadDataFile = true;
+					} else if ((config.firewallBackend == hb::FirewallBackend::BackendNftables || config.firewallBackend == hb::FirewallBackend::BackendNetlink) && nftablesTable != config.nftablesTable) {
+						log.warning("nftables table changed in configuration, updating nftables...");
+
+						// Remove previous table, new table is created and filled with datafile reload
+						try {
+							if (config.firewallBackend == hb::FirewallBackend::BackendNetlink) {
+								hb::Netlink netlink;
+								netlink.removeTable(nftablesTable);
+							} else {
+								hb::Nftables nftables;
+								nftables.removeTable(nftablesTable);
+							}
+						} catch (std::runtime_error& e) {
+							log.error(e.what());
+						}
+						nftablesTable = config.nftablesTable;
+						reloadDataFile = true;
 					}
+
+					// Rule removal time depends on score multiplier
+					data.scheduleExpiries();
 				}
 
 				// Reload datafile
@@ -916,21 +947,31 @@ int main(int argc, char *argv[])
 					reloadDataFile = false;
 				}
 
+				// Check log files changed since last iteration (inotify)
+				changedFiles = logWatcher.takeChanged();
+				if (changedFiles.size() > 0 && !checkAllFiles) {
+					logParser.checkFiles(&changedFiles);
+				}
+
 				// Log file check
-				if ((unsigned int)(currentTime - lastLogCheck) >= config.logCheckInterval) {
+				if (checkAllFiles || (unsigned int)(currentTime - lastLogCheck) >= config.logCheckInterval) {
 
 					// Check log files for suspicious activity and update iptables if needed
 					// TODO make this function responsive to kill
-					// TODO check file size also in this function since this proces can take more time than log rotate
-					logParser.checkFiles();
-
-					// Check iptables rules if any are expired and should be removed
-					for (sait = data.suspiciousAddresses.begin(); sait != data.suspiciousAddresses.end(); ++sait) {
-						if (sait->second.iptableRule) {
-							data.updateIptables(sait->first);
+					if (checkAllFiles || !logWatcher.active()) {
+						logParser.checkFiles();
+						checkAllFiles = false;
+					} else {
+						// Only files without inotify watch
+						polledFiles = logWatcher.polledFiles();
+						if (polledFiles.size() > 0) {
+							logParser.checkFiles(&polledFiles);
 						}
 					}
 
+					// Remove iptables rules that are expired (only addresses with passed removal time are checked)
+					data.expireRules();
+
 					// Update time of last log file check
 					lastLogCheck = currentTime;
 				}
@@ -946,10 +987,19 @@ int main(int argc, char *argv[])
 					}
 				}
 
-				// Sleep 1/5 of a second
-				cunistd::usleep(200000);
+				// Apply iptables changes (in background)
+				data.commitFirewallBatch();
+
+				// Write changes collected in memory (datafile.sync = interval)
+				data.sync();
+
+				// Wait for log file changes, but not longer than 1/5 of a second
+				logWatcher.wait(200);
 			}
 			abuseipdbReporterThread.join();
+			data.waitFirewall();
+			data.flush();
+			logParser.logPrefilterStatistics();
 			log.info("Hostblock daemon stop");
 		}
 
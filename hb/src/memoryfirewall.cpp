@@ -0,0 +1,110 @@
+/*
+ * Firewall backend that keeps blocked addresses in memory
+ *
+ * Transaction sleeps for configured latency, so that cost of firewall tools
+ * (fork and exec of iptables-restore, kernel commit) can be simulated.
+ */
+
+// Thread
+#include <thread>
+// Header
+#include "memoryfirewall.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+MemoryFirewall::MemoryFirewall(hb::Logger* log, hb::Config* config, unsigned int transactionLatency, unsigned int changeLatency, bool timeouts)
+: Firewall(log, config), transactionLatency(transactionLatency), changeLatency(changeLatency), elementTimeouts(timeouts)
+{
+
+}
+
+/*
+ * Apply changes after latency of transaction
+ */
+bool MemoryFirewall::commit(const std::vector<hb::FirewallChange>& changes)
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(this->transactionLatency + (unsigned long long int)this->changeLatency * changes.size()));
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	// Transaction with invalid address is rejected as whole
+	std::vector<hb::Address> keys(changes.size());
+	std::size_t i;
+	for (i = 0; i < changes.size(); ++i) {
+		if (!hb::Address::parse(changes[i].address, keys[i])) {
+			return false;
+		}
+	}
+	for (i = 0; i < changes.size(); ++i) {
+		if (changes[i].create) {
+			this->blockedAddresses[keys[i]] = changes[i].timeout;
+		} else {
+			this->blockedAddresses.erase(keys[i]);
+		}
+		this->operations.push_back(hb::MemoryFirewall::Operation{changes[i].address, changes[i].create, now});
+	}
+	++this->transactions;
+	return true;
+}
+
+/*
+ * Nothing to set up, blocked addresses are listed
+ */
+bool MemoryFirewall::setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	hb::AddressTable<unsigned long long int>::iterator it;
+	for (it = this->blockedAddresses.begin(); it != this->blockedAddresses.end(); ++it) {
+		blocked.push_back(it->first);
+	}
+	return false;
+}
+
+/*
+ * Whether blocks have timeout
+ */
+bool MemoryFirewall::timeouts() const
+{
+	return this->elementTimeouts;
+}
+
+/*
+ * Whether address is blocked
+ */
+bool MemoryFirewall::blocked(const std::string& address) const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->blockedAddresses.find(address) != NULL;
+}
+
+/*
+ * Count of blocked addresses
+ */
+std::size_t MemoryFirewall::blockedCount() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->blockedAddresses.size();
+}
+
+/*
+ * Count of committed transactions
+ */
+unsigned long long int MemoryFirewall::transactionCount() const
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->transactions;
+}
+
+/*
+ * Move committed changes to operations
+ */
+void MemoryFirewall::takeOperations(std::vector<hb::MemoryFirewall::Operation>& operations)
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	operations.insert(operations.end(), this->operations.begin(), this->operations.end());
+	this->operations.clear();
+}
@@ -0,0 +1,106 @@
+/*
+ * Firewall backend that keeps blocked addresses in memory, used to measure hostblock without root and firewall tools
+ */
+
+#ifndef HBMEMORYFIREWALL_H
+#define HBMEMORYFIREWALL_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Mutex
+#include <mutex>
+// Time
+#include <chrono>
+// Firewall
+#include "firewall.h"
+// Address table
+#include "addresstable.h"
+
+namespace hb{
+
+class MemoryFirewall : public hb::Firewall{
+	public:
+
+		/*
+		 * Committed change of single address with time when its transaction was completed
+		 */
+		struct Operation {
+			std::string address;
+			bool create;
+			std::chrono::steady_clock::time_point time;
+		};
+
+	private:
+
+		/*
+		 * Time each transaction takes and time each change adds to it (microseconds)
+		 */
+		unsigned int transactionLatency;
+		unsigned int changeLatency;
+
+		/*
+		 * Whether blocks have timeout (behave as nftables set elements)
+		 */
+		bool elementTimeouts;
+
+		/*
+		 * Guards all members below, changes are committed by worker thread
+		 */
+		mutable std::mutex mutex;
+
+		/*
+		 * Blocked addresses with timeout of their last create
+		 */
+		hb::AddressTable<unsigned long long int> blockedAddresses;
+
+		/*
+		 * Committed changes that are not taken yet
+		 */
+		std::vector<hb::MemoryFirewall::Operation> operations;
+
+		/*
+		 * Count of committed transactions
+		 */
+		unsigned long long int transactions = 0;
+
+	protected:
+
+		bool commit(const std::vector<hb::FirewallChange>& changes) override;
+
+	public:
+
+		/*
+		 * Constructor, latencies in microseconds
+		 */
+		MemoryFirewall(hb::Logger* log, hb::Config* config, unsigned int transactionLatency, unsigned int changeLatency, bool timeouts);
+
+		bool setup(std::vector<hb::Address>& blocked, const hb::Firewall::Known& known) override;
+		bool timeouts() const override;
+
+		/*
+		 * Whether address is blocked
+		 */
+		bool blocked(const std::string& address) const;
+
+		/*
+		 * Count of blocked addresses
+		 */
+		std::size_t blockedCount() const;
+
+		/*
+		 * Count of committed transactions
+		 */
+		unsigned long long int transactionCount() const;
+
+		/*
+		 * Move committed changes to operations
+		 */
+		void takeOperations(std::vector<hb::MemoryFirewall::Operation>& operations);
+
+};
+
+}
+
+#endif
@@ -0,0 +1,597 @@
+/*
+ * nftables over netlink
+ * Messages are built with nf_tables netlink interface (kernel headers, no
+ * libnftnl/libmnl needed) and sent from daemon process through single
+ * socket, so blocking address does not start any process. Changes are sent
+ * as nfnetlink batch, kernel applies whole batch as single transaction.
+ * Table, sets and chain are same as created by nftables backend, so that
+ * nft can be used to review them.
+ */
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Exceptions (runtime_error)
+#include <stdexcept>
+// C string (memcpy, strerror)
+#include <cstring>
+// Error numbers
+#include <cerrno>
+// Byte order (htobe64)
+#include <endian.h>
+// Byte order (htonl)
+#include <arpa/inet.h>
+// Socket
+#include <sys/socket.h>
+// poll
+#include <poll.h>
+// Netlink
+#include <linux/netlink.h>
+// Netfilter constants (NF_DROP, NFPROTO_INET, NF_INET_LOCAL_IN)
+#include <linux/netfilter.h>
+// nfnetlink
+#include <linux/netfilter/nfnetlink.h>
+// nf_tables netlink interface
+#include <linux/netfilter/nf_tables.h>
+// Miscellaneous UNIX symbolic constants, types and functions (getpid, close)
+namespace cunistd{
+	#include <unistd.h>
+}
+// Address
+#include "address.h"
+// Nftables (set names)
+#include "nftables.h"
+// Header
+#include "netlink.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Default socket send buffer is enough for batch of this size, larger batch needs larger buffer (kernel refuses
+ * message larger than send buffer)
+ */
+static const std::size_t kDefaultBatchSize = 65536;
+
+/*
+ * nftables set key types (same as nft uses for ipv4_addr and ipv6_addr)
+ */
+static const uint32_t kIpv4AddrType = 7;
+static const uint32_t kIpv6AddrType = 8;
+
+Netlink::Netlink()
+{
+
+}
+
+Netlink::~Netlink()
+{
+	this->close();
+}
+
+/*
+ * Close socket
+ */
+void Netlink::close()
+{
+	if (this->fd >= 0) {
+		cunistd::close(this->fd);
+		this->fd = -1;
+	}
+}
+
+/*
+ * Open socket
+ */
+void Netlink::open()
+{
+	if (this->fd >= 0 && this->openPid == (long int)cunistd::getpid()) {
+		return;
+	}
+
+	// Socket opened before fork is shared with parent, child closes own copy and opens new socket
+	this->close();
+	this->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+	if (this->fd < 0) {
+		throw std::runtime_error("Failed to open netlink socket: " + std::string(strerror(errno)));
+	}
+	struct sockaddr_nl local;
+	memset(&local, 0, sizeof(local));
+	local.nl_family = AF_NETLINK;
+	if (bind(this->fd, (struct sockaddr*)&local, sizeof(local)) != 0) {
+		std::string error = strerror(errno);
+		this->close();
+		throw std::runtime_error("Failed to bind netlink socket: " + error);
+	}
+
+	// Error responses do not need to include whole message
+	int value = 1;
+	setsockopt(this->fd, SOL_NETLINK, NETLINK_CAP_ACK, &value, sizeof(value));
+	this->openPid = (long int)cunistd::getpid();
+	this->sendBuffer = kDefaultBatchSize;
+}
+
+/*
+ * Make socket send buffer large enough for batch
+ */
+void Netlink::reserveSendBuffer(std::size_t size)
+{
+	if (size <= this->sendBuffer) {
+		return;
+	}
+	// Kernel doubles requested size for its bookkeeping, forced size (CAP_NET_ADMIN) is not limited by net.core.wmem_max
+	int value = (int)(size + 4096);
+	if (setsockopt(this->fd, SOL_SOCKET, SO_SNDBUFFORCE, &value, sizeof(value)) != 0
+			&& setsockopt(this->fd, SOL_SOCKET, SO_SNDBUF, &value, sizeof(value)) != 0) {
+		throw std::runtime_error("Failed to set netlink socket send buffer for batch of " + std::to_string(size) + " bytes: " + std::string(strerror(errno)));
+	}
+	this->sendBuffer = size;
+}
+
+/*
+ * Start new message
+ */
+void Netlink::beginMessage(uint16_t type, uint16_t flags, uint8_t family)
+{
+	struct nlmsghdr header;
+	memset(&header, 0, sizeof(header));
+	header.nlmsg_type = type;
+	header.nlmsg_flags = flags;
+	header.nlmsg_seq = ++this->seq;
+	struct nfgenmsg nfheader;
+	memset(&nfheader, 0, sizeof(nfheader));
+	nfheader.nfgen_family = family;
+	nfheader.version = NFNETLINK_V0;
+	if (type == NFNL_MSG_BATCH_BEGIN || type == NFNL_MSG_BATCH_END) {
+		nfheader.res_id = htons(NFNL_SUBSYS_NFTABLES);
+	}
+	this->message.assign((const char*)&header, sizeof(header));
+	this->message.append((const char*)&nfheader, sizeof(nfheader));
+	this->message.resize(NLMSG_ALIGN(this->message.size()), '\0');
+}
+
+/*
+ * Finish message
+ */
+void Netlink::endMessage()
+{
+	struct nlmsghdr* header = (struct nlmsghdr*)&this->message[0];
+	header->nlmsg_len = this->message.size();
+	if (this->batchMessages == 0) {
+		this->batchStart = header->nlmsg_seq;
+	}
+	this->batch += this->message;
+	++this->batchMessages;
+}
+
+/*
+ * Add attribute to message
+ */
+void Netlink::putAttribute(uint16_t type, const void* data, std::size_t length)
+{
+	struct nlattr attribute;
+	attribute.nla_len = NLA_HDRLEN + length;
+	attribute.nla_type = type;
+	this->message.append((const char*)&attribute, sizeof(attribute));
+	this->message.resize(this->message.size() + NLA_HDRLEN - sizeof(attribute), '\0');
+	this->message.append((const char*)data, length);
+	this->message.resize(NLA_ALIGN(this->message.size()), '\0');
+}
+
+void Netlink::putString(uint16_t type, const std::string& value)
+{
+	this->putAttribute(type, value.c_str(), value.size() + 1);
+}
+
+void Netlink::putU32(uint16_t type, uint32_t value)
+{
+	value = htonl(value);
+	this->putAttribute(type, &value, sizeof(value));
+}
+
+void Netlink::putU64(uint16_t type, uint64_t value)
+{
+	value = htobe64(value);
+	this->putAttribute(type, &value, sizeof(value));
+}
+
+/*
+ * Start nested attribute, length is set by endNested
+ */
+std::size_t Netlink::beginNested(uint16_t type)
+{
+	std::size_t offset = this->message.size();
+	this->putAttribute(type | NLA_F_NESTED, NULL, 0);
+	return offset;
+}
+
+void Netlink::endNested(std::size_t offset)
+{
+	struct nlattr* attribute = (struct nlattr*)&this->message[offset];
+	attribute->nla_len = this->message.size() - offset;
+}
+
+/*
+ * Find attribute
+ */
+bool Netlink::findAttribute(const char* data, std::size_t length, uint16_t type, const char*& value, std::size_t& valueLength)
+{
+	const struct nlattr* attribute;
+	std::size_t offset = 0;
+	while (offset + NLA_HDRLEN <= length) {
+		attribute = (const struct nlattr*)(data + offset);
+		if (attribute->nla_len < NLA_HDRLEN || offset + attribute->nla_len > length) {
+			return false;
+		}
+		if ((attribute->nla_type & NLA_TYPE_MASK) == type) {
+			value = data + offset + NLA_HDRLEN;
+			valueLength = attribute->nla_len - NLA_HDRLEN;
+			return true;
+		}
+		offset += NLA_ALIGN(attribute->nla_len);
+	}
+	return false;
+}
+
+/*
+ * Add set element message
+ */
+void Netlink::elementMessage(uint16_t type, uint16_t flags, const std::string& table, const std::string& address, int version, unsigned long long int timeout)
+{
+	hb::Address key;
+	if (!hb::Address::parse(address, key) || key.version != version) {
+		throw std::runtime_error("Invalid IP address " + address + " for nftables set!");
+	}
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | type, NLM_F_REQUEST | NLM_F_ACK | flags, NFPROTO_INET);
+	this->putString(NFTA_SET_ELEM_LIST_TABLE, table);
+	this->putString(NFTA_SET_ELEM_LIST_SET, hb::Nftables::setName(version));
+	std::size_t elements = this->beginNested(NFTA_SET_ELEM_LIST_ELEMENTS);
+	std::size_t element = this->beginNested(NFTA_LIST_ELEM);
+	std::size_t keyData = this->beginNested(NFTA_SET_ELEM_KEY);
+	this->putAttribute(NFTA_DATA_VALUE, key.bytes, version == 6 ? 16 : 4);
+	this->endNested(keyData);
+	if (timeout > 0) {
+		this->putU64(NFTA_SET_ELEM_TIMEOUT, (uint64_t)timeout * 1000);
+	}
+	this->endNested(element);
+	this->endNested(elements);
+	this->endMessage();
+}
+
+/*
+ * Add rule "ip saddr @addresses4 drop" (ip6 saddr @addresses6 for IPv6)
+ */
+void Netlink::dropRule(const std::string& table, int version)
+{
+	std::size_t element, data, nested, verdict;
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWRULE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_APPEND, NFPROTO_INET);
+	this->putString(NFTA_RULE_TABLE, table);
+	this->putString(NFTA_RULE_CHAIN, "input");
+	std::size_t expressions = this->beginNested(NFTA_RULE_EXPRESSIONS);
+
+	// Packet protocol (inet table has both IPv4 and IPv6 packets)
+	element = this->beginNested(NFTA_LIST_ELEM);
+	this->putString(NFTA_EXPR_NAME, "meta");
+	data = this->beginNested(NFTA_EXPR_DATA);
+	this->putU32(NFTA_META_DREG, NFT_REG_1);
+	this->putU32(NFTA_META_KEY, NFT_META_NFPROTO);
+	this->endNested(data);
+	this->endNested(element);
+
+	element = this->beginNested(NFTA_LIST_ELEM);
+	this->putString(NFTA_EXPR_NAME, "cmp");
+	data = this->beginNested(NFTA_EXPR_DATA);
+	this->putU32(NFTA_CMP_SREG, NFT_REG_1);
+	this->putU32(NFTA_CMP_OP, NFT_CMP_EQ);
+	nested = this->beginNested(NFTA_CMP_DATA);
+	uint8_t protocol = version == 6 ? NFPROTO_IPV6 : NFPROTO_IPV4;
+	this->putAttribute(NFTA_DATA_VALUE, &protocol, sizeof(protocol));
+	this->endNested(nested);
+	this->endNested(data);
+	this->endNested(element);
+
+	// Source address
+	element = this->beginNested(NFTA_LIST_ELEM);
+	this->putString(NFTA_EXPR_NAME, "payload");
+	data = this->beginNested(NFTA_EXPR_DATA);
+	this->putU32(NFTA_PAYLOAD_DREG, NFT_REG_1);
+	this->putU32(NFTA_PAYLOAD_BASE, NFT_PAYLOAD_NETWORK_HEADER);
+	this->putU32(NFTA_PAYLOAD_OFFSET, version == 6 ? 8 : 12);
+	this->putU32(NFTA_PAYLOAD_LEN, version == 6 ? 16 : 4);
+	this->endNested(data);
+	this->endNested(element);
+
+	// Lookup in set, set can be created in same batch (set id)
+	element = this->beginNested(NFTA_LIST_ELEM);
+	this->putString(NFTA_EXPR_NAME, "lookup");
+	data = this->beginNested(NFTA_EXPR_DATA);
+	this->putString(NFTA_LOOKUP_SET, hb::Nftables::setName(version));
+	this->putU32(NFTA_LOOKUP_SET_ID, version);
+	this->putU32(NFTA_LOOKUP_SREG, NFT_REG_1);
+	this->endNested(data);
+	this->endNested(element);
+
+	// Drop
+	element = this->beginNested(NFTA_LIST_ELEM);
+	this->putString(NFTA_EXPR_NAME, "immediate");
+	data = this->beginNested(NFTA_EXPR_DATA);
+	this->putU32(NFTA_IMMEDIATE_DREG, NFT_REG_VERDICT);
+	nested = this->beginNested(NFTA_IMMEDIATE_DATA);
+	verdict = this->beginNested(NFTA_DATA_VERDICT);
+	this->putU32(NFTA_VERDICT_CODE, NF_DROP);
+	this->endNested(verdict);
+	this->endNested(nested);
+	this->endNested(data);
+	this->endNested(element);
+
+	this->endNested(expressions);
+	this->endMessage();
+}
+
+/*
+ * Send batch and wait for acknowledgements
+ */
+void Netlink::send(const std::string& messages, uint32_t start, unsigned int count)
+{
+	this->open();
+
+	// Batch begin and end
+	std::string data = "";
+	this->beginMessage(NFNL_MSG_BATCH_BEGIN, NLM_F_REQUEST, AF_UNSPEC);
+	((struct nlmsghdr*)&this->message[0])->nlmsg_len = this->message.size();
+	uint32_t batchBegin = this->seq;
+	data += this->message;
+	data += messages;
+	this->beginMessage(NFNL_MSG_BATCH_END, NLM_F_REQUEST, AF_UNSPEC);
+	((struct nlmsghdr*)&this->message[0])->nlmsg_len = this->message.size();
+	data += this->message;
+
+	// Whole batch is sent as single message, so that kernel applies it as single transaction
+	this->reserveSendBuffer(data.size());
+	struct sockaddr_nl kernel;
+	memset(&kernel, 0, sizeof(kernel));
+	kernel.nl_family = AF_NETLINK;
+	if (sendto(this->fd, data.data(), data.size(), 0, (struct sockaddr*)&kernel, sizeof(kernel)) < 0) {
+		throw std::runtime_error("Failed to send netlink message: " + std::string(strerror(errno)));
+	}
+
+	// Only last message is acknowledged (errors are reported for any message), whole batch is rejected if any message
+	// fails and acknowledgement of last message comes after errors
+	char buffer[65536];
+	uint32_t last = start + count - 1;
+	bool acknowledged = false;
+	int error = 0;
+	struct pollfd pfd;
+	pfd.fd = this->fd;
+	pfd.events = POLLIN;
+	while (!acknowledged) {
+		if (poll(&pfd, 1, 5000) <= 0) {
+			throw std::runtime_error("Netlink batch not acknowledged");
+		}
+		ssize_t length = recv(this->fd, buffer, sizeof(buffer), 0);
+		if (length < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::runtime_error("Failed to receive netlink message: " + std::string(strerror(errno)));
+		}
+		int remaining = length;
+		for (struct nlmsghdr* header = (struct nlmsghdr*)buffer; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+			if (header->nlmsg_type != NLMSG_ERROR) {
+				continue;
+			}
+			struct nlmsgerr* response = (struct nlmsgerr*)NLMSG_DATA(header);
+			if (header->nlmsg_seq == batchBegin && response->error != 0) {// Whole batch refused (e.g. no permission)
+				throw std::runtime_error("Netlink batch refused: " + std::string(strerror(-response->error)));
+			}
+			if (header->nlmsg_seq < start || header->nlmsg_seq > last) {// Response to earlier batch
+				continue;
+			}
+			if (response->error != 0 && error == 0) {
+				error = response->error;
+			}
+			if (header->nlmsg_seq == last) {
+				acknowledged = true;
+			}
+		}
+	}
+	if (error != 0) {
+		throw std::runtime_error("Netlink batch failed: " + std::string(strerror(-error)));
+	}
+}
+
+/*
+ * Create table, sets and chain
+ */
+bool Netlink::setup(const std::string& table)
+{
+	this->discard();
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWTABLE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE, NFPROTO_INET);
+	this->putString(NFTA_TABLE_NAME, table);
+	this->endMessage();
+
+	int versions[] = {4, 6};
+	for (int version : versions) {
+		this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWSET, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE, NFPROTO_INET);
+		this->putString(NFTA_SET_TABLE, table);
+		this->putString(NFTA_SET_NAME, hb::Nftables::setName(version));
+		this->putU32(NFTA_SET_FLAGS, NFT_SET_TIMEOUT);
+		this->putU32(NFTA_SET_KEY_TYPE, version == 6 ? kIpv6AddrType : kIpv4AddrType);
+		this->putU32(NFTA_SET_KEY_LEN, version == 6 ? 16 : 4);
+		this->putU32(NFTA_SET_ID, version);
+		this->endMessage();
+	}
+
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWCHAIN, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE, NFPROTO_INET);
+	this->putString(NFTA_CHAIN_TABLE, table);
+	this->putString(NFTA_CHAIN_NAME, "input");
+	std::size_t hook = this->beginNested(NFTA_CHAIN_HOOK);
+	this->putU32(NFTA_HOOK_HOOKNUM, NF_INET_LOCAL_IN);
+	this->putU32(NFTA_HOOK_PRIORITY, (uint32_t)-10);
+	this->endNested(hook);
+	this->putU32(NFTA_CHAIN_POLICY, NF_ACCEPT);
+	this->putString(NFTA_CHAIN_TYPE, "filter");
+	this->endMessage();
+
+	// Replace chain rules
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_DELRULE, NLM_F_REQUEST | NLM_F_ACK, NFPROTO_INET);
+	this->putString(NFTA_RULE_TABLE, table);
+	this->putString(NFTA_RULE_CHAIN, "input");
+	this->endMessage();
+	this->dropRule(table, 4);
+	this->dropRule(table, 6);
+
+	return this->commit();
+}
+
+/*
+ * Delete table
+ */
+bool Netlink::removeTable(const std::string& table)
+{
+	this->discard();
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_NEWTABLE, NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE, NFPROTO_INET);
+	this->putString(NFTA_TABLE_NAME, table);
+	this->endMessage();
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_DELTABLE, NLM_F_REQUEST | NLM_F_ACK, NFPROTO_INET);
+	this->putString(NFTA_TABLE_NAME, table);
+	this->endMessage();
+	return this->commit();
+}
+
+/*
+ * Add address to set, add of existing element does not change its timeout, so element is added, deleted and added
+ * again with new timeout
+ */
+void Netlink::addElement(const std::string& table, const std::string& address, int version, unsigned long long int timeout)
+{
+	this->elementMessage(NFT_MSG_NEWSETELEM, NLM_F_CREATE, table, address, version, 0);
+	this->elementMessage(NFT_MSG_DELSETELEM, 0, table, address, version, 0);
+	this->elementMessage(NFT_MSG_NEWSETELEM, NLM_F_CREATE, table, address, version, timeout);
+}
+
+/*
+ * Delete address from set, element is added first so that delete does not fail
+ */
+void Netlink::removeElement(const std::string& table, const std::string& address, int version)
+{
+	this->elementMessage(NFT_MSG_NEWSETELEM, NLM_F_CREATE, table, address, version, 0);
+	this->elementMessage(NFT_MSG_DELSETELEM, 0, table, address, version, 0);
+}
+
+/*
+ * Send current batch as single transaction
+ */
+bool Netlink::commit()
+{
+	std::string messages;
+	messages.swap(this->batch);
+	uint32_t start = this->batchStart;
+	unsigned int count = this->batchMessages;
+	this->discard();
+	if (count == 0) {
+		return true;
+	}
+
+	// Only last message is acknowledged
+	std::size_t offset = 0, last = 0;
+	while (offset < messages.size()) {
+		last = offset;
+		((struct nlmsghdr*)&messages[offset])->nlmsg_flags &= ~NLM_F_ACK;
+		offset += NLMSG_ALIGN(((struct nlmsghdr*)&messages[offset])->nlmsg_len);
+	}
+	((struct nlmsghdr*)&messages[last])->nlmsg_flags |= NLM_F_ACK;
+	this->send(messages, start, count);
+	return true;
+}
+
+/*
+ * Drop current batch
+ */
+void Netlink::discard()
+{
+	this->batch.clear();
+	this->batchMessages = 0;
+}
+
+/*
+ * List set elements (dump request)
+ */
+void Netlink::listElements(const std::string& table, int version, std::vector<std::string>& elements)
+{
+	this->open();
+	this->discard();
+	this->beginMessage((NFNL_SUBSYS_NFTABLES << 8) | NFT_MSG_GETSETELEM, NLM_F_REQUEST | NLM_F_DUMP, NFPROTO_INET);
+	this->putString(NFTA_SET_ELEM_LIST_TABLE, table);
+	this->putString(NFTA_SET_ELEM_LIST_SET, hb::Nftables::setName(version));
+	((struct nlmsghdr*)&this->message[0])->nlmsg_len = this->message.size();
+	uint32_t requestSeq = this->seq;
+
+	struct sockaddr_nl kernel;
+	memset(&kernel, 0, sizeof(kernel));
+	kernel.nl_family = AF_NETLINK;
+	if (sendto(this->fd, this->message.data(), this->message.size(), 0, (struct sockaddr*)&kernel, sizeof(kernel)) < 0) {
+		throw std::runtime_error("Failed to send netlink message: " + std::string(strerror(errno)));
+	}
+
+	char buffer[65536];
+	struct pollfd pfd;
+	pfd.fd = this->fd;
+	pfd.events = POLLIN;
+	const char* value;
+	std::size_t valueLength;
+	hb::Address address;
+	address.version = version;
+	while (true) {
+		if (poll(&pfd, 1, 5000) <= 0) {
+			throw std::runtime_error("Netlink set element dump not finished");
+		}
+		ssize_t length = recv(this->fd, buffer, sizeof(buffer), 0);
+		if (length < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::runtime_error("Failed to receive netlink message: " + std::string(strerror(errno)));
+		}
+		int remaining = length;
+		for (struct nlmsghdr* header = (struct nlmsghdr*)buffer; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+			if (header->nlmsg_seq != requestSeq) {
+				continue;
+			}
+			if (header->nlmsg_type == NLMSG_DONE) {
+				return;
+			}
+			if (header->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr* response = (struct nlmsgerr*)NLMSG_DATA(header);
+				if (response->error == -ENOENT) {// No table or set yet
+					return;
+				}
+				throw std::runtime_error("Failed to list nftables set elements: " + std::string(strerror(-response->error)));
+			}
+
+			// Elements, each has key with address bytes
+			const char* attributes = (const char*)NLMSG_DATA(header) + NLMSG_ALIGN(sizeof(struct nfgenmsg));
+			std::size_t attributesLength = header->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+			const char* list;
+			std::size_t listLength;
+			if (!Netlink::findAttribute(attributes, attributesLength, NFTA_SET_ELEM_LIST_ELEMENTS, list, listLength)) {
+				continue;
+			}
+			std::size_t offset = 0;
+			while (offset + NLA_HDRLEN <= listLength) {
+				const struct nlattr* element = (const struct nlattr*)(list + offset);
+				if (element->nla_len < NLA_HDRLEN || offset + element->nla_len > listLength) {
+					break;
+				}
+				if (Netlink::findAttribute(list + offset + NLA_HDRLEN, element->nla_len - NLA_HDRLEN, NFTA_SET_ELEM_KEY, value, valueLength)
+						&& Netlink::findAttribute(value, valueLength, NFTA_DATA_VALUE, value, valueLength)
+						&& valueLength == (version == 6 ? 16u : 4u)) {
+					memcpy(address.bytes, value, valueLength);
+					elements.push_back(address.toString());
+				}
+				offset += NLA_ALIGN(element->nla_len);
+			}
+		}
+	}
+}
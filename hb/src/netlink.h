@@ -0,0 +1,163 @@
+/*
+ * nftables over netlink (iptables.backend = netlink), same table layout as
+ * nftables backend without executing nft
+ */
+
+#ifndef HBNETLINK_H
+#define HBNETLINK_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Fixed width integer types
+#include <cstdint>
+
+namespace hb{
+
+class Netlink{
+	private:
+
+		/*
+		 * Netlink socket, opened with first use
+		 * Process id is kept, socket opened before fork is not used in child process
+		 */
+		int fd = -1;
+		long int openPid = 0;
+
+		/*
+		 * Batch size socket send buffer is set for
+		 */
+		std::size_t sendBuffer = 0;
+
+		/*
+		 * Sequence number of last message
+		 */
+		uint32_t seq = 0;
+
+		/*
+		 * Messages of batch that is not sent yet, their count and sequence number of first one
+		 */
+		std::string batch;
+		unsigned int batchMessages = 0;
+		uint32_t batchStart = 0;
+
+		/*
+		 * Message that is being built
+		 */
+		std::string message;
+
+		/*
+		 * Open socket if it is not open yet
+		 */
+		void open();
+
+		/*
+		 * Make socket send buffer large enough for batch of size bytes, throws on failure
+		 */
+		void reserveSendBuffer(std::size_t size);
+
+		/*
+		 * Start new message (netlink and nfnetlink header)
+		 */
+		void beginMessage(uint16_t type, uint16_t flags, uint8_t family);
+
+		/*
+		 * Finish message, set its length and add it to batch
+		 */
+		void endMessage();
+
+		/*
+		 * Add attribute to message
+		 */
+		void putAttribute(uint16_t type, const void* data, std::size_t length);
+		void putString(uint16_t type, const std::string& value);
+		void putU32(uint16_t type, uint32_t value);
+		void putU64(uint16_t type, uint64_t value);
+
+		/*
+		 * Start and finish nested attribute
+		 */
+		std::size_t beginNested(uint16_t type);
+		void endNested(std::size_t offset);
+
+		/*
+		 * Find attribute in attribute stream, returns false if attribute is not found
+		 */
+		static bool findAttribute(const char* data, std::size_t length, uint16_t type, const char*& value, std::size_t& valueLength);
+
+		/*
+		 * Add set element message (with key and optional timeout) to batch
+		 */
+		void elementMessage(uint16_t type, uint16_t flags, const std::string& table, const std::string& address, int version, unsigned long long int timeout);
+
+		/*
+		 * Add rule that drops packets from addresses in set of IP version to batch
+		 */
+		void dropRule(const std::string& table, int version);
+
+		/*
+		 * Send batch (batch begin and end messages are added) and wait for acknowledgement of last message, throws on error
+		 */
+		void send(const std::string& messages, uint32_t start, unsigned int count);
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		Netlink();
+
+		/*
+		 * Destructor, closes socket
+		 */
+		~Netlink();
+
+		/*
+		 * Close socket
+		 */
+		void close();
+
+		/*
+		 * Create table, sets and input chain that drops packets from addresses in sets (same as Nftables::setup),
+		 * existing sets are kept, chain rules are replaced
+		 */
+		bool setup(const std::string& table);
+
+		/*
+		 * Delete table
+		 */
+		bool removeTable(const std::string& table);
+
+		/*
+		 * Add address to set of table in current batch, timeout in seconds (0 - no timeout), timeout of address that is
+		 * already in set is replaced
+		 */
+		void addElement(const std::string& table, const std::string& address, int version, unsigned long long int timeout);
+
+		/*
+		 * Delete address from set of table in current batch, address that is not in set is not an error
+		 */
+		void removeElement(const std::string& table, const std::string& address, int version);
+
+		/*
+		 * Send current batch as single transaction, none of changes is applied if one fails (socket send buffer grows
+		 * with batch size)
+		 */
+		bool commit();
+
+		/*
+		 * Drop current batch
+		 */
+		void discard();
+
+		/*
+		 * Get addresses in set of table
+		 */
+		void listElements(const std::string& table, int version, std::vector<std::string>& elements);
+
+};
+
+}
+
+#endif
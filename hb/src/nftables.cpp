@@ -0,0 +1,181 @@
+/*
+ * Simple class to work with nftables
+ * Same as with iptables, nft command is executed, commands are written to
+ * nft -f so that multiple changes are applied in single transaction.
+ * Blocked addresses are kept in sets with timeout flag, so that kernel
+ * removes address from set when its block time passes.
+ */
+
+// Standard string library
+#include <string>
+// String stream library
+#include <sstream>
+// Vector
+#include <vector>
+// Exceptions (runtime_error)
+#include <stdexcept>
+// Standard input/output C library (popen, fgets, fwrite, pclose)
+#include <cstdio>
+// POSIX (getuid)
+namespace cunistd{
+	#include <unistd.h>
+}
+// Address
+#include "address.h"
+// Header
+#include "nftables.h"
+
+// Hostblock namespace
+using namespace hb;
+
+Nftables::Nftables()
+{
+
+}
+
+/*
+ * Set name for IP version
+ */
+std::string Nftables::setName(int version)
+{
+	if (version == 6) {
+		return "addresses6";
+	}
+	return "addresses4";
+}
+
+/*
+ * Command to add address to set
+ * Add of existing element does not change its timeout, so element is added, deleted and added again with new timeout
+ */
+std::string Nftables::addElement(std::string table, std::string address, int version, unsigned long long int timeout)
+{
+	std::string element = "inet " + table + " " + Nftables::setName(version) + " { " + address;
+	std::string command = "add element " + element + " }\n";
+	command += "delete element " + element + " }\n";
+	command += "add element " + element;
+	if (timeout > 0) {
+		command += " timeout " + std::to_string(timeout) + "s";
+	}
+	command += " }";
+	return command;
+}
+
+/*
+ * Command to delete address from set, element is added first so that delete does not fail
+ */
+std::string Nftables::removeElement(std::string table, std::string address, int version)
+{
+	std::string element = "inet " + table + " " + Nftables::setName(version) + " { " + address + " }";
+	return "add element " + element + "\ndelete element " + element;
+}
+
+/*
+ * Create table, sets and chain
+ */
+bool Nftables::setup(std::string table)
+{
+	std::vector<std::string> commands;
+	commands.push_back("add table inet " + table);
+	commands.push_back("add set inet " + table + " " + Nftables::setName(4) + " { type ipv4_addr; flags timeout; }");
+	commands.push_back("add set inet " + table + " " + Nftables::setName(6) + " { type ipv6_addr; flags timeout; }");
+	commands.push_back("add chain inet " + table + " input { type filter hook input priority -10; policy accept; }");
+	commands.push_back("flush chain inet " + table + " input");
+	commands.push_back("add rule inet " + table + " input ip saddr @" + Nftables::setName(4) + " drop");
+	commands.push_back("add rule inet " + table + " input ip6 saddr @" + Nftables::setName(6) + " drop");
+	return this->apply(commands);
+}
+
+/*
+ * Delete table
+ */
+bool Nftables::removeTable(std::string table)
+{
+	std::vector<std::string> commands;
+	commands.push_back("add table inet " + table);
+	commands.push_back("delete table inet " + table);
+	return this->apply(commands);
+}
+
+/*
+ * Apply commands in single nft transaction
+ */
+bool Nftables::apply(const std::vector<std::string>& commands)
+{
+	// Need root access to work with nftables
+	if (cunistd::getuid() != 0) {
+		throw std::runtime_error("Error, root access required to work with nftables!");
+	}
+
+	if (commands.size() == 0) {
+		return true;
+	}
+
+	std::string input = "";
+	for (std::vector<std::string>::const_iterator it = commands.begin(); it != commands.end(); ++it) {
+		input += *it + "\n";
+	}
+
+	// Open pipe stream, nft reads whole input and applies it as single transaction
+	FILE* pipe = popen("nft -f -", "w");
+	if (!pipe) {
+		throw std::runtime_error("Unable to open pipe to nft.");
+	}
+	std::size_t written = fwrite(input.data(), 1, input.size(), pipe);
+
+	// Close stream
+	int response = pclose(pipe);
+
+	if (written == input.size() && response == 0) {
+		return true;
+	} else {
+		throw std::runtime_error("Failed to execute nft, returned code: " + std::to_string(response));
+	}
+}
+
+/*
+ * List set elements
+ */
+void Nftables::listElements(std::string table, int version, std::vector<std::string>& elements)
+{
+	// Need root access to work with nftables
+	if (cunistd::getuid() != 0) {
+		throw std::runtime_error("Error, root access required to work with nftables!");
+	}
+
+	// Command
+	std::string cmd = "nft list set inet " + table + " " + Nftables::setName(version);
+
+	// Open pipe stream
+	FILE* pipe = popen(cmd.c_str(), "r");
+	if (!pipe) {
+		throw std::runtime_error("Unable to open pipe to nft for element listing.");
+	}
+	char buffer[128];
+	std::string result = "";
+
+	// Read pipe stream
+	while (!feof(pipe)) {
+		if(fgets(buffer, 128, pipe) != NULL) result += buffer;
+	}
+
+	// Close stream
+	pclose(pipe);
+
+	// Elements are listed as "elements = { 10.0.0.1 timeout 1h expires 59m, 10.0.0.2, ... }", list can span multiple lines
+	std::size_t start = result.find("elements = {");
+	if (start == std::string::npos) {
+		return;
+	}
+	std::size_t end = result.find('}', start);
+	std::istringstream iss(result.substr(start + 12, end == std::string::npos ? std::string::npos : end - start - 12));
+	std::string element, address;
+	hb::Address parsed;
+	while (std::getline(iss, element, ',')) {
+		std::istringstream words(element);
+		if (words >> address && hb::Address::parse(address, parsed)) {
+			elements.push_back(address);
+		}
+	}
+	return;
+}
@@ -0,0 +1,66 @@
+/*
+ * Simple class to work with nftables
+ */
+
+// Vector
+#include <vector>
+// Standard string library
+#include <string>
+
+#ifndef HBNFTABLES_H
+#define HBNFTABLES_H
+
+namespace hb{
+
+class Nftables{
+	private:
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		Nftables();
+
+		/*
+		 * Set name for IP version
+		 */
+		static std::string setName(int version);
+
+		/*
+		 * Command to add address to set of table, element with timeout (seconds, 0 - no timeout) is removed by kernel when
+		 * timeout passes, timeout of address that is already in set is replaced
+		 */
+		static std::string addElement(std::string table, std::string address, int version, unsigned long long int timeout);
+
+		/*
+		 * Command to delete address from set of table, address that is not in set is not an error
+		 */
+		static std::string removeElement(std::string table, std::string address, int version);
+
+		/*
+		 * Create table with IPv4 and IPv6 sets and input chain that drops packets from addresses in sets, existing sets
+		 * are kept, chain rules are replaced
+		 */
+		bool setup(std::string table);
+
+		/*
+		 * Delete table
+		 */
+		bool removeTable(std::string table);
+
+		/*
+		 * Apply commands in single nft transaction (nft -f), none of commands is applied if one fails
+		 */
+		bool apply(const std::vector<std::string>& commands);
+
+		/*
+		 * Get addresses in set of table
+		 */
+		void listElements(std::string table, int version, std::vector<std::string>& elements);
+
+};
+
+}
+
+#endif
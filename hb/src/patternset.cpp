@@ -0,0 +1,542 @@
+/*
+ * Set of log group patterns compiled into single regex, so that each line is
+ * matched only once regardless of pattern count
+ *
+ * Patterns are joined into one alternation where each pattern is wrapped in
+ * its own capture group:
+ *   (pattern1)|(pattern2)|...
+ * ECMAScript alternation is ordered, so the first pattern in configuration
+ * order that matches whole line wins, same as matching patterns one by one.
+ * Group that wraps pattern tells which pattern matched, groups inside it are
+ * IP address and port of that pattern. If that address is not valid, rest of
+ * patterns are matched one by one, so the first pattern whose address is
+ * valid wins.
+ *
+ * With RE2 engine patterns are added to RE2::Set, which finds all matching
+ * patterns in single DFA pass over line. Matching patterns are then matched
+ * once more alone (lowest index first) to extract IP address and port, until
+ * one of them has valid address.
+ *
+ * Before any regex is run, line can be checked with literal prefilter. For
+ * each pattern longest literal substring, that every matching line must
+ * contain, is extracted (for example "sshd[" or "invalid user "). If line
+ * contains none of them, none of patterns can match. Literal search uses
+ * memchr on single byte of literal, which libc implements with vector
+ * instructions, and only then compares whole literal.
+ */
+
+// Vector
+#include <vector>
+// Standard string library
+#include <string>
+// Exceptions
+#include <stdexcept>
+// C string (memchr)
+#include <cstring>
+// Character classification (tolower, isalnum)
+#include <cctype>
+// Algorithm (find)
+#include <algorithm>
+// RegEx
+#include <regex>
+// RE2
+#include <re2/re2.h>
+// RE2 set
+#include <re2/set.h>
+// Util
+#include "util.h"
+// Header
+#include "patternset.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * Constructor
+ */
+PatternSet::PatternSet()
+{
+
+}
+
+/*
+ * Count capturing groups in regex, skips escaped characters, character classes and (?...) groups
+ */
+int PatternSet::countGroups(const std::string& pattern)
+{
+	int count = 0;
+	bool inClass = false;
+	for (std::size_t i = 0; i < pattern.length(); ++i) {
+		if (pattern[i] == '\\') {
+			++i;// Skip escaped character
+		} else if (inClass) {
+			if (pattern[i] == ']') inClass = false;
+		} else if (pattern[i] == '[') {
+			inClass = true;
+			// Closing bracket right after opening (or after negation) is literal
+			if (i + 1 < pattern.length() && pattern[i + 1] == '^') ++i;
+			if (i + 1 < pattern.length() && pattern[i + 1] == ']') ++i;
+		} else if (pattern[i] == '(') {
+			if (i + 1 >= pattern.length() || pattern[i + 1] != '?') ++count;
+		}
+	}
+	return count;
+}
+
+/*
+ * Extract longest literal substring that any line matching pattern must contain
+ * Only top level of pattern is examined, groups, character classes and escape classes (\d, \s, ...) end literal
+ * Characters made optional by following ?, * or {0,...} are not part of literal
+ * If pattern has top level alternation, there is no required literal (empty string is returned)
+ */
+std::string PatternSet::extractLiteral(const std::string& pattern)
+{
+	std::string longest = "";
+	std::string current = "";
+	bool lastIsLiteral = false;// Whether last atom is character in current literal (quantifier applies to it)
+	bool lastIsQuantifier = false;// For lazy quantifiers (+?, *?, ??)
+	int depth = 0;
+	std::size_t i, close;
+	unsigned long minCount;
+	char c;
+
+	for (i = 0; i < pattern.length(); ++i) {
+		c = pattern[i];
+		if (c == '\\') {
+			if (i + 1 >= pattern.length()) break;
+			++i;
+			if (std::isalnum((unsigned char)pattern[i])) {
+				// Escape class or special character (\d, \s, \b, \n, ...)
+				if (current.length() > longest.length()) longest = current;
+				current = "";
+				lastIsLiteral = false;
+			} else {
+				// Escaped punctuation is literal
+				current += (char)std::tolower((unsigned char)pattern[i]);
+				lastIsLiteral = true;
+			}
+			lastIsQuantifier = false;
+		} else if (c == '[') {
+			// Skip character class
+			++i;
+			if (i < pattern.length() && pattern[i] == '^') ++i;
+			if (i < pattern.length() && pattern[i] == ']') ++i;
+			while (i < pattern.length() && pattern[i] != ']') {
+				if (pattern[i] == '\\') ++i;
+				++i;
+			}
+			if (current.length() > longest.length()) longest = current;
+			current = "";
+			lastIsLiteral = false;
+			lastIsQuantifier = false;
+		} else if (c == '(') {
+			// Skip group
+			depth = 1;
+			for (++i; i < pattern.length() && depth > 0; ++i) {
+				if (pattern[i] == '\\') {
+					++i;
+				} else if (pattern[i] == '[') {
+					++i;
+					if (i < pattern.length() && pattern[i] == '^') ++i;
+					if (i < pattern.length() && pattern[i] == ']') ++i;
+					while (i < pattern.length() && pattern[i] != ']') {
+						if (pattern[i] == '\\') ++i;
+						++i;
+					}
+				} else if (pattern[i] == '(') {
+					++depth;
+				} else if (pattern[i] == ')') {
+					--depth;
+				}
+			}
+			--i;
+			if (current.length() > longest.length()) longest = current;
+			current = "";
+			lastIsLiteral = false;
+			lastIsQuantifier = false;
+		} else if (c == '|') {
+			// Top level alternation, no literal is required
+			return "";
+		} else if (c == '?' || c == '*') {
+			if (!lastIsQuantifier && lastIsLiteral && current.length() > 0) {
+				// Previous character is optional
+				current.erase(current.length() - 1);
+			}
+			if (current.length() > longest.length()) longest = current;
+			current = "";
+			lastIsLiteral = false;
+			lastIsQuantifier = !lastIsQuantifier;
+		} else if (c == '+') {
+			// Previous character is required, but literal can not continue over repetition
+			if (current.length() > longest.length()) longest = current;
+			current = "";
+			lastIsLiteral = false;
+			lastIsQuantifier = true;
+		} else if (c == '{') {
+			close = pattern.find('}', i);
+			if (close == std::string::npos) {
+				// Not quantifier, literal brace
+				current += c;
+				lastIsLiteral = true;
+				lastIsQuantifier = false;
+				continue;
+			}
+			minCount = strtoul(pattern.substr(i + 1, close - i - 1).c_str(), NULL, 10);
+			if (minCount == 0 && lastIsLiteral && current.length() > 0) {
+				current.erase(current.length() - 1);
+			}
+			if (current.length() > longest.length()) longest = current;
+			current = "";
+			lastIsLiteral = false;
+			lastIsQuantifier = true;
+			i = close;
+		} else if (c == '.' || c == '^' || c == '$') {
+			if (current.length() > longest.length()) longest = current;
+			current = "";
+			lastIsLiteral = false;
+			lastIsQuantifier = false;
+		} else {
+			current += (char)std::tolower((unsigned char)c);
+			lastIsLiteral = true;
+			lastIsQuantifier = false;
+		}
+	}
+	if (current.length() > longest.length()) longest = current;
+
+	return longest;
+}
+
+/*
+ * Case insensitive search of lower case literal in line
+ */
+bool PatternSet::containsLiteral(const char* begin, const char* end, const std::string& literal)
+{
+	std::size_t length = literal.length();
+	if (length == 0) return true;
+	if ((std::size_t)(end - begin) < length) return false;
+
+	// Prefer byte without case for memchr, then only one scan is needed
+	std::size_t anchor = 0;
+	for (std::size_t i = 0; i < length; ++i) {
+		if (!std::isalpha((unsigned char)literal[i])) {
+			anchor = i;
+			break;
+		}
+	}
+	char anchorChars[2] = {literal[anchor], (char)std::toupper((unsigned char)literal[anchor])};
+	int anchorCount = (anchorChars[0] == anchorChars[1] ? 1 : 2);
+
+	const char* pos;
+	const char* last = end - length + anchor;// Last possible position of anchor byte
+	std::size_t j;
+	for (int a = 0; a < anchorCount; ++a) {
+		pos = begin + anchor;
+		while (pos <= last) {
+			pos = (const char*)memchr(pos, anchorChars[a], last - pos + 1);
+			if (pos == nullptr) break;
+			for (j = 0; j < length; ++j) {
+				if ((char)std::tolower((unsigned char)pos[j - anchor]) != literal[j]) break;
+			}
+			if (j == length) return true;
+			++pos;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Compile patterns (with %i and %p already replaced) into single regex
+ */
+void PatternSet::compile(const std::vector<hb::Pattern>& patterns, hb::RegexEngine engine)
+{
+	int innerGroups = 0;
+
+	this->engine = engine;
+	this->markerGroups.clear();
+	this->ipGroups.clear();
+	this->portGroups.clear();
+
+	// Same group order as when matching pattern alone (group 1 and 2)
+	for (std::vector<hb::Pattern>::const_iterator itp = patterns.begin(); itp != patterns.end(); ++itp) {
+		innerGroups = PatternSet::countGroups(itp->patternString);
+		if (itp->portSearch != -1 && innerGroups > 1) {
+			if (itp->portSearch == 1) {
+				// Port is after IP address
+				this->ipGroups.push_back(1);
+				this->portGroups.push_back(2);
+			} else {
+				// Port is before IP address
+				this->ipGroups.push_back(2);
+				this->portGroups.push_back(1);
+			}
+		} else if (innerGroups > 0) {
+			this->ipGroups.push_back(1);
+			this->portGroups.push_back(-1);
+		} else {
+			this->ipGroups.push_back(-1);
+			this->portGroups.push_back(-1);
+		}
+	}
+
+	// Literal prefilter
+	this->patternLiterals.clear();
+	this->literals.clear();
+	this->prefilter = (patterns.size() > 0);
+	for (std::vector<hb::Pattern>::const_iterator itp = patterns.begin(); itp != patterns.end(); ++itp) {
+		std::string literal = PatternSet::extractLiteral(itp->patternString);
+		this->patternLiterals.push_back(literal);
+		if (literal.length() == 0) {
+			this->prefilter = false;
+		} else if (std::find(this->literals.begin(), this->literals.end(), literal) == this->literals.end()) {
+			this->literals.push_back(literal);
+		}
+	}
+
+	if (this->engine == hb::RegexEngine::Re2Regex) {
+		this->compileRe2(patterns);
+	} else {
+		this->compileStd(patterns);
+	}
+}
+
+/*
+ * Compile patterns with std::regex
+ */
+void PatternSet::compileStd(const std::vector<hb::Pattern>& patterns)
+{
+	std::string combinedString = "";
+	int group = 1;
+
+	this->re2Set.reset();
+	this->re2Patterns.clear();
+	this->stdPatterns.clear();
+
+	for (std::vector<hb::Pattern>::const_iterator itp = patterns.begin(); itp != patterns.end(); ++itp) {
+		this->stdPatterns.push_back(std::make_shared<std::regex>(itp->patternString, std::regex_constants::icase));
+		if (combinedString.length() > 0) combinedString += '|';
+		combinedString += '(' + itp->patternString + ')';
+		this->markerGroups.push_back(group);
+		group += 1 + PatternSet::countGroups(itp->patternString);
+	}
+
+	if (combinedString.length() > 0) {
+		this->combined = std::regex(combinedString, std::regex_constants::icase);
+	} else {
+		this->combined = std::regex();
+	}
+}
+
+/*
+ * Compile patterns with RE2
+ */
+void PatternSet::compileRe2(const std::vector<hb::Pattern>& patterns)
+{
+	std::string error;
+	re2::RE2::Options options;
+	options.set_case_sensitive(false);
+	options.set_log_errors(false);
+	// Give DFA enough memory for long pattern lists, default 8MB is shared between all patterns in set
+	options.set_max_mem(64 << 20);
+
+	this->combined = std::regex();
+	this->stdPatterns.clear();
+	this->re2Patterns.clear();
+	this->re2Set = std::make_shared<re2::RE2::Set>(options, re2::RE2::ANCHOR_BOTH);
+
+	for (std::vector<hb::Pattern>::const_iterator itp = patterns.begin(); itp != patterns.end(); ++itp) {
+		std::shared_ptr<re2::RE2> re = std::make_shared<re2::RE2>(itp->patternString, options);
+		if (!re->ok()) {
+			throw std::runtime_error("Failed to compile pattern with RE2: " + re->error() + ": " + itp->patternString);
+		}
+		this->re2Patterns.push_back(re);
+		if (this->re2Set->Add(itp->patternString, &error) < 0) {
+			throw std::runtime_error("Failed to add pattern to RE2 set: " + error + ": " + itp->patternString);
+		}
+	}
+
+	if (this->re2Patterns.size() > 0 && !this->re2Set->Compile()) {
+		throw std::runtime_error("Failed to compile RE2 pattern set, out of memory");
+	}
+}
+
+/*
+ * Pattern count in set
+ */
+std::size_t PatternSet::size() const
+{
+	return this->ipGroups.size();
+}
+
+/*
+ * Literal prefilter check
+ */
+bool PatternSet::candidate(const char* begin, const char* end) const
+{
+	if (this->ipGroups.size() == 0) {
+		return false;
+	}
+	if (!this->prefilter) {
+		return true;
+	}
+	for (std::vector<std::string>::const_iterator itl = this->literals.begin(); itl != this->literals.end(); ++itl) {
+		if (PatternSet::containsLiteral(begin, end, *itl)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Required literal of pattern used by prefilter
+ */
+const std::string& PatternSet::literal(std::size_t index) const
+{
+	return this->patternLiterals[index];
+}
+
+/*
+ * Match line with all patterns at once
+ */
+int PatternSet::match(const char* begin, const char* end, hb::PatternMatch& result) const
+{
+	result.index = -1;
+	if (this->ipGroups.size() == 0) {
+		return -1;
+	}
+	if (this->engine == hb::RegexEngine::Re2Regex) {
+		return this->matchRe2(begin, end, result);
+	}
+	return this->matchStd(begin, end, result);
+}
+
+/*
+ * Match line with std::regex
+ */
+int PatternSet::matchStd(const char* begin, const char* end, hb::PatternMatch& result) const
+{
+	std::cmatch matchResults;
+	if (!std::regex_match(begin, end, matchResults, this->combined)) {
+		return -1;
+	}
+
+	// Find which pattern matched
+	for (std::size_t i = 0; i < this->markerGroups.size(); ++i) {
+		if (matchResults[this->markerGroups[i]].matched) {
+			if (this->matchStdGroups(matchResults, this->markerGroups[i], i, result)) {
+				return result.index;
+			}
+			// Address is not valid, alternation does not try later patterns, match them one by one
+			for (++i; i < this->stdPatterns.size(); ++i) {
+				if (std::regex_match(begin, end, matchResults, *this->stdPatterns[i]) && this->matchStdGroups(matchResults, 0, i, result)) {
+					return result.index;
+				}
+			}
+			return -1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Take IP address and port of pattern from std::regex match results
+ */
+bool PatternSet::matchStdGroups(const std::cmatch& matchResults, int offset, std::size_t index, hb::PatternMatch& result) const
+{
+	if (this->ipGroups[index] == -1 || !matchResults[offset + this->ipGroups[index]].matched) {
+		return false;
+	}
+	result.index = (int)index;
+	result.ipBegin = matchResults[offset + this->ipGroups[index]].first;
+	result.ipEnd = matchResults[offset + this->ipGroups[index]].second;
+	if (this->portGroups[index] != -1 && matchResults[offset + this->portGroups[index]].matched) {
+		result.portBegin = matchResults[offset + this->portGroups[index]].first;
+		result.portEnd = matchResults[offset + this->portGroups[index]].second;
+	} else {
+		result.portBegin = result.ipEnd;
+		result.portEnd = result.ipEnd;
+	}
+	if (!hb::Address::parse(result.ipBegin, result.ipEnd, result.address)) {
+		result.index = -1;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Match line with RE2
+ */
+int PatternSet::matchRe2(const char* begin, const char* end, hb::PatternMatch& result) const
+{
+	std::vector<int> matched;
+	re2::RE2::Set::ErrorInfo errorInfo;
+	if (!this->re2Set->Match(re2::StringPiece(begin, end - begin), &matched, &errorInfo)) {
+		if (errorInfo.kind != re2::RE2::Set::kOutOfMemory) {
+			return -1;
+		}
+		// DFA ran out of memory for this line, check patterns one by one
+		for (std::size_t i = 0; i < this->re2Patterns.size(); ++i) {
+			if (this->matchRe2Pattern(i, begin, end, result)) {
+				return result.index;
+			}
+		}
+		return -1;
+	}
+
+	// Set reports all matching patterns, first one in configuration order with valid address wins
+	std::sort(matched.begin(), matched.end());
+	for (std::vector<int>::iterator itm = matched.begin(); itm != matched.end(); ++itm) {
+		if (this->matchRe2Pattern((std::size_t)*itm, begin, end, result)) {
+			return result.index;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Extract IP address and port of single pattern with RE2
+ */
+bool PatternSet::matchRe2Pattern(std::size_t index, const char* begin, const char* end, hb::PatternMatch& result) const
+{
+	if (this->ipGroups[index] == -1) {
+		return false;
+	}
+	re2::StringPiece text(begin, end - begin);
+	re2::StringPiece groups[3];
+	// RE2 refuses to match if asked for more groups than pattern has
+	int groupCount = 1 + (this->portGroups[index] > this->ipGroups[index] ? this->portGroups[index] : this->ipGroups[index]);
+	if (!this->re2Patterns[index]->Match(text, 0, text.size(), re2::RE2::ANCHOR_BOTH, groups, groupCount)) {
+		return false;
+	}
+	if (groups[this->ipGroups[index]].data() == nullptr) {
+		return false;
+	}
+	result.index = (int)index;
+	result.ipBegin = groups[this->ipGroups[index]].data();
+	result.ipEnd = result.ipBegin + groups[this->ipGroups[index]].size();
+	if (this->portGroups[index] != -1 && groups[this->portGroups[index]].data() != nullptr) {
+		result.portBegin = groups[this->portGroups[index]].data();
+		result.portEnd = result.portBegin + groups[this->portGroups[index]].size();
+	} else {
+		result.portBegin = result.ipEnd;
+		result.portEnd = result.ipEnd;
+	}
+	if (!hb::Address::parse(result.ipBegin, result.ipEnd, result.address)) {
+		result.index = -1;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Engine name as used in configuration file
+ */
+std::string PatternSet::engineName(hb::RegexEngine engine)
+{
+	if (engine == hb::RegexEngine::Re2Regex) {
+		return "re2";
+	}
+	return "std";
+}
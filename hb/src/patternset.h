@@ -0,0 +1,175 @@
+/*
+ * Set of log group patterns compiled into single regex, so that each line is
+ * matched only once regardless of pattern count
+ */
+
+#ifndef HBPATTERNSET_H
+#define HBPATTERNSET_H
+
+// Vector
+#include <vector>
+// Standard string library
+#include <string>
+// Shared pointer
+#include <memory>
+// RegEx
+#include <regex>
+// RE2
+#include <re2/re2.h>
+// RE2 set
+#include <re2/set.h>
+// Address
+#include "address.h"
+// Pattern, regex engine
+#include "util.h"
+
+namespace hb{
+
+/*
+ * Result of line match with pattern set
+ * Note, pointers point to matched line, they are valid only while line is not changed
+ */
+struct PatternMatch {
+	int index = -1;// Index of matched pattern in log group pattern list
+	const char* ipBegin = nullptr;
+	const char* ipEnd = nullptr;
+	const char* portBegin = nullptr;// Same as portEnd if pattern does not contain port
+	const char* portEnd = nullptr;
+	hb::Address address;// Parsed IP address
+};
+
+class PatternSet{
+	private:
+
+		/*
+		 * Engine patterns are compiled for
+		 */
+		hb::RegexEngine engine = hb::RegexEngine::StdRegex;
+
+		/*
+		 * Per pattern capture group layout, IP and port group numbers are relative to pattern (as if pattern is matched alone)
+		 */
+		std::vector<int> markerGroups;// Group that wraps whole pattern in combined std::regex
+		std::vector<int> ipGroups;// Group with IP address, -1 if pattern does not contain IP address group
+		std::vector<int> portGroups;// Group with port, -1 if pattern does not contain port
+
+		/*
+		 * std::regex - all patterns joined in single alternation, each pattern is wrapped in capture group
+		 * Patterns are compiled also one by one for lines where address of first matching pattern is not valid
+		 */
+		std::regex combined;
+		std::vector<std::shared_ptr<std::regex>> stdPatterns;
+
+		/*
+		 * RE2 - set to find which patterns match and compiled patterns to extract IP address and port from matched one
+		 * Note, compiled RE2 objects are immutable and thread safe, so copies of pattern set share them
+		 */
+		std::shared_ptr<re2::RE2::Set> re2Set;
+		std::vector<std::shared_ptr<re2::RE2>> re2Patterns;
+
+		/*
+		 * Literal prefilter - longest literal substring (lower case) each pattern requires, empty if pattern has no required literal
+		 */
+		std::vector<std::string> patternLiterals;
+
+		/*
+		 * Unique literals of all patterns, line is candidate for regex if it contains any of these
+		 */
+		std::vector<std::string> literals;
+
+		/*
+		 * Whether prefilter can be used, false if at least one pattern has no required literal
+		 */
+		bool prefilter = false;
+
+		/*
+		 * Extract longest literal substring that any line matching pattern must contain
+		 */
+		static std::string extractLiteral(const std::string& pattern);
+
+		/*
+		 * Case insensitive search of lower case literal in line
+		 */
+		static bool containsLiteral(const char* begin, const char* end, const std::string& literal);
+
+		/*
+		 * Count capturing groups in regex
+		 */
+		static int countGroups(const std::string& pattern);
+
+		/*
+		 * Compile patterns with std::regex
+		 */
+		void compileStd(const std::vector<hb::Pattern>& patterns);
+
+		/*
+		 * Compile patterns with RE2
+		 */
+		void compileRe2(const std::vector<hb::Pattern>& patterns);
+
+		/*
+		 * Match line with std::regex
+		 */
+		int matchStd(const char* begin, const char* end, hb::PatternMatch& result) const;
+
+		/*
+		 * Take IP address and port of pattern from std::regex match results (offset - group that wraps pattern)
+		 */
+		bool matchStdGroups(const std::cmatch& matchResults, int offset, std::size_t index, hb::PatternMatch& result) const;
+
+		/*
+		 * Match line with RE2
+		 */
+		int matchRe2(const char* begin, const char* end, hb::PatternMatch& result) const;
+
+		/*
+		 * Extract IP address and port of single pattern with RE2
+		 */
+		bool matchRe2Pattern(std::size_t index, const char* begin, const char* end, hb::PatternMatch& result) const;
+
+	public:
+
+		/*
+		 * Constructor
+		 */
+		PatternSet();
+
+		/*
+		 * Compile patterns (with %i and %p already replaced) into single regex
+		 * Note, std::regex_error (std::regex) or std::runtime_error (RE2) is thrown if any of patterns fails to compile
+		 */
+		void compile(const std::vector<hb::Pattern>& patterns, hb::RegexEngine engine = hb::RegexEngine::StdRegex);
+
+		/*
+		 * Pattern count in set
+		 */
+		std::size_t size() const;
+
+		/*
+		 * Literal prefilter check, returns false if line can not match any of patterns (no need to run regex)
+		 */
+		bool candidate(const char* begin, const char* end) const;
+
+		/*
+		 * Required literal of pattern used by prefilter, empty string if pattern is not prefiltered
+		 */
+		const std::string& literal(std::size_t index) const;
+
+		/*
+		 * Match line with all patterns at once, first pattern (in configuration order) that matches wins
+		 * IP address found at %i position is parsed to result.address, if it is not valid address, next pattern that
+		 * matches wins
+		 * Returns index of matched pattern or -1 if line does not match any pattern
+		 */
+		int match(const char* begin, const char* end, hb::PatternMatch& result) const;
+
+		/*
+		 * Engine name as used in configuration file
+		 */
+		static std::string engineName(hb::RegexEngine engine);
+
+};
+
+}
+
+#endif
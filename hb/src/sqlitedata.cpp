@@ -0,0 +1,669 @@
+/*
+ * SQLite datafile (datafile.engine = sqlite)
+ *
+ * Each record type has its own table with address or log file path as primary
+ * key, so single record is read or written with indexed lookup instead of
+ * search in whole datafile. Database is in WAL mode, readers (CLI) do not
+ * block daemon writing changes and concurrent writers wait for each other with
+ * busy timeout instead of lockf retries.
+ *
+ * addresses - suspicious addresses (d records of text datafile), indexed also
+ *             by last activity + score and blacklisted flag, to list blocked
+ *             addresses without reading whole table
+ * abuseipdb - AbuseIPDB blacklisted addresses (a records)
+ * files     - log file bookmarks (f records)
+ * sync      - AbuseIPDB sync data (s record), single row
+ */
+
+// Standard string library
+#include <string>
+// C string (memcmp, strerror)
+#include <cstring>
+// Error numbers
+#include <cerrno>
+// C standard input/output (rename, remove)
+#include <cstdio>
+// File stream library (ifstream)
+#include <fstream>
+// Miscellaneous UNIX symbolic constants, types and functions (getpid)
+namespace cunistd{
+	#include <unistd.h>
+}
+// Header
+#include "sqlitedata.h"
+
+// Hostblock namespace
+using namespace hb;
+
+/*
+ * First bytes of SQLite database file
+ */
+static const char kMagic[16] = {'S', 'Q', 'L', 'i', 't', 'e', ' ', 'f', 'o', 'r', 'm', 'a', 't', ' ', '3', 0};
+
+/*
+ * How long to wait for lock held by other process (ms)
+ */
+static const int kBusyTimeout = 5000;
+
+/*
+ * Schema
+ */
+static const char kSchema[] =
+	"CREATE TABLE IF NOT EXISTS addresses ("
+		"address TEXT PRIMARY KEY NOT NULL, version INTEGER NOT NULL, last_activity INTEGER NOT NULL, "
+		"activity_score INTEGER NOT NULL, activity_count INTEGER NOT NULL, refused_count INTEGER NOT NULL, "
+		"whitelisted INTEGER NOT NULL, blacklisted INTEGER NOT NULL, last_reported INTEGER NOT NULL"
+	") WITHOUT ROWID;"
+	"CREATE INDEX IF NOT EXISTS addresses_expiry ON addresses (last_activity + activity_score);"
+	"CREATE INDEX IF NOT EXISTS addresses_blacklisted ON addresses (blacklisted) WHERE blacklisted = 1;"
+	"CREATE TABLE IF NOT EXISTS abuseipdb ("
+		"address TEXT PRIMARY KEY NOT NULL, version INTEGER NOT NULL, total_reports INTEGER NOT NULL, "
+		"abuse_confidence_score INTEGER NOT NULL"
+	") WITHOUT ROWID;"
+	"CREATE TABLE IF NOT EXISTS files ("
+		"path TEXT PRIMARY KEY NOT NULL, bookmark INTEGER NOT NULL, size INTEGER NOT NULL, device INTEGER NOT NULL, "
+		"inode INTEGER NOT NULL, fingerprint INTEGER NOT NULL, fingerprint_size INTEGER NOT NULL"
+	") WITHOUT ROWID;"
+	"CREATE TABLE IF NOT EXISTS sync ("
+		"id INTEGER PRIMARY KEY CHECK (id = 1), sync_time INTEGER NOT NULL, blacklist_gen_time INTEGER NOT NULL"
+	");";
+
+/*
+ * Queries, prepared once per connection
+ */
+#define HB_ADDRESS_COLUMNS "address, version, last_activity, activity_score, activity_count, refused_count, whitelisted, blacklisted, last_reported"
+static const char kSelectAddresses[] = "SELECT " HB_ADDRESS_COLUMNS " FROM addresses";
+static const char kSelectAddress[] = "SELECT " HB_ADDRESS_COLUMNS " FROM addresses WHERE address = ?1";
+static const char kSelectBlockedByExpiry[] = "SELECT " HB_ADDRESS_COLUMNS " FROM addresses WHERE whitelisted = 0 AND (blacklisted = 1 OR last_activity + activity_score > ?1)";
+static const char kSelectBlockedByScore[] = "SELECT " HB_ADDRESS_COLUMNS " FROM addresses WHERE whitelisted = 0 AND (blacklisted = 1 OR activity_score > ?1)";
+static const char kInsertAddress[] = "INSERT OR REPLACE INTO addresses (" HB_ADDRESS_COLUMNS ") VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)";
+static const char kDeleteAddress[] = "DELETE FROM addresses WHERE address = ?1";
+static const char kSelectAbuseIPDBAddresses[] = "SELECT address, version, total_reports, abuse_confidence_score FROM abuseipdb";
+static const char kInsertAbuseIPDBAddress[] = "INSERT OR REPLACE INTO abuseipdb (address, version, total_reports, abuse_confidence_score) VALUES (?1, ?2, ?3, ?4)";
+static const char kDeleteAbuseIPDBAddress[] = "DELETE FROM abuseipdb WHERE address = ?1";
+static const char kSelectFiles[] = "SELECT path, bookmark, size, device, inode, fingerprint, fingerprint_size FROM files";
+static const char kInsertFile[] = "INSERT OR REPLACE INTO files (path, bookmark, size, device, inode, fingerprint, fingerprint_size) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)";
+static const char kDeleteFile[] = "DELETE FROM files WHERE path = ?1";
+static const char kSelectSync[] = "SELECT sync_time, blacklist_gen_time FROM sync WHERE id = 1";
+static const char kInsertSync[] = "INSERT OR REPLACE INTO sync (id, sync_time, blacklist_gen_time) VALUES (1, ?1, ?2)";
+
+/*
+ * Constructor
+ */
+SqliteData::SqliteData(hb::Logger* log)
+: log(log)
+{
+
+}
+
+/*
+ * Destructor
+ */
+SqliteData::~SqliteData()
+{
+	this->close();
+}
+
+/*
+ * Set datafile path
+ */
+void SqliteData::setPath(const std::string& path)
+{
+	if (path == this->path) {
+		return;
+	}
+	this->close();
+	this->path = path;
+}
+
+/*
+ * Close database
+ */
+void SqliteData::close()
+{
+	if (this->db == NULL) {
+		return;
+	}
+	// Connection inherited from parent process (before fork) is left to parent
+	if (this->openPid == (long int)cunistd::getpid()) {
+		for (std::map<const char*, sqlite3_stmt*>::iterator it = this->statements.begin(); it != this->statements.end(); ++it) {
+			sqlite3_finalize(it->second);
+		}
+		sqlite3_close(this->db);
+	}
+	this->statements.clear();
+	this->db = NULL;
+}
+
+/*
+ * Whether file is SQLite database
+ */
+bool SqliteData::isSqlite(const std::string& path)
+{
+	char magic[sizeof(kMagic)];
+	std::ifstream f(path, std::ios::binary);
+	if (!f.read(magic, sizeof(magic))) {
+		return false;
+	}
+	return memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+/*
+ * Open database if needed
+ */
+bool SqliteData::open()
+{
+	if (this->db != NULL && this->openPid == (long int)cunistd::getpid()) {
+		return true;
+	}
+	this->close();
+	if (!this->connect(this->path, this->db)) {
+		return false;
+	}
+	this->openPid = (long int)cunistd::getpid();
+	return true;
+}
+
+/*
+ * Open database at path
+ */
+bool SqliteData::connect(const std::string& path, sqlite3*& connection)
+{
+	int result = sqlite3_open_v2(path.c_str(), &connection, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+	if (result != SQLITE_OK) {
+		this->log->error("Unable to open SQLite datafile " + path + "! " + (connection != NULL ? sqlite3_errmsg(connection) : sqlite3_errstr(result)));
+		sqlite3_close(connection);
+		connection = NULL;
+		return false;
+	}
+	sqlite3_busy_timeout(connection, kBusyTimeout);
+
+	// WAL is persistent, synchronous = NORMAL is safe with WAL (last transactions can be lost on power failure, not on crash)
+	if (!this->exec(connection, "PRAGMA journal_mode = WAL") || !this->exec(connection, "PRAGMA synchronous = NORMAL")) {
+		sqlite3_close(connection);
+		connection = NULL;
+		return false;
+	}
+
+	// Schema is created once, version is checked so that datafile of newer version is not modified
+	int schemaVersion = -1;
+	sqlite3_stmt* stmt = NULL;
+	if (sqlite3_prepare_v2(connection, "PRAGMA user_version", -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+		schemaVersion = sqlite3_column_int(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	if (schemaVersion < 0 || schemaVersion > SqliteData::kSchemaVersion) {
+		this->log->error("Unsupported SQLite datafile " + path + " (schema version " + std::to_string(schemaVersion) + ")!");
+		sqlite3_close(connection);
+		connection = NULL;
+		return false;
+	}
+	if (schemaVersion < SqliteData::kSchemaVersion) {
+		if (!this->exec(connection, "BEGIN IMMEDIATE") || !this->exec(connection, kSchema)
+			|| !this->exec(connection, ("PRAGMA user_version = " + std::to_string(SqliteData::kSchemaVersion)).c_str())
+			|| !this->exec(connection, "COMMIT")) {
+			this->fail(connection, "Failed to create SQLite datafile schema!");
+			sqlite3_close(connection);
+			connection = NULL;
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Prepared statement
+ */
+sqlite3_stmt* SqliteData::statement(const char* sql)
+{
+	std::map<const char*, sqlite3_stmt*>::iterator it = this->statements.find(sql);
+	if (it != this->statements.end()) {
+		sqlite3_reset(it->second);
+		sqlite3_clear_bindings(it->second);
+		return it->second;
+	}
+	sqlite3_stmt* stmt = NULL;
+	if (sqlite3_prepare_v3(this->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK) {
+		this->log->error("Failed to prepare SQLite statement! " + std::string(sqlite3_errmsg(this->db)));
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+	this->statements[sql] = stmt;
+	return stmt;
+}
+
+/*
+ * Execute SQL
+ */
+bool SqliteData::exec(sqlite3* connection, const char* sql)
+{
+	char* message = NULL;
+	if (sqlite3_exec(connection, sql, NULL, NULL, &message) != SQLITE_OK) {
+		this->log->error("SQLite datafile error: " + std::string(message != NULL ? message : sqlite3_errmsg(connection)));
+		sqlite3_free(message);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Execute prepared statement
+ */
+bool SqliteData::step(sqlite3_stmt* stmt)
+{
+	int result = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	return result == SQLITE_DONE;
+}
+
+/*
+ * Rollback and log error
+ */
+bool SqliteData::fail(sqlite3* connection, const std::string& message)
+{
+	this->log->error(message + " " + sqlite3_errmsg(connection));
+	if (!sqlite3_get_autocommit(connection)) {
+		sqlite3_exec(connection, "ROLLBACK", NULL, NULL, NULL);
+	}
+	return false;
+}
+
+/*
+ * Bind suspicious address
+ */
+void SqliteData::bindAddress(sqlite3_stmt* stmt, const std::string& address, const hb::SuspiciosAddressType& data)
+{
+	sqlite3_bind_text(stmt, 1, address.c_str(), address.length(), SQLITE_TRANSIENT);
+	sqlite3_bind_int(stmt, 2, data.version);
+	sqlite3_bind_int64(stmt, 3, (sqlite3_int64)data.lastActivity);
+	sqlite3_bind_int64(stmt, 4, data.activityScore);
+	sqlite3_bind_int64(stmt, 5, data.activityCount);
+	sqlite3_bind_int64(stmt, 6, data.refusedCount);
+	sqlite3_bind_int(stmt, 7, data.whitelisted ? 1 : 0);
+	sqlite3_bind_int(stmt, 8, data.blacklisted ? 1 : 0);
+	sqlite3_bind_int64(stmt, 9, (sqlite3_int64)data.lastReported);
+}
+
+/*
+ * Bind AbuseIPDB blacklisted address
+ */
+void SqliteData::bindAbuseIPDBAddress(sqlite3_stmt* stmt, const std::string& address, const hb::AbuseIPDBBlacklistedAddressType& data)
+{
+	sqlite3_bind_text(stmt, 1, address.c_str(), address.length(), SQLITE_TRANSIENT);
+	sqlite3_bind_int(stmt, 2, data.version);
+	sqlite3_bind_int64(stmt, 3, data.totalReports);
+	sqlite3_bind_int64(stmt, 4, data.abuseConfidenceScore);
+}
+
+/*
+ * Bind log file bookmark
+ */
+void SqliteData::bindFile(sqlite3_stmt* stmt, const hb::LogFile& logFile)
+{
+	sqlite3_bind_text(stmt, 1, logFile.path.c_str(), logFile.path.length(), SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, 2, (sqlite3_int64)logFile.bookmark);
+	sqlite3_bind_int64(stmt, 3, (sqlite3_int64)logFile.size);
+	sqlite3_bind_int64(stmt, 4, (sqlite3_int64)logFile.device);
+	sqlite3_bind_int64(stmt, 5, (sqlite3_int64)logFile.inode);
+	sqlite3_bind_int64(stmt, 6, (sqlite3_int64)logFile.fingerprint);// Bits are kept, value can be negative in database
+	sqlite3_bind_int64(stmt, 7, logFile.fingerprintSize);
+}
+
+/*
+ * Read suspicious addresses from query result
+ */
+bool SqliteData::readAddresses(sqlite3_stmt* stmt, hb::AddressTable<hb::SuspiciosAddressType>& addresses)
+{
+	int result;
+	hb::SuspiciosAddressType data;
+	hb::Address address;
+	while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (!hb::Address::parse(std::string((const char*)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0)), address)) {
+			this->log->warning("Invalid IP address " + std::string((const char*)sqlite3_column_text(stmt, 0)) + " in SQLite datafile, record ignored");
+			continue;
+		}
+		data.version = sqlite3_column_int(stmt, 1);
+		data.lastActivity = (unsigned long long int)sqlite3_column_int64(stmt, 2);
+		data.activityScore = (unsigned int)sqlite3_column_int64(stmt, 3);
+		data.activityCount = (unsigned int)sqlite3_column_int64(stmt, 4);
+		data.refusedCount = (unsigned int)sqlite3_column_int64(stmt, 5);
+		data.whitelisted = sqlite3_column_int(stmt, 6) != 0;
+		data.blacklisted = sqlite3_column_int(stmt, 7) != 0;
+		data.lastReported = (unsigned long long int)sqlite3_column_int64(stmt, 8);
+		addresses.insert(address, data);
+	}
+	sqlite3_reset(stmt);
+	return result == SQLITE_DONE;
+}
+
+/*
+ * Load whole datafile
+ */
+bool SqliteData::load(hb::AddressTable<hb::SuspiciosAddressType>& addresses, hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, std::vector<hb::LogFile>& files, unsigned long long int& syncTime, unsigned long long int& blacklistGenTime)
+{
+	int result;
+	sqlite3_stmt* stmt;
+
+	if (!this->open()) {
+		return false;
+	}
+
+	// All tables are read from the same snapshot
+	if (!this->exec(this->db, "BEGIN")) {
+		return false;
+	}
+
+	if ((stmt = this->statement(kSelectAddresses)) == NULL || !this->readAddresses(stmt, addresses)) {
+		return this->fail(this->db, "Failed to load addresses from SQLite datafile!");
+	}
+
+	if ((stmt = this->statement(kSelectAbuseIPDBAddresses)) == NULL) {
+		return this->fail(this->db, "Failed to load AbuseIPDB blacklist from SQLite datafile!");
+	}
+	hb::AbuseIPDBBlacklistedAddressType abuseIPDBData;
+	hb::Address address;
+	while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (!hb::Address::parse(std::string((const char*)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0)), address)) {
+			this->log->warning("Invalid IP address " + std::string((const char*)sqlite3_column_text(stmt, 0)) + " in SQLite datafile, AbuseIPDB record ignored");
+			continue;
+		}
+		abuseIPDBData.version = sqlite3_column_int(stmt, 1);
+		abuseIPDBData.totalReports = (unsigned int)sqlite3_column_int64(stmt, 2);
+		abuseIPDBData.abuseConfidenceScore = (unsigned int)sqlite3_column_int64(stmt, 3);
+		blacklist.insert(address, abuseIPDBData);
+	}
+	sqlite3_reset(stmt);
+	if (result != SQLITE_DONE) {
+		return this->fail(this->db, "Failed to load AbuseIPDB blacklist from SQLite datafile!");
+	}
+
+	if ((stmt = this->statement(kSelectFiles)) == NULL) {
+		return this->fail(this->db, "Failed to load log file bookmarks from SQLite datafile!");
+	}
+	while ((result = sqlite3_step(stmt)) == SQLITE_ROW) {
+		hb::LogFile logFile;
+		logFile.path = std::string((const char*)sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0));
+		logFile.bookmark = (unsigned long long int)sqlite3_column_int64(stmt, 1);
+		logFile.size = (unsigned long long int)sqlite3_column_int64(stmt, 2);
+		logFile.device = (unsigned long long int)sqlite3_column_int64(stmt, 3);
+		logFile.inode = (unsigned long long int)sqlite3_column_int64(stmt, 4);
+		logFile.fingerprint = (unsigned long long int)sqlite3_column_int64(stmt, 5);
+		logFile.fingerprintSize = (unsigned int)sqlite3_column_int64(stmt, 6);
+		files.push_back(logFile);
+	}
+	sqlite3_reset(stmt);
+	if (result != SQLITE_DONE) {
+		return this->fail(this->db, "Failed to load log file bookmarks from SQLite datafile!");
+	}
+
+	if ((stmt = this->statement(kSelectSync)) == NULL) {
+		return this->fail(this->db, "Failed to load AbuseIPDB sync data from SQLite datafile!");
+	}
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		syncTime = (unsigned long long int)sqlite3_column_int64(stmt, 0);
+		blacklistGenTime = (unsigned long long int)sqlite3_column_int64(stmt, 1);
+	}
+	sqlite3_reset(stmt);
+
+	return this->exec(this->db, "COMMIT");
+}
+
+/*
+ * Load single address
+ */
+bool SqliteData::loadAddress(const std::string& address, hb::AddressTable<hb::SuspiciosAddressType>& addresses)
+{
+	sqlite3_stmt* stmt;
+	if (!this->open() || (stmt = this->statement(kSelectAddress)) == NULL) {
+		return false;
+	}
+	sqlite3_bind_text(stmt, 1, address.c_str(), address.length(), SQLITE_TRANSIENT);
+	if (!this->readAddresses(stmt, addresses)) {
+		return this->fail(this->db, "Failed to load address " + address + " from SQLite datafile!");
+	}
+	return true;
+}
+
+/*
+ * Load blocked addresses
+ */
+bool SqliteData::loadBlocked(hb::AddressTable<hb::SuspiciosAddressType>& addresses, bool byExpiry, unsigned long long int limit)
+{
+	sqlite3_stmt* stmt;
+	if (!this->open() || (stmt = this->statement(byExpiry ? kSelectBlockedByExpiry : kSelectBlockedByScore)) == NULL) {
+		return false;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)limit);
+	if (!this->readAddresses(stmt, addresses)) {
+		return this->fail(this->db, "Failed to load blocked addresses from SQLite datafile!");
+	}
+	return true;
+}
+
+/*
+ * Write all records
+ */
+bool SqliteData::insertAll(sqlite3* connection, const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<hb::LogGroup>& logGroups, unsigned long long int syncTime, unsigned long long int blacklistGenTime)
+{
+	sqlite3_stmt* addressStmt = NULL;
+	sqlite3_stmt* abuseIPDBStmt = NULL;
+	sqlite3_stmt* fileStmt = NULL;
+	sqlite3_stmt* syncStmt = NULL;
+	bool result = sqlite3_prepare_v2(connection, kInsertAddress, -1, &addressStmt, NULL) == SQLITE_OK
+		&& sqlite3_prepare_v2(connection, kInsertAbuseIPDBAddress, -1, &abuseIPDBStmt, NULL) == SQLITE_OK
+		&& sqlite3_prepare_v2(connection, kInsertFile, -1, &fileStmt, NULL) == SQLITE_OK
+		&& sqlite3_prepare_v2(connection, kInsertSync, -1, &syncStmt, NULL) == SQLITE_OK;
+
+	hb::AddressTable<hb::SuspiciosAddressType>::const_iterator it;
+	for (it = addresses.begin(); result && it != addresses.end(); ++it) {
+		SqliteData::bindAddress(addressStmt, it->first.toString(), it->second);
+		result = this->step(addressStmt);
+	}
+
+	std::vector<hb::LogGroup>::const_iterator itlg;
+	std::vector<hb::LogFile>::const_iterator itlf;
+	for (itlg = logGroups.begin(); result && itlg != logGroups.end(); ++itlg) {
+		for (itlf = itlg->logFiles.begin(); result && itlf != itlg->logFiles.end(); ++itlf) {
+			SqliteData::bindFile(fileStmt, *itlf);
+			result = this->step(fileStmt);
+		}
+	}
+
+	hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::const_iterator itb;
+	for (itb = blacklist.begin(); result && itb != blacklist.end(); ++itb) {
+		SqliteData::bindAbuseIPDBAddress(abuseIPDBStmt, itb->first.toString(), itb->second);
+		result = this->step(abuseIPDBStmt);
+	}
+
+	if (result) {
+		sqlite3_bind_int64(syncStmt, 1, (sqlite3_int64)syncTime);
+		sqlite3_bind_int64(syncStmt, 2, (sqlite3_int64)blacklistGenTime);
+		result = this->step(syncStmt);
+	}
+
+	sqlite3_finalize(addressStmt);
+	sqlite3_finalize(abuseIPDBStmt);
+	sqlite3_finalize(fileStmt);
+	sqlite3_finalize(syncStmt);
+	return result;
+}
+
+/*
+ * Replace all records
+ */
+bool SqliteData::save(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<hb::LogGroup>& logGroups, unsigned long long int syncTime, unsigned long long int blacklistGenTime)
+{
+	// Existing database is updated in single transaction, readers see either old or new data
+	if (SqliteData::isSqlite(this->path)) {
+		if (!this->open() || !this->exec(this->db, "BEGIN IMMEDIATE")) {
+			return false;
+		}
+		if (!this->exec(this->db, "DELETE FROM addresses; DELETE FROM abuseipdb; DELETE FROM files; DELETE FROM sync")
+			|| !this->insertAll(this->db, addresses, blacklist, logGroups, syncTime, blacklistGenTime)
+			|| !this->exec(this->db, "COMMIT")) {
+			return this->fail(this->db, "Failed to save SQLite datafile!");
+		}
+		return true;
+	}
+
+	// Datafile in other format (or missing) is replaced with new database, created next to it and renamed
+	this->close();
+	std::string tmpPath = this->path + ".tmp";
+	std::remove(tmpPath.c_str());
+	std::remove((tmpPath + "-wal").c_str());
+	std::remove((tmpPath + "-shm").c_str());
+	sqlite3* connection = NULL;
+	if (!this->connect(tmpPath, connection)) {
+		return false;
+	}
+	if (!this->exec(connection, "BEGIN IMMEDIATE")
+		|| !this->insertAll(connection, addresses, blacklist, logGroups, syncTime, blacklistGenTime)
+		|| !this->exec(connection, "COMMIT")) {
+		this->fail(connection, "Failed to write SQLite datafile!");
+		sqlite3_close(connection);
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	// Closing last connection checkpoints WAL into database file
+	if (sqlite3_close(connection) != SQLITE_OK || std::rename(tmpPath.c_str(), this->path.c_str()) != 0) {
+		this->log->error("Failed to write SQLite datafile! " + std::to_string(errno) + ": " + strerror(errno));
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	std::remove((this->path + "-wal").c_str());
+	std::remove((this->path + "-shm").c_str());
+	return true;
+}
+
+/*
+ * Add or update suspicious addresses
+ */
+bool SqliteData::putAddresses(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const std::vector<std::string>& keys)
+{
+	sqlite3_stmt* stmt;
+	const hb::SuspiciosAddressType* data;
+	if (keys.size() == 0) {
+		return true;
+	}
+	if (!this->open() || (stmt = this->statement(kInsertAddress)) == NULL || !this->exec(this->db, "BEGIN IMMEDIATE")) {
+		return false;
+	}
+	for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+		if ((data = addresses.find(*it)) == NULL) {
+			continue;
+		}
+		SqliteData::bindAddress(stmt, *it, *data);
+		if (!this->step(stmt)) {
+			return this->fail(this->db, "Failed to save address " + *it + " in SQLite datafile!");
+		}
+	}
+	return this->exec(this->db, "COMMIT") || this->fail(this->db, "Failed to save addresses in SQLite datafile!");
+}
+
+/*
+ * Add or update AbuseIPDB blacklisted addresses
+ */
+bool SqliteData::putAbuseIPDBAddresses(const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<std::string>& keys)
+{
+	sqlite3_stmt* stmt;
+	const hb::AbuseIPDBBlacklistedAddressType* data;
+	if (keys.size() == 0) {
+		return true;
+	}
+	if (!this->open() || (stmt = this->statement(kInsertAbuseIPDBAddress)) == NULL || !this->exec(this->db, "BEGIN IMMEDIATE")) {
+		return false;
+	}
+	for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+		if ((data = blacklist.find(*it)) == NULL) {
+			continue;
+		}
+		SqliteData::bindAbuseIPDBAddress(stmt, *it, *data);
+		if (!this->step(stmt)) {
+			return this->fail(this->db, "Failed to save AbuseIPDB blacklisted address " + *it + " in SQLite datafile!");
+		}
+	}
+	return this->exec(this->db, "COMMIT") || this->fail(this->db, "Failed to save AbuseIPDB blacklist in SQLite datafile!");
+}
+
+/*
+ * Add or update log file bookmarks
+ */
+bool SqliteData::putFiles(const std::vector<hb::LogFile>& logFiles)
+{
+	sqlite3_stmt* stmt;
+	if (logFiles.size() == 0) {
+		return true;
+	}
+	if (!this->open() || (stmt = this->statement(kInsertFile)) == NULL || !this->exec(this->db, "BEGIN IMMEDIATE")) {
+		return false;
+	}
+	for (std::vector<hb::LogFile>::const_iterator it = logFiles.begin(); it != logFiles.end(); ++it) {
+		SqliteData::bindFile(stmt, *it);
+		if (!this->step(stmt)) {
+			return this->fail(this->db, "Failed to save log file " + it->path + " bookmark in SQLite datafile!");
+		}
+	}
+	return this->exec(this->db, "COMMIT") || this->fail(this->db, "Failed to save log file bookmarks in SQLite datafile!");
+}
+
+/*
+ * Delete records by key
+ */
+bool SqliteData::removeRecords(const char* sql, const std::vector<std::string>& keys)
+{
+	sqlite3_stmt* stmt;
+	if (keys.size() == 0) {
+		return true;
+	}
+	if (!this->open() || (stmt = this->statement(sql)) == NULL || !this->exec(this->db, "BEGIN IMMEDIATE")) {
+		return false;
+	}
+	for (std::vector<std::string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+		sqlite3_bind_text(stmt, 1, it->c_str(), it->length(), SQLITE_TRANSIENT);
+		if (!this->step(stmt)) {
+			return this->fail(this->db, "Failed to remove " + *it + " from SQLite datafile!");
+		}
+	}
+	return this->exec(this->db, "COMMIT") || this->fail(this->db, "Failed to remove records from SQLite datafile!");
+}
+
+/*
+ * Delete suspicious addresses
+ */
+bool SqliteData::removeAddresses(const std::vector<std::string>& keys)
+{
+	return this->removeRecords(kDeleteAddress, keys);
+}
+
+/*
+ * Delete AbuseIPDB blacklisted addresses
+ */
+bool SqliteData::removeAbuseIPDBAddresses(const std::vector<std::string>& keys)
+{
+	return this->removeRecords(kDeleteAbuseIPDBAddress, keys);
+}
+
+/*
+ * Delete log file bookmark
+ */
+bool SqliteData::removeFile(const std::string& filePath)
+{
+	return this->removeRecords(kDeleteFile, std::vector<std::string>(1, filePath));
+}
+
+/*
+ * Update AbuseIPDB sync data
+ */
+bool SqliteData::putSyncData(unsigned long long int syncTime, unsigned long long int blacklistGenTime)
+{
+	sqlite3_stmt* stmt;
+	if (!this->open() || (stmt = this->statement(kInsertSync)) == NULL) {
+		return false;
+	}
+	sqlite3_bind_int64(stmt, 1, (sqlite3_int64)syncTime);
+	sqlite3_bind_int64(stmt, 2, (sqlite3_int64)blacklistGenTime);
+	if (!this->step(stmt)) {
+		return this->fail(this->db, "Failed to save AbuseIPDB sync data in SQLite datafile!");
+	}
+	return true;
+}
@@ -0,0 +1,180 @@
+/*
+ * SQLite datafile (datafile.engine = sqlite), database in WAL mode with
+ * prepared statements, changes are written in transactions
+ */
+
+#ifndef HBSQLITEDATA_H
+#define HBSQLITEDATA_H
+
+// Standard string library
+#include <string>
+// Vector
+#include <vector>
+// Map
+#include <map>
+// SQLite
+#include <sqlite3.h>
+// Logger
+#include "logger.h"
+// Util
+#include "util.h"
+// Address table
+#include "addresstable.h"
+
+namespace hb{
+
+class SqliteData{
+	private:
+
+		/*
+		 * Logger object
+		 */
+		hb::Logger* log;
+
+		/*
+		 * Datafile path
+		 */
+		std::string path;
+
+		/*
+		 * Database connection, opened with first use
+		 * Process id is kept, connection opened before fork is never used nor closed in child process
+		 */
+		sqlite3* db = NULL;
+		long int openPid = 0;
+
+		/*
+		 * Prepared statements of connection by SQL text
+		 */
+		std::map<const char*, sqlite3_stmt*> statements;
+
+		/*
+		 * Open database connection if it is not open yet
+		 */
+		bool open();
+
+		/*
+		 * Open database at path, set WAL mode and create tables if needed
+		 */
+		bool connect(const std::string& path, sqlite3*& connection);
+
+		/*
+		 * Prepared statement of current connection, statement is reset for new execution, NULL on failure
+		 */
+		sqlite3_stmt* statement(const char* sql);
+
+		/*
+		 * Execute SQL without parameters
+		 */
+		bool exec(sqlite3* connection, const char* sql);
+
+		/*
+		 * Execute prepared statement that returns no rows
+		 */
+		bool step(sqlite3_stmt* stmt);
+
+		/*
+		 * Rollback and log error of connection
+		 */
+		bool fail(sqlite3* connection, const std::string& message);
+
+		/*
+		 * Write all records with prepared statements of given connection (open transaction expected)
+		 */
+		bool insertAll(sqlite3* connection, const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<hb::LogGroup>& logGroups, unsigned long long int syncTime, unsigned long long int blacklistGenTime);
+
+		/*
+		 * Read suspicious addresses returned by query
+		 */
+		bool readAddresses(sqlite3_stmt* stmt, hb::AddressTable<hb::SuspiciosAddressType>& addresses);
+
+		/*
+		 * Bind record fields to insert or update statement
+		 */
+		static void bindAddress(sqlite3_stmt* stmt, const std::string& address, const hb::SuspiciosAddressType& data);
+		static void bindAbuseIPDBAddress(sqlite3_stmt* stmt, const std::string& address, const hb::AbuseIPDBBlacklistedAddressType& data);
+		static void bindFile(sqlite3_stmt* stmt, const hb::LogFile& logFile);
+
+		/*
+		 * Delete records by key in single transaction
+		 */
+		bool removeRecords(const char* sql, const std::vector<std::string>& keys);
+
+	public:
+
+		/*
+		 * Schema version (PRAGMA user_version)
+		 */
+		static const int kSchemaVersion = 1;
+
+		/*
+		 * Constructor
+		 */
+		SqliteData(hb::Logger* log);
+
+		/*
+		 * Destructor, closes database
+		 */
+		~SqliteData();
+
+		/*
+		 * Set datafile path, database is closed if path changes
+		 */
+		void setPath(const std::string& path);
+
+		/*
+		 * Close database, WAL is checkpointed and removed when last connection is closed
+		 */
+		void close();
+
+		/*
+		 * Whether file at path is SQLite database
+		 */
+		static bool isSqlite(const std::string& path);
+
+		/*
+		 * Load whole datafile
+		 * Log file records are returned in files, caller matches them with configuration
+		 */
+		bool load(hb::AddressTable<hb::SuspiciosAddressType>& addresses, hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, std::vector<hb::LogFile>& files, unsigned long long int& syncTime, unsigned long long int& blacklistGenTime);
+
+		/*
+		 * Load single suspicious address (primary key lookup), returns true also if address is not found
+		 */
+		bool loadAddress(const std::string& address, hb::AddressTable<hb::SuspiciosAddressType>& addresses);
+
+		/*
+		 * Load addresses that are blocked - blacklisted or with last activity + score above limit (byExpiry) or score
+		 * above limit, whitelisted addresses are not loaded
+		 */
+		bool loadBlocked(hb::AddressTable<hb::SuspiciosAddressType>& addresses, bool byExpiry, unsigned long long int limit);
+
+		/*
+		 * Replace all records in single transaction, datafile in other format is replaced with new database
+		 */
+		bool save(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<hb::LogGroup>& logGroups, unsigned long long int syncTime, unsigned long long int blacklistGenTime);
+
+		/*
+		 * Add or update records, each call is single transaction
+		 */
+		bool putAddresses(const hb::AddressTable<hb::SuspiciosAddressType>& addresses, const std::vector<std::string>& keys);
+		bool putAbuseIPDBAddresses(const hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>& blacklist, const std::vector<std::string>& keys);
+		bool putFiles(const std::vector<hb::LogFile>& logFiles);
+
+		/*
+		 * Delete records
+		 */
+		bool removeAddresses(const std::vector<std::string>& keys);
+		bool removeAbuseIPDBAddresses(const std::vector<std::string>& keys);
+		bool removeFile(const std::string& filePath);
+
+		/*
+		 * Update AbuseIPDB sync data
+		 */
+		bool putSyncData(unsigned long long int syncTime, unsigned long long int blacklistGenTime);
+
+};
+
+}
+
+#endif
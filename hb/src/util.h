@@ -9,12 +9,17 @@
 #include <vector>
 // RegEx
 #include <regex>
+// Shared pointer
+#include <memory>
 
 namespace hb{
 
 static const std::string kHostblockVersion = "1.0.4";
 
-static const std::string kIpSearchPattern = "(?:(?:[0-9a-f]{1,4}:){6}|::(?:[0-9a-f]{1,4}:){5}|(?:[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:){4}|(?:(?:[0-9a-f]{1,4}:){0,1}[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:){3}|(?:(?:[0-9a-f]{1,4}:){0,2}[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:){2}|(?:(?:[0-9a-f]{1,4}:){0,3}[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:)|(?:(?:[0-9a-f]{1,4}:){0,4}[0-9a-f]{1,4})?::)(?:[0-9a-f]{1,4}:[0-9a-f]{1,4}|(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])\\.){3}(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])))|(?:(?:[0-9a-f]{1,4}:){0,5}[0-9a-f]{1,4})?::[0-9a-f]{1,4}|(?:(?:[0-9a-f]{1,4}:){0,6}[0-9a-f]{1,4})?::|(?:(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\.){3}(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?))";
+// IPv4 address with octet ranges, so that regex backtracks past invalid address (e.g. in user name) to next one
+static const std::string kIpv4TokenPattern = "(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\.){3}(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)";
+// IPv4/IPv6 address token used for %i in log patterns, IPv6 is matched by shape only, address is validated and parsed by hb::Address
+static const std::string kIpTokenPattern = "(?:" + kIpv4TokenPattern + "|(?:[0-9a-f]{0,4}:){2,7}(?:" + kIpv4TokenPattern + "|[0-9a-f]{1,4})?)";
 static const std::string kPortSearchPattern = "(\\d{1,5})";
 
 enum Report {
@@ -23,13 +28,23 @@ enum Report {
 	NotSet
 };
 
+/*
+ * Regex engine used to match log lines
+ */
+enum RegexEngine {
+	StdRegex,// std::regex (ECMAScript)
+	Re2Regex// RE2 (linear time, DFA based)
+};
+
+// Compiled patterns (patternset.h)
+class PatternSet;
+
 /*
  * Pattern
  */
 struct Pattern {
 	std::string patternString = "";// Regex as string
 	int portSearch = -1;// Port position in pattern (before or after IP address, or port not included in pattern)
-	std::regex pattern;// Regex to match
 	unsigned int score = 1;// Score if pattern matched
 	Report abuseipdbReport = Report::NotSet;
 	std::vector<unsigned int> abuseipdbCategories;
@@ -44,6 +59,10 @@ struct LogFile {
 	std::string path = "";// Path (config file)
 	unsigned long long int bookmark = 0;// Bookmark for seekg (data file)
 	unsigned long long int size = 0;// File size when last processed (data file)
+	unsigned long long int device = 0;// Device and inode of file when last processed, to detect rotation while daemon was not running (data file)
+	unsigned long long int inode = 0;
+	unsigned long long int fingerprint = 0;// Hash of first fingerprintSize bytes, to detect rewritten file with the same inode (data file)
+	unsigned int fingerprintSize = 0;
 	bool dataFileRecord = false;
 };
 
@@ -53,6 +72,10 @@ struct LogFile {
 struct LogGroup {
 	std::vector<Pattern> patterns;
 	std::vector<Pattern> refusedPatterns;
+	std::shared_ptr<PatternSet> patternSet;// Compiled patterns (set by Config::processPatterns)
+	std::shared_ptr<PatternSet> refusedPatternSet;// Compiled refused patterns
+	unsigned long long int prefilterHits = 0;// Lines passed literal prefilter and were matched with regex
+	unsigned long long int prefilterMisses = 0;// Lines rejected by literal prefilter without running regex
 	std::vector<LogFile> logFiles;
 	std::string name = "";
 	Report abuseipdbReport = Report::NotSet;
@@ -0,0 +1,527 @@
+// Standard input/output stream library (cin, cout, cerr, clog)
+#include <iostream>
+// Parametric manipulators (setw)
+#include <iomanip>
+// Time measurement
+#include <chrono>
+// File stream library (ifstream)
+#include <fstream>
+// Standard vector library
+#include <vector>
+// Standard string library
+#include <string>
+// C standard library (rand)
+#include <cstdlib>
+// C standard input/output (remove)
+#include <cstdio>
+// Map
+#include <map>
+// Sort
+#include <algorithm>
+// Time (time)
+#include <ctime>
+// Heap statistics (mallinfo2)
+#include <malloc.h>
+// Syslog
+namespace csyslog{
+	#include <syslog.h>
+}
+// Logger
+#include "../src/logger.h"
+// Iptables
+#include "../src/iptables.h"
+// Config
+#include "../src/config.h"
+// Data
+#include "../src/data.h"
+// Address table
+#include "../src/addresstable.h"
+// Log parser
+#include "../src/logparser.h"
+// In-memory firewall backend
+#include "../src/memoryfirewall.h"
+
+/*
+ * Seconds since start
+ */
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Address for benchmark record number
+ */
+static std::string benchmarkAddress(unsigned int i)
+{
+	return "10." + std::to_string((i >> 16) & 255) + "." + std::to_string((i >> 8) & 255) + "." + std::to_string(i & 255);
+}
+
+/*
+ * Allocated heap bytes (including large blocks allocated with mmap)
+ */
+static std::size_t heapUsage()
+{
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+int main(int argc, char *argv[])
+{
+	bool benchDataUpdates = true;
+	bool benchDataLoad = true;
+	bool benchAddressTable = true;
+	bool benchRuleExpiry = true;
+	bool benchFirewallPipeline = true;
+	bool benchRuleLimit = true;
+
+	const std::string dataFilePath = "benchmark_datafile";
+
+	try{
+		hb::Logger log = hb::Logger(LOG_USER);
+		log.setLevel(LOG_ERR);
+
+		hb::Config config = hb::Config(&log, "config/hostblock.conf");
+		config.dataFilePath = dataFilePath;
+
+		hb::Iptables iptables = hb::Iptables();
+
+		if (benchDataUpdates) {
+			/*
+			 * Single record update in datafile with different datafile sizes
+			 * With offset index (after loadData) update time should not depend on record count,
+			 * without index (record not indexed yet) whole datafile is searched, journal engine appends record to journal,
+			 * SQLite engine updates row in own transaction
+			 */
+			const unsigned int updates = 1000;
+			std::vector<unsigned int> sizes = {1000, 10000, 100000, 200000};
+			std::cout << "Datafile record update, " << updates << " updates of random records" << std::endl;
+			std::cout << std::setw(10) << "records" << std::setw(20) << "indexed us/update" << std::setw(20) << "search us/update" << std::setw(20) << "journal us/update" << std::setw(20) << "sqlite us/update" << std::endl;
+
+			for (unsigned int size : sizes) {
+				hb::Data data = hb::Data(&log, &config, &iptables);
+				hb::SuspiciosAddressType record;
+				record.lastActivity = 1500000000;
+				record.activityScore = 1;
+				record.activityCount = 1;
+				record.version = 4;
+				for (unsigned int i = 0; i < size; ++i) {
+					data.suspiciousAddresses[benchmarkAddress(i)] = record;
+				}
+				if (!data.saveData() || !data.loadData()) {
+					std::cerr << "Failed to create benchmark datafile!" << std::endl;
+					return 1;
+				}
+
+				// Indexed updates
+				srand(1);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (unsigned int i = 0; i < updates; ++i) {
+					std::string address = benchmarkAddress(rand() % size);
+					data.suspiciousAddresses[address].activityCount++;
+					data.updateAddress(address);
+				}
+				double indexed = elapsed(start) * 1000000 / updates;
+
+				// Updates without index, separate object that has not loaded datafile, each address is updated once (fewer, search is slow)
+				hb::Data search = hb::Data(&log, &config, &iptables);
+				search.suspiciousAddresses = data.suspiciousAddresses;
+				unsigned int searchUpdates = 100;
+				start = std::chrono::steady_clock::now();
+				for (unsigned int i = 0; i < searchUpdates; ++i) {
+					std::string address = benchmarkAddress((unsigned long long int)i * size / searchUpdates);
+					search.updateAddress(address);
+				}
+				double searched = elapsed(start) * 1000000 / searchUpdates;
+
+				// Journal engine, snapshot is written first
+				config.dataFileEngine = hb::DataFileEngine::EngineJournal;
+				if (!data.saveData()) {
+					std::cerr << "Failed to create benchmark snapshot!" << std::endl;
+					return 1;
+				}
+				srand(1);
+				start = std::chrono::steady_clock::now();
+				for (unsigned int i = 0; i < updates; ++i) {
+					std::string address = benchmarkAddress(rand() % size);
+					data.suspiciousAddresses[address].activityCount++;
+					data.updateAddress(address);
+				}
+				double journaled = elapsed(start) * 1000000 / updates;
+				std::remove((dataFilePath + ".journal").c_str());
+
+				// SQLite engine, datafile is converted first
+				config.dataFileEngine = hb::DataFileEngine::EngineSqlite;
+				if (!data.saveData()) {
+					std::cerr << "Failed to create benchmark database!" << std::endl;
+					return 1;
+				}
+				srand(1);
+				start = std::chrono::steady_clock::now();
+				for (unsigned int i = 0; i < updates; ++i) {
+					std::string address = benchmarkAddress(rand() % size);
+					data.suspiciousAddresses[address].activityCount++;
+					data.updateAddress(address);
+				}
+				double sqlite = elapsed(start) * 1000000 / updates;
+				config.dataFileEngine = hb::DataFileEngine::EngineText;
+
+				std::cout << std::setw(10) << size << std::setw(20) << std::fixed << std::setprecision(1) << indexed << std::setw(20) << searched << std::setw(20) << journaled << std::setw(20) << sqlite << std::endl;
+			}
+
+			std::remove(dataFilePath.c_str());
+		}
+
+		if (benchDataLoad) {
+			/*
+			 * Datafile load (daemon start, reload after SIGUSR1 or blacklist sync) with text, binary and SQLite engine
+			 * and load of single address for CLI operation (-b, -w, -r), text datafile is loaded whole for that
+			 */
+			std::vector<unsigned int> sizes = {10000, 100000, 500000};
+			std::cout << std::endl << "Datafile load" << std::endl;
+			std::cout << std::setw(10) << "records" << std::setw(20) << "text ms" << std::setw(20) << "binary ms" << std::setw(20) << "sqlite ms" << std::setw(20) << "sqlite address ms" << std::setw(20) << "text MiB" << std::setw(20) << "binary MiB" << std::setw(20) << "sqlite MiB" << std::endl;
+
+			for (unsigned int size : sizes) {
+				hb::Data data = hb::Data(&log, &config, &iptables);
+				hb::SuspiciosAddressType record;
+				record.lastActivity = 1500000000;
+				record.activityScore = 1;
+				record.activityCount = 1;
+				record.version = 4;
+				for (unsigned int i = 0; i < size; ++i) {
+					data.suspiciousAddresses[benchmarkAddress(i)] = record;
+				}
+
+				double times[3], fileSizes[3], addressTime = 0;
+				hb::DataFileEngine engines[3] = {hb::DataFileEngine::EngineText, hb::DataFileEngine::EngineBinary, hb::DataFileEngine::EngineSqlite};
+				for (int e = 0; e < 3; ++e) {
+					config.dataFileEngine = engines[e];
+					if (!data.saveData()) {
+						std::cerr << "Failed to create benchmark datafile!" << std::endl;
+						return 1;
+					}
+					std::ifstream f(dataFilePath, std::ios::binary | std::ios::ate);
+					fileSizes[e] = (double)f.tellg() / 1048576;
+					hb::Data loaded = hb::Data(&log, &config, &iptables);
+					std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					if (!loaded.loadData() || loaded.suspiciousAddresses.size() != size) {
+						std::cerr << "Failed to load benchmark datafile!" << std::endl;
+						return 1;
+					}
+					times[e] = elapsed(start) * 1000;
+					if (engines[e] == hb::DataFileEngine::EngineSqlite) {
+						hb::Data single = hb::Data(&log, &config, &iptables);
+						start = std::chrono::steady_clock::now();
+						if (!single.loadAddress(benchmarkAddress(size / 2)) || single.suspiciousAddresses.size() != 1) {
+							std::cerr << "Failed to load address from benchmark database!" << std::endl;
+							return 1;
+						}
+						addressTime = elapsed(start) * 1000;
+					}
+				}
+				config.dataFileEngine = hb::DataFileEngine::EngineText;
+
+				std::cout << std::setw(10) << size << std::fixed << std::setprecision(1) << std::setw(20) << times[0] << std::setw(20) << times[1] << std::setw(20) << times[2] << std::setw(20) << addressTime << std::setw(20) << fileSizes[0] << std::setw(20) << fileSizes[1] << std::setw(20) << fileSizes[2] << std::endl;
+			}
+
+			std::remove(dataFilePath.c_str());
+		}
+
+		if (benchAddressTable) {
+			/*
+			 * Suspicious address table, std::map keyed by address text (previous implementation) compared with
+			 * hb::AddressTable, memory is allocated heap per entry, lookups are done with address text (CLI, datafile)
+			 * and with parsed address (log parser)
+			 */
+			const unsigned int size = 1000000;
+			const unsigned int lookups = 1000000;
+			std::vector<std::string> texts;
+			std::vector<hb::Address> addresses(lookups);
+			texts.reserve(lookups);
+			srand(1);
+			for (unsigned int i = 0; i < lookups; ++i) {
+				texts.push_back(benchmarkAddress(rand() % size));
+				hb::Address::parse(texts.back(), addresses[i]);
+			}
+			hb::SuspiciosAddressType record;
+			record.version = 4;
+			unsigned long long int found;
+
+			std::cout << std::endl << "Address table, " << size << " IPv4 addresses, " << lookups << " random lookups" << std::endl;
+			std::cout << std::setw(20) << "" << std::setw(20) << "bytes/entry" << std::setw(20) << "build ms" << std::setw(20) << "text Mlookup/s" << std::setw(20) << "parsed Mlookup/s" << std::endl;
+
+			{
+				std::size_t heap = heapUsage();
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				std::map<std::string, hb::SuspiciosAddressType> map;
+				for (unsigned int i = 0; i < size; ++i) {
+					map[benchmarkAddress(i)] = record;
+				}
+				double build = elapsed(start) * 1000;
+				double bytes = (double)(heapUsage() - heap) / size;
+				found = 0;
+				start = std::chrono::steady_clock::now();
+				for (unsigned int i = 0; i < lookups; ++i) {
+					found += map.count(texts[i]);
+				}
+				double textRate = lookups / elapsed(start) / 1000000;
+				if (found != lookups) {
+					std::cerr << "Address lookup failed!" << std::endl;
+					return 1;
+				}
+				std::cout << std::setw(20) << "std::map<string>" << std::fixed << std::setprecision(1) << std::setw(20) << bytes << std::setw(20) << build << std::setw(20) << textRate << std::setw(20) << "-" << std::endl;
+			}
+
+			{
+				std::size_t heap = heapUsage();
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				hb::AddressTable<hb::SuspiciosAddressType> table;
+				for (unsigned int i = 0; i < size; ++i) {
+					table[benchmarkAddress(i)] = record;
+				}
+				double build = elapsed(start) * 1000;
+				double bytes = (double)(heapUsage() - heap) / size;
+				found = 0;
+				start = std::chrono::steady_clock::now();
+				for (unsigned int i = 0; i < lookups; ++i) {
+					found += table.find(texts[i]) != NULL;
+				}
+				double textRate = lookups / elapsed(start) / 1000000;
+				start = std::chrono::steady_clock::now();
+				for (unsigned int i = 0; i < lookups; ++i) {
+					found += table.find(addresses[i]) != NULL;
+				}
+				double parsedRate = lookups / elapsed(start) / 1000000;
+				if (found != 2 * (unsigned long long int)lookups) {
+					std::cerr << "Address lookup failed!" << std::endl;
+					return 1;
+				}
+				std::cout << std::setw(20) << "hb::AddressTable" << std::fixed << std::setprecision(1) << std::setw(20) << bytes << std::setw(20) << build << std::setw(20) << textRate << std::setw(20) << parsedRate << std::endl;
+			}
+		}
+
+		if (benchRuleExpiry) {
+			/*
+			 * Expiry check after log check, full sweep calling updateIptables for every address with rule (previous
+			 * implementation) compared with expiry queue, none of rules is expired, so iptables is not called
+			 */
+			const unsigned int checks = 10;
+			std::vector<unsigned int> sizes = {1000, 10000, 100000};
+			config.keepBlockedScoreMultiplier = 10;
+			std::time_t currentTime;
+			std::time(&currentTime);
+
+			std::cout << std::endl << "Rule expiry check, addresses with iptables rule, none expired" << std::endl;
+			std::cout << std::setw(10) << "rules" << std::setw(20) << "sweep us/check" << std::setw(20) << "queue us/check" << std::endl;
+
+			for (unsigned int size : sizes) {
+				hb::Data data = hb::Data(&log, &config, &iptables);
+				hb::SuspiciosAddressType record;
+				record.lastActivity = (unsigned long long int)currentTime;
+				record.activityScore = 3600;
+				record.activityCount = 1;
+				record.iptableRule = true;
+				record.version = 4;
+				for (unsigned int i = 0; i < size; ++i) {
+					data.suspiciousAddresses[benchmarkAddress(i)] = record;
+				}
+				data.scheduleExpiries();
+
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				hb::AddressTable<hb::SuspiciosAddressType>::iterator it;
+				for (unsigned int c = 0; c < checks; ++c) {
+					for (it = data.suspiciousAddresses.begin(); it != data.suspiciousAddresses.end(); ++it) {
+						if (it->second.iptableRule) {
+							data.updateIptables(it->first.toString());
+						}
+					}
+				}
+				double sweep = elapsed(start) * 1000000 / checks;
+
+				start = std::chrono::steady_clock::now();
+				for (unsigned int c = 0; c < checks; ++c) {
+					data.expireRules();
+				}
+				double queue = elapsed(start) * 1000000 / checks;
+
+				std::cout << std::setw(10) << size << std::fixed << std::setprecision(1) << std::setw(20) << sweep << std::setw(20) << queue << std::endl;
+			}
+		}
+
+		if (benchFirewallPipeline) {
+			/*
+			 * Log parsing, scoring and blocking with in-memory firewall backend (no root or firewall tools needed),
+			 * backend sleeps for each transaction to simulate iptables-restore, log is appended in rounds like daemon
+			 * sees it, each address is blocked on its third line
+			 * Sync applies each block right away on parsing thread (no batch), batched collects blocks of round and
+			 * applies them on worker thread in single transaction
+			 * Block latency is time from start of round until transaction with block is completed
+			 */
+			const unsigned int size = 5000;
+			const unsigned int rounds = 10;
+			const unsigned int transactionLatency = 2000;
+			const unsigned int changeLatency = 5;
+			const std::string configPath = "benchmark_config";
+			const std::string logPath = "benchmark_log";
+
+			std::cout << std::endl << "Firewall pipeline, " << size << " addresses blocked, " << size * 3 << " log lines in " << rounds << " rounds, " << transactionLatency << " us/transaction + " << changeLatency << " us/change" << std::endl;
+			std::cout << std::setw(10) << "mode" << std::setw(20) << "klines/s" << std::setw(20) << "blocked" << std::setw(20) << "transactions" << std::setw(20) << "mean latency ms" << std::setw(20) << "max latency ms" << std::endl;
+
+			std::ofstream c(configPath);
+			c << "[Global]" << std::endl;
+			c << "log.level = ERROR" << std::endl;
+			c << "log.threads = 1" << std::endl;
+			c << "datafile.path = " << dataFilePath << std::endl;
+			c << "datafile.sync = shutdown" << std::endl;
+			c << "datafile.sync.dirty = 1000000" << std::endl;
+			c << "address.block.score = 2" << std::endl;
+			c << "address.block.multiplier = 0" << std::endl;
+			c << "[Log.Bench]" << std::endl;
+			c << "log.path = " << logPath << std::endl;
+			c << "log.pattern = ^.+? sshd\\[\\d+\\]: Invalid user .+? from %i port %p" << std::endl;
+			c << "log.score = 1" << std::endl;
+			c.close();
+
+			for (int batched = 0; batched < 2; ++batched) {
+				std::remove(dataFilePath.c_str());
+				std::remove(logPath.c_str());
+				std::ofstream(dataFilePath).close();
+				std::ofstream(logPath).close();
+				hb::Config pipelineConfig = hb::Config(&log, configPath);
+				if (!pipelineConfig.load() || !pipelineConfig.processPatterns()) {
+					std::cerr << "Failed to load benchmark configuration!" << std::endl;
+					return 1;
+				}
+				hb::Data data = hb::Data(&log, &pipelineConfig, &iptables);
+				if (!data.loadData()) {
+					std::cerr << "Failed to load benchmark datafile!" << std::endl;
+					return 1;
+				}
+				hb::MemoryFirewall firewall(&log, &pipelineConfig, transactionLatency, changeLatency, false);
+				data.setFirewall(&firewall);
+				std::queue<hb::ReportToAbuseIPDB> reports;
+				std::mutex reportsMutex;
+				hb::LogParser parser(&log, &pipelineConfig, &data, &reports, &reportsMutex);
+
+				std::vector<hb::MemoryFirewall::Operation> operations;
+				double latencySum = 0, latencyMax = 0, busy = 0;
+				std::chrono::steady_clock::time_point start;
+				for (unsigned int r = 0; r < rounds; ++r) {
+					std::ofstream l(logPath, std::ios::app);
+					for (unsigned int line = 0; line < 3 * size / rounds; ++line) {
+						unsigned int i = r * size / rounds + line % (size / rounds);
+						l << "Jan  1 00:00:00 host sshd[1]: Invalid user bench from " << benchmarkAddress(i) << " port 22" << std::endl;
+					}
+					l.close();
+
+					start = std::chrono::steady_clock::now();
+					if (batched == 1) {
+						data.beginFirewallBatch();
+					}
+					parser.checkFiles();
+					if (batched == 1) {
+						data.commitFirewallBatch();
+						data.waitFirewall();
+					}
+					busy += elapsed(start);
+					firewall.takeOperations(operations);
+					for (const hb::MemoryFirewall::Operation& operation : operations) {
+						double latency = std::chrono::duration<double>(operation.time - start).count() * 1000;
+						latencySum += latency;
+						if (latency > latencyMax) {
+							latencyMax = latency;
+						}
+					}
+					operations.clear();
+				}
+				if (firewall.blockedCount() != size) {
+					std::cerr << "Blocked " << firewall.blockedCount() << " addresses instead of " << size << "!" << std::endl;
+					return 1;
+				}
+
+				std::cout << std::setw(10) << (batched == 1 ? "batched" : "sync") << std::fixed << std::setprecision(1) << std::setw(20) << size * 3 / busy / 1000 << std::setw(20) << firewall.blockedCount() << std::setw(20) << firewall.transactionCount() << std::setw(20) << latencySum / size << std::setw(20) << latencyMax << std::endl;
+			}
+
+			std::remove(configPath.c_str());
+			std::remove(logPath.c_str());
+			std::remove(dataFilePath.c_str());
+		}
+
+		if (benchRuleLimit) {
+			/*
+			 * New blocks when iptables.limit is reached, each block evicts rule with lowest priority (last activity +
+			 * score) taken from indexed queue, compared with sorting addresses with rule by priority for each eviction
+			 * (sort is timed alone, without firewall changes)
+			 */
+			const unsigned int blocks = 1000;
+			const unsigned int sortBlocks = 20;
+			std::vector<unsigned int> sizes = {1000, 10000, 100000};
+			std::time_t currentTime;
+			std::time(&currentTime);
+			config.keepBlockedScoreMultiplier = 3600;
+
+			std::cout << std::endl << "Rule limit reached, " << blocks << " new blocks, each evicts one rule" << std::endl;
+			std::cout << std::setw(10) << "rules" << std::setw(20) << "queue us/block" << std::setw(20) << "sort us/block" << std::endl;
+
+			for (unsigned int size : sizes) {
+				config.firewallLimit = size;
+				hb::MemoryFirewall firewall(&log, &config, 0, 0, false);
+				hb::Data data = hb::Data(&log, &config, &iptables);
+				data.setFirewall(&firewall);
+				hb::SuspiciosAddressType record;
+				record.activityCount = 1;
+				record.iptableRule = true;
+				record.version = 4;
+				srand(1);
+				for (unsigned int i = 0; i < size; ++i) {
+					record.lastActivity = (unsigned long long int)currentTime - rand() % 3600;
+					record.activityScore = 3600 * (1 + rand() % 10);
+					data.suspiciousAddresses[benchmarkAddress(i)] = record;
+				}
+				data.scheduleExpiries();
+
+				// New addresses have highest score, so that each of them evicts rule
+				record.lastActivity = (unsigned long long int)currentTime;
+				record.activityScore = 3600 * 100;
+				record.iptableRule = false;
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				data.beginFirewallBatch();
+				for (unsigned int i = size; i < size + blocks; ++i) {
+					std::string address = benchmarkAddress(i);
+					data.suspiciousAddresses[address] = record;
+					data.updateIptables(address);
+				}
+				data.commitFirewallBatch();
+				data.waitFirewall();
+				double queue = elapsed(start) * 1000000 / blocks;
+				if (firewall.blockedCount() != blocks) {
+					std::cerr << "Blocked " << firewall.blockedCount() << " addresses instead of " << blocks << "!" << std::endl;
+					return 1;
+				}
+
+				std::vector<std::pair<unsigned long long int, hb::Address>> sorted;
+				hb::AddressTable<hb::SuspiciosAddressType>::iterator it;
+				start = std::chrono::steady_clock::now();
+				for (unsigned int b = 0; b < sortBlocks; ++b) {
+					sorted.clear();
+					for (it = data.suspiciousAddresses.begin(); it != data.suspiciousAddresses.end(); ++it) {
+						if (it->second.iptableRule && !it->second.blacklisted) {
+							sorted.push_back(std::make_pair(it->second.lastActivity + it->second.activityScore, it->first));
+						}
+					}
+					std::sort(sorted.begin(), sorted.end());
+				}
+				double sort = elapsed(start) * 1000000 / sortBlocks;
+
+				std::cout << std::setw(10) << size << std::fixed << std::setprecision(1) << std::setw(20) << queue << std::setw(20) << sort << std::endl;
+			}
+			config.firewallLimit = 0;
+		}
+
+	} catch (std::exception& e) {
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
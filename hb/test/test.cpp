@@ -6,14 +6,40 @@
 #include <map>
 // Standard vector library
 #include <vector>
+// RegEx
+#include <regex>
+// Queue
+#include <queue>
+// Mutex
+#include <mutex>
+// Threads
+#include <thread>
+// Atomic
+#include <atomic>
+// File stream
+#include <fstream>
+// Remove file
+#include <cstdio>
 // Syslog
 namespace csyslog{
 	#include <syslog.h>
 }
 // Limits
 #include <climits>
+// Make directory
+namespace cstat{
+	#include <sys/stat.h>
+}
+// C signal handling
+namespace csignal{
+	#include <signal.h>
+}
+// SIG_IGN expands to unqualified handler type
+using csignal::__sighandler_t;
 // Logger
 #include "../src/logger.h"
+// Address
+#include "../src/address.h"
 // Iptables
 #include "../src/iptables.h"
 // Config
@@ -22,23 +48,53 @@ namespace csyslog{
 #include "../src/data.h"
 // LogParser
 #include "../src/logparser.h"
+// Firewall in memory
+#include "../src/memoryfirewall.h"
+// Firewall worker
+#include "../src/firewallworker.h"
+// Expiry queue
+#include "../src/expiryqueue.h"
+// CPU budget
+#include "../src/cpubudget.h"
+// Pattern set
+#include "../src/patternset.h"
 
 int main(int argc, char *argv[])
 {
 	clock_t start = clock();
 	clock_t end;
 
+	// Firewall tools can close pipe before whole transaction is written, write error is checked instead
+	csignal::signal(SIGPIPE, SIG_IGN);
+
 	time_t currentTime;
 	time(&currentTime);
 
 	bool testSyslog = false;
+	bool testAddress = true;
+	bool testPatternSet = true;
+	bool testFirewallWorker = true;
+	bool testExpiryQueue = true;
+	bool testCpuBudget = true;
 	bool testIptables = false;
 	bool testConfig = false;
 	bool testData = false;
 	bool removeTempData = false;
+	bool testDataEngines = true;
 	bool testLogParsing = true;
+	bool testLogStreaming = true;
+	bool testBackfill = true;
+	bool testRuleLimit = true;
+	bool testTimeoutRefresh = true;
 	bool testConfiguredLogParsing = true;
 
+	// Count of failed checks, test fails if any check fails
+	unsigned int failures = 0;
+
+	// Queue for AbuseIPDB reporting (not sent from tests)
+	std::queue<hb::ReportToAbuseIPDB> abuseipdbReportingQueue;
+	std::mutex abuseipdbReportingQueueMutex;
+
 	try{
 		// Syslog
 		std::cout << "Creating Logger object..." << std::endl;
@@ -79,6 +135,529 @@ int main(int argc, char *argv[])
 		end = clock();
 		std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
 
+		// Address parser, expected presentation form (same as inet_ntop) or empty string if text is not valid address
+		if (testAddress) {
+			std::cout << "Parsing addresses..." << std::endl;
+			std::vector<std::pair<std::string, std::string>> addresses = {
+				{"192.168.1.1", "192.168.1.1"},
+				{"0.0.0.0", "0.0.0.0"},
+				{"255.255.255.255", "255.255.255.255"},
+				{"256.1.1.1", ""},
+				{"1.2.3.999", ""},
+				{"1.2.3.1000", ""},
+				{"1.2.3", ""},
+				{"1.2.3.4.5", ""},
+				{"1..2.3", ""},
+				{"1.2.3.4.", ""},
+				{" 1.2.3.4", ""},
+				{"1.2.3.4 ", ""},
+				{"a1.2.3.4", ""},
+				{"1.2.3.4x", ""},
+				{"1.2.3.4/32", ""},
+				{"", ""},
+				{"::", "::"},
+				{"::1", "::1"},
+				{"1::", "1::"},
+				{"2001:DB8::1", "2001:db8::1"},
+				{"2001:db8:0:0:0:0:0:1", "2001:db8::1"},
+				{"1:0:0:2:0:0:0:3", "1:0:0:2::3"},
+				{"::1:2:3:4:5:6:7", "0:1:2:3:4:5:6:7"},
+				{"1:2:3:4:5:6:7:8", "1:2:3:4:5:6:7:8"},
+				{"::ffff:10.0.0.1", "::ffff:10.0.0.1"},
+				{"1:2:3:4:5:6:1.2.3.4", "1:2:3:4:5:6:102:304"},
+				{"::1.2.3.4", "::1.2.3.4"},
+				{"1:2:3:4:5:6:7:8:9", ""},
+				{"1:2:3:4:5:6:7:1.2.3.4", ""},
+				{"1:2:3:4:5:6:7", ""},
+				{"1::2::3", ""},
+				{"12345::1", ""},
+				{":1:2:3:4:5:6:7", ""},
+				{"1:2:3:4:5:6:7:", ""},
+				{"::ffff:256.0.0.1", ""},
+				{"::1.2.3", ""},
+				{"fe80::1%eth0", ""},
+				{"g::1", ""},
+				{":::", ""},
+			};
+			hb::Address address, again;
+			for (std::vector<std::pair<std::string, std::string>>::iterator ita = addresses.begin(); ita != addresses.end(); ++ita) {
+				bool valid = hb::Address::parse(ita->first, address);
+				if (valid != (ita->second.length() > 0)) {
+					std::cerr << "Address \"" << ita->first << "\" is " << (valid ? "parsed" : "not parsed") << "!" << std::endl;
+					++failures;
+				} else if (valid && address.toString() != ita->second) {
+					std::cerr << "Address \"" << ita->first << "\" is formatted as " << address.toString() << " instead of " << ita->second << "!" << std::endl;
+					++failures;
+				} else if (valid && (!hb::Address::parse(address.toString(), again) || again != address || again.version != (ita->second.find(':') == std::string::npos ? 4 : 6))) {
+					std::cerr << "Address \"" << ita->first << "\" is not the same after parsing its presentation form!" << std::endl;
+					++failures;
+				}
+			}
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
+		// Pattern set, combined regex (with and without literal prefilter) finds the same pattern, address and port as
+		// matching patterns one by one, first pattern whose address is valid wins
+		if (testPatternSet) {
+			std::cout << "Matching lines with pattern sets..." << std::endl;
+
+			// Required literals
+			std::vector<std::pair<std::string, std::string>> literals = {
+				{"^.+? sshd\\[\\d+\\]: Invalid user .+? from (x)", "]: invalid user "},
+				{"Failed password for", "failed password for"},
+				{"abc?def", "def"},
+				{"a{0,3}bcd", "bcd"},
+				{"[abc]hello.world", "hello"},
+				{"x(y)z", "x"},
+				{"foo|bar", ""},
+				{"^.*$", ""},
+			};
+			std::vector<hb::Pattern> literalPatterns(literals.size());
+			for (std::size_t i = 0; i < literals.size(); ++i) {
+				literalPatterns[i].patternString = literals[i].first;
+			}
+			hb::PatternSet literalSet;
+			literalSet.compile(literalPatterns);
+			for (std::size_t i = 0; i < literals.size(); ++i) {
+				if (literalSet.literal(i) != literals[i].second) {
+					std::cerr << "Literal of pattern " << literals[i].first << " is \"" << literalSet.literal(i) << "\" instead of \"" << literals[i].second << "\"!" << std::endl;
+					++failures;
+				}
+			}
+
+			// Patterns with extra groups (group of each pattern in combined regex) and overlapping patterns
+			const std::string configPath = "test_patterns_config";
+			std::ofstream c(configPath);
+			c << "[Global]" << std::endl;
+			c << "[Log.Synthetic]" << std::endl;
+			c << "log.pattern = ^test (?:alpha|beta) from %i port %p(,| ;)(x*)$" << std::endl;
+			c << "log.pattern = ^test [(] gamma %i( done)?$" << std::endl;
+			c << "log.pattern = ^test (?:alpha|beta) from %i port %p.*$" << std::endl;
+			c << "log.pattern = ^.*client %i.*$" << std::endl;
+			c << "log.refused.pattern = ^test refused %i$" << std::endl;
+			c << "[Log.NoLiteral]" << std::endl;
+			c << "log.pattern = ^%i$" << std::endl;
+			c.close();
+			std::vector<std::string> lines = {
+				"test alpha from 10.0.0.1 port 22,xx",
+				"test beta from 10.0.0.2 port 2222 ;",
+				"test alpha from 10.0.0.3 port 22 trailing",
+				"test ( gamma 2001:db8::1 done",
+				"TEST ( GAMMA 10.0.0.4",
+				"test alpha from 999.0.0.1 port 22,x",
+				"test alpha from 999.0.0.1 port 22 client 10.0.0.5",
+				"x client 1.2.3.4 y",
+				"test refused 10.0.0.9",
+				"test refused 10.0.0.256",
+				"10.0.0.10",
+				"1:2:3:4:5:6:7:8:9",
+				"nothing here",
+				"",
+			};
+			std::vector<std::string> logFiles = {"hb/test/test_sshd_log_file", "hb/test/test_apache_access_log_file"};
+			for (std::vector<std::string>::iterator itf = logFiles.begin(); itf != logFiles.end(); ++itf) {
+				std::ifstream f(*itf);
+				std::string line;
+				while (std::getline(f, line)) {
+					lines.push_back(line);
+				}
+			}
+
+			std::vector<std::string> configPaths = {configPath, "config/hostblock.conf"};
+			std::vector<hb::RegexEngine> engines = {hb::RegexEngine::StdRegex, hb::RegexEngine::Re2Regex};
+			unsigned int matches = 0;
+			std::vector<hb::LogGroup>::iterator itpg;
+			for (std::vector<std::string>::iterator itc = configPaths.begin(); itc != configPaths.end(); ++itc) {
+				for (std::vector<hb::RegexEngine>::iterator ite = engines.begin(); ite != engines.end(); ++ite) {
+					hb::Config patternConfig = hb::Config(&log, *itc);
+					if (!patternConfig.load()) {
+						std::cerr << "Failed to load configuration " << *itc << "!" << std::endl;
+						++failures;
+						continue;
+					}
+					patternConfig.regexEngine = *ite;
+					if (!patternConfig.processPatterns()) {
+						std::cerr << "Failed to compile patterns of " << *itc << "!" << std::endl;
+						++failures;
+						continue;
+					}
+					for (itpg = patternConfig.logGroups.begin(); itpg != patternConfig.logGroups.end(); ++itpg) {
+						for (int refused = 0; refused < 2; ++refused) {
+							const std::vector<hb::Pattern>& patterns = refused ? itpg->refusedPatterns : itpg->patterns;
+							const hb::PatternSet& patternSet = *(refused ? itpg->refusedPatternSet : itpg->patternSet);
+							std::vector<std::regex> regexes;
+							for (std::vector<hb::Pattern>::const_iterator itp = patterns.begin(); itp != patterns.end(); ++itp) {
+								regexes.push_back(std::regex(itp->patternString, std::regex_constants::icase));
+							}
+							for (std::vector<std::string>::iterator itl = lines.begin(); itl != lines.end(); ++itl) {
+								// Patterns one by one, %i is group 1 (or 2 if port is before it)
+								int expectedIndex = -1;
+								hb::Address expectedAddress;
+								std::string expectedPort = "";
+								std::smatch matchResults;
+								for (std::size_t i = 0; i < regexes.size() && expectedIndex == -1; ++i) {
+									if (std::regex_match(*itl, matchResults, regexes[i])) {
+										int ipGroup = patterns[i].portSearch == 2 ? 2 : 1;
+										if (hb::Address::parse(matchResults[ipGroup].str(), expectedAddress)) {
+											expectedIndex = (int)i;
+											if (patterns[i].portSearch != -1) {
+												expectedPort = matchResults[patterns[i].portSearch == 2 ? 1 : 2].str();
+											}
+										}
+									}
+								}
+								if (expectedIndex != -1) {
+									++matches;
+								}
+								// Pattern set with and without prefilter
+								for (int prefilter = 0; prefilter < 2; ++prefilter) {
+									hb::PatternMatch patternMatch;
+									int index = -1;
+									const char* begin = itl->data();
+									const char* end = begin + itl->length();
+									if (prefilter == 0 || patternSet.candidate(begin, end)) {
+										index = patternSet.match(begin, end, patternMatch);
+									}
+									if (index != expectedIndex || (index != -1 && (patternMatch.address != expectedAddress || std::string(patternMatch.portBegin, patternMatch.portEnd) != expectedPort))) {
+										std::cerr << hb::PatternSet::engineName(*ite) << (prefilter ? " with prefilter" : "") << ", log group " << itpg->name << (refused ? " refused" : "") << ": line \"" << *itl << "\" matches pattern " << std::to_string(index) << (index != -1 ? " (" + patternMatch.address.toString() + " port " + std::string(patternMatch.portBegin, patternMatch.portEnd) + ")" : "") << " instead of " << std::to_string(expectedIndex) << (expectedIndex != -1 ? " (" + expectedAddress.toString() + " port " + expectedPort + ")" : "") << "!" << std::endl;
+										++failures;
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+
+			// Address found with %i is the same as with address regex of previous versions (IPv4 with octet ranges), invalid
+			// address in user name does not hide valid address after it
+			const std::string baselineIpSearchPattern = "(?:(?:[0-9a-f]{1,4}:){6}|::(?:[0-9a-f]{1,4}:){5}|(?:[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:){4}|(?:(?:[0-9a-f]{1,4}:){0,1}[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:){3}|(?:(?:[0-9a-f]{1,4}:){0,2}[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:){2}|(?:(?:[0-9a-f]{1,4}:){0,3}[0-9a-f]{1,4})?::(?:[0-9a-f]{1,4}:)|(?:(?:[0-9a-f]{1,4}:){0,4}[0-9a-f]{1,4})?::)(?:[0-9a-f]{1,4}:[0-9a-f]{1,4}|(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])\\.){3}(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9]?[0-9])))|(?:(?:[0-9a-f]{1,4}:){0,5}[0-9a-f]{1,4})?::[0-9a-f]{1,4}|(?:(?:[0-9a-f]{1,4}:){0,6}[0-9a-f]{1,4})?::|(?:(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\.){3}(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?))";
+			std::vector<std::string> baselinePatterns = {
+				"^.+? sshd\\[\\d+\\]: Invalid user .+? from %i port %p.*$",
+				"^.+? sshd\\[\\d+\\]: Failed password for .+? from %i( .*)?$",
+			};
+			std::vector<std::string> baselineLines = {
+				"Jan  1 00:00:00 host sshd[1]: Invalid user x from 5.6.7.8 port 22",
+				"Jan  1 00:00:00 host sshd[1]: Invalid user x from 999.1.1.1 from 5.6.7.8 port 22",
+				"Jan  1 00:00:00 host sshd[1]: Invalid user x from 1.2.3.256 port 1 from 5.6.7.8 port 22",
+				"Jan  1 00:00:00 host sshd[1]: Invalid user x from 300.300.300.300 port 22",
+				"Jan  1 00:00:00 host sshd[1]: Invalid user x from 2001:db8::1 port 22",
+				"Jan  1 00:00:00 host sshd[1]: Invalid user x from ::ffff:10.0.0.1 port 22",
+				"Jan  1 00:00:00 host sshd[1]: Invalid user x from ::ffff:10.0.0.256 from 2001:db8::2 port 22",
+				"Jan  1 00:00:00 host sshd[1]: Failed password for x from 256.0.0.1 from 10.0.0.2",
+				"Jan  1 00:00:00 host sshd[1]: Failed password for x from 10.0.0.3 from 10.0.0.999",
+				"Jan  1 00:00:00 host sshd[1]: Failed password for x from 10.0.0.4",
+			};
+			const std::string baselineConfigPath = "test_baseline_config";
+			std::ofstream b(baselineConfigPath);
+			b << "[Global]" << std::endl;
+			b << "[Log.Baseline]" << std::endl;
+			for (std::size_t i = 0; i < baselinePatterns.size(); ++i) {
+				b << "log.pattern = " << baselinePatterns[i] << std::endl;
+			}
+			b.close();
+			std::vector<std::regex> baselineRegexes;
+			for (std::size_t i = 0; i < baselinePatterns.size(); ++i) {
+				std::string pattern = baselinePatterns[i];
+				pattern.replace(pattern.find("%i"), 2, "(" + baselineIpSearchPattern + ")");
+				if (pattern.find("%p") != std::string::npos) {
+					pattern.replace(pattern.find("%p"), 2, "(\\d{1,5})");
+				}
+				baselineRegexes.push_back(std::regex(pattern, std::regex_constants::icase));
+			}
+			for (std::vector<hb::RegexEngine>::iterator ite = engines.begin(); ite != engines.end(); ++ite) {
+				hb::Config baselineConfig = hb::Config(&log, baselineConfigPath);
+				if (!baselineConfig.load() || baselineConfig.logGroups.size() != 1) {
+					std::cerr << "Failed to load configuration " << baselineConfigPath << "!" << std::endl;
+					++failures;
+					continue;
+				}
+				baselineConfig.regexEngine = *ite;
+				if (!baselineConfig.processPatterns()) {
+					std::cerr << "Failed to compile patterns of " << baselineConfigPath << "!" << std::endl;
+					++failures;
+					continue;
+				}
+				for (std::vector<std::string>::iterator itl = baselineLines.begin(); itl != baselineLines.end(); ++itl) {
+					std::string expected = "";
+					std::smatch matchResults;
+					hb::Address expectedAddress;
+					for (std::size_t i = 0; i < baselineRegexes.size() && expected == ""; ++i) {
+						if (std::regex_match(*itl, matchResults, baselineRegexes[i]) && hb::Address::parse(matchResults[1].str(), expectedAddress)) {
+							expected = expectedAddress.toString();
+						}
+					}
+					hb::PatternMatch patternMatch;
+					std::string found = "";
+					if (baselineConfig.logGroups[0].patternSet->match(itl->data(), itl->data() + itl->length(), patternMatch) != -1) {
+						found = patternMatch.address.toString();
+					}
+					if (found != expected) {
+						std::cerr << hb::PatternSet::engineName(*ite) << ": address in line \"" << *itl << "\" is \"" << found << "\" instead of \"" << expected << "\" found by address regex of previous versions!" << std::endl;
+						++failures;
+					}
+				}
+			}
+			std::remove(baselineConfigPath.c_str());
+			std::remove(configPath.c_str());
+			std::cout << "Matched lines: " << std::to_string(matches) << std::endl;
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
+		// Coalescing of firewall changes, changes are written as address with + (create) or - (remove)
+		if (testFirewallWorker) {
+			std::cout << "Coalescing firewall changes..." << std::endl;
+			struct CoalesceCase {
+				std::string changes;
+				bool replace;
+				std::string kept;
+			};
+			std::vector<CoalesceCase> cases = {
+				{"a+ b- c+", false, "a+ b- c+"},// Different addresses are not changed
+				{"a+ a-", false, ""},// Address had no rule before and after
+				{"a- a+", false, ""},// Address had rule before and after
+				{"a+ a- a+", false, "a+"},// Only last change is needed
+				{"a- a+ a-", false, "a-"},
+				{"a+ a+", false, "a+"},
+				{"a+ b+ a- c- b-", false, "c-"},// Order of kept changes is kept
+				{"a+ a-", true, "a-"},// Create replaces rule (new timeout), last change is always needed
+				{"a- a+", true, "a+"},
+				{"a+ b+ a+ b-", true, "a+ b-"},
+			};
+			auto parseChanges = [](const std::string& text, std::vector<hb::FirewallChange>& changes) {
+				std::string token;
+				std::size_t pos = 0, next;
+				while (pos < text.length()) {
+					next = text.find(' ', pos);
+					if (next == std::string::npos) next = text.length();
+					token = text.substr(pos, next - pos);
+					changes.push_back(hb::FirewallChange{"10.40.0." + std::to_string(token[0] - 'a' + 1), 4, token[1] == '+', 0, changes.size(), false});
+					pos = next + 1;
+				}
+			};
+			auto formatChanges = [](const std::vector<hb::FirewallChange>& changes) {
+				std::string text = "";
+				for (std::vector<hb::FirewallChange>::const_iterator itc = changes.begin(); itc != changes.end(); ++itc) {
+					if (text.length() > 0) text += " ";
+					text += std::string(1, (char)('a' + std::stoi(itc->address.substr(8)) - 1)) + (itc->create ? "+" : "-");
+				}
+				return text;
+			};
+			for (std::vector<CoalesceCase>::iterator itcc = cases.begin(); itcc != cases.end(); ++itcc) {
+				std::vector<hb::FirewallChange> changes, dropped;
+				parseChanges(itcc->changes, changes);
+				std::size_t count = changes.size();
+				hb::FirewallWorker::coalesce(changes, itcc->replace, dropped);
+				if (formatChanges(changes) != itcc->kept) {
+					std::cerr << "Coalesced changes " << itcc->changes << (itcc->replace ? " (replace)" : "") << " are \"" << formatChanges(changes) << "\" instead of \"" << itcc->kept << "\"!" << std::endl;
+					++failures;
+				}
+				if (changes.size() + dropped.size() != count) {
+					std::cerr << "Coalesced changes " << itcc->changes << " lost " << std::to_string(count - changes.size() - dropped.size()) << " changes!" << std::endl;
+					++failures;
+				}
+				for (std::vector<hb::FirewallChange>::iterator itc = dropped.begin(); itc != dropped.end(); ++itc) {
+					if (!itc->applied) {
+						std::cerr << "Dropped change of " << itc->address << " is not marked as applied!" << std::endl;
+						++failures;
+					}
+				}
+				for (std::vector<hb::FirewallChange>::iterator itc = changes.begin(); itc != changes.end(); ++itc) {
+					if (itc->applied) {
+						std::cerr << "Kept change of " << itc->address << " is marked as applied!" << std::endl;
+						++failures;
+					}
+				}
+			}
+
+			// Worker applies coalesced changes in its thread and returns all changes as results
+			hb::FirewallWorker worker(&log);
+			std::vector<hb::FirewallChange> changes, applied, results;
+			parseChanges("a+ b+ a- c+ b+", changes);
+			worker.submit(changes, [&applied](std::vector<hb::FirewallChange>& changes) {
+				for (std::vector<hb::FirewallChange>::iterator itc = changes.begin(); itc != changes.end(); ++itc) {
+					itc->applied = true;
+				}
+				applied.insert(applied.end(), changes.begin(), changes.end());
+			}, false);
+			worker.wait();
+			worker.takeResults(results);
+			if (formatChanges(applied) != "c+ b+" || results.size() != 5) {
+				std::cerr << "Firewall worker applied \"" << formatChanges(applied) << "\" instead of \"c+ b+\" and returned " << std::to_string(results.size()) << " results instead of 5!" << std::endl;
+				++failures;
+			}
+			for (std::vector<hb::FirewallChange>::iterator itc = results.begin(); itc != results.end(); ++itc) {
+				if (!itc->applied) {
+					std::cerr << "Firewall worker returned change of " << itc->address << " that is not applied!" << std::endl;
+					++failures;
+				}
+			}
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
+		// Expiry queue, addresses are taken by deadline, rescheduled or cancelled addresses are not taken by their old deadline
+		if (testExpiryQueue) {
+			std::cout << "Scheduling rule expiries..." << std::endl;
+			hb::ExpiryQueue queue;
+			std::vector<hb::Address> keys(5);
+			for (unsigned int i = 0; i < keys.size(); ++i) {
+				hb::Address::parse("10.30.0." + std::to_string(i), keys[i]);
+			}
+			std::vector<hb::Address> expired;
+			hb::Address firstAddress;
+			unsigned long long int firstDeadline;
+
+			// Earliest deadline is taken first, deadline equal to current time is not expired yet
+			queue.schedule(keys[0], 100);
+			queue.schedule(keys[1], 50);
+			queue.schedule(keys[2], 200);
+			queue.takeExpired(200, expired);
+			if (expired.size() != 2 || expired[0] != keys[1] || expired[1] != keys[0] || queue.size() != 1) {
+				std::cerr << "Expiry queue did not take addresses with deadline 50 and 100 in order!" << std::endl;
+				++failures;
+			}
+
+			// Later deadline, address is not taken by old deadline
+			expired.clear();
+			queue.schedule(keys[3], 300);
+			queue.schedule(keys[3], 500);
+			queue.takeExpired(400, expired);
+			if (expired.size() != 1 || expired[0] != keys[2]) {
+				std::cerr << "Expiry queue took address by deadline that was postponed!" << std::endl;
+				++failures;
+			}
+			expired.clear();
+			queue.takeExpired(501, expired);
+			if (expired.size() != 1 || expired[0] != keys[3] || queue.size() != 0) {
+				std::cerr << "Expiry queue did not take address by postponed deadline!" << std::endl;
+				++failures;
+			}
+
+			// Earlier deadline, address is taken once
+			expired.clear();
+			queue.schedule(keys[0], 1000);
+			queue.schedule(keys[0], 700);
+			queue.schedule(keys[1], 800);
+			if (!queue.first(firstAddress, firstDeadline) || firstAddress != keys[0] || firstDeadline != 700) {
+				std::cerr << "First address in expiry queue is not the one with earliest deadline!" << std::endl;
+				++failures;
+			}
+			queue.takeExpired(2000, expired);
+			if (expired.size() != 2 || expired[0] != keys[0] || expired[1] != keys[1]) {
+				std::cerr << "Expiry queue took address with earlier deadline " << expired.size() << " times in wrong order!" << std::endl;
+				++failures;
+			}
+
+			// Cancelled address is not taken and is skipped by first
+			expired.clear();
+			queue.schedule(keys[0], 100);
+			queue.schedule(keys[1], 200);
+			queue.schedule(keys[2], 300);
+			queue.cancel(keys[0]);
+			queue.cancel(keys[4]);
+			if (!queue.first(firstAddress, firstDeadline) || firstAddress != keys[1] || firstDeadline != 200 || queue.size() != 2) {
+				std::cerr << "First address in expiry queue is cancelled address!" << std::endl;
+				++failures;
+			}
+			queue.takeExpired(1000, expired);
+			if (expired.size() != 2 || expired[0] != keys[1] || expired[1] != keys[2]) {
+				std::cerr << "Expiry queue took cancelled address!" << std::endl;
+				++failures;
+			}
+			if (queue.first(firstAddress, firstDeadline)) {
+				std::cerr << "Expiry queue is not empty after all addresses were taken!" << std::endl;
+				++failures;
+			}
+
+			// Many reschedules (heap is compacted), every address is taken once by its last deadline
+			expired.clear();
+			const unsigned int count = 1000;
+			std::vector<hb::Address> many(count);
+			std::vector<unsigned long long int> deadlines(count);
+			srand(1);
+			for (unsigned int i = 0; i < count; ++i) {
+				hb::Address::parse("10.31." + std::to_string(i / 256) + "." + std::to_string(i % 256), many[i]);
+				deadlines[i] = 1000000 + rand() % 1000000;
+				queue.schedule(many[i], deadlines[i]);
+			}
+			for (unsigned int r = 0; r < 10; ++r) {
+				for (unsigned int i = 0; i < count; ++i) {
+					deadlines[i] = deadlines[i] - rand() % 100000;
+					queue.schedule(many[i], deadlines[i]);
+				}
+			}
+			for (unsigned int i = 0; i < count; i += 2) {
+				queue.cancel(many[i]);
+			}
+			queue.takeExpired(ULLONG_MAX, expired);
+			hb::AddressTable<unsigned long long int> index;
+			for (unsigned int i = 0; i < count; ++i) {
+				index[many[i]] = i;
+			}
+			bool ordered = true;
+			std::vector<bool> taken(count, false);
+			for (unsigned int e = 0; e < expired.size(); ++e) {
+				unsigned long long int i = index[expired[e]];
+				if (i % 2 == 0 || taken[i] || (e > 0 && deadlines[index[expired[e - 1]]] > deadlines[i])) {
+					ordered = false;
+				}
+				taken[i] = true;
+			}
+			if (!ordered || expired.size() != count / 2 || queue.size() != 0) {
+				std::cerr << "Expiry queue took " << expired.size() << " of " << count / 2 << " rescheduled addresses, order or cancelling is wrong!" << std::endl;
+				++failures;
+			}
+
+			queue.schedule(keys[0], 100);
+			queue.clear();
+			expired.clear();
+			queue.takeExpired(1000, expired);
+			if (expired.size() != 0 || queue.size() != 0) {
+				std::cerr << "Expiry queue is not empty after clear!" << std::endl;
+				++failures;
+			}
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
+		// CPU budget shared by several threads, threads together use about limit of one core, not limit each
+		if (testCpuBudget) {
+			std::cout << "Limiting CPU usage of threads sharing budget..." << std::endl;
+			const unsigned int threads = 4;
+			const unsigned int limit = 20;
+			hb::CpuBudget::Account account;
+			std::vector<std::thread> budgetThreads;
+			std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+			clock_t cpuStart = clock();
+			for (unsigned int t = 0; t < threads; ++t) {
+				budgetThreads.push_back(std::thread([&account, &wallStart]{
+					hb::CpuBudget cpuBudget(limit, 20, &account);
+					cpuBudget.start();
+					volatile unsigned int work = 0;
+					while (std::chrono::steady_clock::now() - wallStart < std::chrono::milliseconds(1000)) {
+						for (unsigned int i = 0; i < 1000; ++i) {
+							work = work + i;
+						}
+						cpuBudget.tick();
+					}
+				}));
+			}
+			for (unsigned int t = 0; t < threads; ++t) {
+				budgetThreads[t].join();
+			}
+			double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+			double cpu = (double)(clock() - cpuStart) / CLOCKS_PER_SEC;
+			if (cpu / wall * 100 > limit * 1.75) {
+				std::cerr << threads << " threads with shared CPU budget used " << (unsigned int)(cpu / wall * 100) << "% of core instead of " << limit << "%!" << std::endl;
+				++failures;
+			}
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
 		// Config
 		std::cout << "Creating Config object..." << std::endl;
 		hb::Config cfg = hb::Config(&log, "config/hostblock.conf");
@@ -100,8 +679,8 @@ int main(int argc, char *argv[])
 		std::cout << "Creating Iptables object..." << std::endl;
 		hb::Iptables iptbl = hb::Iptables();
 		if (testIptables){
-			std::map<unsigned int, std::string> rules;
-			std::map<unsigned int, std::string>::iterator ruleIt;
+			std::vector<std::string> rules;
+			std::vector<std::string>::iterator ruleIt;
 			std::cout << "iptable rules (INPUT):" << std::endl;
 			std::string ruleStart = "";
 			std::string ruleEnd = "";
@@ -110,27 +689,30 @@ int main(int argc, char *argv[])
 				ruleStart = cfg.iptablesRule.substr(0, posip);
 				ruleEnd = cfg.iptablesRule.substr(posip + 2);
 			}
-			rules = iptbl.listRules("INPUT");
+			rules.clear();
+			iptbl.listRules("INPUT", rules);
 			for(ruleIt=rules.begin(); ruleIt!=rules.end(); ++ruleIt){
-				std::cout << "Rule: " << ruleIt->second << std::endl;
+				std::cout << "Rule: " << *ruleIt << std::endl;
 			}
 			std::cout << "Adding rule to drop all connections from 10.10.10.10..." << std::endl;
 			if(iptbl.append("INPUT",ruleStart + "10.10.10.10" + ruleEnd) == false){
 				std::cerr << "Failed to add rule for address 10.10.10.10" << std::endl;
 			}
 			std::cout << "iptable rules (INPUT):" << std::endl;
-			rules = iptbl.listRules("INPUT");
+			rules.clear();
+			iptbl.listRules("INPUT", rules);
 			for(ruleIt=rules.begin(); ruleIt!=rules.end(); ++ruleIt){
-				std::cout << "Rule: " << ruleIt->second << std::endl;
+				std::cout << "Rule: " << *ruleIt << std::endl;
 			}
 			std::cout << "Removing rule for address 10.10.10.10..." << std::endl;
 			if(iptbl.remove("INPUT",ruleStart + "10.10.10.10" + ruleEnd) == false){
 				std::cerr << "Failed to remove rule for address 10.10.10.10" << std::endl;
 			}
 			std::cout << "iptable rules (INPUT):" << std::endl;
-			rules = iptbl.listRules("INPUT");
+			rules.clear();
+			iptbl.listRules("INPUT", rules);
 			for(ruleIt=rules.begin(); ruleIt!=rules.end(); ++ruleIt){
-				std::cout << "Rule: " << ruleIt->second << std::endl;
+				std::cout << "Rule: " << *ruleIt << std::endl;
 			}
 		}
 		end = clock();
@@ -167,7 +749,7 @@ int main(int argc, char *argv[])
 			rec.refusedCount = 2;
 			rec.whitelisted = false;
 			rec.blacklisted = true;
-			data.suspiciousAddresses.insert(std::pair<std::string,hb::SuspiciosAddressType>("10.10.10.15",rec));
+			data.suspiciousAddresses["10.10.10.15"] = rec;
 			if (!data.addAddress("10.10.10.15")) {
 				std::cerr << "Failed to add new record to datafile!" << std::endl;
 			}
@@ -261,6 +843,219 @@ int main(int argc, char *argv[])
 		end = clock();
 		std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
 
+		// Datafile engines, data saved and changed record by record is the same after load, also after conversion to next engine
+		if (testDataEngines) {
+			std::cout << "Saving and loading data with each datafile engine..." << std::endl;
+			const std::string configPath = "test_engine_config";
+			const std::string logPath = "test_engine_log";
+			const std::string dataFilePath = "test_engine_datafile";
+			const std::vector<std::string> dataFileSuffixes = {"", ".journal", ".journal.old", ".tmp", "-wal", "-shm"};
+			std::vector<std::string> engines = {"text", "journal", "binary", "sqlite"};
+			std::ofstream(logPath).close();
+
+			// First difference of saved and loaded data, empty if data is the same
+			auto difference = [](hb::Data& saved, hb::Config& savedConfig, hb::Data& loaded, hb::Config& loadedConfig) -> std::string {
+				if (saved.suspiciousAddresses.size() != loaded.suspiciousAddresses.size()) {
+					return std::to_string(loaded.suspiciousAddresses.size()) + " addresses instead of " + std::to_string(saved.suspiciousAddresses.size());
+				}
+				for (hb::AddressTable<hb::SuspiciosAddressType>::iterator it = saved.suspiciousAddresses.begin(); it != saved.suspiciousAddresses.end(); ++it) {
+					hb::SuspiciosAddressType* sa = loaded.suspiciousAddresses.find(it->first);
+					if (sa == NULL || sa->lastActivity != it->second.lastActivity || sa->activityScore != it->second.activityScore
+							|| sa->activityCount != it->second.activityCount || sa->refusedCount != it->second.refusedCount
+							|| sa->whitelisted != it->second.whitelisted || sa->blacklisted != it->second.blacklisted
+							|| sa->lastReported != it->second.lastReported || sa->version != it->first.version) {
+						return "address " + it->first.toString();
+					}
+				}
+				if (saved.abuseIPDBBlacklist.size() != loaded.abuseIPDBBlacklist.size()) {
+					return std::to_string(loaded.abuseIPDBBlacklist.size()) + " AbuseIPDB addresses instead of " + std::to_string(saved.abuseIPDBBlacklist.size());
+				}
+				for (hb::AddressTable<hb::AbuseIPDBBlacklistedAddressType>::iterator it = saved.abuseIPDBBlacklist.begin(); it != saved.abuseIPDBBlacklist.end(); ++it) {
+					hb::AbuseIPDBBlacklistedAddressType* ab = loaded.abuseIPDBBlacklist.find(it->first);
+					if (ab == NULL || ab->totalReports != it->second.totalReports || ab->abuseConfidenceScore != it->second.abuseConfidenceScore || ab->version != it->first.version) {
+						return "AbuseIPDB address " + it->first.toString();
+					}
+				}
+				if (saved.abuseIPDBSyncTime != loaded.abuseIPDBSyncTime || saved.abuseIPDBBlacklistGenTime != loaded.abuseIPDBBlacklistGenTime) {
+					return "AbuseIPDB sync data";
+				}
+				const hb::LogFile& savedFile = savedConfig.logGroups[0].logFiles[0];
+				const hb::LogFile& loadedFile = loadedConfig.logGroups[0].logFiles[0];
+				if (savedFile.bookmark != loadedFile.bookmark || savedFile.size != loadedFile.size || savedFile.device != loadedFile.device
+						|| savedFile.inode != loadedFile.inode || savedFile.fingerprint != loadedFile.fingerprint || savedFile.fingerprintSize != loadedFile.fingerprintSize) {
+					return "log file " + savedFile.path;
+				}
+				return "";
+			};
+
+			for (std::size_t e = 0; e < engines.size(); ++e) {
+				std::ofstream c(configPath);
+				c << "[Global]" << std::endl;
+				c << "datafile.path = " << dataFilePath << std::endl;
+				c << "datafile.engine = " << engines[e] << std::endl;
+				c << "[Log.Engine]" << std::endl;
+				c << "log.path = " << logPath << std::endl;
+				c << "log.pattern = ^.+? sshd\\[\\d+\\]: Invalid user .+? from %i port %p" << std::endl;
+				c << "log.score = 1" << std::endl;
+				c.close();
+
+				hb::Config savedConfig = hb::Config(&log, configPath);
+				hb::Config loadedConfig = hb::Config(&log, configPath);
+				if (!savedConfig.load() || !loadedConfig.load() || savedConfig.logGroups.size() != 1 || savedConfig.logGroups[0].logFiles.size() != 1) {
+					std::cerr << "Failed to load configuration for " << engines[e] << " datafile engine test!" << std::endl;
+					++failures;
+					continue;
+				}
+
+				// Whole datafile is saved
+				hb::Data saved = hb::Data(&log, &savedConfig, &iptbl);
+				hb::SuspiciosAddressType rec;
+				rec.lastActivity = (unsigned long long int)currentTime;
+				rec.activityScore = 99;
+				rec.activityCount = 3;
+				rec.refusedCount = 2;
+				rec.lastReported = (unsigned long long int)currentTime - 10;
+				rec.version = 4;
+				saved.suspiciousAddresses["10.50.0.1"] = rec;
+				rec.activityScore = UINT_MAX;
+				rec.activityCount = UINT_MAX;
+				rec.refusedCount = UINT_MAX;
+				rec.lastReported = 0;
+				rec.blacklisted = true;
+				saved.suspiciousAddresses["10.50.0.2"] = rec;
+				rec.activityScore = 0;
+				rec.blacklisted = false;
+				rec.whitelisted = true;
+				rec.version = 6;
+				saved.suspiciousAddresses["2001:db8::1"] = rec;
+				hb::AbuseIPDBBlacklistedAddressType abuseRec;
+				abuseRec.totalReports = 12;
+				abuseRec.abuseConfidenceScore = 100;
+				abuseRec.version = 4;
+				saved.abuseIPDBBlacklist["10.51.0.1"] = abuseRec;
+				abuseRec.version = 6;
+				saved.abuseIPDBBlacklist["2001:db8::2"] = abuseRec;
+				saved.abuseIPDBSyncTime = (unsigned long long int)currentTime - 100;
+				saved.abuseIPDBBlacklistGenTime = (unsigned long long int)currentTime - 200;
+				hb::LogFile& logFile = savedConfig.logGroups[0].logFiles[0];
+				logFile.bookmark = 800;
+				logFile.size = 900;
+				logFile.device = 2049;
+				logFile.inode = 123456;
+				logFile.fingerprint = 0x0123456789abcdefULL;
+				logFile.fingerprintSize = 4096;
+				if (!saved.saveData()) {
+					std::cerr << "Failed to save datafile with " << engines[e] << " engine!" << std::endl;
+					++failures;
+				}
+
+				// Changes record by record
+				rec.activityScore = 5;
+				rec.whitelisted = false;
+				rec.version = 4;
+				saved.suspiciousAddresses["10.50.0.3"] = rec;
+				saved.suspiciousAddresses["10.50.0.1"].activityScore += 10;
+				saved.suspiciousAddresses["10.50.0.1"].activityCount++;
+				abuseRec.version = 4;
+				saved.abuseIPDBBlacklist["10.51.0.2"] = abuseRec;
+				saved.abuseIPDBBlacklist["10.51.0.1"].totalReports++;
+				logFile.bookmark += 100;
+				logFile.size += 100;
+				if (!saved.addAddress("10.50.0.3") || !saved.updateAddress("10.50.0.1") || !saved.removeAddress("10.50.0.2")
+						|| !saved.addAbuseIPDBAddress("10.51.0.2") || !saved.updateAbuseIPDBAddress("10.51.0.1") || !saved.removeAbuseIPDBAddress("2001:db8::2")
+						|| !saved.updateAbuseIPDBSyncData(saved.abuseIPDBSyncTime + 1, saved.abuseIPDBBlacklistGenTime + 1) || !saved.updateFile(logPath)) {
+					std::cerr << "Failed to update records in datafile with " << engines[e] << " engine!" << std::endl;
+					++failures;
+				}
+				saved.suspiciousAddresses.erase("10.50.0.2");
+				saved.abuseIPDBBlacklist.erase("2001:db8::2");
+				saved.abuseIPDBSyncTime++;
+				saved.abuseIPDBBlacklistGenTime++;
+
+				hb::Data loaded = hb::Data(&log, &loadedConfig, &iptbl);
+				std::string different;
+				if (!loaded.loadData()) {
+					std::cerr << "Failed to load datafile with " << engines[e] << " engine!" << std::endl;
+					++failures;
+				} else if ((different = difference(saved, savedConfig, loaded, loadedConfig)) != "") {
+					std::cerr << "Loaded data differs from saved data with " << engines[e] << " engine, " << different << "!" << std::endl;
+					++failures;
+				}
+
+				// Conversion (--convert), datafile is saved with next engine when it is loaded
+				std::string next = engines[(e + 1) % engines.size()];
+				hb::Config convertedConfig = hb::Config(&log, configPath);
+				convertedConfig.load();
+				hb::Config::parseDataFileEngine(next, convertedConfig.dataFileEngine);
+				hb::Data converting = hb::Data(&log, &convertedConfig, &iptbl);
+				if (!converting.loadData()) {
+					std::cerr << "Failed to convert datafile from " << engines[e] << " to " << next << " engine!" << std::endl;
+					++failures;
+				}
+				hb::Config reloadedConfig = hb::Config(&log, configPath);
+				reloadedConfig.load();
+				reloadedConfig.dataFileEngine = convertedConfig.dataFileEngine;
+				hb::Data reloaded = hb::Data(&log, &reloadedConfig, &iptbl);
+				if (!reloaded.loadData()) {
+					std::cerr << "Failed to load datafile converted from " << engines[e] << " to " << next << " engine!" << std::endl;
+					++failures;
+				} else if ((different = difference(saved, savedConfig, reloaded, reloadedConfig)) != "") {
+					std::cerr << "Data converted from " << engines[e] << " to " << next << " engine differs, " << different << "!" << std::endl;
+					++failures;
+				} else if ((next == "binary") != hb::BinaryData::isBinary(dataFilePath) || (next == "sqlite") != hb::SqliteData::isSqlite(dataFilePath)) {
+					std::cerr << "Datafile converted from " << engines[e] << " is not saved with " << next << " engine!" << std::endl;
+					++failures;
+				}
+
+				for (std::size_t f = 0; f < dataFileSuffixes.size(); ++f) {
+					std::remove((dataFilePath + dataFileSuffixes[f]).c_str());
+				}
+			}
+
+			// Changes collected in memory stay dirty when journal append fails (journal path is directory), they are
+			// appended with next flush
+			std::ofstream c(configPath);
+			c << "[Global]" << std::endl;
+			c << "datafile.path = " << dataFilePath << std::endl;
+			c << "datafile.engine = journal" << std::endl;
+			c << "datafile.sync = shutdown" << std::endl;
+			c << "[Log.Engine]" << std::endl;
+			c << "log.path = " << logPath << std::endl;
+			c << "log.pattern = ^.+? sshd\\[\\d+\\]: Invalid user .+? from %i port %p" << std::endl;
+			c << "log.score = 1" << std::endl;
+			c.close();
+			hb::Config failedConfig = hb::Config(&log, configPath);
+			hb::Config retriedConfig = hb::Config(&log, configPath);
+			if (!failedConfig.load() || !retriedConfig.load()) {
+				std::cerr << "Failed to load configuration for failed journal append test!" << std::endl;
+				++failures;
+			} else {
+				hb::MemoryFirewall firewall(&log, &failedConfig, 0, 0, false);
+				hb::Data failed = hb::Data(&log, &failedConfig, &iptbl);
+				failed.setFirewall(&firewall);
+				failed.saveData();
+				cstat::mkdir((dataFilePath + ".journal").c_str(), 0700);
+				failed.saveActivity("10.52.0.1", 3, 1, 0);
+				if (failed.flush()) {
+					std::cerr << "Flush succeeded although journal can not be written!" << std::endl;
+					++failures;
+				}
+				std::remove((dataFilePath + ".journal").c_str());
+				hb::Data retried = hb::Data(&log, &retriedConfig, &iptbl);
+				if (!failed.flush() || !retried.loadData() || retried.suspiciousAddresses.count("10.52.0.1") == 0 || retried.suspiciousAddresses["10.52.0.1"].activityScore != failed.suspiciousAddresses["10.52.0.1"].activityScore) {
+					std::cerr << "Activity of 10.52.0.1 is lost after failed journal append!" << std::endl;
+					++failures;
+				}
+			}
+			for (std::size_t f = 0; f < dataFileSuffixes.size(); ++f) {
+				std::remove((dataFilePath + dataFileSuffixes[f]).c_str());
+			}
+			std::remove(configPath.c_str());
+			std::remove(logPath.c_str());
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
 		// Log parsing
 		if (testLogParsing) {
 			// Reload configuration
@@ -309,7 +1104,7 @@ int main(int argc, char *argv[])
 
 			// Check log files
 			std::cout << "Log file check..." << std::endl;
-			hb::LogParser lp = hb::LogParser(&log, &cfg, &data);
+			hb::LogParser lp(&log, &cfg, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
 			lp.checkFiles();
 		}
 		end = clock();
@@ -327,6 +1122,326 @@ int main(int argc, char *argv[])
 		end = clock();
 		std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
 
+		// Activity is saved while log file is read, not after whole file is read
+		if (testLogStreaming) {
+			std::cout << "Log parsing, blocking before end of file..." << std::endl;
+			const std::string configPath = "test_stream_config";
+			const std::string logPath = "test_stream_log";
+			const std::string dataFilePath = "test_stream_datafile";
+			std::ofstream c(configPath);
+			c << "[Global]" << std::endl;
+			c << "log.threads = 1" << std::endl;
+			c << "datafile.path = " << dataFilePath << std::endl;
+			c << "datafile.sync = shutdown" << std::endl;
+			c << "address.block.score = 2" << std::endl;
+			c << "address.block.multiplier = 0" << std::endl;
+			c << "[Log.Stream]" << std::endl;
+			c << "log.path = " << logPath << std::endl;
+			c << "log.pattern = ^.+? sshd\\[\\d+\\]: Invalid user .+? from %i port %p" << std::endl;
+			c << "log.score = 1" << std::endl;
+			c.close();
+			std::ofstream(logPath).close();
+			std::ofstream(dataFilePath).close();
+
+			hb::Config streamConfig = hb::Config(&log, configPath);
+			if (!streamConfig.load() || !streamConfig.processPatterns()) {
+				std::cerr << "Failed to load configuration for log streaming test!" << std::endl;
+				++failures;
+			} else {
+				hb::Data streamData = hb::Data(&log, &streamConfig, &iptbl);
+				streamData.loadData();
+				hb::MemoryFirewall firewall(&log, &streamConfig, 0, 0, false);
+				streamData.setFirewall(&firewall);
+				hb::LogParser parser(&log, &streamConfig, &streamData, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
+				parser.checkFiles();
+
+				// First address in first read block, followed by lines that need regex, but do not match (few MiB)
+				std::ofstream l(logPath, std::ios::app);
+				for (unsigned int i = 0; i < 3; ++i) {
+					l << "Jan  1 00:00:00 host sshd[1]: Invalid user test from 10.20.0.1 port 22" << std::endl;
+				}
+				for (unsigned int i = 0; i < 40000; ++i) {
+					l << "Jan  1 00:00:00 host sshd[1]: Invalid user test from host.example port 22, address is not valid" << std::endl;
+				}
+				l.close();
+
+				// As soon as first address is blocked, second one is appended, it is found only if file is still being read
+				std::atomic<bool> checked(false);
+				std::thread appender([&]{
+					while (!checked && !firewall.blocked("10.20.0.1")) {
+						std::this_thread::yield();
+					}
+					std::ofstream a(logPath, std::ios::app);
+					for (unsigned int i = 0; i < 3; ++i) {
+						a << "Jan  1 00:00:00 host sshd[1]: Invalid user test from 10.20.0.2 port 22" << std::endl;
+					}
+				});
+				parser.checkFiles();
+				checked = true;
+				appender.join();
+				if (!firewall.blocked("10.20.0.1")) {
+					std::cerr << "Address 10.20.0.1 is not blocked after log check!" << std::endl;
+					++failures;
+				}
+				if (!firewall.blocked("10.20.0.2")) {
+					std::cerr << "Address 10.20.0.2 is not blocked, 10.20.0.1 was blocked only after end of log file!" << std::endl;
+					++failures;
+				}
+			}
+			std::remove(configPath.c_str());
+			std::remove(logPath.c_str());
+			std::remove(dataFilePath.c_str());
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
+		// Backfill of several large files in chunks, same activity as sequential read, threads are limited by log.threads
+		if (testBackfill) {
+			std::cout << "Log parsing, backfill in chunks..." << std::endl;
+			const std::string configPath = "test_backfill_config";
+			const std::string dataFilePath = "test_backfill_datafile";
+			const unsigned int files = 3;
+			const unsigned int lines = 50000;
+			std::ofstream c(configPath);
+			c << "[Global]" << std::endl;
+			c << "log.threads = 4" << std::endl;
+			c << "log.backfill.chunk = 1" << std::endl;
+			c << "datafile.path = " << dataFilePath << std::endl;
+			c << "datafile.sync = shutdown" << std::endl;
+			c << "address.block.score = 1000000" << std::endl;
+			c << "[Log.Backfill]" << std::endl;
+			for (unsigned int f = 0; f < files; ++f) {
+				std::ofstream("test_backfill_log" + std::to_string(f)).close();
+				c << "log.path = test_backfill_log" << std::to_string(f) << std::endl;
+			}
+			c << "log.pattern = ^.+? sshd\\[\\d+\\]: Invalid user .+? from %i port %p" << std::endl;
+			c << "log.score = 1" << std::endl;
+			c.close();
+			std::ofstream(dataFilePath).close();
+
+			hb::Config backfillConfig = hb::Config(&log, configPath);
+			if (!backfillConfig.load() || !backfillConfig.processPatterns()) {
+				std::cerr << "Failed to load configuration for backfill test!" << std::endl;
+				++failures;
+			} else {
+				hb::Data backfillData = hb::Data(&log, &backfillConfig, &iptbl);
+				backfillData.loadData();
+				hb::MemoryFirewall firewall(&log, &backfillConfig, 0, 0, false);
+				backfillData.setFirewall(&firewall);
+				hb::LogParser parser(&log, &backfillConfig, &backfillData, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
+				parser.checkFiles();
+
+				// Each file has 200 addresses, address i appears i + 1 times in each 20100 lines
+				for (unsigned int f = 0; f < files; ++f) {
+					std::ofstream l("test_backfill_log" + std::to_string(f), std::ios::app);
+					for (unsigned int n = 0, i = 0, k = 0; n < lines; ++n) {
+						l << "Jan  1 00:00:00 host sshd[1]: Invalid user test from 10.30." << std::to_string(f) << "." << std::to_string(i) << " port 22" << std::endl;
+						if (++k > i) {
+							k = 0;
+							i = (i + 1) % 200;
+						}
+					}
+				}
+
+				// Count of threads of process, sampled while files are checked (sampler is one of them)
+				std::atomic<bool> checked(false);
+				unsigned int threads = 0, maxThreads = 0;
+				auto countThreads = []{
+					std::ifstream status("/proc/self/status");
+					std::string line;
+					while (std::getline(status, line)) {
+						if (line.substr(0, 8) == "Threads:") {
+							return (unsigned int)std::stoul(line.substr(8));
+						}
+					}
+					return 0u;
+				};
+				threads = countThreads() + 1;
+				std::thread sampler([&]{
+					unsigned int sample;
+					while (!checked) {
+						sample = countThreads();
+						if (sample > maxThreads) {
+							maxThreads = sample;
+						}
+						std::this_thread::yield();
+					}
+				});
+				parser.checkFiles();
+				checked = true;
+				sampler.join();
+				if (maxThreads > threads + 4) {
+					std::cerr << "Backfill used " << std::to_string(maxThreads - threads) << " threads, log.threads is 4!" << std::endl;
+					++failures;
+				}
+
+				for (unsigned int f = 0; f < files; ++f) {
+					std::map<unsigned int, unsigned int> expected;
+					for (unsigned int n = 0, i = 0, k = 0; n < lines; ++n) {
+						expected[i]++;
+						if (++k > i) {
+							k = 0;
+							i = (i + 1) % 200;
+						}
+					}
+					for (unsigned int i = 0; i < 200; ++i) {
+						std::string address = "10.30." + std::to_string(f) + "." + std::to_string(i);
+						if (backfillData.suspiciousAddresses[address].activityCount != expected[i]) {
+							std::cerr << "Backfill found " << std::to_string(backfillData.suspiciousAddresses[address].activityCount) << " matches of " << address << " instead of " << std::to_string(expected[i]) << "!" << std::endl;
+							++failures;
+						}
+					}
+				}
+			}
+			for (unsigned int f = 0; f < files; ++f) {
+				std::remove(("test_backfill_log" + std::to_string(f)).c_str());
+			}
+			std::remove(configPath.c_str());
+			std::remove(dataFilePath.c_str());
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
+		// Rule limit, rule with lowest last activity + score is evicted, locally blacklisted address is never evicted
+		if (testRuleLimit) {
+			std::cout << "Evicting rules over iptables.limit..." << std::endl;
+			const std::string configPath = "test_limit_config";
+			const std::string dataFilePath = "test_limit_datafile";
+			std::ofstream c(configPath);
+			c << "[Global]" << std::endl;
+			c << "datafile.path = " << dataFilePath << std::endl;
+			c << "datafile.sync = shutdown" << std::endl;
+			c << "address.block.score = 1" << std::endl;
+			c << "address.block.multiplier = 3600" << std::endl;
+			c << "iptables.limit = 3" << std::endl;
+			c.close();
+			std::ofstream(dataFilePath).close();
+
+			hb::Config limitConfig = hb::Config(&log, configPath);
+			if (!limitConfig.load() || limitConfig.firewallLimit != 3) {
+				std::cerr << "Failed to load configuration for rule limit test!" << std::endl;
+				++failures;
+			} else {
+				hb::MemoryFirewall firewall(&log, &limitConfig, 0, 0, false);
+				hb::Data limitData = hb::Data(&log, &limitConfig, &iptbl);
+				limitData.setFirewall(&firewall);
+
+				// First three blocks fill the limit, priority (last activity + score) of 10.40.0.1 is the lowest, blacklisted
+				// 10.40.0.3 has the lowest score, then address with higher priority evicts the lowest one and address with
+				// lower priority than all rules is not blocked
+				std::vector<std::pair<std::string, unsigned long long int>> blocks = {
+					{"10.40.0.1", 3600 * 10},
+					{"10.40.0.2", 3600 * 20},
+					{"10.40.0.3", 3600 * 2},
+					{"10.40.0.4", 3600 * 30},
+					{"10.40.0.5", 3600 * 5},
+					{"10.40.0.6", 3600 * 40},
+					{"10.40.0.7", 3600 * 50},
+				};
+				hb::SuspiciosAddressType record;
+				record.lastActivity = (unsigned long long int)currentTime;
+				record.activityCount = 1;
+				record.version = 4;
+				for (std::vector<std::pair<std::string, unsigned long long int>>::iterator itb = blocks.begin(); itb != blocks.end(); ++itb) {
+					record.activityScore = itb->second;
+					record.blacklisted = itb->first == "10.40.0.3";
+					limitData.suspiciousAddresses[itb->first] = record;
+					limitData.updateIptables(itb->first);
+				}
+				std::vector<std::pair<std::string, bool>> rules = {
+					{"10.40.0.1", false},
+					{"10.40.0.2", false},
+					{"10.40.0.3", true},
+					{"10.40.0.4", false},
+					{"10.40.0.5", false},
+					{"10.40.0.6", true},
+					{"10.40.0.7", true},
+				};
+				for (std::vector<std::pair<std::string, bool>>::iterator itr = rules.begin(); itr != rules.end(); ++itr) {
+					if (limitData.suspiciousAddresses[itr->first].iptableRule != itr->second || firewall.blocked(itr->first) != itr->second) {
+						std::cerr << "Address " << itr->first << (itr->second ? " has no rule" : " has rule") << " after new blocks over iptables.limit!" << std::endl;
+						++failures;
+					}
+				}
+
+				// Lower limit, rules are evicted by priority, blacklisted address keeps its rule even over limit
+				limitConfig.firewallLimit = 2;
+				limitData.enforceRuleLimit();
+				if (limitData.suspiciousAddresses["10.40.0.6"].iptableRule || !limitData.suspiciousAddresses["10.40.0.7"].iptableRule) {
+					std::cerr << "Rule of 10.40.0.6 was not evicted first when iptables.limit was lowered!" << std::endl;
+					++failures;
+				}
+				limitConfig.firewallLimit = 1;
+				limitData.enforceRuleLimit();
+				if (limitData.suspiciousAddresses["10.40.0.7"].iptableRule || !limitData.suspiciousAddresses["10.40.0.3"].iptableRule || !firewall.blocked("10.40.0.3")) {
+					std::cerr << "Blacklisted address 10.40.0.3 was evicted or 10.40.0.7 kept its rule over iptables.limit!" << std::endl;
+					++failures;
+				}
+			}
+			std::remove(configPath.c_str());
+			std::remove(dataFilePath.c_str());
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
+		// Timeout of nftables set element is refreshed only when less than half of block time is left in set or when it
+		// must be shortened, not with every match of blocked address
+		if (testTimeoutRefresh) {
+			std::cout << "Refreshing nftables set element timeouts..." << std::endl;
+			const std::string configPath = "test_refresh_config";
+			const std::string dataFilePath = "test_refresh_datafile";
+			std::ofstream c(configPath);
+			c << "[Global]" << std::endl;
+			c << "datafile.path = " << dataFilePath << std::endl;
+			c << "datafile.sync = shutdown" << std::endl;
+			c << "address.block.score = 1" << std::endl;
+			c << "address.block.multiplier = 3600" << std::endl;
+			c.close();
+			std::ofstream(dataFilePath).close();
+
+			hb::Config refreshConfig = hb::Config(&log, configPath);
+			if (!refreshConfig.load()) {
+				std::cerr << "Failed to load configuration for timeout refresh test!" << std::endl;
+				++failures;
+			} else {
+				hb::MemoryFirewall firewall(&log, &refreshConfig, 0, 0, true);
+				hb::Data refreshData = hb::Data(&log, &refreshConfig, &iptbl);
+				refreshData.setFirewall(&firewall);
+				hb::SuspiciosAddressType record;
+				record.lastActivity = (unsigned long long int)currentTime;
+				record.activityCount = 1;
+				record.version = 4;
+				record.activityScore = 3600 * 10;
+				refreshData.suspiciousAddresses["10.60.0.1"] = record;
+
+				// Block time after each match and transactions expected so far, 10 hours are left in set after block
+				std::vector<std::pair<unsigned long long int, unsigned long long int>> matches = {
+					{3600 * 10, 1},// Address is blocked
+					{3600 * 11, 1},// More than half of block time is left
+					{3600 * 19, 1},
+					{3600 * 21, 2},// Less than half is left, refreshed to 21 hours
+					{3600 * 25, 2},
+					{3600 * 20, 3},// Block time is shorter than in set
+				};
+				for (std::size_t m = 0; m < matches.size(); ++m) {
+					refreshData.suspiciousAddresses["10.60.0.1"].activityScore = matches[m].first;
+					refreshData.updateIptables("10.60.0.1");
+					if (firewall.transactionCount() != matches[m].second) {
+						std::cerr << "Timeout of 10.60.0.1 with block time " << matches[m].first / 3600 << " hours is changed in " << firewall.transactionCount() << " transactions instead of " << matches[m].second << "!" << std::endl;
+						++failures;
+					}
+				}
+				if (!firewall.blocked("10.60.0.1")) {
+					std::cerr << "Address 10.60.0.1 is not blocked after timeout refresh!" << std::endl;
+					++failures;
+				}
+			}
+			std::remove(configPath.c_str());
+			std::remove(dataFilePath.c_str());
+			end = clock();
+			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+		}
+
 		// Test currently configured log file parsing (not test file like above)
 		if (testConfiguredLogParsing) {
 
@@ -378,7 +1493,7 @@ int main(int argc, char *argv[])
 
 			// Check log files
 			std::cout << "Log file check..." << std::endl;
-			hb::LogParser lp = hb::LogParser(&log, &cfg, &data);
+			hb::LogParser lp(&log, &cfg, &data, &abuseipdbReportingQueue, &abuseipdbReportingQueueMutex);
 			lp.checkFiles();
 			end = clock();
 			std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
@@ -399,4 +1514,9 @@ int main(int argc, char *argv[])
 
 	end = clock();
 	std::cout << "Exec time: " << (double)(end - start)/CLOCKS_PER_SEC << " sec" << std::endl;
+
+	if (failures > 0) {
+		std::cerr << std::to_string(failures) << " checks failed!" << std::endl;
+		return 1;
+	}
 }